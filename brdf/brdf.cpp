@@ -1,6 +1,7 @@
 #include "graphicsApp.h"
 #include "colorTable.h"
 #include "textureLoader.h"
+#include "quadricMesh.h"
 #include "quadric/include/teapot.h"
 
 class BasicBrdf : public GraphicsApp
@@ -168,6 +169,7 @@ public:
     void createMesh()
     {
         teapot = std::make_unique<quadric::Teapot>(16, cmdCopyBuf);
+        mesh::optimize(*teapot, "Teapot", commandPools[0]);
     }
 
     void loadAnisoTexture()
@@ -1,5 +1,6 @@
 #include "graphicsApp.h"
 #include "textureLoader.h"
+#include "quadricMesh.h"
 
 #include "quadric/include/sphere.h"
 
@@ -118,6 +119,7 @@ public:
     {
         sphere = std::make_unique<quadric::Sphere>(1.2f, 128, 128, false, cmdCopyBuf);
         dot = std::make_unique<quadric::Sphere>(0.02f, 8, 8, true, cmdCopyBuf);
+        mesh::optimize(*sphere, "Sphere", commandPools[0]);
     }
 
     void loadHeightMap()
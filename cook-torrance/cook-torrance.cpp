@@ -1,5 +1,6 @@
 #include "graphicsApp.h"
 #include "colorTable.h"
+#include "quadricMesh.h"
 #include "quadric/include/teapot.h"
 
 class CookTorrance : public GraphicsApp
@@ -192,6 +193,7 @@ public:
     void createMesh()
     {
         teapot = std::make_unique<quadric::Teapot>(16, cmdCopyBuf);
+        mesh::optimize(*teapot, "Teapot", commandPools[0]);
     }
 
     void setupDescriptorSets()
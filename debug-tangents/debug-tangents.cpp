@@ -1,4 +1,5 @@
 #include "graphicsApp.h"
+#include "quadricMesh.h"
 #include "quadric/include/torus.h"
 
 class DebugTangents : public GraphicsApp
@@ -90,6 +91,7 @@ public:
     void createMesh()
     {
         torus = std::make_unique<quadric::Torus>(0.4f, 1.0f, 16, 32, true, cmdCopyBuf);
+        mesh::optimize(*torus, "Torus", commandPools[0]);
     }
 
     void createUniformBuffer()
@@ -1,7 +1,11 @@
+#include <cassert>
+#include <random>
 #include "graphicsApp.h"
+#include "gpuTimer.h"
 #include "colorTable.h"
 #include "textureLoader.h"
 #include "utilities.h"
+#include "quadricMesh.h"
 
 #include "quadric/include/cube.h"
 #include "quadric/include/sphere.h"
@@ -9,6 +13,19 @@
 #include "quadric/include/teapot.h"
 #include "quadric/include/plane.h"
 
+// Attachment that is never stored to memory, so it may reside in tile memory only.
+// Lazily allocated memory is committed by tile-based GPUs only if tile memory is spilled.
+class TransientAttachment : public magma::Image2D
+{
+public:
+    explicit TransientAttachment(std::shared_ptr<magma::Device> device, VkFormat format, const VkExtent2D& extent,
+        VkImageUsageFlags usage, VkMemoryPropertyFlags memoryFlags):
+        magma::Image2D(std::move(device), format, extent, 1, 1,
+            usage | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT,
+            0, memoryFlags, magma::Sharing(), nullptr)
+    {}
+};
+
 class DeferredShading : public GraphicsApp
 {
     enum {
@@ -20,6 +37,87 @@ class DeferredShading : public GraphicsApp
         MaxObjects
     };
 
+    enum {
+        SingleLight = 0, TiledShading, LightVolumes,
+        MaxLightingModes
+    };
+
+    enum {
+        DepthPrePass = 0, GbufferPass, LightCullingPass,
+        LightingPass, HalfResLightingPass, QuarterResLightingPass, UpsamplePass,
+        MsaaGbufferPass, ClassificationPass, MsaaLightingPass, MsaaPerSampleLightingPass,
+        SinglePass, VisibilityPass, VisibilityShadingPass,
+        CubeShadowPass, CubeShadowSinglePass,
+        MaxPasses
+    };
+
+    struct alignas(16) PointLight
+    {
+        rapid::float4a position; // xyz - world position, w - radius
+        LinearColor color;
+    };
+
+    struct alignas(16) LightsHeader
+    {   // Matches uvec4 at the beginning of Lights block
+        uint32_t lightCount;
+    };
+
+    struct alignas(16) ShadingParameters
+    {
+        rapid::float4a backgroundColor;
+        float depthThreshold;
+        float normalThreshold;
+        VkBool32 tiledShading;
+    };
+
+    struct alignas(16) ObjectIndex
+    {
+        uint32_t index;
+    };
+
+    struct alignas(16) Constants
+    {
+        VkBool32 cullLights = true;
+        VkBool32 packedGbuffer = false;
+        int32_t sampleCount = 1;
+        VkBool32 perSampleShading = false;
+        VkBool32 pointShadows = false;
+    };
+
+    // Should match cubeShadow.h
+    struct alignas(16) CubeShadow
+    {
+        rapid::matrix faceViewProj[6];
+        rapid::float4a lightPosition; // w - 1/far
+    };
+
+    // Should match tiledLights.h
+    static constexpr uint32_t tileSize = 16;
+    static constexpr uint32_t maxLightsPerTile = 256;
+    // Should match visibility.h
+    static constexpr uint32_t triangleIdBits = 24;
+
+    struct alignas(16) VisibilityVertex
+    {
+        rapid::float4a position; // xyz - position, w - u
+        rapid::float4a normal; // xyz - normal, w - v
+    };
+
+    struct alignas(16) VisibilityMesh
+    {
+        uint32_t firstIndex;
+        uint32_t baseVertex;
+        uint32_t triangleCount;
+        uint32_t padding;
+    };
+
+    // Should match visibilityShading.frag
+    struct alignas(16) ObjectTransforms
+    {
+        rapid::matrix worldView[MaxObjects];
+        rapid::matrix normal[MaxObjects];
+    };
+
     std::unique_ptr<quadric::Quadric> objects[MaxObjects];
     std::shared_ptr<magma::aux::MultiAttachmentFramebuffer> gbuffer;
     std::shared_ptr<magma::DynamicUniformBuffer<PhongMaterial>> materials;
@@ -28,25 +126,131 @@ class DeferredShading : public GraphicsApp
     std::shared_ptr<magma::GraphicsPipeline> gbufferPipeline;
     std::shared_ptr<magma::GraphicsPipeline> gbufferTexPipeline;
     std::shared_ptr<magma::GraphicsPipeline> deferredPipeline;
+    std::shared_ptr<magma::StorageBuffer> pointLights;
+    std::shared_ptr<magma::StorageBuffer> tileLights;
+    std::shared_ptr<magma::ComputePipeline> cullLightsPipeline;
+    std::shared_ptr<magma::GraphicsPipeline> tiledPipeline;
+    std::shared_ptr<magma::RenderPass> volumeRenderPass;
+    std::vector<std::shared_ptr<magma::Framebuffer>> volumeFramebuffers;
+    std::shared_ptr<magma::GraphicsPipeline> ambientPipeline;
+    std::shared_ptr<magma::GraphicsPipeline> lightVolumePipeline;
+    std::shared_ptr<magma::aux::ColorFramebuffer> lowResFramebuffer;
+    std::shared_ptr<magma::GraphicsPipeline> lowResDeferredPipeline;
+    std::shared_ptr<magma::GraphicsPipeline> lowResTiledPipeline;
+    std::shared_ptr<magma::StorageImage2D> upsampledImage;
+    std::shared_ptr<magma::ImageView> upsampledView;
+    std::shared_ptr<magma::UniformBuffer<ShadingParameters>> shadingParameters;
+    std::shared_ptr<magma::ComputePipeline> upsamplePipeline;
+    std::unique_ptr<magma::aux::BlitRectangle> upsampleBltRect;
+    std::shared_ptr<magma::RenderPass> msaaGbufferRenderPass;
+    std::shared_ptr<magma::Framebuffer> msaaGbufferFramebuffer;
+    std::vector<std::shared_ptr<magma::ImageView>> msaaGbufferViews;
+    std::shared_ptr<magma::GraphicsPipeline> msaaGbufferPipeline;
+    std::shared_ptr<magma::GraphicsPipeline> msaaGbufferTexPipeline;
+    std::shared_ptr<magma::StorageImage2D> complexMask;
+    std::shared_ptr<magma::ImageView> complexMaskView;
+    std::shared_ptr<magma::StorageBuffer> complexPixelCounter;
+    std::shared_ptr<magma::DstTransferBuffer> complexPixelReadback;
+    std::shared_ptr<magma::ComputePipeline> classifyPipeline;
+    std::shared_ptr<magma::ComputePipeline> msaaCullLightsPipeline;
+    std::shared_ptr<magma::GraphicsPipeline> msaaLightingPipeline;
+    std::unique_ptr<GpuTimer> gpuTimer;
+    std::shared_ptr<magma::RenderPass> singleRenderPass;
+    std::vector<std::shared_ptr<magma::Framebuffer>> singlePassFramebuffers;
+    std::vector<std::shared_ptr<magma::ImageView>> transientViews;
+    std::shared_ptr<magma::GraphicsPipeline> subpassDepthPipeline;
+    std::shared_ptr<magma::GraphicsPipeline> subpassGbufferPipeline;
+    std::shared_ptr<magma::GraphicsPipeline> subpassGbufferTexPipeline;
+    std::shared_ptr<magma::GraphicsPipeline> subpassDeferredPipeline;
+    std::shared_ptr<magma::StorageBuffer> materialArray;
+    std::shared_ptr<magma::DynamicUniformBuffer<ObjectIndex>> objectIndices;
+    std::shared_ptr<magma::StorageBuffer> visibilityVertices;
+    std::shared_ptr<magma::StorageBuffer> visibilityIndices;
+    std::shared_ptr<magma::StorageBuffer> visibilityMeshes;
+    std::shared_ptr<magma::UniformBuffer<ObjectTransforms>> objectTransforms;
+    uint32_t visibilityDepthSize = 0;
+    std::shared_ptr<magma::RenderPass> visibilityRenderPass;
+    std::shared_ptr<magma::Framebuffer> visibilityFramebuffer;
+    std::shared_ptr<magma::ImageView> visibilityView;
+    std::shared_ptr<magma::ImageView> visibilityDepthView;
+    std::shared_ptr<magma::GraphicsPipeline> visibilityPipeline;
+    std::shared_ptr<magma::GraphicsPipeline> visibilityShadingPipeline;
+    std::shared_ptr<magma::aux::DepthFramebuffer> cubeShadowAtlas;
+    std::shared_ptr<magma::Sampler> shadowSampler;
+    std::shared_ptr<magma::DynamicUniformBuffer<rapid::matrix>> faceTransforms;
+    std::shared_ptr<magma::UniformBuffer<CubeShadow>> cubeShadow;
+    std::shared_ptr<magma::GraphicsPipeline> cubeShadowPipeline;
+    std::shared_ptr<magma::GraphicsPipeline> cubeShadowSinglePassPipeline;
     DescriptorSet depthDescriptor;
     DescriptorSet gbDescriptor;
     DescriptorSet gbTexDescriptor;
     DescriptorSet dsDescriptor;
+    DescriptorSet cullDescriptor;
+    DescriptorSet tiledDescriptor;
+    DescriptorSet volumeDescriptor;
+    DescriptorSet upsampleDescriptor;
+    DescriptorSet classifyDescriptor;
+    DescriptorSet msaaCullDescriptor;
+    DescriptorSet msaaDescriptor;
+    DescriptorSet subpassDescriptor;
+    DescriptorSet visibilityDescriptor;
+    DescriptorSet visibilityCullDescriptor;
+    DescriptorSet visibilityShadingDescriptor;
+    DescriptorSet cubeShadowDescriptor;
 
     rapid::matrix objTransforms[MaxObjects];
+    std::vector<PointLight, core::aligned_allocator<PointLight>> lights;
+    const uint32_t lightCounts[4] = {1, 64, 1024, 4096};
+    uint32_t lightCountIndex = 1;
+    Constants constants;
+    uint32_t lightingMode = TiledShading;
+    const uint32_t resolutionScales[3] = {1, 2, 4};
+    uint32_t scaleIndex = 0;
+    float depthThreshold = 0.02f;
+    bool singlePass = false;
+    bool depthBoundsSupported = false;
+    bool visibilityBuffer = false;
+    bool visibilitySupported = false;
+    bool msaaGbuffer = false;
+    bool singlePassCubeShadow = false;
+    bool singlePassCubeShadowSupported = false;
+    uint32_t msaaSampleCount = 1;
+    uint32_t frameIndex = 0;
 
 public:
     DeferredShading(const AppEntry& entry):
         GraphicsApp(entry, TEXT("Deferred shading"), 1280, 720, true)
     {
+        depthBoundsSupported = (VK_TRUE == physicalDevice->getFeatures().depthBounds);
+        // Fragment shader reads gl_PrimitiveID
+        visibilitySupported = (VK_TRUE == physicalDevice->getFeatures().geometryShader);
+        // Geometry shader routes triangles to cube faces, clip distances cut them at tile border
+        singlePassCubeShadowSupported = (VK_TRUE == physicalDevice->getFeatures().geometryShader) &&
+            (VK_TRUE == physicalDevice->getFeatures().shaderClipDistance);
         setupViewProjection();
         setupTransforms();
         setupMaterials();
         createGbuffer();
         createMeshObjects();
         loadTextures();
+        createPointLights();
+        createTileLightList();
+        createLightVolumeFramebuffers();
+        createLowResLighting();
+        updateShadingParameters();
+        createMsaaGbuffer();
+        createSinglePassFramebuffers();
+        createVisibilityBuffer();
+        createCubeShadowMap();
         setupDescriptorSets();
         setupGraphicsPipelines();
+        setupSubpassPipelines();
+        gpuTimer = std::make_unique<GpuTimer>(commandPools[0],
+            std::vector<std::string>{"Depth pre-pass", "G-buffer", "Light culling",
+                "Lighting", "Lighting 1/2", "Lighting 1/4", "Upsample",
+                "MSAA G-buffer", "Classification", "MSAA lighting", "MSAA lighting per sample",
+                "Single pass", "Visibility buffer", "Visibility shading",
+                "Cube shadow map (6 passes)", "Cube shadow map (single pass)"});
 
         renderScene(FrontBuffer);
         renderScene(BackBuffer);
@@ -56,6 +260,14 @@ public:
 
     virtual void render(uint32_t bufferIndex) override
     {
+        gpuTimer->update();
+        if (++frameIndex % 300 == 0)
+        {
+            if (msaaGbuffer)
+                printComplexPixels();
+            else if (visibilityBuffer)
+                printVisibilityTraffic();
+        }
         updateTransforms();
         queue->submit(commandBuffers[bufferIndex],
             VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
@@ -86,10 +298,105 @@ public:
         case AppKey::PgUp:
             lightViewProj->translate(0.f, 0.5f, 0.f);
             break;
+        case AppKey::Space:
+            lightingMode = (lightingMode + 1) % MaxLightingModes;
+            switch (lightingMode)
+            {
+            case SingleLight: std::cout << "Single light shading" << std::endl; break;
+            case TiledShading: std::cout << "Tiled shading" << std::endl; break;
+            case LightVolumes: std::cout << "Light volumes" << (depthBoundsSupported ?
+                " with depth bounds test" : " without depth bounds test") << std::endl; break;
+            }
+            break;
+        case AppKey::Tab:
+            constants.cullLights = !constants.cullLights;
+            std::cout << "Light culling " << (constants.cullLights ? "on" : "off") << std::endl;
+            setupGraphicsPipelines();
+            break;
+        case AppKey::Enter:
+            lightCountIndex = (lightCountIndex + 1) % 4;
+            std::cout << lightCounts[lightCountIndex] << " point lights" << std::endl;
+            break;
+        case AppKey::Home:
+            constants.packedGbuffer = !constants.packedGbuffer;
+            createGbuffer();
+            createLightVolumeFramebuffers();
+            createMsaaGbuffer();
+            writeGbufferDescriptors();
+            setupGraphicsPipelines();
+            break;
+        case AppKey::End:
+            singlePass = !singlePass;
+            std::cout << (singlePass ? "Single render pass with subpasses" : "Separate render passes") << std::endl;
+            break;
+        case '1': case '2': case '3':
+            scaleIndex = key - '1';
+            std::cout << "Lighting resolution 1/" << resolutionScales[scaleIndex] << std::endl;
+            createLowResLighting();
+            setupGraphicsPipelines();
+            break;
+        case '4':
+            msaaGbuffer = !msaaGbuffer;
+            std::cout << (msaaGbuffer ? "Multisampled G-buffer" : "Single sample G-buffer") << std::endl;
+            break;
+        case '5':
+            constants.perSampleShading = !constants.perSampleShading;
+            std::cout << (constants.perSampleShading ? "Shade every sample" : "Shade every sample of complex pixels only") << std::endl;
+            setupGraphicsPipelines();
+            break;
+        case '6':
+            if (visibilitySupported)
+            {
+                visibilityBuffer = !visibilityBuffer;
+                std::cout << (visibilityBuffer ? "Visibility buffer" : "G-buffer") << std::endl;
+            }
+            else
+                std::cout << "Visibility buffer requires geometry shader" << std::endl;
+            break;
+        case '7':
+            constants.pointShadows = !constants.pointShadows;
+            std::cout << "Point light shadows " << (constants.pointShadows ? "on" : "off") << std::endl;
+            setupGraphicsPipelines();
+            break;
+        case '8':
+            if (singlePassCubeShadowSupported)
+            {
+                singlePassCubeShadow = !singlePassCubeShadow;
+                std::cout << (singlePassCubeShadow ? "Cube shadow map in single pass" : "Cube shadow map in 6 passes") << std::endl;
+            }
+            else
+                std::cout << "Single pass cube shadow map requires geometry shader and clip distances" << std::endl;
+            break;
+        case '9':
+            depthThreshold = std::max(depthThreshold * 0.5f, 0.001f);
+            std::cout << "Depth threshold " << depthThreshold << std::endl;
+            break;
+        case '0':
+            depthThreshold = std::min(depthThreshold * 2.f, 1.f);
+            std::cout << "Depth threshold " << depthThreshold << std::endl;
+            break;
         }
         lightViewProj->updateView();
         lightViewProj->updateProjection();
         updateLightSource();
+        updateShadingParameters();
+        updateCubeShadow();
+        const bool moveLight = (AppKey::Left == key) || (AppKey::Right == key) || (AppKey::Up == key) ||
+            (AppKey::Down == key) || (AppKey::PgUp == key) || (AppKey::PgDn == key);
+        if ((AppKey::Enter == key) || (moveLight && (1 == lightCounts[lightCountIndex])))
+        {   // Single point light follows light source
+            createPointLights();
+            cullDescriptor.set->writeDescriptor(2, pointLights);
+            msaaCullDescriptor.set->writeDescriptor(2, pointLights);
+            visibilityCullDescriptor.set->writeDescriptor(2, pointLights);
+            tiledDescriptor.set->writeDescriptor(6, pointLights);
+            volumeDescriptor.set->writeDescriptor(6, pointLights);
+            upsampleDescriptor.set->writeDescriptor(6, pointLights);
+            msaaDescriptor.set->writeDescriptor(6, pointLights);
+            visibilityShadingDescriptor.set->writeDescriptor(6, pointLights);
+        }
+        renderScene(FrontBuffer);
+        renderScene(BackBuffer);
         VulkanApp::onKeyDown(key, repeat, flags);
     }
 
@@ -111,6 +418,16 @@ public:
             torusRotation * objTransforms[Torus] * rotation,
             objTransforms[Ground] * rotation };
         updateObjectTransforms(transforms);
+        // Visibility shading transforms vertices of all objects in a single draw call
+        magma::helpers::mapScoped(objectTransforms,
+            [this, &transforms](auto *objectTransforms)
+            {
+                for (uint32_t i = Cube; i < MaxObjects; ++i)
+                {
+                    objectTransforms->worldView[i] = transforms[i] * viewProj->getView();
+                    objectTransforms->normal[i] = viewProj->calculateNormal(transforms[i]);
+                }
+            });
     }
 
     void setupViewProjection()
@@ -150,32 +467,38 @@ public:
 
     void setupMaterials()
     {   // https://www.rapidtables.com/web/color/RGB_Color.html
-        materials = std::make_shared<magma::DynamicUniformBuffer<PhongMaterial>>(device, 5);
-        magma::helpers::mapScoped<PhongMaterial>(materials,
-            [this](magma::helpers::AlignedUniformArray<PhongMaterial>& materials)
-            {
-                constexpr float ambientFactor = 0.4f;
+        constexpr float ambientFactor = 0.4f;
+        PhongMaterial surfaces[MaxObjects];
 
-                materials[Cube].diffuse = sRGBColor(pale_golden_rod, ambientFactor);
-                materials[Cube].specular = pale_golden_rod;
-                materials[Cube].shininess = 4.f;
+        surfaces[Cube].diffuse = sRGBColor(pale_golden_rod, ambientFactor);
+        surfaces[Cube].specular = pale_golden_rod;
+        surfaces[Cube].shininess = 4.f;
 
-                materials[Teapot].diffuse = sRGBColor(hot_pink, ambientFactor);
-                materials[Teapot].specular = pink * 1.2f;
-                materials[Teapot].shininess = 128.f;
+        surfaces[Teapot].diffuse = sRGBColor(hot_pink, ambientFactor);
+        surfaces[Teapot].specular = pink * 1.2f;
+        surfaces[Teapot].shininess = 128.f;
 
-                materials[Sphere].diffuse = sRGBColor(corn_flower_blue, ambientFactor);
-                materials[Sphere].specular = corn_flower_blue * 1.2f;
-                materials[Sphere].shininess = 16.f;
+        surfaces[Sphere].diffuse = sRGBColor(corn_flower_blue, ambientFactor);
+        surfaces[Sphere].specular = corn_flower_blue * 1.2f;
+        surfaces[Sphere].shininess = 16.f;
 
-                materials[Torus].diffuse = sRGBColor(spring_green, ambientFactor);
-                materials[Torus].specular = pale_green;
-                materials[Torus].shininess = 64.f;
+        surfaces[Torus].diffuse = sRGBColor(spring_green, ambientFactor);
+        surfaces[Torus].specular = pale_green;
+        surfaces[Torus].shininess = 64.f;
 
-                materials[Ground].diffuse = sRGBColor(slate_gray, ambientFactor);
-                materials[Ground].specular = slate_gray * 1.4f;
-                materials[Ground].shininess = 8.f;
+        surfaces[Ground].diffuse = sRGBColor(slate_gray, ambientFactor);
+        surfaces[Ground].specular = slate_gray * 1.4f;
+        surfaces[Ground].shininess = 8.f;
+
+        materials = std::make_shared<magma::DynamicUniformBuffer<PhongMaterial>>(device, MaxObjects);
+        magma::helpers::mapScoped<PhongMaterial>(materials,
+            [&surfaces](magma::helpers::AlignedUniformArray<PhongMaterial>& materials)
+            {
+                for (uint32_t i = Cube; i < MaxObjects; ++i)
+                    materials[i] = surfaces[i];
             });
+        // Visibility shading indexes materials by object ID
+        materialArray = std::make_shared<magma::StorageBuffer>(cmdCopyBuf, surfaces, sizeof(surfaces));
     }
 
     void createGbuffer()
@@ -183,14 +506,37 @@ public:
         constexpr bool depthSampled = true;
         constexpr bool separateDepthPass = true;
         const VkFormat depthFormat = utilities::getSupportedDepthFormat(physicalDevice, false, true);
+        const std::initializer_list<VkFormat> standardFormats = {
+            VK_FORMAT_R16G16_SFLOAT, // Normal
+            VK_FORMAT_R8G8B8A8_UNORM, // Albedo
+            VK_FORMAT_R8G8B8A8_UNORM}; // Specular
+        const std::initializer_list<VkFormat> packedFormats = {
+            VK_FORMAT_A2B10G10R10_UNORM_PACK32, // Octahedral normal, ambient and shininess
+            VK_FORMAT_R8G8B8A8_UNORM}; // Albedo and specular intensity
+        const std::initializer_list<VkFormat>& colorFormats = constants.packedGbuffer ? packedFormats : standardFormats;
         gbuffer = std::make_shared<magma::aux::MultiAttachmentFramebuffer>(device,
-            std::initializer_list<VkFormat>{
-                VK_FORMAT_R16G16_SFLOAT, // Normal
-                VK_FORMAT_R8G8B8A8_UNORM, // Albedo
-                VK_FORMAT_R8G8B8A8_UNORM}, // Specular
-            depthFormat, framebuffers[FrontBuffer]->getExtent(),
+            colorFormats, depthFormat, framebuffers[FrontBuffer]->getExtent(),
             depthSampled, // Reconstruct position from depth
             separateDepthPass); // Depth pre-pass for zero overdraw
+        printGbufferTraffic(colorFormats, depthFormat);
+    }
+
+    void printGbufferTraffic(const std::initializer_list<VkFormat>& colorFormats, VkFormat depthFormat) const
+    {
+        uint32_t colorSize = 0;
+        for (VkFormat format : colorFormats)
+            colorSize += utilities::getFormatSize(format);
+        const uint32_t depthSize = utilities::getFormatSize(depthFormat);
+        const VkExtent2D extent = framebuffers[FrontBuffer]->getExtent();
+        const float megabytes = extent.width * extent.height/(1024.f * 1024.f);
+        // Zero overdraw: each pixel is written once by depth pre-pass and once by G-buffer pass
+        const float written = (colorSize + depthSize) * megabytes;
+        // Lighting pass reads every attachment, light culling reads depth once more
+        const float read = (colorSize + depthSize * 2) * megabytes;
+        std::cout << (constants.packedGbuffer ? "Packed" : "Standard") << " G-buffer: "
+            << colorFormats.size() << " color attachments, "
+            << colorSize << " bytes per pixel + " << depthSize << " bytes depth" << std::endl
+            << "Written " << written << " MB, read " << read << " MB per frame" << std::endl;
     }
 
     void createMeshObjects()
@@ -200,6 +546,9 @@ public:
         objects[Sphere] = std::make_unique<quadric::Sphere>(1.7f, 64, 64, false, cmdCopyBuf);
         objects[Torus] = std::make_unique<quadric::Torus>(0.5f, 2.0f, 32, 128, true, cmdCopyBuf);
         objects[Ground] = std::make_unique<quadric::Plane>(25.f, 25.f, true, cmdCopyBuf);
+        mesh::optimize(*objects[Teapot], "Teapot", commandPools[0]);
+        mesh::optimize(*objects[Sphere], "Sphere", commandPools[0]);
+        mesh::optimize(*objects[Torus], "Torus", commandPools[0]);
     }
 
     void loadTextures()
@@ -207,6 +556,458 @@ public:
         normalMap = loadDxtTexture(cmdCopyImg, "sand.dds");
     }
 
+    void createPointLights()
+    {
+        const uint32_t lightCount = lightCounts[lightCountIndex];
+        lights.resize(lightCount);
+        if (1 == lightCount)
+        {   // Match light source of single light shading
+            const rapid::float3& pos = lightViewProj->getPosition();
+            lights[0].position = rapid::float4a(pos.x, pos.y, pos.z, 100.f);
+            lights[0].color = sRGBColor(1.f, 1.f, 1.f);
+        }
+        else
+        {   // Scatter lights above the ground, shrinking average radius as their density grows
+            const sRGBColor palette[] = {red, orange, yellow, lime, cyan, deep_sky_blue, blue_violet, fuchsia};
+            const float meanRadius = std::max(1.f, 30.f/sqrtf(float(lightCount)));
+            std::mt19937 rng(lightCount);
+            std::uniform_real_distribution<float> xz(-12.5f, 12.5f);
+            std::uniform_real_distribution<float> y(0.2f, 3.f);
+            std::uniform_real_distribution<float> radius(meanRadius * 0.25f, meanRadius * 1.75f);
+            std::uniform_int_distribution<int> color(0, 7);
+            for (uint32_t i = 0; i < lightCount; ++i)
+            {
+                lights[i].position = rapid::float4a(xz(rng), y(rng), xz(rng), radius(rng));
+                lights[i].color = palette[color(rng)];
+            }
+        }
+        // 16-byte header with number of lights is followed by array of lights
+        std::vector<char, core::aligned_allocator<char>> data(sizeof(LightsHeader) + lights.size() * sizeof(PointLight));
+        LightsHeader header = {lightCount};
+        memcpy(data.data(), &header, sizeof(LightsHeader));
+        memcpy(data.data() + sizeof(LightsHeader), lights.data(), lights.size() * sizeof(PointLight));
+        pointLights = std::make_shared<magma::StorageBuffer>(cmdCopyBuf, data.data(), data.size());
+    }
+
+    void createTileLightList()
+    {
+        const VkExtent2D extent = gbuffer->getExtent();
+        const uint32_t tileCount = ((extent.width + tileSize - 1)/tileSize) * ((extent.height + tileSize - 1)/tileSize);
+        tileLights = std::make_shared<magma::StorageBuffer>(device, tileCount * (1 + maxLightsPerTile) * sizeof(uint32_t));
+    }
+
+    void createLightVolumeFramebuffers()
+    {   // Light volumes are drawn to the swapchain image with read-only G-buffer depth attached,
+        // so the depth bounds test can reject pixels which lie outside of light range.
+        const magma::AttachmentDescription colorAttachment(chooseSurfaceFormat().format, 1,
+            magma::op::clearStore,
+            magma::op::dontCare,
+            VK_IMAGE_LAYOUT_UNDEFINED,
+            VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+        const magma::AttachmentDescription depthAttachment(gbuffer->getDepthStencilView()->getFormat(), 1,
+            magma::op::loadStore, // Depth is filled once for both command buffers
+            magma::op::dontCare,
+            VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL,
+            VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL);
+        const magma::AttachmentReference colorOutput(0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
+        const magma::AttachmentReference depthReadOnly(1, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL);
+        const magma::SubpassDescription subpass({colorOutput}, depthReadOnly);
+        volumeRenderPass = std::make_shared<magma::RenderPass>(device,
+            std::vector<magma::AttachmentDescription>{colorAttachment, depthAttachment},
+            std::vector<magma::SubpassDescription>{subpass},
+            std::vector<magma::SubpassDependency>{});
+        volumeFramebuffers.clear();
+        for (const auto& image : swapchain->getImages())
+        {
+            const std::vector<std::shared_ptr<magma::ImageView>> attachmentViews = {
+                std::make_shared<magma::ImageView>(image),
+                gbuffer->getDepthStencilView()};
+            volumeFramebuffers.push_back(std::make_shared<magma::Framebuffer>(volumeRenderPass, attachmentViews));
+        }
+    }
+
+    void createLowResLighting()
+    {   // Lighting is computed at reduced resolution, then upsampled to full resolution
+        const uint32_t scale = resolutionScales[scaleIndex];
+        const VkExtent2D extent = framebuffers[FrontBuffer]->getExtent();
+        const VkExtent2D lowResExtent = {
+            std::max(1u, extent.width/scale),
+            std::max(1u, extent.height/scale)};
+        // Accumulated lights may exceed 1, keep range and precision for bilateral upsample
+        lowResFramebuffer = std::make_shared<magma::aux::ColorFramebuffer>(device,
+            VK_FORMAT_R16G16B16A16_SFLOAT, lowResExtent, false);
+        if (!upsampledImage)
+        {
+            // Sum of lights isn't clamped before blit, R16G16B16A16_SFLOAT is core storage format
+            upsampledImage = std::make_shared<magma::StorageImage2D>(device, VK_FORMAT_R16G16B16A16_SFLOAT, extent, 1);
+            upsampledView = std::make_shared<magma::ImageView>(upsampledImage);
+            magma::helpers::executeCommandBuffer(commandPools[0],
+                [this](std::shared_ptr<magma::CommandBuffer> cmdBuffer)
+                {   // Perform transition from undefined to general image layout
+                    const magma::ImageSubresourceRange subresourceRange(upsampledImage);
+                    cmdBuffer->pipelineBarrier(VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                        magma::ImageMemoryBarrier(upsampledImage, VK_IMAGE_LAYOUT_GENERAL, subresourceRange));
+                });
+            upsampleBltRect = std::make_unique<magma::aux::BlitRectangle>(renderPass);
+        }
+        if (upsampleDescriptor.set)
+            upsampleDescriptor.set->writeDescriptor(11, lowResFramebuffer->getColorView(), nearestClampToEdge);
+    }
+
+    void updateShadingParameters()
+    {
+        if (!shadingParameters)
+            shadingParameters = std::make_shared<magma::UniformBuffer<ShadingParameters>>(device);
+        magma::helpers::mapScoped<ShadingParameters>(shadingParameters,
+            [this](auto *parameters)
+            {
+                parameters->backgroundColor = rapid::float4a(0.1f, 0.243f, 0.448f, 1.f); // Clear color
+                parameters->depthThreshold = depthThreshold;
+                parameters->normalThreshold = 0.9f; // ~25 degrees
+                parameters->tiledShading = MAGMA_BOOLEAN(TiledShading == lightingMode);
+            });
+    }
+
+    void createMsaaGbuffer()
+    {   // Multisampled G-buffer is filled in a single pass without depth pre-pass
+        const VkFormat depthFormat = utilities::getSupportedDepthFormat(physicalDevice, false, true);
+        std::vector<VkFormat> colorFormats = {
+            VK_FORMAT_R16G16_SFLOAT, // Normal
+            VK_FORMAT_R8G8B8A8_UNORM, // Albedo
+            VK_FORMAT_R8G8B8A8_UNORM}; // Specular
+        if (constants.packedGbuffer)
+        {
+            colorFormats = {
+                VK_FORMAT_A2B10G10R10_UNORM_PACK32, // Octahedral normal, ambient and shininess
+                VK_FORMAT_R8G8B8A8_UNORM}; // Albedo and specular intensity
+        }
+        msaaSampleCount = 4;
+        for (VkFormat format : colorFormats)
+            msaaSampleCount = std::min(msaaSampleCount, utilities::getSupportedMultisampleLevel(physicalDevice, format));
+        msaaSampleCount = std::min(msaaSampleCount, utilities::getSupportedMultisampleLevel(physicalDevice, depthFormat));
+        constants.sampleCount = static_cast<int32_t>(msaaSampleCount);
+        const VkExtent2D extent = framebuffers[FrontBuffer]->getExtent();
+        std::vector<magma::AttachmentDescription> attachments;
+        std::vector<magma::AttachmentReference> colorOutputs;
+        msaaGbufferViews.clear();
+        for (VkFormat format : colorFormats)
+        {
+            colorOutputs.emplace_back(static_cast<uint32_t>(attachments.size()), VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
+            attachments.emplace_back(format, msaaSampleCount,
+                magma::op::clearStore,
+                magma::op::dontCare,
+                VK_IMAGE_LAYOUT_UNDEFINED,
+                VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+            auto attachment = std::make_shared<magma::ColorAttachment>(device, format, extent, 1, msaaSampleCount, true);
+            msaaGbufferViews.push_back(std::make_shared<magma::ImageView>(attachment));
+        }
+        const magma::AttachmentReference depthOutput(static_cast<uint32_t>(attachments.size()),
+            VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL);
+        attachments.emplace_back(depthFormat, msaaSampleCount,
+            magma::op::clearStore,
+            magma::op::dontCare,
+            VK_IMAGE_LAYOUT_UNDEFINED,
+            VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL);
+        auto depthAttachment = std::make_shared<magma::DepthStencilAttachment>(device, depthFormat, extent, 1, msaaSampleCount, true);
+        msaaGbufferViews.push_back(std::make_shared<magma::ImageView>(depthAttachment));
+        const magma::SubpassDescription subpass(colorOutputs, depthOutput);
+        msaaGbufferRenderPass = std::make_shared<magma::RenderPass>(device, attachments,
+            std::vector<magma::SubpassDescription>{subpass},
+            std::vector<magma::SubpassDependency>{});
+        msaaGbufferFramebuffer = std::make_shared<magma::Framebuffer>(msaaGbufferRenderPass, msaaGbufferViews);
+        if (!complexMask)
+        {   // Classification results
+            complexMask = std::make_shared<magma::StorageImage2D>(device, VK_FORMAT_R8G8B8A8_UNORM, extent, 1);
+            complexMaskView = std::make_shared<magma::ImageView>(complexMask);
+            magma::helpers::executeCommandBuffer(commandPools[0],
+                [this](std::shared_ptr<magma::CommandBuffer> cmdBuffer)
+                {   // Perform transition from undefined to general image layout
+                    const magma::ImageSubresourceRange subresourceRange(complexMask);
+                    cmdBuffer->pipelineBarrier(VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                        magma::ImageMemoryBarrier(complexMask, VK_IMAGE_LAYOUT_GENERAL, subresourceRange));
+                });
+            complexPixelCounter = std::make_shared<magma::StorageBuffer>(device, sizeof(uint32_t));
+            complexPixelReadback = std::make_shared<magma::DstTransferBuffer>(device, sizeof(uint32_t));
+        }
+        std::cout << "Multisampled G-buffer: " << msaaSampleCount << " samples" << std::endl;
+    }
+
+    void printComplexPixels() const
+    {
+        const VkExtent2D extent = framebuffers[FrontBuffer]->getExtent();
+        magma::helpers::mapScoped<uint32_t>(complexPixelReadback,
+            [&extent](uint32_t *complexPixelCount)
+            {
+                const float fraction = *complexPixelCount/float(extent.width * extent.height);
+                std::cout << "Complex pixels: " << *complexPixelCount << " (" << fraction * 100.f << "%)" << std::endl;
+            });
+    }
+
+    VkMemoryPropertyFlags transientMemoryFlags() const
+    {   // Fall back to device local memory if there is no lazily allocated memory type
+        const VkPhysicalDeviceMemoryProperties memoryProperties = physicalDevice->getMemoryProperties();
+        for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; ++i)
+        {
+            if (memoryProperties.memoryTypes[i].propertyFlags & VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT)
+                return VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT;
+        }
+        return VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+    }
+
+    void createSinglePassFramebuffers()
+    {   // Depth pre-pass, G-buffer fill and lighting are subpasses of single render pass.
+        // G-buffer attachments are cleared on load and never stored, so tile-based
+        // rasterizers may keep them in on-chip memory and skip the resolve to DRAM.
+        const VkFormat colorFormat = chooseSurfaceFormat().format;
+        const VkFormat depthFormat = utilities::getSupportedDepthFormat(physicalDevice, false, true);
+        const VkFormat gbufferFormats[] = {
+            VK_FORMAT_R16G16_SFLOAT, // Normal
+            VK_FORMAT_R8G8B8A8_UNORM, // Albedo
+            VK_FORMAT_R8G8B8A8_UNORM}; // Specular
+        const std::vector<magma::AttachmentDescription> attachments = {
+            magma::AttachmentDescription(colorFormat, 1,
+                magma::op::clearStore,
+                magma::op::dontCare,
+                VK_IMAGE_LAYOUT_UNDEFINED,
+                VK_IMAGE_LAYOUT_PRESENT_SRC_KHR),
+            magma::AttachmentDescription(gbufferFormats[0], 1,
+                magma::op::clearDontCare,
+                magma::op::dontCare,
+                VK_IMAGE_LAYOUT_UNDEFINED,
+                VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL),
+            magma::AttachmentDescription(gbufferFormats[1], 1,
+                magma::op::clearDontCare,
+                magma::op::dontCare,
+                VK_IMAGE_LAYOUT_UNDEFINED,
+                VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL),
+            magma::AttachmentDescription(gbufferFormats[2], 1,
+                magma::op::clearDontCare,
+                magma::op::dontCare,
+                VK_IMAGE_LAYOUT_UNDEFINED,
+                VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL),
+            magma::AttachmentDescription(depthFormat, 1,
+                magma::op::clearDontCare,
+                magma::op::dontCare,
+                VK_IMAGE_LAYOUT_UNDEFINED,
+                VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL)
+        };
+        const magma::AttachmentReference depthWrite(4, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL);
+        const magma::AttachmentReference depthReadOnly(4, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL);
+        const std::vector<magma::AttachmentReference> gbufferOutputs = {
+            magma::AttachmentReference(1, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL),
+            magma::AttachmentReference(2, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL),
+            magma::AttachmentReference(3, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL)};
+        const VkAttachmentReference gbufferInputs[] = {
+            {1, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL},
+            {2, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL},
+            {3, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL},
+            {4, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL}};
+        const magma::AttachmentReference colorOutput(0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
+        const magma::SubpassDescription depthSubpass({}, depthWrite);
+        const magma::SubpassDescription gbufferSubpass(gbufferOutputs, depthReadOnly);
+        magma::SubpassDescription lightingSubpass({colorOutput}, magma::AttachmentReference());
+        lightingSubpass.inputAttachmentCount = 4;
+        lightingSubpass.pInputAttachments = gbufferInputs;
+        const std::vector<magma::SubpassDependency> dependencies = {
+            magma::SubpassDependency(VK_SUBPASS_EXTERNAL, 0,
+                VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                0, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT),
+            magma::SubpassDependency(0, 1, // Depth -> G-buffer
+                VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT, VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT,
+                VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT, VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT,
+                VK_DEPENDENCY_BY_REGION_BIT),
+            magma::SubpassDependency(1, 2, // G-buffer -> lighting
+                VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+                VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+                VK_ACCESS_INPUT_ATTACHMENT_READ_BIT,
+                VK_DEPENDENCY_BY_REGION_BIT)
+        };
+        singleRenderPass = std::make_shared<magma::RenderPass>(device, attachments,
+            std::vector<magma::SubpassDescription>{depthSubpass, gbufferSubpass, lightingSubpass},
+            dependencies);
+        const VkExtent2D extent = framebuffers[FrontBuffer]->getExtent();
+        const VkMemoryPropertyFlags memoryFlags = transientMemoryFlags();
+        for (VkFormat format : gbufferFormats)
+        {
+            auto attachment = std::make_shared<TransientAttachment>(device, format, extent,
+                VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, memoryFlags);
+            transientViews.push_back(std::make_shared<magma::ImageView>(attachment));
+        }
+        auto depthAttachment = std::make_shared<TransientAttachment>(device, depthFormat, extent,
+            VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, memoryFlags);
+        transientViews.push_back(std::make_shared<magma::ImageView>(depthAttachment));
+        for (const auto& image : swapchain->getImages())
+        {
+            std::vector<std::shared_ptr<magma::ImageView>> attachmentViews = {std::make_shared<magma::ImageView>(image)};
+            attachmentViews.insert(attachmentViews.end(), transientViews.begin(), transientViews.end());
+            singlePassFramebuffers.push_back(std::make_shared<magma::Framebuffer>(singleRenderPass, attachmentViews));
+        }
+        std::cout << "Transient G-buffer memory: " <<
+            ((memoryFlags & VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT) ? "lazily allocated" : "device local") << std::endl;
+    }
+
+    void createVisibilityBuffer()
+    {   // Visibility buffer stores only object and triangle IDs,
+        // surface attributes are fetched and interpolated during shading
+        const VkFormat depthFormat = utilities::getSupportedDepthFormat(physicalDevice, false, true);
+        const magma::AttachmentDescription visibilityAttachment(VK_FORMAT_R32_UINT, 1,
+            magma::op::clearStore,
+            magma::op::dontCare,
+            VK_IMAGE_LAYOUT_UNDEFINED,
+            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+        const magma::AttachmentDescription depthAttachment(depthFormat, 1,
+            magma::op::clearStore, // Depth is read by light culling
+            magma::op::dontCare,
+            VK_IMAGE_LAYOUT_UNDEFINED,
+            VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL);
+        const magma::AttachmentReference visibilityOutput(0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
+        const magma::AttachmentReference depthOutput(1, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL);
+        const magma::SubpassDescription subpass({visibilityOutput}, depthOutput);
+        visibilityRenderPass = std::make_shared<magma::RenderPass>(device,
+            std::vector<magma::AttachmentDescription>{visibilityAttachment, depthAttachment},
+            std::vector<magma::SubpassDescription>{subpass},
+            std::vector<magma::SubpassDependency>{});
+        const VkExtent2D extent = framebuffers[FrontBuffer]->getExtent();
+        auto visibility = std::make_shared<magma::ColorAttachment>(device, VK_FORMAT_R32_UINT, extent, 1, 1, true);
+        auto depth = std::make_shared<magma::DepthStencilAttachment>(device, depthFormat, extent, 1, 1, true);
+        visibilityView = std::make_shared<magma::ImageView>(visibility);
+        visibilityDepthView = std::make_shared<magma::ImageView>(depth);
+        const std::vector<std::shared_ptr<magma::ImageView>> attachmentViews = {
+            visibilityView,
+            visibilityDepthView};
+        visibilityFramebuffer = std::make_shared<magma::Framebuffer>(visibilityRenderPass, attachmentViews);
+        objectIndices = std::make_shared<magma::DynamicUniformBuffer<ObjectIndex>>(device, MaxObjects);
+        magma::helpers::mapScoped<ObjectIndex>(objectIndices,
+            [](magma::helpers::AlignedUniformArray<ObjectIndex>& objectIndices)
+            {
+                for (uint32_t i = Cube; i < MaxObjects; ++i)
+                    objectIndices[i].index = i;
+            });
+        uploadVisibilityMeshes();
+        objectTransforms = std::make_shared<magma::UniformBuffer<ObjectTransforms>>(device);
+        visibilityDepthSize = utilities::getFormatSize(depthFormat);
+        const float meshKilobytes = (visibilityVertices->getSize() + visibilityIndices->getSize())/1024.f;
+        std::cout << "Visibility buffer: " << utilities::getFormatSize(VK_FORMAT_R32_UINT) << " bytes per pixel + "
+            << visibilityDepthSize << " bytes depth, " << meshKilobytes << " KB of vertices and indices uploaded once" << std::endl;
+    }
+
+    void uploadVisibilityMeshes()
+    {   // Quadric buffers can't be bound as storage buffers, so vertices
+        // and indices of all objects are read back and copied once.
+        // Shading pass fetches vertices of visible triangle by primitive ID.
+        std::vector<VisibilityVertex, core::aligned_allocator<VisibilityVertex>> vertices;
+        std::vector<uint32_t> indices;
+        VisibilityMesh meshes[MaxObjects] = {};
+        for (uint32_t i = Cube; i < MaxObjects; ++i)
+        {
+            const mesh::QuadricGeometry geometry = mesh::readBack(*objects[i], commandPools[0]);
+            const magma::VertexInputState& vertexInput = objects[i]->getVertexInput();
+            const VkVertexInputAttributeDescription *attribs = vertexInput.pVertexAttributeDescriptions;
+            const auto attributeOffset = [&vertexInput, attribs](uint32_t location, VkFormat format) -> uint32_t
+            {
+                for (uint32_t j = 0; j < vertexInput.vertexAttributeDescriptionCount; ++j)
+                {
+                    if (attribs[j].location == location)
+                    {
+                        assert(attribs[j].format == format);
+                        return attribs[j].offset;
+                    }
+                }
+                assert(false);
+                return 0;
+            };
+            const uint32_t normalOffset = attributeOffset(1, VK_FORMAT_R32G32B32_SFLOAT);
+            const uint32_t texCoordOffset = attributeOffset(2, VK_FORMAT_R32G32_SFLOAT);
+            meshes[i].firstIndex = static_cast<uint32_t>(indices.size());
+            meshes[i].baseVertex = static_cast<uint32_t>(vertices.size());
+            meshes[i].triangleCount = static_cast<uint32_t>(geometry.indices.size() / 3);
+            // Triangle ID should fit into its bits of visibility buffer
+            assert(meshes[i].triangleCount <= (1u << triangleIdBits));
+            for (uint32_t v = 0; v < geometry.vertexCount; ++v)
+            {
+                const uint8_t *vertex = geometry.vertices.data() + std::size_t(v) * geometry.vertexStride;
+                const float *position = reinterpret_cast<const float *>(vertex + geometry.positionOffset);
+                const float *normal = reinterpret_cast<const float *>(vertex + normalOffset);
+                const float *texCoord = reinterpret_cast<const float *>(vertex + texCoordOffset);
+                VisibilityVertex packed;
+                packed.position = rapid::float4a(position[0], position[1], position[2], texCoord[0]);
+                packed.normal = rapid::float4a(normal[0], normal[1], normal[2], texCoord[1]);
+                vertices.push_back(packed);
+            }
+            indices.insert(indices.end(), geometry.indices.begin(), geometry.indices.end());
+        }
+        visibilityVertices = std::make_shared<magma::StorageBuffer>(cmdCopyBuf, vertices.data(),
+            vertices.size() * sizeof(VisibilityVertex));
+        visibilityIndices = std::make_shared<magma::StorageBuffer>(cmdCopyBuf, indices.data(),
+            indices.size() * sizeof(uint32_t));
+        visibilityMeshes = std::make_shared<magma::StorageBuffer>(cmdCopyBuf, meshes, sizeof(meshes));
+    }
+
+    void createCubeShadowMap()
+    {   // Six faces are packed into 3x2 tiles of a single depth image
+        constexpr uint32_t faceSize = 1024;
+        constexpr VkExtent2D extent{faceSize * 3, faceSize * 2};
+        cubeShadowAtlas = std::make_shared<magma::aux::DepthFramebuffer>(device, VK_FORMAT_D16_UNORM, extent);
+        shadowSampler = std::make_shared<magma::DepthSampler>(device, magma::samplers::magMinNearestCompareLessOrEqual);
+        faceTransforms = std::make_shared<magma::DynamicUniformBuffer<rapid::matrix>>(device, 6);
+        cubeShadow = std::make_shared<magma::UniformBuffer<CubeShadow>>(device);
+        updateCubeShadow();
+    }
+
+    void updateCubeShadow()
+    {   // Field of view of 90 degrees, so each face covers one major axis
+        constexpr float zNear = 0.1f;
+        constexpr float zFar = 40.f;
+        const rapid::vector3 directions[6] = {
+            rapid::vector3(1.f, 0.f, 0.f), rapid::vector3(-1.f, 0.f, 0.f),
+            rapid::vector3(0.f, 1.f, 0.f), rapid::vector3(0.f, -1.f, 0.f),
+            rapid::vector3(0.f, 0.f, 1.f), rapid::vector3(0.f, 0.f, -1.f)};
+        const rapid::vector3 up(0.f, 1.f, 0.f);
+        const rapid::vector3 forward(0.f, 0.f, 1.f);
+        const rapid::matrix flip(
+            1.f, 0.f, 0.f, 0.f,
+            0.f,-1.f, 0.f, 0.f,
+            0.f, 0.f, 1.f, 0.f,
+            0.f, 0.f, 0.f, 1.f);
+        const rapid::matrix proj = rapid::perspectiveFovLH(rapid::radians(90.f), 1.f, zNear, zFar) * flip;
+        const rapid::float3& position = lightViewProj->getPosition();
+        const rapid::vector3 eye(position);
+        rapid::matrix faceViewProj[6];
+        for (uint32_t face = 0; face < 6; ++face)
+        {   // Up vector shouldn't be collinear with face direction
+            const rapid::vector3& faceUp = (face / 2 == 1) ? forward : up;
+            faceViewProj[face] = rapid::lookAtLH(eye, eye + directions[face], faceUp) * proj;
+        }
+        magma::helpers::mapScoped<rapid::matrix>(faceTransforms,
+            [&faceViewProj](magma::helpers::AlignedUniformArray<rapid::matrix>& faceTransforms)
+            {
+                for (uint32_t face = 0; face < 6; ++face)
+                    faceTransforms[face] = faceViewProj[face];
+            });
+        magma::helpers::mapScoped(cubeShadow,
+            [&](auto *cubeShadow)
+            {
+                for (uint32_t face = 0; face < 6; ++face)
+                    cubeShadow->faceViewProj[face] = faceViewProj[face];
+                cubeShadow->lightPosition = rapid::float4a(position.x, position.y, position.z, 1.f/zFar);
+            });
+    }
+
+    void printVisibilityTraffic() const
+    {
+        const uint32_t visibilitySize = utilities::getFormatSize(VK_FORMAT_R32_UINT);
+        const VkExtent2D extent = framebuffers[FrontBuffer]->getExtent();
+        const float megabytes = extent.width * extent.height/(1024.f * 1024.f);
+        // Without depth pre-pass IDs may be overwritten, but overdraw is cheap as only 4 bytes are written
+        const float written = (visibilitySize + visibilityDepthSize) * megabytes;
+        // Shading reads IDs and vertices of visible triangles only, light culling reads depth
+        const bool culling = (TiledShading == lightingMode) && constants.cullLights;
+        const float read = (visibilitySize + (culling ? visibilityDepthSize : 0)) * megabytes;
+        std::cout << "Visibility buffer: written " << written << " MB, read " << read
+            << " MB per frame (+ vertices of visible triangles)" << std::endl;
+    }
+
     void setupDescriptorSets()
     {
         using namespace magma::bindings;
@@ -252,15 +1053,235 @@ public:
                 FragmentStageBinding(3, CombinedImageSampler(1)), // Normal
                 FragmentStageBinding(4, CombinedImageSampler(1)), // Albedo
                 FragmentStageBinding(5, CombinedImageSampler(1)), // Specular
-                FragmentStageBinding(6, CombinedImageSampler(1))  // Depth
+                FragmentStageBinding(6, CombinedImageSampler(1)), // Depth
+                FragmentStageBinding(9, UniformBuffer(1)), // Cube shadow
+                FragmentStageBinding(10, CombinedImageSampler(1)) // Cube shadow atlas
             }));
         dsDescriptor.set = descriptorPool->allocateDescriptorSet(dsDescriptor.layout);
         dsDescriptor.set->writeDescriptor(0, viewProjTransforms);
         dsDescriptor.set->writeDescriptor(1, lightSource);
-        dsDescriptor.set->writeDescriptor(2, gbuffer->getAttachmentView(0), nearestClampToEdge);
-        dsDescriptor.set->writeDescriptor(3, gbuffer->getAttachmentView(1), nearestClampToEdge);
-        dsDescriptor.set->writeDescriptor(4, gbuffer->getAttachmentView(2), nearestClampToEdge);
-        dsDescriptor.set->writeDescriptor(5, gbuffer->getDepthStencilView(), nearestClampToEdge);
+        dsDescriptor.set->writeDescriptor(6, cubeShadow);
+        dsDescriptor.set->writeDescriptor(7, cubeShadowAtlas->getDepthView(), shadowSampler);
+        // 5. Light culling
+        cullDescriptor.layout = std::shared_ptr<magma::DescriptorSetLayout>(new magma::DescriptorSetLayout(device,
+            {
+                ComputeStageBinding(1, UniformBuffer(1)),
+                ComputeStageBinding(2, CombinedImageSampler(1)), // Depth
+                ComputeStageBinding(3, StorageBuffer(1)), // Point lights
+                ComputeStageBinding(4, StorageBuffer(1))  // Tile light list
+            }));
+        cullDescriptor.set = descriptorPool->allocateDescriptorSet(cullDescriptor.layout);
+        cullDescriptor.set->writeDescriptor(0, viewProjTransforms);
+        cullDescriptor.set->writeDescriptor(2, pointLights);
+        cullDescriptor.set->writeDescriptor(3, tileLights);
+        // 6. Tiled shading
+        tiledDescriptor.layout = std::shared_ptr<magma::DescriptorSetLayout>(new magma::DescriptorSetLayout(device,
+            {
+                VertexFragmentStageBinding(1, UniformBuffer(1)),
+                FragmentStageBinding(2, UniformBuffer(1)), // Light source
+                FragmentStageBinding(3, CombinedImageSampler(1)), // Normal
+                FragmentStageBinding(4, CombinedImageSampler(1)), // Albedo
+                FragmentStageBinding(5, CombinedImageSampler(1)), // Specular
+                FragmentStageBinding(6, CombinedImageSampler(1)), // Depth
+                FragmentStageBinding(7, StorageBuffer(1)), // Point lights
+                FragmentStageBinding(8, StorageBuffer(1))  // Tile light list
+            }));
+        tiledDescriptor.set = descriptorPool->allocateDescriptorSet(tiledDescriptor.layout);
+        tiledDescriptor.set->writeDescriptor(0, viewProjTransforms);
+        tiledDescriptor.set->writeDescriptor(1, lightSource);
+        tiledDescriptor.set->writeDescriptor(6, pointLights);
+        tiledDescriptor.set->writeDescriptor(7, tileLights);
+        // 7. Light volumes
+        volumeDescriptor.layout = std::shared_ptr<magma::DescriptorSetLayout>(new magma::DescriptorSetLayout(device,
+            {
+                VertexFragmentStageBinding(1, UniformBuffer(1)),
+                FragmentStageBinding(2, UniformBuffer(1)), // Light source
+                FragmentStageBinding(3, CombinedImageSampler(1)), // Normal
+                FragmentStageBinding(4, CombinedImageSampler(1)), // Albedo
+                FragmentStageBinding(5, CombinedImageSampler(1)), // Specular
+                FragmentStageBinding(6, CombinedImageSampler(1)), // Depth
+                VertexFragmentStageBinding(7, StorageBuffer(1)) // Point lights
+            }));
+        volumeDescriptor.set = descriptorPool->allocateDescriptorSet(volumeDescriptor.layout);
+        volumeDescriptor.set->writeDescriptor(0, viewProjTransforms);
+        volumeDescriptor.set->writeDescriptor(1, lightSource);
+        volumeDescriptor.set->writeDescriptor(6, pointLights);
+        // 8. Upsampling of reduced resolution lighting
+        upsampleDescriptor.layout = std::shared_ptr<magma::DescriptorSetLayout>(new magma::DescriptorSetLayout(device,
+            {
+                ComputeStageBinding(1, UniformBuffer(1)),
+                ComputeStageBinding(2, UniformBuffer(1)), // Light source
+                ComputeStageBinding(3, CombinedImageSampler(1)), // Normal
+                ComputeStageBinding(4, CombinedImageSampler(1)), // Albedo
+                ComputeStageBinding(5, CombinedImageSampler(1)), // Specular
+                ComputeStageBinding(6, CombinedImageSampler(1)), // Depth
+                ComputeStageBinding(7, StorageBuffer(1)), // Point lights
+                ComputeStageBinding(8, StorageBuffer(1)), // Tile light list
+                ComputeStageBinding(9, UniformBuffer(1)), // Cube shadow
+                ComputeStageBinding(10, CombinedImageSampler(1)), // Cube shadow atlas
+                ComputeStageBinding(11, UniformBuffer(1)), // Shading parameters
+                ComputeStageBinding(12, CombinedImageSampler(1)), // Reduced resolution lighting
+                ComputeStageBinding(13, StorageImage(1)) // Upsampled lighting
+            }));
+        upsampleDescriptor.set = descriptorPool->allocateDescriptorSet(upsampleDescriptor.layout);
+        upsampleDescriptor.set->writeDescriptor(0, viewProjTransforms);
+        upsampleDescriptor.set->writeDescriptor(1, lightSource);
+        upsampleDescriptor.set->writeDescriptor(6, pointLights);
+        upsampleDescriptor.set->writeDescriptor(7, tileLights);
+        upsampleDescriptor.set->writeDescriptor(8, cubeShadow);
+        upsampleDescriptor.set->writeDescriptor(9, cubeShadowAtlas->getDepthView(), shadowSampler);
+        upsampleDescriptor.set->writeDescriptor(10, shadingParameters);
+        upsampleDescriptor.set->writeDescriptor(11, lowResFramebuffer->getColorView(), nearestClampToEdge);
+        upsampleDescriptor.set->writeDescriptor(12, upsampledView, nullptr);
+        // 9. Classification of multisampled pixels
+        classifyDescriptor.layout = std::shared_ptr<magma::DescriptorSetLayout>(new magma::DescriptorSetLayout(device,
+            {
+                ComputeStageBinding(1, UniformBuffer(1)),
+                ComputeStageBinding(3, CombinedImageSampler(1)), // Normal
+                ComputeStageBinding(4, CombinedImageSampler(1)), // Albedo
+                ComputeStageBinding(5, CombinedImageSampler(1)), // Specular
+                ComputeStageBinding(6, CombinedImageSampler(1)), // Depth
+                ComputeStageBinding(7, StorageImage(1)), // Complex pixel mask
+                ComputeStageBinding(8, StorageBuffer(1)), // Complex pixel count
+                ComputeStageBinding(11, UniformBuffer(1)) // Shading parameters
+            }));
+        classifyDescriptor.set = descriptorPool->allocateDescriptorSet(classifyDescriptor.layout);
+        classifyDescriptor.set->writeDescriptor(0, viewProjTransforms);
+        classifyDescriptor.set->writeDescriptor(5, complexMaskView, nullptr);
+        classifyDescriptor.set->writeDescriptor(6, complexPixelCounter);
+        classifyDescriptor.set->writeDescriptor(7, shadingParameters);
+        // Light culling against multisampled depth
+        msaaCullDescriptor.layout = cullDescriptor.layout;
+        msaaCullDescriptor.set = descriptorPool->allocateDescriptorSet(msaaCullDescriptor.layout);
+        msaaCullDescriptor.set->writeDescriptor(0, viewProjTransforms);
+        msaaCullDescriptor.set->writeDescriptor(2, pointLights);
+        msaaCullDescriptor.set->writeDescriptor(3, tileLights);
+        // 10. Deferred shading of multisampled G-buffer
+        msaaDescriptor.layout = std::shared_ptr<magma::DescriptorSetLayout>(new magma::DescriptorSetLayout(device,
+            {
+                VertexFragmentStageBinding(1, UniformBuffer(1)),
+                FragmentStageBinding(2, UniformBuffer(1)), // Light source
+                FragmentStageBinding(3, CombinedImageSampler(1)), // Normal
+                FragmentStageBinding(4, CombinedImageSampler(1)), // Albedo
+                FragmentStageBinding(5, CombinedImageSampler(1)), // Specular
+                FragmentStageBinding(6, CombinedImageSampler(1)), // Depth
+                FragmentStageBinding(7, StorageBuffer(1)), // Point lights
+                FragmentStageBinding(8, StorageBuffer(1)), // Tile light list
+                FragmentStageBinding(9, CombinedImageSampler(1)), // Complex pixel mask
+                FragmentStageBinding(11, UniformBuffer(1)) // Shading parameters
+            }));
+        msaaDescriptor.set = descriptorPool->allocateDescriptorSet(msaaDescriptor.layout);
+        msaaDescriptor.set->writeDescriptor(0, viewProjTransforms);
+        msaaDescriptor.set->writeDescriptor(1, lightSource);
+        msaaDescriptor.set->writeDescriptor(6, pointLights);
+        msaaDescriptor.set->writeDescriptor(7, tileLights);
+        msaaDescriptor.set->writeDescriptor(8, complexMaskView, nearestClampToEdge);
+        msaaDescriptor.set->writeDescriptor(9, shadingParameters);
+        // 11. Deferred shading in subpass
+        subpassDescriptor.layout = std::shared_ptr<magma::DescriptorSetLayout>(new magma::DescriptorSetLayout(device,
+            {
+                VertexFragmentStageBinding(1, UniformBuffer(1)),
+                FragmentStageBinding(2, UniformBuffer(1)), // Light source
+                FragmentStageBinding(3, InputAttachment(1)), // Normal
+                FragmentStageBinding(4, InputAttachment(1)), // Albedo
+                FragmentStageBinding(5, InputAttachment(1)), // Specular
+                FragmentStageBinding(6, InputAttachment(1))  // Depth
+            }));
+        subpassDescriptor.set = descriptorPool->allocateDescriptorSet(subpassDescriptor.layout);
+        subpassDescriptor.set->writeDescriptor(0, viewProjTransforms);
+        subpassDescriptor.set->writeDescriptor(1, lightSource);
+        for (uint32_t i = 0; i < 4; ++i)
+            subpassDescriptor.set->writeDescriptor(2 + i, transientViews[i], nullptr);
+        // 12. Visibility buffer
+        visibilityDescriptor.layout = std::shared_ptr<magma::DescriptorSetLayout>(new magma::DescriptorSetLayout(device,
+            {
+                VertexStageBinding(0, DynamicUniformBuffer(1)),
+                VertexStageBinding(1, UniformBuffer(1)),
+                FragmentStageBinding(2, DynamicUniformBuffer(1)) // Object index
+            }));
+        visibilityDescriptor.set = descriptorPool->allocateDescriptorSet(visibilityDescriptor.layout);
+        visibilityDescriptor.set->writeDescriptor(0, transforms);
+        visibilityDescriptor.set->writeDescriptor(1, viewProjTransforms);
+        visibilityDescriptor.set->writeDescriptor(2, objectIndices);
+        // Light culling against visibility buffer depth
+        visibilityCullDescriptor.layout = cullDescriptor.layout;
+        visibilityCullDescriptor.set = descriptorPool->allocateDescriptorSet(visibilityCullDescriptor.layout);
+        visibilityCullDescriptor.set->writeDescriptor(0, viewProjTransforms);
+        visibilityCullDescriptor.set->writeDescriptor(1, visibilityDepthView, nearestClampToEdge);
+        visibilityCullDescriptor.set->writeDescriptor(2, pointLights);
+        visibilityCullDescriptor.set->writeDescriptor(3, tileLights);
+        // 13. Shading from visibility buffer
+        visibilityShadingDescriptor.layout = std::shared_ptr<magma::DescriptorSetLayout>(new magma::DescriptorSetLayout(device,
+            {
+                VertexFragmentStageBinding(1, UniformBuffer(1)),
+                FragmentStageBinding(2, UniformBuffer(1)), // Light source
+                FragmentStageBinding(3, CombinedImageSampler(1)), // Normal
+                FragmentStageBinding(4, CombinedImageSampler(1)), // Albedo
+                FragmentStageBinding(5, CombinedImageSampler(1)), // Specular
+                FragmentStageBinding(6, CombinedImageSampler(1)), // Depth
+                FragmentStageBinding(7, StorageBuffer(1)), // Point lights
+                FragmentStageBinding(8, StorageBuffer(1)), // Tile light list
+                FragmentStageBinding(9, CombinedImageSampler(1)), // Visibility buffer
+                FragmentStageBinding(10, StorageBuffer(1)), // Vertices
+                FragmentStageBinding(11, UniformBuffer(1)), // Shading parameters
+                FragmentStageBinding(12, StorageBuffer(1)), // Materials
+                FragmentStageBinding(13, CombinedImageSampler(1)), // Normal map
+                FragmentStageBinding(14, StorageBuffer(1)), // Indices
+                FragmentStageBinding(15, StorageBuffer(1)), // Meshes
+                FragmentStageBinding(16, UniformBuffer(1)) // Object transforms
+            }));
+        visibilityShadingDescriptor.set = descriptorPool->allocateDescriptorSet(visibilityShadingDescriptor.layout);
+        visibilityShadingDescriptor.set->writeDescriptor(0, viewProjTransforms);
+        visibilityShadingDescriptor.set->writeDescriptor(1, lightSource);
+        visibilityShadingDescriptor.set->writeDescriptor(6, pointLights);
+        visibilityShadingDescriptor.set->writeDescriptor(7, tileLights);
+        visibilityShadingDescriptor.set->writeDescriptor(8, visibilityView, nearestClampToEdge);
+        visibilityShadingDescriptor.set->writeDescriptor(9, visibilityVertices);
+        visibilityShadingDescriptor.set->writeDescriptor(10, shadingParameters);
+        visibilityShadingDescriptor.set->writeDescriptor(11, materialArray);
+        visibilityShadingDescriptor.set->writeDescriptor(13, visibilityIndices);
+        visibilityShadingDescriptor.set->writeDescriptor(14, visibilityMeshes);
+        visibilityShadingDescriptor.set->writeDescriptor(15, objectTransforms);
+        // 14. Cube shadow map of point light
+        cubeShadowDescriptor.layout = std::shared_ptr<magma::DescriptorSetLayout>(new magma::DescriptorSetLayout(device,
+            {
+                VertexStageBinding(0, DynamicUniformBuffer(1)),
+                VertexStageBinding(2, DynamicUniformBuffer(1)), // Face transform
+                VertexGeometryStageBinding(9, UniformBuffer(1)) // Cube shadow
+            }));
+        cubeShadowDescriptor.set = descriptorPool->allocateDescriptorSet(cubeShadowDescriptor.layout);
+        cubeShadowDescriptor.set->writeDescriptor(0, transforms);
+        cubeShadowDescriptor.set->writeDescriptor(1, faceTransforms);
+        cubeShadowDescriptor.set->writeDescriptor(2, cubeShadow);
+        visibilityShadingDescriptor.set->writeDescriptor(12, normalMap, anisotropicClampToEdge);
+        writeGbufferDescriptors();
+    }
+
+    void writeGbufferDescriptors()
+    {   // Packed layout has no specular attachment, but descriptor should be valid.
+        // Visibility shading doesn't read G-buffer, but its descriptors are statically used by shading.h
+        const uint32_t specular = constants.packedGbuffer ? 1 : 2;
+        for (DescriptorSet *descriptor : {&dsDescriptor, &tiledDescriptor, &volumeDescriptor, &upsampleDescriptor,
+            &visibilityShadingDescriptor})
+        {
+            descriptor->set->writeDescriptor(2, gbuffer->getAttachmentView(0), nearestClampToEdge);
+            descriptor->set->writeDescriptor(3, gbuffer->getAttachmentView(1), nearestClampToEdge);
+            descriptor->set->writeDescriptor(4, gbuffer->getAttachmentView(specular), nearestClampToEdge);
+            descriptor->set->writeDescriptor(5, gbuffer->getDepthStencilView(), nearestClampToEdge);
+        }
+        cullDescriptor.set->writeDescriptor(1, gbuffer->getDepthStencilView(), nearestClampToEdge);
+        // Multisampled G-buffer is read with texelFetch()
+        const std::shared_ptr<magma::ImageView> msaaAttachments[4] = {
+            msaaGbufferViews[0],
+            msaaGbufferViews[1],
+            msaaGbufferViews[specular],
+            msaaGbufferViews.back()};
+        for (uint32_t i = 0; i < 4; ++i)
+        {
+            classifyDescriptor.set->writeDescriptor(1 + i, msaaAttachments[i], nearestClampToEdge);
+            msaaDescriptor.set->writeDescriptor(2 + i, msaaAttachments[i], nearestClampToEdge);
+        }
+        msaaCullDescriptor.set->writeDescriptor(1, msaaGbufferViews.back(), nearestClampToEdge);
     }
 
     void setupGraphicsPipelines()
@@ -275,17 +1296,244 @@ public:
                 magma::blendstates::writeRgba, // Albedo
                 magma::blendstates::writeRgba  // Specular
             });
-        gbufferPipeline = createMrtPipeline("transform.o", "fillGbuffer.o",
+        const magma::MultiColorBlendState packedGbufferBlendState(
+            {
+                magma::blendstates::writeRgb, // Normal, ambient and shininess
+                magma::blendstates::writeRgba // Albedo and specular
+            });
+        const bool packed = constants.packedGbuffer;
+        gbufferPipeline = createMrtPipeline("transform.o", packed ? "fillGbufferPacked.o" : "fillGbuffer.o",
             objects[0]->getVertexInput(),
-            gbufferBlendState,
+            packed ? packedGbufferBlendState : gbufferBlendState,
             gbuffer,
             gbDescriptor.layout);
-        gbufferTexPipeline = createMrtPipeline("transform.o", "fillGbufferTex.o",
+        gbufferTexPipeline = createMrtPipeline("transform.o", packed ? "fillGbufferTexPacked.o" : "fillGbufferTex.o",
             objects[0]->getVertexInput(),
-            gbufferBlendState,
+            packed ? packedGbufferBlendState : gbufferBlendState,
             gbuffer,
             gbTexDescriptor.layout);
-        deferredPipeline = createFullscreenPipeline("quad.o", "deferred.o", dsDescriptor.layout);
+        auto specialization(std::make_shared<magma::Specialization>(constants,
+            std::initializer_list<magma::SpecializationEntry>
+            {
+                {0, &Constants::cullLights},
+                {1, &Constants::packedGbuffer},
+                {2, &Constants::sampleCount},
+                {3, &Constants::perSampleShading},
+                {4, &Constants::pointShadows}
+            }));
+        deferredPipeline = createFullscreenPipeline("quad.o", "deferred.o",
+            specialization, dsDescriptor.layout, framebuffers[FrontBuffer]);
+        cullLightsPipeline = createComputePipeline("cullLights.o", nullptr, cullDescriptor.layout);
+        tiledPipeline = createFullscreenPipeline("quad.o", "tiledDeferred.o",
+            specialization, tiledDescriptor.layout, framebuffers[FrontBuffer]);
+        lowResDeferredPipeline = createFullscreenPipeline("quad.o", "deferred.o",
+            specialization, dsDescriptor.layout, lowResFramebuffer);
+        lowResTiledPipeline = createFullscreenPipeline("quad.o", "tiledDeferred.o",
+            specialization, tiledDescriptor.layout, lowResFramebuffer);
+        upsamplePipeline = createComputePipeline("upsampleLighting.o", specialization, upsampleDescriptor.layout);
+        setupLightVolumePipelines(specialization);
+        setupMsaaPipelines(specialization);
+        if (visibilitySupported)
+            setupVisibilityPipelines(specialization);
+        if (!cubeShadowPipeline)
+            setupCubeShadowPipelines();
+    }
+
+    void setupCubeShadowPipelines()
+    {   // Viewport selects face tile of the atlas
+        cubeShadowPipeline = std::make_shared<magma::GraphicsPipeline>(device,
+            std::vector<magma::PipelineShaderStage>{
+                loadShaderStage("cubeShadowFace.o"),
+                loadShaderStage("cubeShadowDistance.o")
+            },
+            objects[0]->getVertexInput(),
+            magma::renderstates::triangleList,
+            magma::TesselationState(),
+            magma::ViewportState(0.f, 0.f, cubeShadowAtlas->getExtent()),
+            magma::renderstates::fillCullFrontCW, // Draw only back faces to get rid of shadow acne
+            magma::renderstates::dontMultisample,
+            magma::renderstates::depthLessOrEqual,
+            magma::renderstates::dontWriteRgba,
+            std::initializer_list<VkDynamicState>{VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR},
+            std::make_shared<magma::PipelineLayout>(cubeShadowDescriptor.layout),
+            cubeShadowAtlas->getRenderPass(), 0,
+            pipelineCache,
+            nullptr, nullptr, 0);
+        if (singlePassCubeShadowSupported)
+        {   // Geometry shader selects face tile
+            cubeShadowSinglePassPipeline = std::make_shared<magma::GraphicsPipeline>(device,
+                std::vector<magma::PipelineShaderStage>{
+                    loadShaderStage("cubeShadow.o"),
+                    loadShaderStage("cubeShadowFaces.o"),
+                    loadShaderStage("cubeShadowDistance.o")
+                },
+                objects[0]->getVertexInput(),
+                magma::renderstates::triangleList,
+                magma::TesselationState(),
+                magma::ViewportState(0.f, 0.f, cubeShadowAtlas->getExtent()),
+                magma::renderstates::fillCullFrontCW,
+                magma::renderstates::dontMultisample,
+                magma::renderstates::depthLessOrEqual,
+                magma::renderstates::dontWriteRgba,
+                std::initializer_list<VkDynamicState>{},
+                std::make_shared<magma::PipelineLayout>(cubeShadowDescriptor.layout),
+                cubeShadowAtlas->getRenderPass(), 0,
+                pipelineCache,
+                nullptr, nullptr, 0);
+        }
+    }
+
+    void setupVisibilityPipelines(std::shared_ptr<magma::Specialization> specialization)
+    {
+        visibilityPipeline = std::make_shared<magma::GraphicsPipeline>(device,
+            std::vector<magma::PipelineShaderStage>{
+                loadShaderStage("visibility.o"),
+                loadShaderStage("visibilityId.o")
+            },
+            objects[0]->getVertexInput(),
+            magma::renderstates::triangleList,
+            magma::TesselationState(),
+            magma::ViewportState(0.f, 0.f, framebuffers[FrontBuffer]->getExtent()),
+            magma::renderstates::fillCullBackCW,
+            magma::renderstates::dontMultisample,
+            magma::renderstates::depthLessOrEqual,
+            magma::renderstates::dontBlendRgba,
+            std::initializer_list<VkDynamicState>{},
+            std::make_shared<magma::PipelineLayout>(visibilityDescriptor.layout),
+            visibilityRenderPass, 0,
+            pipelineCache,
+            nullptr, nullptr, 0);
+        visibilityShadingPipeline = createFullscreenPipeline("quad.o", "visibilityShading.o",
+            std::move(specialization), visibilityShadingDescriptor.layout, framebuffers[FrontBuffer]);
+    }
+
+    void setupMsaaPipelines(std::shared_ptr<magma::Specialization> specialization)
+    {
+        const magma::MultisampleState multisampleState(static_cast<VkSampleCountFlagBits>(msaaSampleCount));
+        const magma::MultiColorBlendState gbufferBlendState(
+            {
+                magma::blendstates::writeRg, // Normal
+                magma::blendstates::writeRgba, // Albedo
+                magma::blendstates::writeRgba  // Specular
+            });
+        const magma::MultiColorBlendState packedGbufferBlendState(
+            {
+                magma::blendstates::writeRgb, // Normal, ambient and shininess
+                magma::blendstates::writeRgba // Albedo and specular
+            });
+        const bool packed = constants.packedGbuffer;
+        msaaGbufferPipeline = createSubpassPipeline("transform.o", packed ? "fillGbufferPacked.o" : "fillGbuffer.o",
+            objects[0]->getVertexInput(), magma::renderstates::triangleList,
+            magma::renderstates::depthLessOrEqual, packed ? packedGbufferBlendState : gbufferBlendState,
+            gbDescriptor.layout, msaaGbufferRenderPass, 0, multisampleState);
+        msaaGbufferTexPipeline = createSubpassPipeline("transform.o", packed ? "fillGbufferTexPacked.o" : "fillGbufferTex.o",
+            objects[0]->getVertexInput(), magma::renderstates::triangleList,
+            magma::renderstates::depthLessOrEqual, packed ? packedGbufferBlendState : gbufferBlendState,
+            gbTexDescriptor.layout, msaaGbufferRenderPass, 0, multisampleState);
+        classifyPipeline = createComputePipeline("classifySamples.o", specialization, classifyDescriptor.layout);
+        // Tile depth bounds are found over all samples
+        msaaCullLightsPipeline = createComputePipeline("cullLightsMsaa.o", specialization, msaaCullDescriptor.layout);
+        msaaLightingPipeline = createFullscreenPipeline("quad.o", "deferredMsaa.o",
+            std::move(specialization), msaaDescriptor.layout, framebuffers[FrontBuffer]);
+    }
+
+    void setupLightVolumePipelines(std::shared_ptr<magma::Specialization> specialization)
+    {
+        ambientPipeline = std::make_shared<magma::GraphicsPipeline>(device,
+            std::vector<magma::PipelineShaderStage>{
+                loadShaderStage("quad.o"),
+                loadShaderStage("ambient.o", specialization)
+            },
+            magma::renderstates::nullVertexInput,
+            magma::renderstates::triangleStrip,
+            magma::TesselationState(),
+            magma::ViewportState(0.f, 0.f, framebuffers[FrontBuffer]->getExtent()),
+            magma::renderstates::fillCullBackCW,
+            magma::renderstates::dontMultisample,
+            magma::renderstates::depthAlwaysDontWrite,
+            magma::renderstates::dontBlendRgba,
+            std::initializer_list<VkDynamicState>{},
+            std::make_shared<magma::PipelineLayout>(volumeDescriptor.layout),
+            volumeRenderPass, 0,
+            pipelineCache,
+            nullptr, nullptr, 0);
+        // Depth bounds test compares stored G-buffer depth against depth range of light sphere
+        magma::DepthStencilState depthBoundsState(magma::renderstates::depthAlwaysDontWrite);
+        depthBoundsState.depthBoundsTestEnable = depthBoundsSupported;
+        std::vector<VkDynamicState> dynamicStates;
+        if (depthBoundsSupported)
+            dynamicStates.push_back(VK_DYNAMIC_STATE_DEPTH_BOUNDS);
+        lightVolumePipeline = std::make_shared<magma::GraphicsPipeline>(device,
+            std::vector<magma::PipelineShaderStage>{
+                loadShaderStage("lightVolume.o"),
+                loadShaderStage("pointLight.o", std::move(specialization))
+            },
+            magma::renderstates::nullVertexInput,
+            magma::renderstates::triangleStrip,
+            magma::TesselationState(),
+            magma::ViewportState(0.f, 0.f, framebuffers[FrontBuffer]->getExtent()),
+            magma::renderstates::fillCullBackCW,
+            magma::renderstates::dontMultisample,
+            depthBoundsState,
+            magma::blendstates::addRgb, // Accumulate lights
+            dynamicStates,
+            std::make_shared<magma::PipelineLayout>(volumeDescriptor.layout),
+            volumeRenderPass, 0,
+            pipelineCache,
+            nullptr, nullptr, 0);
+    }
+
+    std::shared_ptr<magma::GraphicsPipeline> createSubpassPipeline(const char *vertexShaderFile, const char *fragmentShaderFile,
+        const magma::VertexInputState& vertexInputState, const magma::InputAssemblyState& inputAssemblyState,
+        const magma::DepthStencilState& depthStencilState, const magma::ColorBlendState& colorBlendState,
+        std::shared_ptr<magma::DescriptorSetLayout> setLayout,
+        std::shared_ptr<magma::RenderPass> renderPass, uint32_t subpass,
+        const magma::MultisampleState& multisampleState = magma::renderstates::dontMultisample)
+    {
+        std::vector<magma::PipelineShaderStage> shaderStages = {loadShaderStage(vertexShaderFile)};
+        if (fragmentShaderFile)
+            shaderStages.push_back(loadShaderStage(fragmentShaderFile));
+        return std::make_shared<magma::GraphicsPipeline>(device,
+            std::move(shaderStages),
+            vertexInputState,
+            inputAssemblyState,
+            magma::TesselationState(),
+            magma::ViewportState(0.f, 0.f, framebuffers[FrontBuffer]->getExtent()),
+            magma::renderstates::fillCullBackCW,
+            multisampleState,
+            depthStencilState,
+            colorBlendState,
+            std::initializer_list<VkDynamicState>{},
+            std::make_shared<magma::PipelineLayout>(std::move(setLayout)),
+            std::move(renderPass), subpass,
+            pipelineCache,
+            nullptr, nullptr, 0);
+    }
+
+    void setupSubpassPipelines()
+    {
+        const magma::MultiColorBlendState gbufferBlendState(
+            {
+                magma::blendstates::writeRg, // Normal
+                magma::blendstates::writeRgba, // Albedo
+                magma::blendstates::writeRgba  // Specular
+            });
+        subpassDepthPipeline = createSubpassPipeline("transform.o", nullptr,
+            objects[0]->getVertexInput(), magma::renderstates::triangleList,
+            magma::renderstates::depthLessOrEqual, magma::renderstates::dontWriteRgba,
+            depthDescriptor.layout, singleRenderPass, 0);
+        subpassGbufferPipeline = createSubpassPipeline("transform.o", "fillGbuffer.o",
+            objects[0]->getVertexInput(), magma::renderstates::triangleList,
+            magma::renderstates::depthEqualDontWrite, gbufferBlendState,
+            gbDescriptor.layout, singleRenderPass, 1);
+        subpassGbufferTexPipeline = createSubpassPipeline("transform.o", "fillGbufferTex.o",
+            objects[0]->getVertexInput(), magma::renderstates::triangleList,
+            magma::renderstates::depthEqualDontWrite, gbufferBlendState,
+            gbTexDescriptor.layout, singleRenderPass, 1);
+        subpassDeferredPipeline = createSubpassPipeline("quad.o", "deferredSubpass.o",
+            magma::renderstates::nullVertexInput, magma::renderstates::triangleStrip,
+            magma::renderstates::depthAlwaysDontWrite, magma::renderstates::dontBlendRgba,
+            subpassDescriptor.layout, singleRenderPass, 2);
     }
 
     void renderScene(uint32_t bufferIndex)
@@ -293,78 +1541,429 @@ public:
         std::shared_ptr<magma::CommandBuffer> cmdBuffer = commandBuffers[bufferIndex];
         cmdBuffer->begin();
         {
-            if (FrontBuffer == bufferIndex)
-            {   // Draw once
-                depthPrePass(cmdBuffer);
-                gbufferPass(cmdBuffer);
+            gpuTimer->reset(cmdBuffer);
+            if (singlePass)
+            {   // Transient G-buffer doesn't persist between frames
+                singleRenderPassDeferred(cmdBuffer, bufferIndex);
+            }
+            else if (visibilityBuffer)
+            {
+                if (FrontBuffer == bufferIndex)
+                {   // Draw once
+                    visibilityPass(cmdBuffer);
+                    if ((TiledShading == lightingMode) && constants.cullLights)
+                        lightCullingPass(cmdBuffer, cullLightsPipeline, visibilityCullDescriptor.set);
+                }
+                visibilityShadingPass(cmdBuffer, bufferIndex);
+            }
+            else if (msaaGbuffer)
+            {
+                if (FrontBuffer == bufferIndex)
+                {   // Draw once
+                    msaaGbufferPass(cmdBuffer);
+                    classificationPass(cmdBuffer);
+                    if ((TiledShading == lightingMode) && constants.cullLights)
+                        lightCullingPass(cmdBuffer, msaaCullLightsPipeline, msaaCullDescriptor.set);
+                }
+                msaaLightingPass(cmdBuffer, bufferIndex);
+            }
+            else
+            {
+                if (FrontBuffer == bufferIndex)
+                {   // Draw once
+                    depthPrePass(cmdBuffer);
+                    gbufferPass(cmdBuffer);
+                    if ((TiledShading == lightingMode) && constants.cullLights)
+                        lightCullingPass(cmdBuffer, cullLightsPipeline, cullDescriptor.set);
+                    if ((SingleLight == lightingMode) && constants.pointShadows)
+                        cubeShadowPass(cmdBuffer);
+                }
+                deferredPass(cmdBuffer, bufferIndex);
             }
-            deferredPass(cmdBuffer, bufferIndex);
         }
         cmdBuffer->end();
     }
 
     void depthPrePass(std::shared_ptr<magma::CommandBuffer> cmdBuffer)
     {
+        gpuTimer->begin(cmdBuffer, DepthPrePass);
         cmdBuffer->beginRenderPass(gbuffer->getDepthRenderPass(), gbuffer->getDepthFramebuffer(),
             {   // Clear only depth attachment
                 magma::clears::depthOne
             });
+        drawDepth(cmdBuffer, depthPipeline);
+        cmdBuffer->endRenderPass();
+        gpuTimer->end(cmdBuffer, DepthPrePass);
+    }
+
+    void gbufferPass(std::shared_ptr<magma::CommandBuffer> cmdBuffer)
+    {
+        gpuTimer->begin(cmdBuffer, GbufferPass);
+        if (constants.packedGbuffer)
         {
-            cmdBuffer->bindPipeline(depthPipeline);
-            for (uint32_t i = Cube; i < MaxObjects; ++i)
+            cmdBuffer->beginRenderPass(gbuffer->getRenderPass(), gbuffer->getFramebuffer(),
+                {   // Clear only color attachments
+                    magma::clears::blackColor,
+                    magma::ClearColor(0.35f, 0.53f, 0.7f, 1.0f)
+                });
+        }
+        else
+        {
+            cmdBuffer->beginRenderPass(gbuffer->getRenderPass(), gbuffer->getFramebuffer(),
+                {   // Clear only color attachments
+                    magma::clears::blackColor,
+                    magma::ClearColor(0.35f, 0.53f, 0.7f, 1.0f),
+                    magma::ClearColor(0.35f, 0.53f, 0.7f, 1.0f)
+                });
+        }
+        drawGbuffer(cmdBuffer, gbufferPipeline, gbufferTexPipeline);
+        cmdBuffer->endRenderPass();
+        gpuTimer->end(cmdBuffer, GbufferPass);
+    }
+
+    void cubeShadowPass(std::shared_ptr<magma::CommandBuffer> cmdBuffer)
+    {
+        const uint32_t pass = singlePassCubeShadow ? CubeShadowSinglePass : CubeShadowPass;
+        gpuTimer->begin(cmdBuffer, pass);
+        cmdBuffer->beginRenderPass(cubeShadowAtlas->getRenderPass(), cubeShadowAtlas->getFramebuffer(),
+            {
+                magma::clears::depthOne
+            });
+        if (singlePassCubeShadow)
+        {   // Each caster is submitted once, geometry shader replicates triangles to the faces they overlap
+            cmdBuffer->bindPipeline(cubeShadowSinglePassPipeline);
+            for (uint32_t i = Cube; i < Ground; ++i)
             {
-                cmdBuffer->bindDescriptorSet(depthPipeline, depthDescriptor.set,
-                    transforms->getDynamicOffset(i));
+                cmdBuffer->bindDescriptorSet(cubeShadowSinglePassPipeline, cubeShadowDescriptor.set, {
+                    transforms->getDynamicOffset(i),
+                    faceTransforms->getDynamicOffset(0)
+                });
                 objects[i]->draw(cmdBuffer);
             }
         }
+        else
+        {   // Casters are submitted for every face
+            const uint32_t faceSize = cubeShadowAtlas->getExtent().height/2;
+            cmdBuffer->bindPipeline(cubeShadowPipeline);
+            for (uint32_t face = 0; face < 6; ++face)
+            {
+                const int32_t x = (face % 3) * faceSize;
+                const int32_t y = (face / 3) * faceSize;
+                cmdBuffer->setViewport(magma::Viewport(float(x), float(y), VkExtent2D{faceSize, faceSize}));
+                cmdBuffer->setScissor(magma::Scissor(x, y, VkExtent2D{faceSize, faceSize}));
+                for (uint32_t i = Cube; i < Ground; ++i)
+                {
+                    cmdBuffer->bindDescriptorSet(cubeShadowPipeline, cubeShadowDescriptor.set, {
+                        transforms->getDynamicOffset(i),
+                        faceTransforms->getDynamicOffset(face)
+                    });
+                    objects[i]->draw(cmdBuffer);
+                }
+            }
+        }
         cmdBuffer->endRenderPass();
+        gpuTimer->end(cmdBuffer, pass);
     }
 
-    void gbufferPass(std::shared_ptr<magma::CommandBuffer> cmdBuffer)
+    void drawDepth(std::shared_ptr<magma::CommandBuffer> cmdBuffer, std::shared_ptr<magma::GraphicsPipeline> pipeline)
+    {
+        cmdBuffer->bindPipeline(pipeline);
+        for (uint32_t i = Cube; i < MaxObjects; ++i)
+        {
+            cmdBuffer->bindDescriptorSet(pipeline, depthDescriptor.set,
+                transforms->getDynamicOffset(i));
+            objects[i]->draw(cmdBuffer);
+        }
+    }
+
+    void drawGbuffer(std::shared_ptr<magma::CommandBuffer> cmdBuffer,
+        std::shared_ptr<magma::GraphicsPipeline> pipeline, std::shared_ptr<magma::GraphicsPipeline> texPipeline)
+    {   // 1. Draw objects
+        cmdBuffer->bindPipeline(pipeline);
+        for (uint32_t i = Cube; i < Ground; ++i)
+        {
+            cmdBuffer->bindDescriptorSet(pipeline, gbDescriptor.set,
+                {
+                    transforms->getDynamicOffset(i),
+                    materials->getDynamicOffset(i)
+                });
+            objects[i]->draw(cmdBuffer);
+        }
+        // 2. Draw textured ground
+        cmdBuffer->bindPipeline(texPipeline);
+        cmdBuffer->bindDescriptorSet(texPipeline, gbTexDescriptor.set,
+            {
+                transforms->getDynamicOffset(Ground),
+                materials->getDynamicOffset(Ground)
+            });
+        objects[Ground]->draw(cmdBuffer);
+    }
+
+    void singleRenderPassDeferred(std::shared_ptr<magma::CommandBuffer> cmdBuffer, uint32_t bufferIndex)
     {
-        cmdBuffer->beginRenderPass(gbuffer->getRenderPass(), gbuffer->getFramebuffer(),
-            {   // Clear only color attachments
+        gpuTimer->begin(cmdBuffer, SinglePass);
+        cmdBuffer->beginRenderPass(singleRenderPass, singlePassFramebuffers[bufferIndex],
+            {
+                magma::ClearColor(0.1f, 0.243f, 0.448f, 1.f),
                 magma::clears::blackColor,
                 magma::ClearColor(0.35f, 0.53f, 0.7f, 1.0f),
-                magma::ClearColor(0.35f, 0.53f, 0.7f, 1.0f)
+                magma::ClearColor(0.35f, 0.53f, 0.7f, 1.0f),
+                magma::clears::depthOne
             });
-        {   // 1. Draw objects
-            cmdBuffer->bindPipeline(gbufferPipeline);
-            for (uint32_t i = Cube; i < Ground; ++i)
+        {   // 1. Depth pre-pass
+            drawDepth(cmdBuffer, subpassDepthPipeline);
+            cmdBuffer->nextSubpass();
+            // 2. Fill G-buffer
+            drawGbuffer(cmdBuffer, subpassGbufferPipeline, subpassGbufferTexPipeline);
+            cmdBuffer->nextSubpass();
+            // 3. Read G-buffer from tile memory
+            cmdBuffer->bindPipeline(subpassDeferredPipeline);
+            cmdBuffer->bindDescriptorSet(subpassDeferredPipeline, subpassDescriptor.set);
+            cmdBuffer->draw(4, 0);
+        }
+        cmdBuffer->endRenderPass();
+        gpuTimer->end(cmdBuffer, SinglePass);
+    }
+
+    void msaaGbufferPass(std::shared_ptr<magma::CommandBuffer> cmdBuffer)
+    {
+        gpuTimer->begin(cmdBuffer, MsaaGbufferPass);
+        std::vector<magma::ClearValue> clearValues = {
+            magma::clears::blackColor,
+            magma::ClearColor(0.35f, 0.53f, 0.7f, 1.0f)};
+        if (!constants.packedGbuffer)
+            clearValues.push_back(magma::ClearColor(0.35f, 0.53f, 0.7f, 1.0f));
+        clearValues.push_back(magma::clears::depthOne);
+        cmdBuffer->beginRenderPass(msaaGbufferRenderPass, msaaGbufferFramebuffer, clearValues);
+        drawGbuffer(cmdBuffer, msaaGbufferPipeline, msaaGbufferTexPipeline);
+        cmdBuffer->endRenderPass();
+        cmdBuffer->pipelineBarrier(VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+            magma::MemoryBarrier(VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+                VK_ACCESS_SHADER_READ_BIT));
+        gpuTimer->end(cmdBuffer, MsaaGbufferPass);
+    }
+
+    void classificationPass(std::shared_ptr<magma::CommandBuffer> cmdBuffer)
+    {   // Find pixels whose samples belong to different surfaces
+        gpuTimer->begin(cmdBuffer, ClassificationPass);
+        cmdBuffer->fillBuffer(complexPixelCounter, 0, sizeof(uint32_t));
+        cmdBuffer->pipelineBarrier(VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            magma::MemoryBarrier(VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT));
+        const VkExtent2D extent = framebuffers[FrontBuffer]->getExtent();
+        cmdBuffer->bindPipeline(classifyPipeline);
+        cmdBuffer->bindDescriptorSet(classifyPipeline, classifyDescriptor.set);
+        cmdBuffer->dispatch((extent.width + 7)/8, (extent.height + 7)/8, 1);
+        cmdBuffer->pipelineBarrier(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+            magma::MemoryBarrier(VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_SHADER_READ_BIT));
+        // Read back number of complex pixels for statistics
+        cmdBuffer->copyBuffer(complexPixelCounter, complexPixelReadback);
+        gpuTimer->end(cmdBuffer, ClassificationPass);
+    }
+
+    void msaaLightingPass(std::shared_ptr<magma::CommandBuffer> cmdBuffer, uint32_t bufferIndex)
+    {   // Shade simple pixels once and complex pixels per sample
+        const uint32_t lightingPass = constants.perSampleShading ? MsaaPerSampleLightingPass : MsaaLightingPass;
+        gpuTimer->begin(cmdBuffer, lightingPass);
+        cmdBuffer->beginRenderPass(renderPass, framebuffers[bufferIndex],
+            {
+                magma::ClearColor(0.1f, 0.243f, 0.448f, 1.f)
+            });
+        {
+            cmdBuffer->bindPipeline(msaaLightingPipeline);
+            cmdBuffer->bindDescriptorSet(msaaLightingPipeline, msaaDescriptor.set);
+            cmdBuffer->draw(4, 0);
+        }
+        cmdBuffer->endRenderPass();
+        gpuTimer->end(cmdBuffer, lightingPass);
+    }
+
+    void visibilityPass(std::shared_ptr<magma::CommandBuffer> cmdBuffer)
+    {
+        gpuTimer->begin(cmdBuffer, VisibilityPass);
+        cmdBuffer->beginRenderPass(visibilityRenderPass, visibilityFramebuffer,
             {
-                cmdBuffer->bindDescriptorSet(gbufferPipeline, gbDescriptor.set,
+                magma::clears::blackColor, // Zero ID is background
+                magma::clears::depthOne
+            });
+        {
+            cmdBuffer->bindPipeline(visibilityPipeline);
+            for (uint32_t i = Cube; i < MaxObjects; ++i)
+            {
+                cmdBuffer->bindDescriptorSet(visibilityPipeline, visibilityDescriptor.set,
                     {
                         transforms->getDynamicOffset(i),
-                        materials->getDynamicOffset(i)
+                        objectIndices->getDynamicOffset(i)
                     });
                 objects[i]->draw(cmdBuffer);
             }
-            // 2. Draw textured ground
-            cmdBuffer->bindPipeline(gbufferTexPipeline);
-            cmdBuffer->bindDescriptorSet(gbufferTexPipeline, gbTexDescriptor.set,
-                {
-                    transforms->getDynamicOffset(Ground),
-                    materials->getDynamicOffset(Ground)
-                });
-            objects[Ground]->draw(cmdBuffer);
         }
         cmdBuffer->endRenderPass();
+        cmdBuffer->pipelineBarrier(VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+            magma::MemoryBarrier(VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT));
+        gpuTimer->end(cmdBuffer, VisibilityPass);
+    }
+
+    void visibilityShadingPass(std::shared_ptr<magma::CommandBuffer> cmdBuffer, uint32_t bufferIndex)
+    {   // Fetch triangle of each pixel and interpolate its attributes
+        gpuTimer->begin(cmdBuffer, VisibilityShadingPass);
+        cmdBuffer->beginRenderPass(renderPass, framebuffers[bufferIndex],
+            {
+                magma::ClearColor(0.1f, 0.243f, 0.448f, 1.f)
+            });
+        {
+            cmdBuffer->bindPipeline(visibilityShadingPipeline);
+            cmdBuffer->bindDescriptorSet(visibilityShadingPipeline, visibilityShadingDescriptor.set);
+            cmdBuffer->draw(4, 0);
+        }
+        cmdBuffer->endRenderPass();
+        gpuTimer->end(cmdBuffer, VisibilityShadingPass);
+    }
+
+    void lightCullingPass(std::shared_ptr<magma::CommandBuffer> cmdBuffer,
+        std::shared_ptr<magma::ComputePipeline> pipeline, std::shared_ptr<magma::DescriptorSet> descriptorSet)
+    {
+        gpuTimer->begin(cmdBuffer, LightCullingPass);
+        cmdBuffer->pipelineBarrier(VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            magma::MemoryBarrier(VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT));
+        const VkExtent2D extent = gbuffer->getExtent();
+        cmdBuffer->bindPipeline(pipeline);
+        cmdBuffer->bindDescriptorSet(pipeline, descriptorSet);
+        cmdBuffer->dispatch((extent.width + tileSize - 1)/tileSize, (extent.height + tileSize - 1)/tileSize, 1);
+        cmdBuffer->pipelineBarrier(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+            magma::MemoryBarrier(VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT));
+        gpuTimer->end(cmdBuffer, LightCullingPass);
     }
 
     void deferredPass(std::shared_ptr<magma::CommandBuffer> cmdBuffer, uint32_t bufferIndex)
     {
-        cmdBuffer->beginRenderPass(renderPass, framebuffers[bufferIndex],
+        if ((LightVolumes != lightingMode) && (resolutionScales[scaleIndex] > 1))
+        {
+            reducedResolutionLighting(cmdBuffer, bufferIndex);
+            return;
+        }
+        gpuTimer->begin(cmdBuffer, LightingPass);
+        if (LightVolumes == lightingMode)
+            lightVolumesPass(cmdBuffer, bufferIndex);
+        else
+        {
+            cmdBuffer->beginRenderPass(renderPass, framebuffers[bufferIndex],
+                {
+                    magma::ClearColor(0.1f, 0.243f, 0.448f, 1.f)
+                });
+            {
+                if (TiledShading == lightingMode)
+                {   // Loop over point lights in a single pass
+                    cmdBuffer->bindPipeline(tiledPipeline);
+                    cmdBuffer->bindDescriptorSet(tiledPipeline, tiledDescriptor.set);
+                }
+                else
+                {
+                    cmdBuffer->bindPipeline(deferredPipeline);
+                    cmdBuffer->bindDescriptorSet(deferredPipeline, dsDescriptor.set);
+                }
+                cmdBuffer->draw(4, 0);
+            }
+            cmdBuffer->endRenderPass();
+        }
+        gpuTimer->end(cmdBuffer, LightingPass);
+    }
+
+    void reducedResolutionLighting(std::shared_ptr<magma::CommandBuffer> cmdBuffer, uint32_t bufferIndex)
+    {   // 1. Shade reduced resolution image
+        const uint32_t lightingPass = LightingPass + scaleIndex;
+        gpuTimer->begin(cmdBuffer, lightingPass);
+        cmdBuffer->beginRenderPass(lowResFramebuffer->getRenderPass(), lowResFramebuffer->getFramebuffer(),
             {
                 magma::ClearColor(0.1f, 0.243f, 0.448f, 1.f)
             });
         {
-            cmdBuffer->bindPipeline(deferredPipeline);
-            cmdBuffer->bindDescriptorSet(deferredPipeline, dsDescriptor.set);
+            if (TiledShading == lightingMode)
+            {
+                cmdBuffer->bindPipeline(lowResTiledPipeline);
+                cmdBuffer->bindDescriptorSet(lowResTiledPipeline, tiledDescriptor.set);
+            }
+            else
+            {
+                cmdBuffer->bindPipeline(lowResDeferredPipeline);
+                cmdBuffer->bindDescriptorSet(lowResDeferredPipeline, dsDescriptor.set);
+            }
+            cmdBuffer->draw(4, 0);
+        }
+        cmdBuffer->endRenderPass();
+        gpuTimer->end(cmdBuffer, lightingPass);
+        // 2. Joint bilateral upsample, shading discontinuities at full rate
+        gpuTimer->begin(cmdBuffer, UpsamplePass);
+        cmdBuffer->pipelineBarrier(VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            magma::MemoryBarrier(VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT));
+        const VkExtent2D extent = gbuffer->getExtent();
+        cmdBuffer->bindPipeline(upsamplePipeline);
+        cmdBuffer->bindDescriptorSet(upsamplePipeline, upsampleDescriptor.set);
+        cmdBuffer->dispatch((extent.width + 7)/8, (extent.height + 7)/8, 1);
+        cmdBuffer->pipelineBarrier(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+            magma::MemoryBarrier(VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT));
+        gpuTimer->end(cmdBuffer, UpsamplePass);
+        // 3. Copy to swapchain
+        cmdBuffer->beginRenderPass(renderPass, framebuffers[bufferIndex]);
+        {
+            const VkRect2D rc{0, 0, framebuffers[bufferIndex]->getExtent()};
+            upsampleBltRect->blit(cmdBuffer, upsampledView, VK_FILTER_NEAREST, rc);
+        }
+        cmdBuffer->endRenderPass();
+    }
+
+    void lightVolumesPass(std::shared_ptr<magma::CommandBuffer> cmdBuffer, uint32_t bufferIndex)
+    {
+        cmdBuffer->beginRenderPass(volumeRenderPass, volumeFramebuffers[bufferIndex],
+            {
+                magma::ClearColor(0.1f, 0.243f, 0.448f, 1.f),
+                magma::clears::depthOne // Ignored
+            });
+        {   // 1. Ambient term
+            cmdBuffer->bindPipeline(ambientPipeline);
+            cmdBuffer->bindDescriptorSet(ambientPipeline, volumeDescriptor.set);
             cmdBuffer->draw(4, 0);
+            // 2. Accumulate screen-space bounding rectangle of each light
+            cmdBuffer->bindPipeline(lightVolumePipeline);
+            cmdBuffer->bindDescriptorSet(lightVolumePipeline, volumeDescriptor.set);
+            const uint32_t lightCount = lightCounts[lightCountIndex];
+            if (depthBoundsSupported)
+            {   // Depth bounds are set per light
+                for (uint32_t i = 0; i < lightCount; ++i)
+                {
+                    float minDepth, maxDepth;
+                    calculateDepthBounds(lights[i], minDepth, maxDepth);
+                    cmdBuffer->setDepthBounds(minDepth, maxDepth);
+                    cmdBuffer->drawInstanced(4, 1, 0, i);
+                }
+            }
+            else
+            {   // Draw all lights at once, relying on range test in fragment shader
+                cmdBuffer->drawInstanced(4, lightCount, 0, 0);
+            }
         }
         cmdBuffer->endRenderPass();
     }
+
+    void calculateDepthBounds(const PointLight& light, float& minDepth, float& maxDepth) const
+    {   // Project view space depth range of light sphere
+        const rapid::vector3 eye(viewProj->getPosition());
+        const rapid::vector3 viewDir = (rapid::vector3(viewProj->getFocus()) - eye).normalized();
+        const rapid::vector3 center(light.position.x, light.position.y, light.position.z);
+        const float z = (center - eye).dot(viewDir);
+        const float radius = light.position.w;
+        const float zNear = viewProj->getNearZ();
+        const float zFar = viewProj->getFarZ();
+        auto depth = [zNear, zFar](float z) -> float
+        {   // Left-handed perspective projection to [0, 1] range
+            z = std::min(std::max(z, zNear), zFar);
+            return zFar/(zFar - zNear) * (1.f - zNear/z);
+        };
+        minDepth = depth(z - radius);
+        maxDepth = depth(z + radius);
+    }
 };
 
 std::unique_ptr<IApplication> appFactory(const AppEntry& entry)
@@ -0,0 +1,20 @@
+#version 450
+#extension GL_GOOGLE_include_directive : enable
+#include "common/transforms.h"
+#include "brdf/phong.h"
+#include "gbuffer.h"
+#include "shading.h"
+
+layout(location = 0) in vec2 screenPos;
+layout(location = 1) in vec2 texCoord;
+
+layout(location = 0) out vec3 oColor;
+
+void main()
+{   // Light volumes are accumulated on top of ambient term
+    float depth = loadGbufferDepth(texCoord);
+    if (1. == depth)
+        discard;
+    Gbuffer gbuffer = loadGbuffer(texCoord, depth);
+    oColor = ambientLight(gbuffer);
+}
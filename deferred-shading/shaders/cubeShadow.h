@@ -0,0 +1,15 @@
+// Should match DeferredShading::CubeShadow.
+// Six faces of cube shadow map are packed into 3x2 tiles of depth atlas,
+// which stores distance to the light divided by far plane distance.
+layout(binding = 9) uniform CubeShadow
+{
+    mat4 faceViewProj[6]; // +X, -X, +Y, -Y, +Z, -Z
+    vec4 lightPos; // w - 1/far
+};
+
+const vec2 faceTileScale = vec2(1./3., 1./2.);
+
+vec2 faceTile(int face)
+{
+    return vec2(face % 3, face / 3);
+}
@@ -0,0 +1,8 @@
+#version 450
+
+layout(location = 0) in vec3 lightVec; // Divided by far plane distance
+
+void main()
+{   // Radial distance doesn't depend on the face
+    gl_FragDepth = length(lightVec);
+}
@@ -0,0 +1,23 @@
+#version 450
+#extension GL_GOOGLE_include_directive : enable
+#include "common/transforms.h"
+#include "cubeShadow.h"
+
+layout(binding = 2) uniform Face
+{
+    mat4 faceTransform;
+};
+
+layout(location = 0) in vec4 position;
+
+layout(location = 0) out vec3 oLightVec;
+out gl_PerVertex {
+    vec4 gl_Position;
+};
+
+void main()
+{   // Viewport selects tile of the atlas
+    vec4 worldPos = world * position;
+    oLightVec = (worldPos.xyz - lightPos.xyz) * lightPos.w;
+    gl_Position = faceTransform * worldPos;
+}
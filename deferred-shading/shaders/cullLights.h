@@ -0,0 +1,131 @@
+
+layout(local_size_x = TILE_SIZE, local_size_y = TILE_SIZE) in;
+
+#ifdef MULTISAMPLED_DEPTH
+layout(constant_id = 2) const int c_sampleCount = 4;
+
+layout(binding = 2) uniform sampler2DMS depthMap;
+#else
+layout(binding = 2) uniform sampler2D depthMap;
+#endif
+layout(binding = 3, std430) readonly buffer Lights
+{
+    uvec4 lightCount; // x - number of lights, padded to alignment of lights[]
+    PointLight lights[];
+};
+layout(binding = 4, std430) writeonly buffer TileLightList
+{
+    TileLights tiles[];
+};
+
+shared uint minDepthBits;
+shared uint maxDepthBits;
+shared uint tileLightCount;
+shared vec3 frustumPlanes[4];
+
+#ifdef MULTISAMPLED_DEPTH
+ivec2 depthSize()
+{
+    return textureSize(depthMap);
+}
+
+// Tile depth bounds should enclose every sample, as complex pixels are shaded per sample
+void pixelDepthRange(ivec2 pixel, out float minDepth, out float maxDepth)
+{
+    minDepth = 1.;
+    maxDepth = 0.;
+    for (int i = 0; i < c_sampleCount; ++i)
+    {
+        float depth = texelFetch(depthMap, pixel, i).r;
+        if (depth < 1.)
+        {   // Skip background
+            minDepth = min(minDepth, depth);
+            maxDepth = max(maxDepth, depth);
+        }
+    }
+}
+#else
+ivec2 depthSize()
+{
+    return textureSize(depthMap, 0);
+}
+
+void pixelDepthRange(ivec2 pixel, out float minDepth, out float maxDepth)
+{
+    float depth = texelFetch(depthMap, pixel, 0).r;
+    minDepth = depth < 1. ? depth : 1.; // Skip background
+    maxDepth = depth < 1. ? depth : 0.;
+}
+#endif // MULTISAMPLED_DEPTH
+
+void main()
+{
+    ivec2 size = depthSize();
+    uint tileIndex = gl_WorkGroupID.y * gl_NumWorkGroups.x + gl_WorkGroupID.x;
+    if (0 == gl_LocalInvocationIndex)
+    {
+        minDepthBits = 0xFFFFFFFF;
+        maxDepthBits = 0;
+        tileLightCount = 0;
+    }
+    barrier();
+
+    // Positive floats preserve their order when compared as unsigned integers
+    ivec2 pixel = min(ivec2(gl_GlobalInvocationID.xy), size - 1);
+    float minDepth, maxDepth;
+    pixelDepthRange(pixel, minDepth, maxDepth);
+    if (minDepth <= maxDepth)
+    {   // Pixel isn't background
+        atomicMin(minDepthBits, floatBitsToUint(minDepth));
+        atomicMax(maxDepthBits, floatBitsToUint(maxDepth));
+    }
+
+    vec2 tileMin = vec2(gl_WorkGroupID.xy * TILE_SIZE) / vec2(size) * 2. - 1.;
+    vec2 tileMax = vec2((gl_WorkGroupID.xy + 1) * TILE_SIZE) / vec2(size) * 2. - 1.;
+    vec2 tileCenter = (tileMin + tileMax) * .5;
+    if (0 == gl_LocalInvocationIndex)
+    {   // Side planes of tile frustum pass through the eye at (0, 0, 0)
+        vec3 corners[4];
+        corners[0] = reconstructViewPos(tileMin, 1.);
+        corners[1] = reconstructViewPos(vec2(tileMax.x, tileMin.y), 1.);
+        corners[2] = reconstructViewPos(tileMax, 1.);
+        corners[3] = reconstructViewPos(vec2(tileMin.x, tileMax.y), 1.);
+        vec3 center = reconstructViewPos(tileCenter, 1.);
+        for (int i = 0; i < 4; ++i)
+        {
+            vec3 n = normalize(cross(corners[i], corners[(i + 1) & 3]));
+            frustumPlanes[i] = dot(n, center) < 0. ? -n : n; // Point inside
+        }
+    }
+    barrier();
+
+    if (minDepthBits > maxDepthBits)
+    {   // Tile covers background only
+        if (0 == gl_LocalInvocationIndex)
+            tiles[tileIndex].count = 0;
+        return;
+    }
+
+    float minZ = reconstructViewPos(tileCenter, uintBitsToFloat(minDepthBits)).z;
+    float maxZ = reconstructViewPos(tileCenter, uintBitsToFloat(maxDepthBits)).z;
+    for (uint i = gl_LocalInvocationIndex; i < lightCount.x; i += TILE_SIZE * TILE_SIZE)
+    {
+        vec3 lightPos = (view * vec4(lights[i].position.xyz, 1.)).xyz;
+        float radius = lights[i].position.w;
+        if (lightPos.z + radius < minZ || lightPos.z - radius > maxZ)
+            continue;
+        bool inside = true;
+        for (int j = 0; j < 4; ++j)
+            inside = inside && (dot(frustumPlanes[j], lightPos) > -radius);
+        if (inside)
+        {
+            uint index = atomicAdd(tileLightCount, 1);
+            if (index < MAX_LIGHTS_PER_TILE)
+                tiles[tileIndex].indices[index] = i;
+        }
+    }
+    barrier();
+
+    if (0 == gl_LocalInvocationIndex)
+        tiles[tileIndex].count = min(tileLightCount, MAX_LIGHTS_PER_TILE);
+}
@@ -0,0 +1,49 @@
+#version 450
+#extension GL_GOOGLE_include_directive : enable
+#define MULTISAMPLED_GBUFFER
+#include "common/transforms.h"
+#include "common/reconstruct.h"
+#include "brdf/phong.h"
+#include "gbuffer.h"
+#include "shading.h"
+#include "parameters.h"
+
+layout(constant_id = 2) const int c_sampleCount = 4;
+layout(constant_id = 3) const bool c_perSampleShading = false;
+
+layout(binding = 9) uniform sampler2D complexMask;
+
+layout(location = 0) in vec2 screenPos;
+layout(location = 1) in vec2 texCoord;
+
+layout(location = 0) out vec3 oColor;
+
+vec3 shadeSample(ivec2 pixel, int i)
+{
+    float depth = loadGbufferDepth(pixel, i);
+    if (1. == depth)
+        return backgroundColor.rgb;
+    Gbuffer gbuffer = loadGbuffer(pixel, i, depth);
+    vec3 viewPos = reconstructViewPos(screenPos, depth);
+    vec3 v = normalize(-viewPos); // view position at (0, 0, 0)
+    if (tiledShading)
+        return tiledLights(uvec2(pixel), viewPos, v, gbuffer);
+    return singleLight(viewPos, v, gbuffer);
+}
+
+void main()
+{
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    bool complex = texelFetch(complexMask, pixel, 0).r > 0.;
+    if (c_perSampleShading || complex)
+    {   // Shade every sample and resolve
+        oColor = vec3(0.);
+        for (int i = 0; i < c_sampleCount; ++i)
+            oColor += shadeSample(pixel, i);
+        oColor /= float(c_sampleCount);
+    }
+    else
+    {   // All samples belong to the same surface
+        oColor = shadeSample(pixel, 0);
+    }
+}
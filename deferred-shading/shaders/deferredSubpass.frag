@@ -0,0 +1,25 @@
+#version 450
+#extension GL_GOOGLE_include_directive : enable
+#define SUBPASS_GBUFFER
+#include "common/transforms.h"
+#include "common/reconstruct.h"
+#include "brdf/phong.h"
+#include "gbuffer.h"
+#include "shading.h"
+
+layout(location = 0) in vec2 screenPos;
+layout(location = 1) in vec2 texCoord;
+
+layout(location = 0) out vec3 oColor;
+
+void main()
+{
+    float depth = loadGbufferDepth();
+    if (1. == depth)
+        discard;
+    Gbuffer gbuffer = loadGbuffer(depth);
+
+    vec3 viewPos = reconstructViewPos(screenPos, depth);
+    vec3 v = normalize(-viewPos); // view position at (0, 0, 0)
+    oColor = singleLight(viewPos, v, gbuffer);
+}
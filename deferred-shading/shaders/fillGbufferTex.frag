@@ -1,6 +1,7 @@
 #version 450
 #extension GL_GOOGLE_include_directive : enable
 #include "common/transforms.h"
+#include "common/gbufferPacking.h"
 #include "common/cotangentFrame.h"
 
 layout(binding = 2) uniform Material
@@ -22,14 +23,6 @@ layout(location = 0) out vec2 oNormal;
 layout(location = 1) out vec4 oAlbedo;
 layout(location = 2) out vec4 oSpecular;
 
-// https://aras-p.info/texts/CompactNormalStorage.html
-vec2 encode(vec3 n)
-{
-    vec2 enc = normalize(n.xy) * (sqrt(-n.z * .5 + .5));
-    enc = enc * .5 + .5;
-    return enc;
-}
-
 void main()
 {
     vec3 txNormal = texture(normalMap, texCoord).rgb;
@@ -43,7 +36,7 @@ void main()
     // transform from object space to view space
     vec3 viewNormal = mat3(normalMatrix) * objNormal;
 
-    oNormal = encode(normalize(viewNormal));
+    oNormal = encodeSpheremap(normalize(viewNormal));
     oAlbedo = surface.diffuse;
     oSpecular = vec4(surface.specular.rgb, surface.shininess/256.);
 }
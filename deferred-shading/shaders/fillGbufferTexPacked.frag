@@ -0,0 +1,42 @@
+#version 450
+#extension GL_GOOGLE_include_directive : enable
+#include "common/transforms.h"
+#include "common/gbufferPacking.h"
+#include "common/luma.h"
+#include "common/cotangentFrame.h"
+
+layout(binding = 2) uniform Material
+{
+    vec4 ambient;
+    vec4 diffuse;
+    vec4 specular;
+    float shininess;
+} surface;
+
+layout(binding = 3) uniform sampler2D normalMap;
+
+layout(location = 0) in vec3 position;
+layout(location = 1) in vec3 normal;
+layout(location = 2) in vec2 texCoord;
+
+// Packed G-buffer color targets
+layout(location = 0) out vec3 oNormal; // RGB10A2
+layout(location = 1) out vec4 oAlbedo; // RGBA8
+
+void main()
+{
+    vec3 txNormal = texture(normalMap, texCoord).rgb;
+
+    // compute per-pixel cotangent frame
+    vec3 N = normalize(normal);
+    mat3 TBN = cotangentFrame(N, position, texCoord);
+
+    // transform from texture space to object space
+    vec3 objNormal = TBN * (txNormal * 2. - 1.);
+    // transform from object space to view space
+    vec3 viewNormal = mat3(normalMatrix) * objNormal;
+
+    oNormal.xy = encodeOctahedral(normalize(viewNormal));
+    oNormal.z = packAmbientShininess(surface.diffuse.a, surface.shininess);
+    oAlbedo = vec4(surface.diffuse.rgb, luma709(surface.specular.rgb));
+}
@@ -0,0 +1,126 @@
+#include "common/gbufferPacking.h"
+
+layout(constant_id = 1) const bool c_packedGbuffer = false;
+
+struct Gbuffer
+{
+    vec3 normal;
+    vec3 albedo;
+    float ambient;
+    vec3 specular;
+    float shininess;
+    float depth;
+};
+
+// Packed layout uses only first two color attachments:
+// normal (RGB10A2) - octahedral normal, ambient and shininess
+// albedo (RGBA8) - albedo and specular intensity
+#if defined(SUBPASS_GBUFFER)
+// G-buffer is read from tile memory of the current pixel
+layout(input_attachment_index = 0, binding = 3) uniform subpassInput gbufferNormal;
+layout(input_attachment_index = 1, binding = 4) uniform subpassInput gbufferAlbedo;
+layout(input_attachment_index = 2, binding = 5) uniform subpassInput gbufferSpecular;
+layout(input_attachment_index = 3, binding = 6) uniform subpassInput gbufferDepth;
+#elif defined(MULTISAMPLED_GBUFFER)
+layout(binding = 3) uniform sampler2DMS gbufferNormal;
+layout(binding = 4) uniform sampler2DMS gbufferAlbedo;
+layout(binding = 5) uniform sampler2DMS gbufferSpecular;
+layout(binding = 6) uniform sampler2DMS gbufferDepth;
+#else
+layout(binding = 3) uniform sampler2D gbufferNormal;
+layout(binding = 4) uniform sampler2D gbufferAlbedo;
+layout(binding = 5) uniform sampler2D gbufferSpecular;
+layout(binding = 6) uniform sampler2D gbufferDepth;
+#endif
+
+vec3 decodeNormal(vec2 normal)
+{
+    if (c_packedGbuffer)
+        return decodeOctahedral(normal);
+    return normalize(decodeSpheremap(normal));
+}
+
+Gbuffer decodeGbuffer(vec4 normal, vec4 albedo, vec4 specular, float depth)
+{
+    Gbuffer gbuffer;
+    gbuffer.normal = decodeNormal(normal.xy);
+    gbuffer.albedo = albedo.rgb;
+    if (c_packedGbuffer)
+    {
+        unpackAmbientShininess(normal.z, gbuffer.ambient, gbuffer.shininess);
+        gbuffer.specular = vec3(albedo.a);
+    }
+    else
+    {
+        gbuffer.ambient = albedo.a;
+        gbuffer.specular = specular.rgb;
+        gbuffer.shininess = specular.a * 256.;
+    }
+    gbuffer.depth = depth;
+    return gbuffer;
+}
+
+#if defined(SUBPASS_GBUFFER)
+float loadGbufferDepth()
+{
+    return subpassLoad(gbufferDepth).r;
+}
+
+Gbuffer loadGbuffer(float depth)
+{   // Packed layout has no specular attachment
+    return decodeGbuffer(
+        subpassLoad(gbufferNormal),
+        subpassLoad(gbufferAlbedo),
+        c_packedGbuffer ? vec4(0.) : subpassLoad(gbufferSpecular),
+        depth);
+}
+#elif defined(MULTISAMPLED_GBUFFER)
+ivec2 gbufferSize()
+{
+    return textureSize(gbufferDepth);
+}
+
+float loadGbufferDepth(ivec2 pixel, int i)
+{
+    return texelFetch(gbufferDepth, pixel, i).r;
+}
+
+vec3 loadGbufferNormal(ivec2 pixel, int i)
+{
+    return decodeNormal(texelFetch(gbufferNormal, pixel, i).xy);
+}
+
+Gbuffer loadGbuffer(ivec2 pixel, int i, float depth)
+{   // Packed layout has no specular attachment
+    return decodeGbuffer(
+        texelFetch(gbufferNormal, pixel, i),
+        texelFetch(gbufferAlbedo, pixel, i),
+        c_packedGbuffer ? vec4(0.) : texelFetch(gbufferSpecular, pixel, i),
+        depth);
+}
+#else
+ivec2 gbufferSize()
+{
+    return textureSize(gbufferDepth, 0);
+}
+
+// Fetch depth first to reject sky pixels before reading the rest of G-buffer
+float loadGbufferDepth(vec2 texCoord)
+{
+    return texture(gbufferDepth, texCoord).r;
+}
+
+vec3 loadGbufferNormal(vec2 texCoord)
+{
+    return decodeNormal(texture(gbufferNormal, texCoord).xy);
+}
+
+Gbuffer loadGbuffer(vec2 texCoord, float depth)
+{   // Packed layout has no specular attachment
+    return decodeGbuffer(
+        texture(gbufferNormal, texCoord),
+        texture(gbufferAlbedo, texCoord),
+        c_packedGbuffer ? vec4(0.) : texture(gbufferSpecular, texCoord),
+        depth);
+}
+#endif // SUBPASS_GBUFFER
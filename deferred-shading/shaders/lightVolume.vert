@@ -0,0 +1,58 @@
+#version 450
+#extension GL_GOOGLE_include_directive : enable
+#include "common/transforms.h"
+#include "tiledLights.h"
+
+layout(binding = 7, std430) readonly buffer Lights
+{
+    uvec4 lightCount; // x - number of lights, padded to alignment of lights[]
+    PointLight lights[];
+};
+
+layout(location = 0) out vec2 oScreenPos;
+layout(location = 1) out vec2 oTexCoord;
+layout(location = 2) flat out uint oLightIndex;
+out gl_PerVertex {
+    vec4 gl_Position;
+};
+
+// Screen-space rectangle that bounds projected light sphere
+vec4 boundingRect(vec3 center, float radius)
+{
+    float zNear = -proj[3][2]/proj[2][2];
+    if (center.z - radius <= zNear)
+        return vec4(-1., -1., 1., 1.); // Camera inside or behind light volume
+    vec2 minCorner = vec2(1.);
+    vec2 maxCorner = vec2(-1.);
+    for (int i = 0; i < 8; ++i)
+    {   // Project corners of view space bounding box
+        vec3 corner = center + radius * vec3(
+            (i & 1) != 0 ? 1. : -1.,
+            (i & 2) != 0 ? 1. : -1.,
+            (i & 4) != 0 ? 1. : -1.);
+        vec4 clipPos = proj * vec4(corner, 1.);
+        vec2 ndc = clipPos.xy/clipPos.w;
+        minCorner = min(minCorner, ndc);
+        maxCorner = max(maxCorner, ndc);
+    }
+    return clamp(vec4(minCorner, maxCorner), -1., 1.);
+}
+
+void main()
+{
+    PointLight light = lights[gl_InstanceIndex];
+    vec3 center = (view * vec4(light.position.xyz, 1.)).xyz;
+    vec4 rect = boundingRect(center, light.position.w);
+    vec2 quad[4] = vec2[](
+        // top
+        rect.xy, // left
+        rect.zy, // right
+        // bottom
+        rect.xw, // left
+        rect.zw  // right
+    );
+    oScreenPos = quad[gl_VertexIndex];
+    oTexCoord = oScreenPos * .5 + .5;
+    oLightIndex = gl_InstanceIndex;
+    gl_Position = vec4(oScreenPos, 0., 1.);
+}
@@ -0,0 +1,7 @@
+layout(binding = 11) uniform Parameters
+{
+    vec4 backgroundColor;
+    float depthThreshold; // Relative difference of view depth
+    float normalThreshold; // Cosine of angle between normals
+    bool tiledShading;
+};
@@ -0,0 +1,29 @@
+#version 450
+#extension GL_GOOGLE_include_directive : enable
+#include "common/transforms.h"
+#include "common/reconstruct.h"
+#include "brdf/phong.h"
+#include "gbuffer.h"
+#include "shading.h"
+
+layout(location = 0) in vec2 screenPos;
+layout(location = 1) in vec2 texCoord;
+layout(location = 2) flat in uint lightIndex;
+
+layout(location = 0) out vec3 oColor;
+
+void main()
+{   // Depth bounds test (if supported) has already rejected most of pixels
+    // outside of light range, so fetch depth first to cull the rest.
+    float depth = loadGbufferDepth(texCoord);
+    if (1. == depth)
+        discard;
+    vec3 viewPos = reconstructViewPos(screenPos, depth);
+    vec3 lightPos = (view * vec4(lights[lightIndex].position.xyz, 1.)).xyz;
+    if (distance(lightPos, viewPos) >= lights[lightIndex].position.w)
+        discard;
+
+    Gbuffer gbuffer = loadGbuffer(texCoord, depth);
+    vec3 v = normalize(-viewPos); // view position at (0, 0, 0)
+    oColor = pointLight(lightIndex, viewPos, v, gbuffer);
+}
@@ -0,0 +1,37 @@
+#include "cubeShadow.h"
+
+layout(binding = 10) uniform sampler2DShadow cubeShadowAtlas;
+
+int cubeFace(vec3 dir)
+{
+    vec3 absDir = abs(dir);
+    if (absDir.x >= absDir.y && absDir.x >= absDir.z)
+        return dir.x > 0. ? 0 : 1;
+    if (absDir.y >= absDir.z)
+        return dir.y > 0. ? 2 : 3;
+    return dir.z > 0. ? 4 : 5;
+}
+
+float pointShadow(vec3 worldPos, float bias)
+{   // Major axis of light vector selects the face
+    vec3 lightVec = worldPos - lightPos.xyz;
+    int face = cubeFace(lightVec);
+    vec4 clipPos = faceViewProj[face] * vec4(worldPos, 1.);
+    vec2 texCoord = clipPos.xy/clipPos.w * .5 + .5;
+    float distance = (length(lightVec) - bias) * lightPos.w;
+    vec2 faceSize = textureSize(cubeShadowAtlas, 0) * faceTileScale;
+    const vec2 offsets[4] = vec2[](
+        vec2(-.5, -.5),
+        vec2( .5, -.5),
+        vec2(-.5,  .5),
+        vec2( .5,  .5)
+    );
+    float shadow = 0.;
+    for (int i = 0; i < 4; ++i)
+    {   // Keep filter footprint inside of the tile
+        vec2 uv = clamp(texCoord + offsets[i]/faceSize, .5/faceSize, 1. - .5/faceSize);
+        uv = (faceTile(face) + uv) * faceTileScale;
+        shadow += texture(cubeShadowAtlas, vec3(uv, distance));
+    }
+    return shadow * .25;
+}
@@ -0,0 +1,81 @@
+#include "tiledLights.h"
+
+layout(constant_id = 0) const bool c_cullLights = true;
+
+layout(binding = 2) uniform Light
+{
+    vec4 viewPos;
+    vec4 ambient;
+    vec4 diffuse;
+    vec4 specular;
+} light;
+
+layout(binding = 7, std430) readonly buffer Lights
+{
+    uvec4 lightCount; // x - number of lights, padded to alignment of lights[]
+    PointLight lights[];
+};
+layout(binding = 8, std430) readonly buffer TileLightList
+{
+    TileLights tiles[];
+};
+
+vec3 ambientLight(Gbuffer gbuffer)
+{
+    return gbuffer.albedo * gbuffer.ambient * light.ambient.rgb;
+}
+
+vec3 singleLight(vec3 viewPos, vec3 v, Gbuffer gbuffer, float shadow)
+{
+    vec3 l = normalize(light.viewPos.xyz - viewPos);
+    return phong(gbuffer.normal, l, v,
+        gbuffer.albedo * gbuffer.ambient, light.ambient.rgb,
+        gbuffer.albedo, light.diffuse.rgb,
+        gbuffer.specular, light.specular.rgb,
+        gbuffer.shininess, shadow);
+}
+
+vec3 singleLight(vec3 viewPos, vec3 v, Gbuffer gbuffer)
+{
+    return singleLight(viewPos, v, gbuffer, 1.);
+}
+
+vec3 pointLight(uint index, vec3 viewPos, vec3 v, Gbuffer gbuffer)
+{
+    vec3 lightPos = (view * vec4(lights[index].position.xyz, 1.)).xyz;
+    vec3 l = lightPos - viewPos;
+    float distance = length(l);
+    float radius = lights[index].position.w;
+    if (distance >= radius)
+        return vec3(0.);
+    vec3 color = lights[index].color.rgb;
+    return phong(gbuffer.normal, l/distance, v,
+        vec3(0.), vec3(0.),
+        gbuffer.albedo, color,
+        gbuffer.specular, color,
+        gbuffer.shininess,
+        attenuation(distance, radius));
+}
+
+#ifndef SUBPASS_GBUFFER
+// Pixel is given at full resolution, as lights are culled against full resolution depth tiles
+vec3 tiledLights(uvec2 pixel, vec3 viewPos, vec3 v, Gbuffer gbuffer)
+{
+    vec3 color = ambientLight(gbuffer);
+    if (c_cullLights)
+    {
+        uint tileCountX = (gbufferSize().x + TILE_SIZE - 1) / TILE_SIZE;
+        uvec2 tile = pixel / TILE_SIZE;
+        uint tileIndex = tile.y * tileCountX + tile.x;
+        uint count = tiles[tileIndex].count;
+        for (uint i = 0; i < count; ++i)
+            color += pointLight(tiles[tileIndex].indices[i], viewPos, v, gbuffer);
+    }
+    else
+    {   // Brute force
+        for (uint i = 0; i < lightCount.x; ++i)
+            color += pointLight(i, viewPos, v, gbuffer);
+    }
+    return color;
+}
+#endif // !SUBPASS_GBUFFER
@@ -0,0 +1,26 @@
+#version 450
+#extension GL_GOOGLE_include_directive : enable
+#include "common/transforms.h"
+#include "common/reconstruct.h"
+#include "brdf/phong.h"
+#include "gbuffer.h"
+#include "shading.h"
+
+layout(location = 0) in vec2 screenPos;
+layout(location = 1) in vec2 texCoord;
+
+layout(location = 0) out vec3 oColor;
+
+void main()
+{   // Fetch G-buffer once for all lights
+    float depth = loadGbufferDepth(texCoord);
+    if (1. == depth)
+        discard;
+    Gbuffer gbuffer = loadGbuffer(texCoord, depth);
+
+    vec3 viewPos = reconstructViewPos(screenPos, depth);
+    vec3 v = normalize(-viewPos); // view position at (0, 0, 0)
+    // Lighting may be computed at reduced resolution, so find full resolution pixel
+    uvec2 pixel = uvec2(texCoord * gbufferSize());
+    oColor = tiledLights(pixel, viewPos, v, gbuffer);
+}
@@ -0,0 +1,23 @@
+#define TILE_SIZE 16
+#define MAX_LIGHTS_PER_TILE 256
+
+struct PointLight
+{
+    vec4 position; // xyz - world position, w - radius
+    vec4 color;
+};
+
+struct TileLights
+{
+    uint count;
+    uint indices[MAX_LIGHTS_PER_TILE];
+};
+
+// Smooth window function that reaches zero at light radius
+float attenuation(float distance, float radius)
+{
+    float x = distance / radius;
+    float x2 = x * x;
+    float window = clamp(1. - x2 * x2, 0., 1.);
+    return window * window;
+}
@@ -0,0 +1,33 @@
+// Should match DeferredShading::MaxObjects
+#define MAX_OBJECTS 5
+#define TRIANGLE_ID_BITS 24
+#define TRIANGLE_ID_MASK ((1u << TRIANGLE_ID_BITS) - 1u)
+
+// Vertex of mesh in object space,
+// texture coordinates are packed into w components
+struct Vertex
+{
+    vec4 position; // xyz - position, w - u
+    vec4 normal; // xyz - normal, w - v
+};
+
+// Triangles of object in shared vertex and index arrays
+struct Mesh
+{
+    uint firstIndex;
+    uint baseVertex;
+    uint triangleCount;
+    uint padding;
+};
+
+// Zero is reserved for background, so object index is biased by one
+uint packVisibility(uint objectIndex, uint triangleIndex)
+{
+    return ((objectIndex + 1u) << TRIANGLE_ID_BITS) | (triangleIndex & TRIANGLE_ID_MASK);
+}
+
+void unpackVisibility(uint visibility, out uint objectIndex, out uint triangleIndex)
+{
+    objectIndex = (visibility >> TRIANGLE_ID_BITS) - 1u;
+    triangleIndex = visibility & TRIANGLE_ID_MASK;
+}
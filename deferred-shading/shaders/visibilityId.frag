@@ -0,0 +1,15 @@
+#version 450
+#extension GL_GOOGLE_include_directive : enable
+#include "visibility.h"
+
+layout(binding = 2) uniform Object
+{
+    uint objectIndex;
+};
+
+layout(location = 0) out uint oVisibility;
+
+void main()
+{   // Primitive ID counts triangles from the first index of the draw call
+    oVisibility = packVisibility(objectIndex, uint(gl_PrimitiveID));
+}
@@ -0,0 +1,141 @@
+#version 450
+#extension GL_GOOGLE_include_directive : enable
+#include "common/transforms.h"
+#include "common/reconstruct.h"
+#include "brdf/phong.h"
+#include "gbuffer.h"
+#include "shading.h"
+#include "parameters.h"
+#include "visibility.h"
+
+#define GROUND 4 // Should match DeferredShading::Ground
+
+struct Material
+{
+    vec4 ambient;
+    vec4 diffuse;
+    vec4 specular;
+    float shininess;
+};
+
+layout(binding = 9) uniform usampler2D visibilityBuffer;
+layout(binding = 10, std430) readonly buffer Vertices
+{
+    Vertex vertices[];
+};
+layout(binding = 12, std430) readonly buffer Materials
+{
+    Material materials[];
+};
+layout(binding = 13) uniform sampler2D normalMap;
+layout(binding = 14, std430) readonly buffer Indices
+{
+    uint indices[];
+};
+layout(binding = 15, std430) readonly buffer Meshes
+{
+    Mesh meshes[];
+};
+// Single draw call shades all objects, so their transforms are indexed by object ID
+layout(binding = 16) uniform ObjectTransforms
+{
+    mat4 worldView[MAX_OBJECTS];
+    mat4 normalMatrix[MAX_OBJECTS];
+} objects;
+
+layout(location = 0) in vec2 screenPos;
+layout(location = 1) in vec2 texCoord;
+
+layout(location = 0) out vec3 oColor;
+
+// Intersect view ray with plane of triangle, barycentrics are not clamped,
+// so they extrapolate attributes for neighbour pixels outside of triangle
+vec3 barycentrics(vec2 xy, vec3 p0, vec3 p1, vec3 p2)
+{
+    vec3 dir = reconstructViewPos(xy, 1.); // ray origin at (0, 0, 0)
+    vec3 e1 = p1 - p0;
+    vec3 e2 = p2 - p0;
+    vec3 p = cross(dir, e2);
+    float invDet = 1./dot(e1, p);
+    vec3 t = -p0;
+    float u = dot(t, p) * invDet;
+    float v = dot(dir, cross(t, e1)) * invDet;
+    return vec3(1. - u - v, u, v);
+}
+
+// Same solution as in cotangentFrame(), but edges
+// of the triangle are used instead of pixel derivatives
+mat3 triangleTangentFrame(vec3 N, vec3 p[3], vec2 uv[3])
+{
+    vec3 dp1 = p[1] - p[0];
+    vec3 dp2 = p[2] - p[0];
+    vec2 duv1 = uv[1] - uv[0];
+    vec2 duv2 = uv[2] - uv[0];
+    vec3 dp2perp = cross(dp2, N);
+    vec3 dp1perp = cross(N, dp1);
+    vec3 T = dp2perp * duv1.x + dp1perp * duv2.x;
+    vec3 B = dp2perp * duv1.y + dp1perp * duv2.y;
+    float invmax = inversesqrt(max(dot(T, T), dot(B, B)));
+    return mat3(T * invmax, B * invmax, N);
+}
+
+void main()
+{
+    uint visibility = texelFetch(visibilityBuffer, ivec2(gl_FragCoord.xy), 0).r;
+    if (0 == visibility)
+        discard;
+    uint objectIndex, triangleIndex;
+    unpackVisibility(visibility, objectIndex, triangleIndex);
+    if (objectIndex >= MAX_OBJECTS)
+        discard;
+    Mesh mesh = meshes[objectIndex];
+    if (triangleIndex >= mesh.triangleCount)
+        discard; // ID doesn't belong to mesh
+
+    // Fetch vertices of triangle and transform them to view space
+    mat4 objectWorldView = objects.worldView[objectIndex];
+    mat3 objectNormalMatrix = mat3(objects.normalMatrix[objectIndex]);
+    vec3 p[3], n[3];
+    vec2 uv[3];
+    for (int i = 0; i < 3; ++i)
+    {
+        uint index = mesh.baseVertex + indices[mesh.firstIndex + triangleIndex * 3 + i];
+        Vertex vertex = vertices[index];
+        p[i] = (objectWorldView * vec4(vertex.position.xyz, 1.)).xyz;
+        n[i] = objectNormalMatrix * vertex.normal.xyz;
+        uv[i] = vec2(vertex.position.w, vertex.normal.w);
+    }
+
+    // Analytic derivatives from barycentrics of adjacent pixels
+    vec2 pixelSize = 2./vec2(textureSize(visibilityBuffer, 0));
+    vec3 b = barycentrics(screenPos, p[0], p[1], p[2]);
+    vec3 bx = barycentrics(screenPos + vec2(pixelSize.x, 0.), p[0], p[1], p[2]);
+    vec3 by = barycentrics(screenPos + vec2(0., pixelSize.y), p[0], p[1], p[2]);
+    vec3 viewPos = b.x * p[0] + b.y * p[1] + b.z * p[2];
+    vec2 meshTexCoord = b.x * uv[0] + b.y * uv[1] + b.z * uv[2];
+    vec2 dx = bx.x * uv[0] + bx.y * uv[1] + bx.z * uv[2] - meshTexCoord;
+    vec2 dy = by.x * uv[0] + by.y * uv[1] + by.z * uv[2] - meshTexCoord;
+
+    vec3 normal = normalize(b.x * n[0] + b.y * n[1] + b.z * n[2]);
+    if (GROUND == objectIndex)
+    {   // Tangent frame is built in view space, so normal matrix isn't needed
+        vec3 txNormal = textureGrad(normalMap, meshTexCoord, dx, dy).rgb;
+        mat3 TBN = triangleTangentFrame(normal, p, uv);
+        normal = normalize(TBN * (txNormal * 2. - 1.));
+    }
+
+    Gbuffer gbuffer;
+    gbuffer.normal = normal;
+    gbuffer.albedo = materials[objectIndex].diffuse.rgb;
+    gbuffer.ambient = materials[objectIndex].diffuse.a;
+    gbuffer.specular = materials[objectIndex].specular.rgb;
+    gbuffer.shininess = materials[objectIndex].shininess;
+    vec4 clipPos = proj * vec4(viewPos, 1.);
+    gbuffer.depth = clipPos.z/clipPos.w;
+
+    vec3 v = normalize(-viewPos); // view position at (0, 0, 0)
+    if (tiledShading)
+        oColor = tiledLights(uvec2(gl_FragCoord.xy), viewPos, v, gbuffer);
+    else
+        oColor = singleLight(viewPos, v, gbuffer);
+}
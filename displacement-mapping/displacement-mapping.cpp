@@ -1,6 +1,7 @@
 #include "graphicsApp.h"
 #include "textureLoader.h"
 #include "colorTable.h"
+#include "quadricMesh.h"
 #include "quadric/include/torus.h"
 #include "quadric/include/sphere.h"
 
@@ -183,6 +184,7 @@ public:
     {
         torus = std::make_unique<quadric::Torus>(0.2f, 1.0f, 128, 128, true, cmdCopyBuf);
         dot = std::make_unique<quadric::Sphere>(0.02f, 8, 8, true, cmdCopyBuf);
+        mesh::optimize(*torus, "Torus", commandPools[0]);
     }
 
     void loadDisplacementMap()
@@ -1,5 +1,6 @@
 #include "graphicsApp.h"
 #include "colorTable.h"
+#include "quadricMesh.h"
 #include "quadric/include/cube.h"
 #include "quadric/include/sphere.h"
 #include "quadric/include/teapot.h"
@@ -16,13 +17,30 @@ class EdgeDetection : public GraphicsApp
         VkBool32 sobelFilter = true;
     };
 
+    struct EdgeListHeader
+    {
+        VkDispatchIndirectCommand dispatch;
+        uint32_t count;
+    };
+
+    static constexpr uint32_t tileSize = 16;
+
     std::unique_ptr<quadric::Quadric> objects[MaxObjects];
     std::shared_ptr<magma::GraphicsPipeline> depthPipeline;
+    std::shared_ptr<magma::ComputePipeline> edgeDetectPipeline;
+    std::shared_ptr<magma::ComputePipeline> outlinePipeline;
     std::shared_ptr<magma::aux::DepthFramebuffer> depthFramebuffer;
+    std::shared_ptr<magma::StorageImage2D> edgeMask;
+    std::shared_ptr<magma::ImageView> edgeMaskView;
+    std::shared_ptr<magma::StorageBuffer> edgeList;
+    std::unique_ptr<magma::aux::BlitRectangle> edgeMaskBltRect;
     DescriptorSet descriptor;
+    DescriptorSet edgeDescriptor;
 
     rapid::matrix objTransforms[MaxObjects];
     Constants constants;
+    bool computeEdges = true;
+    bool drawOutline = false;
 
 public:
     explicit EdgeDetection(const AppEntry& entry):
@@ -31,6 +49,7 @@ public:
         setupViewProjection();
         setupTransforms();
         createDepthFramebuffer();
+        createEdgeResources();
         createMeshObjects();
         setupDescriptorSets();
         setupGraphicsPipelines();
@@ -56,6 +75,14 @@ public:
             setupGraphicsPipelines();
             renderScene(drawCmdBuffer);
             break;
+        case AppKey::Enter:
+            computeEdges = !computeEdges;
+            renderScene(drawCmdBuffer);
+            break;
+        case AppKey::Tab:
+            drawOutline = !drawOutline;
+            renderScene(drawCmdBuffer);
+            break;
         }
         VulkanApp::onKeyDown(key, repeat, flags);
     }
@@ -99,11 +126,31 @@ public:
         depthFramebuffer = std::make_shared<magma::aux::DepthFramebuffer>(device, VK_FORMAT_D16_UNORM, msaaFramebuffer->getExtent());
     }
 
+    void createEdgeResources()
+    {
+        const VkExtent2D& extent = depthFramebuffer->getExtent();
+        edgeMask = std::make_shared<magma::StorageImage2D>(device, VK_FORMAT_R8G8B8A8_UNORM, extent, 1);
+        edgeMaskView = std::make_shared<magma::ImageView>(edgeMask);
+        magma::helpers::executeCommandBuffer(commandPools[0],
+            [this](std::shared_ptr<magma::CommandBuffer> cmdBuffer)
+            {   // Perform transition from undefined to general image layout
+                const magma::ImageSubresourceRange subresourceRange(edgeMask);
+                cmdBuffer->pipelineBarrier(VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                    magma::ImageMemoryBarrier(edgeMask, VK_IMAGE_LAYOUT_GENERAL, subresourceRange));
+            });
+        // Worst case is when every pixel is an edge
+        const VkDeviceSize maxEdgeCount = extent.width * extent.height;
+        edgeList = std::make_shared<magma::StorageBuffer>(device, sizeof(EdgeListHeader) + maxEdgeCount * sizeof(uint32_t));
+        edgeMaskBltRect = std::make_unique<magma::aux::BlitRectangle>(renderPass);
+    }
+
     void createMeshObjects()
     {
         objects[Cube] = std::make_unique<quadric::Cube>(cmdCopyBuf);
         objects[Teapot] = std::make_unique<quadric::Teapot>(16, cmdCopyBuf);
         objects[Sphere] = std::make_unique<quadric::Sphere>(1.5f, 64, 64, false, cmdCopyBuf);
+        mesh::optimize(*objects[Teapot], "Teapot", commandPools[0]);
+        mesh::optimize(*objects[Sphere], "Sphere", commandPools[0]);
     }
 
     void setupDescriptorSets()
@@ -114,6 +161,17 @@ public:
             VertexStageBinding(0, DynamicUniformBuffer(1))));
         descriptor.set = descriptorPool->allocateDescriptorSet(descriptor.layout);
         descriptor.set->writeDescriptor(0, transforms);
+        // Edge detection and outline compute shaders
+        edgeDescriptor.layout = std::shared_ptr<magma::DescriptorSetLayout>(new magma::DescriptorSetLayout(device,
+            {
+                ComputeStageBinding(0, CombinedImageSampler(1)),
+                ComputeStageBinding(1, StorageImage(1)),
+                ComputeStageBinding(2, StorageBuffer(1))
+            }));
+        edgeDescriptor.set = descriptorPool->allocateDescriptorSet(edgeDescriptor.layout);
+        edgeDescriptor.set->writeDescriptor(0, depthFramebuffer->getDepthView(), nearestClampToEdge);
+        edgeDescriptor.set->writeDescriptor(1, edgeMaskView, nullptr);
+        edgeDescriptor.set->writeDescriptor(2, edgeList);
     }
 
     void setupGraphicsPipelines()
@@ -125,6 +183,9 @@ public:
             depthFramebuffer);
         auto specialization(std::make_shared<magma::Specialization>(constants,
             magma::SpecializationEntry(0, &Constants::sobelFilter)));
+        edgeDetectPipeline = createComputePipeline("edgeDetectTiled.o", specialization, edgeDescriptor.layout);
+        if (!outlinePipeline)
+            outlinePipeline = createComputePipeline("outline.o", nullptr, edgeDescriptor.layout);
         bltRect = std::make_unique<magma::aux::BlitRectangle>(renderPass,
             loadShader("edgeDetect.o"), std::move(specialization));
     }
@@ -160,15 +221,40 @@ public:
 
     void edgeDetectPass(std::shared_ptr<magma::CommandBuffer> cmdBuffer)
     {
+        if (computeEdges)
+            edgeDetectCompute(cmdBuffer);
         cmdBuffer->beginRenderPass(msaaFramebuffer->getRenderPass(), msaaFramebuffer->getFramebuffer());
         {
-            bltRect->blit(cmdBuffer,
-                depthFramebuffer->getDepthView(),
-                VK_FILTER_NEAREST,
-                VkRect2D{0, 0, msaaFramebuffer->getExtent()});
+            const VkRect2D rc{0, 0, msaaFramebuffer->getExtent()};
+            if (computeEdges)
+                edgeMaskBltRect->blit(cmdBuffer, edgeMaskView, VK_FILTER_NEAREST, rc);
+            else
+                bltRect->blit(cmdBuffer, depthFramebuffer->getDepthView(), VK_FILTER_NEAREST, rc);
         }
         cmdBuffer->endRenderPass();
     }
+
+    void edgeDetectCompute(std::shared_ptr<magma::CommandBuffer> cmdBuffer)
+    {   // Reset indirect dispatch arguments and edge counter
+        cmdBuffer->fillBuffer(edgeList, 0, sizeof(EdgeListHeader));
+        cmdBuffer->pipelineBarrier(VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            magma::MemoryBarrier(VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT));
+        const VkExtent2D& extent = depthFramebuffer->getExtent();
+        cmdBuffer->bindPipeline(edgeDetectPipeline);
+        cmdBuffer->bindDescriptorSet(edgeDetectPipeline, edgeDescriptor.set);
+        cmdBuffer->dispatch((extent.width + tileSize - 1)/tileSize, (extent.height + tileSize - 1)/tileSize, 1);
+        if (drawOutline)
+        {   // Process only edge pixels
+            cmdBuffer->pipelineBarrier(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                magma::MemoryBarrier(VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT));
+            cmdBuffer->bindPipeline(outlinePipeline);
+            cmdBuffer->bindDescriptorSet(outlinePipeline, edgeDescriptor.set);
+            cmdBuffer->dispatchIndirect(edgeList, 0);
+        }
+        cmdBuffer->pipelineBarrier(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+            magma::MemoryBarrier(VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT));
+    }
 };
 
 std::unique_ptr<IApplication> appFactory(const AppEntry& entry)
@@ -0,0 +1,23 @@
+// Edge pixels are appended in arbitrary order. The header
+// is laid out as VkDispatchIndirectCommand, so downstream
+// passes can be dispatched indirectly, one thread per pixel.
+#define EDGE_GROUP_SIZE 64
+
+layout(binding = 2) buffer EdgeList
+{
+    uint groupCountX;
+    uint groupCountY;
+    uint groupCountZ;
+    uint count;
+    uint coords[]; // x | y << 16
+} edges;
+
+uint packCoord(ivec2 pixel)
+{
+    return uint(pixel.x) | (uint(pixel.y) << 16);
+}
+
+ivec2 unpackCoord(uint xy)
+{
+    return ivec2(xy & 0xFFFF, xy >> 16);
+}
@@ -0,0 +1,94 @@
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include "magma/magma.h"
+#include "gpuTimer.h"
+
+GpuTimer::GpuTimer(std::shared_ptr<magma::CommandPool> commandPool, const std::vector<std::string>& passNames,
+    uint32_t reportInterval /* 300 */):
+    device(commandPool->getDevice()),
+    queryPool(std::make_shared<magma::TimestampQuery>(device, static_cast<uint32_t>(passNames.size() * 2))),
+    passNames(passNames),
+    totalTime(passNames.size(), 0.),
+    frameCount(passNames.size(), 0),
+    timestampPeriod(device->getPhysicalDevice()->getProperties().limits.timestampPeriod),
+    reportInterval(reportInterval)
+{   // Queries should be reset before first read back
+    magma::helpers::executeCommandBuffer(commandPool,
+        [this](std::shared_ptr<magma::CommandBuffer> cmdBuffer)
+        {
+            reset(cmdBuffer);
+        });
+}
+
+void GpuTimer::reset(std::shared_ptr<magma::CommandBuffer> cmdBuffer) const
+{
+    cmdBuffer->resetQueryPool(queryPool, 0, static_cast<uint32_t>(passNames.size() * 2));
+}
+
+void GpuTimer::begin(std::shared_ptr<magma::CommandBuffer> cmdBuffer, uint32_t pass) const
+{
+    cmdBuffer->writeTimestamp(VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, queryPool, pass * 2);
+}
+
+void GpuTimer::end(std::shared_ptr<magma::CommandBuffer> cmdBuffer, uint32_t pass) const
+{
+    cmdBuffer->writeTimestamp(VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, pass * 2 + 1);
+}
+
+void GpuTimer::update()
+{   // Passes that weren't recorded in the last submitted command buffer stay unavailable
+    struct Timestamp
+    {
+        uint64_t value;
+        uint64_t availability;
+    };
+    std::vector<Timestamp> timestamps(passNames.size() * 2);
+    const VkResult result = vkGetQueryPoolResults(MAGMA_HANDLE(device), MAGMA_HANDLE(queryPool),
+        0, static_cast<uint32_t>(timestamps.size()),
+        sizeof(Timestamp) * timestamps.size(), timestamps.data(), sizeof(Timestamp),
+        VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+    if (result != VK_SUCCESS && result != VK_NOT_READY)
+        return;
+    for (std::size_t i = 0; i < passNames.size(); ++i)
+    {
+        const Timestamp& begin = timestamps[i * 2];
+        const Timestamp& end = timestamps[i * 2 + 1];
+        if (begin.availability && end.availability)
+        {
+            totalTime[i] += (end.value - begin.value) * timestampPeriod * 1e-6;
+            ++frameCount[i];
+        }
+    }
+    if (++frame == reportInterval)
+    {
+        report();
+        std::fill(totalTime.begin(), totalTime.end(), 0.);
+        std::fill(frameCount.begin(), frameCount.end(), 0);
+        frame = 0;
+    }
+}
+
+float GpuTimer::getAverageMilliseconds(uint32_t pass) const noexcept
+{
+    if (!frameCount[pass])
+        return 0.f;
+    return static_cast<float>(totalTime[pass] / frameCount[pass]);
+}
+
+void GpuTimer::report()
+{
+    double frameTime = 0.;
+    std::cout << std::fixed << std::setprecision(3);
+    for (uint32_t i = 0; i < static_cast<uint32_t>(passNames.size()); ++i)
+    {
+        if (frameCount[i])
+        {
+            const float ms = getAverageMilliseconds(i);
+            std::cout << passNames[i] << ": " << ms << " ms" << std::endl;
+            frameTime += ms;
+        }
+    }
+    std::cout << "GPU total: " << frameTime << " ms" << std::endl;
+    std::cout.unsetf(std::ios_base::floatfield);
+}
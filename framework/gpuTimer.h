@@ -0,0 +1,41 @@
+#pragma once
+#include <memory>
+#include <string>
+#include <vector>
+#include "core/noncopyable.h"
+
+namespace magma
+{
+    class Device;
+    class CommandPool;
+    class CommandBuffer;
+    class QueryPool;
+}
+
+// Measures GPU time of render passes with timestamp queries.
+// Results of previous frame are read back without stalling,
+// averaged and printed to output every few hundred frames.
+class GpuTimer : public core::NonCopyable
+{
+public:
+    explicit GpuTimer(std::shared_ptr<magma::CommandPool> commandPool,
+        const std::vector<std::string>& passNames,
+        uint32_t reportInterval = 300);
+    void reset(std::shared_ptr<magma::CommandBuffer> cmdBuffer) const;
+    void begin(std::shared_ptr<magma::CommandBuffer> cmdBuffer, uint32_t pass) const;
+    void end(std::shared_ptr<magma::CommandBuffer> cmdBuffer, uint32_t pass) const;
+    void update();
+    float getAverageMilliseconds(uint32_t pass) const noexcept;
+
+private:
+    void report();
+
+    std::shared_ptr<magma::Device> device;
+    std::shared_ptr<magma::QueryPool> queryPool;
+    std::vector<std::string> passNames;
+    std::vector<double> totalTime;
+    std::vector<uint32_t> frameCount;
+    float timestampPeriod;
+    uint32_t reportInterval;
+    uint32_t frame = 0;
+};
@@ -23,10 +23,12 @@ GraphicsApp::GraphicsApp(const AppEntry& entry, const core::tstring& caption, ui
     descriptorPool = std::shared_ptr<magma::DescriptorPool>(new magma::DescriptorPool(device, maxDescriptorSets,
         {
             magma::descriptors::DynamicUniformBuffer(10),
-            magma::descriptors::UniformBuffer(10),
-            magma::descriptors::CombinedImageSampler(8),
-            magma::descriptors::StorageBuffer(4),
-            magma::descriptors::DynamicStorageBuffer(4)
+            magma::descriptors::UniformBuffer(32),
+            magma::descriptors::CombinedImageSampler(48),
+            magma::descriptors::StorageImage(16),
+            magma::descriptors::StorageBuffer(16),
+            magma::descriptors::DynamicStorageBuffer(4),
+            magma::descriptors::InputAttachment(4)
         }));
 
     arcball = std::shared_ptr<Trackball>(new Trackball(rapid::vector2(width/2.f, height/2.f), 300.f, false));
@@ -322,6 +324,17 @@ std::shared_ptr<magma::GraphicsPipeline> GraphicsApp::createFullscreenPipeline(c
         nullptr, nullptr, 0);
 }
 
+std::shared_ptr<magma::ComputePipeline> GraphicsApp::createComputePipeline(const char *shaderFileName,
+    std::shared_ptr<magma::Specialization> specialization, std::shared_ptr<magma::DescriptorSetLayout> setLayout)
+{
+    auto pipelineLayout = std::make_shared<magma::PipelineLayout>(
+         std::move(setLayout));
+    return std::make_shared<magma::ComputePipeline>(device,
+        loadShaderStage(shaderFileName, std::move(specialization)),
+        std::move(pipelineLayout),
+        pipelineCache);
+}
+
 void GraphicsApp::updateViewProjTransforms()
 {
     viewProj->updateView();
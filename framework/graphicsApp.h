@@ -59,6 +59,8 @@ protected:
     std::shared_ptr<magma::GraphicsPipeline> createFullscreenPipeline(const char *vertexShaderFile, const char *fragmentShaderFile,
         std::shared_ptr<magma::Specialization> specialization, std::shared_ptr<magma::DescriptorSetLayout> setLayout,
         std::shared_ptr<magma::Framebuffer> framebuffer);
+    std::shared_ptr<magma::ComputePipeline> createComputePipeline(const char *shaderFileName,
+        std::shared_ptr<magma::Specialization> specialization, std::shared_ptr<magma::DescriptorSetLayout> setLayout);
 
     void updateSysUniforms();
     void updateViewProjTransforms();
@@ -0,0 +1,305 @@
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <numeric>
+#include "meshOptimizer.h"
+
+namespace mesh
+{
+namespace
+{
+struct Adjacency
+{   // Triangles of each vertex
+    std::vector<uint32_t> offsets;
+    std::vector<uint32_t> triangles;
+    std::vector<uint32_t> counts;
+};
+
+Adjacency buildAdjacency(const std::vector<uint32_t>& indices, uint32_t vertexCount)
+{
+    Adjacency adjacency;
+    adjacency.counts.resize(vertexCount, 0);
+    for (uint32_t index : indices)
+        ++adjacency.counts[index];
+    adjacency.offsets.resize(vertexCount + 1, 0);
+    std::partial_sum(adjacency.counts.begin(), adjacency.counts.end(), adjacency.offsets.begin() + 1);
+    adjacency.triangles.resize(indices.size());
+    std::vector<uint32_t> fill(adjacency.offsets.begin(), adjacency.offsets.end() - 1);
+    for (std::size_t i = 0; i < indices.size(); ++i)
+        adjacency.triangles[fill[indices[i]]++] = uint32_t(i/3);
+    return adjacency;
+}
+
+class FifoCache
+{
+public:
+    FifoCache(uint32_t cacheSize, uint32_t vertexCount):
+        size(cacheSize), timestamps(vertexCount, 0) {}
+    bool access(uint32_t vertex) noexcept
+    {   // Vertex is in cache if it was one of the last size misses
+        if (timestamps[vertex] && (time - timestamps[vertex] <= size))
+            return true;
+        timestamps[vertex] = time++;
+        return false;
+    }
+    void flush() noexcept { time += size; }
+
+private:
+    const uint32_t size;
+    std::vector<uint32_t> timestamps;
+    uint32_t time = 1;
+};
+
+uint32_t countMisses(const uint32_t *indices, std::size_t indexCount, FifoCache& cache)
+{
+    uint32_t misses = 0;
+    for (std::size_t i = 0; i < indexCount; ++i)
+        misses += cache.access(indices[i]) ? 0 : 1;
+    return misses;
+}
+
+const float *position(const float *positions, uint32_t stride, uint32_t vertex) noexcept
+{
+    return (const float *)((const char *)positions + std::size_t(vertex) * stride);
+}
+} // namespace
+
+std::vector<uint32_t> unrollTriangleStrip(const std::vector<uint32_t>& strip, uint32_t restartIndex)
+{
+    std::vector<uint32_t> indices;
+    uint32_t start = 0;
+    for (uint32_t i = 0; i < strip.size(); ++i)
+    {
+        if (strip[i] == restartIndex)
+        {
+            start = i + 1;
+            continue;
+        }
+        if (i - start < 2)
+            continue;
+        // Odd triangles are flipped to keep winding of the strip
+        const bool odd = (i - start) & 1;
+        indices.push_back(strip[odd ? i - 1 : i - 2]);
+        indices.push_back(strip[odd ? i - 2 : i - 1]);
+        indices.push_back(strip[i]);
+    }
+    return indices;
+}
+
+VertexCacheStatistics analyzeVertexCache(const std::vector<uint32_t>& indices, uint32_t vertexCount,
+    uint32_t cacheSize /* defaultCacheSize */)
+{
+    FifoCache cache(cacheSize, vertexCount);
+    const uint32_t misses = countMisses(indices.data(), indices.size(), cache);
+    const float triangleCount = float(indices.size()/3);
+    return VertexCacheStatistics{misses/triangleCount, misses/float(vertexCount)};
+}
+
+std::vector<uint32_t> optimizeVertexCache(const std::vector<uint32_t>& indices, uint32_t vertexCount,
+    uint32_t cacheSize /* defaultCacheSize */, std::vector<uint32_t> *clusters /* nullptr */)
+{
+    const Adjacency adjacency = buildAdjacency(indices, vertexCount);
+    std::vector<uint32_t> live = adjacency.counts; // Number of not yet emitted triangles
+    std::vector<uint32_t> cacheTime(vertexCount, 0);
+    std::vector<bool> emitted(indices.size()/3, false);
+    std::vector<uint32_t> deadEnd; // Recently used vertices
+    std::vector<uint32_t> candidates;
+    std::vector<uint32_t> output;
+    output.reserve(indices.size());
+    if (clusters)
+        clusters->clear();
+    uint32_t time = cacheSize + 1;
+    uint32_t cursor = 0; // Next vertex in input order
+    auto skipDeadEnd = [&]() -> uint32_t
+    {
+        while (!deadEnd.empty())
+        {
+            const uint32_t vertex = deadEnd.back();
+            deadEnd.pop_back();
+            if (live[vertex])
+                return vertex;
+        }
+        for (; cursor < vertexCount; ++cursor)
+        {
+            if (live[cursor])
+                return cursor;
+        }
+        return ~0u;
+    };
+    uint32_t fanning = skipDeadEnd();
+    bool hardBoundary = true;
+    while (fanning != ~0u)
+    {
+        if (hardBoundary && clusters)
+            clusters->push_back(uint32_t(output.size()/3));
+        // Emit all triangles of fanning vertex
+        candidates.clear();
+        for (uint32_t i = adjacency.offsets[fanning]; i < adjacency.offsets[fanning + 1]; ++i)
+        {
+            const uint32_t triangle = adjacency.triangles[i];
+            if (emitted[triangle])
+                continue;
+            for (uint32_t j = 0; j < 3; ++j)
+            {
+                const uint32_t vertex = indices[triangle * 3 + j];
+                output.push_back(vertex);
+                deadEnd.push_back(vertex);
+                candidates.push_back(vertex);
+                --live[vertex];
+                if (time - cacheTime[vertex] > cacheSize)
+                    cacheTime[vertex] = time++;
+            }
+            emitted[triangle] = true;
+        }
+        // Choose the oldest candidate that will still be in cache after its triangles are emitted
+        uint32_t next = ~0u;
+        int maxPriority = -1;
+        for (uint32_t vertex : candidates)
+        {
+            if (!live[vertex])
+                continue;
+            int priority = 0;
+            if (time - cacheTime[vertex] + 2 * live[vertex] <= cacheSize)
+                priority = int(time - cacheTime[vertex]);
+            if (priority > maxPriority)
+            {
+                maxPriority = priority;
+                next = vertex;
+            }
+        }
+        hardBoundary = (~0u == next);
+        fanning = hardBoundary ? skipDeadEnd() : next;
+    }
+    return output;
+}
+
+std::vector<uint32_t> optimizeOverdraw(const std::vector<uint32_t>& indices, const std::vector<uint32_t>& clusters,
+    const float *positions, uint32_t stride, uint32_t cacheSize /* defaultCacheSize */, float threshold /* 1.05f */)
+{
+    const uint32_t triangleCount = uint32_t(indices.size()/3);
+    const uint32_t vertexCount = indices.empty() ? 0 : *std::max_element(indices.begin(), indices.end()) + 1;
+    // Split hard clusters where local ACMR is close enough to ACMR of the whole cluster
+    std::vector<uint32_t> softClusters;
+    FifoCache cache(cacheSize, vertexCount);
+    for (std::size_t c = 0; c < clusters.size(); ++c)
+    {
+        const uint32_t first = clusters[c];
+        const uint32_t last = (c + 1 < clusters.size()) ? clusters[c + 1] : triangleCount;
+        cache.flush();
+        const uint32_t clusterMisses = countMisses(&indices[first * 3], (last - first) * 3, cache);
+        const float maxAcmr = clusterMisses * threshold/(last - first);
+        cache.flush();
+        uint32_t start = first, misses = 0;
+        softClusters.push_back(first);
+        for (uint32_t i = first; i < last; ++i)
+        {
+            misses += countMisses(&indices[i * 3], 3, cache);
+            if ((i + 1 < last) && (misses <= maxAcmr * (i + 1 - start)))
+            {
+                softClusters.push_back(i + 1);
+                cache.flush();
+                start = i + 1;
+                misses = 0;
+            }
+        }
+    }
+    // Area weighted centroid and normal of each cluster
+    struct Cluster
+    {
+        uint32_t first, last;
+        float centroid[3];
+        float normal[3];
+        float sortKey;
+    };
+    std::vector<Cluster> sorted(softClusters.size());
+    float meshCentroid[3] = {0.f, 0.f, 0.f};
+    float meshArea = 0.f;
+    for (std::size_t c = 0; c < softClusters.size(); ++c)
+    {
+        Cluster& cluster = sorted[c];
+        cluster.first = softClusters[c];
+        cluster.last = (c + 1 < softClusters.size()) ? softClusters[c + 1] : triangleCount;
+        float area = 0.f;
+        std::fill_n(cluster.centroid, 3, 0.f);
+        std::fill_n(cluster.normal, 3, 0.f);
+        for (uint32_t i = cluster.first; i < cluster.last; ++i)
+        {
+            const float *a = position(positions, stride, indices[i * 3]);
+            const float *b = position(positions, stride, indices[i * 3 + 1]);
+            const float *c = position(positions, stride, indices[i * 3 + 2]);
+            const float e0[3] = {b[0] - a[0], b[1] - a[1], b[2] - a[2]};
+            const float e1[3] = {c[0] - a[0], c[1] - a[1], c[2] - a[2]};
+            const float n[3] = {
+                e0[1] * e1[2] - e0[2] * e1[1],
+                e0[2] * e1[0] - e0[0] * e1[2],
+                e0[0] * e1[1] - e0[1] * e1[0]};
+            const float doubleArea = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+            for (int k = 0; k < 3; ++k)
+            {
+                cluster.centroid[k] += (a[k] + b[k] + c[k])/3.f * doubleArea;
+                cluster.normal[k] += n[k];
+            }
+            area += doubleArea;
+        }
+        for (int k = 0; k < 3; ++k)
+        {
+            meshCentroid[k] += cluster.centroid[k];
+            cluster.centroid[k] /= std::max(area, 1e-20f);
+        }
+        meshArea += area;
+    }
+    for (int k = 0; k < 3; ++k)
+        meshCentroid[k] /= std::max(meshArea, 1e-20f);
+    // Clusters that face away from the center are likely occluders, draw them first
+    for (Cluster& cluster : sorted)
+    {
+        const float *n = cluster.normal;
+        const float length = std::max(sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]), 1e-20f);
+        cluster.sortKey = 0.f;
+        for (int k = 0; k < 3; ++k)
+            cluster.sortKey += (cluster.centroid[k] - meshCentroid[k]) * n[k]/length;
+    }
+    std::stable_sort(sorted.begin(), sorted.end(),
+        [](const Cluster& a, const Cluster& b)
+        {
+            return a.sortKey > b.sortKey;
+        });
+    std::vector<uint32_t> output;
+    output.reserve(indices.size());
+    for (const Cluster& cluster : sorted)
+        output.insert(output.end(), indices.begin() + cluster.first * 3, indices.begin() + cluster.last * 3);
+    return output;
+}
+
+std::vector<uint32_t> optimizeVertexFetch(std::vector<uint32_t>& indices, uint32_t vertexCount)
+{   // Vertices are placed in order of first use, unused ones go to the end
+    std::vector<uint32_t> remap(vertexCount, ~0u);
+    std::vector<uint32_t> order;
+    order.reserve(vertexCount);
+    for (uint32_t& index : indices)
+    {
+        if (~0u == remap[index])
+        {
+            remap[index] = uint32_t(order.size());
+            order.push_back(index);
+        }
+        index = remap[index];
+    }
+    for (uint32_t i = 0; i < vertexCount; ++i)
+    {
+        if (~0u == remap[i])
+            order.push_back(i);
+    }
+    assert(order.size() == vertexCount);
+    return order;
+}
+
+std::vector<uint32_t> optimize(std::vector<uint32_t>& indices, const float *positions, uint32_t stride,
+    uint32_t vertexCount, uint32_t cacheSize /* defaultCacheSize */)
+{
+    std::vector<uint32_t> clusters;
+    indices = optimizeVertexCache(indices, vertexCount, cacheSize, &clusters);
+    indices = optimizeOverdraw(indices, clusters, positions, stride, cacheSize);
+    return optimizeVertexFetch(indices, vertexCount);
+}
+} // namespace mesh
@@ -0,0 +1,32 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+/* Reordering of indexed triangle lists for post-transform vertex cache,
+   overdraw and vertex fetch locality. Vertex cache optimization and
+   overdraw ordering follow Tipsify from "Fast Triangle Reordering for
+   Vertex Locality and Reduced Overdraw" by Sander et al. (2007).
+   Positions are float X, Y, Z with stride in bytes. */
+
+namespace mesh
+{
+    struct VertexCacheStatistics
+    {
+        float acmr; // Average cache miss ratio: transformed vertices per triangle, 0.5 is ideal for grids
+        float atvr; // Average transformed vertex ratio: transformed vertices per unique vertex, 1 is ideal
+    };
+
+    constexpr uint32_t defaultCacheSize = 16;
+
+    std::vector<uint32_t> unrollTriangleStrip(const std::vector<uint32_t>& strip, uint32_t restartIndex);
+    VertexCacheStatistics analyzeVertexCache(const std::vector<uint32_t>& indices, uint32_t vertexCount,
+        uint32_t cacheSize = defaultCacheSize);
+    std::vector<uint32_t> optimizeVertexCache(const std::vector<uint32_t>& indices, uint32_t vertexCount,
+        uint32_t cacheSize = defaultCacheSize, std::vector<uint32_t> *clusters = nullptr);
+    std::vector<uint32_t> optimizeOverdraw(const std::vector<uint32_t>& indices, const std::vector<uint32_t>& clusters,
+        const float *positions, uint32_t stride, uint32_t cacheSize = defaultCacheSize, float threshold = 1.05f);
+    std::vector<uint32_t> optimizeVertexFetch(std::vector<uint32_t>& indices, uint32_t vertexCount);
+    // All stages above, returns old vertex index for each new one
+    std::vector<uint32_t> optimize(std::vector<uint32_t>& indices, const float *positions, uint32_t stride,
+        uint32_t vertexCount, uint32_t cacheSize = defaultCacheSize);
+} // namespace mesh
@@ -0,0 +1,116 @@
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <iostream>
+#include "magma/magma.h"
+#include "quadric/include/quadric.h"
+#include "quadricMesh.h"
+
+namespace mesh
+{
+QuadricGeometry readBack(const quadric::Quadric& quadric,
+    std::shared_ptr<magma::CommandPool> commandPool)
+{
+    const magma::VertexInputState& vertexInput = quadric.getVertexInput();
+    // Expect single interleaved binding with float X, Y, Z position at location 0
+    assert(1 == vertexInput.vertexBindingDescriptionCount);
+    const VkVertexInputAttributeDescription *position = std::find_if(vertexInput.pVertexAttributeDescriptions,
+        vertexInput.pVertexAttributeDescriptions + vertexInput.vertexAttributeDescriptionCount,
+        [](const VkVertexInputAttributeDescription& attrib) { return 0 == attrib.location; });
+    assert(position != vertexInput.pVertexAttributeDescriptions + vertexInput.vertexAttributeDescriptionCount);
+    assert((VK_FORMAT_R32G32B32_SFLOAT == position->format) || (VK_FORMAT_R32G32B32A32_SFLOAT == position->format));
+    std::shared_ptr<magma::VertexBuffer> vertexBuffer = quadric.getVertexBuffer();
+    std::shared_ptr<magma::IndexBuffer> indexBuffer = quadric.getIndexBuffer();
+    std::shared_ptr<magma::Device> device = commandPool->getDevice();
+    std::shared_ptr<magma::DstTransferBuffer> vertexReadback = std::make_shared<magma::DstTransferBuffer>(
+        device, vertexBuffer->getSize());
+    std::shared_ptr<magma::DstTransferBuffer> indexReadback = std::make_shared<magma::DstTransferBuffer>(
+        device, indexBuffer->getSize());
+    magma::helpers::executeCommandBuffer(commandPool,
+        [&](std::shared_ptr<magma::CommandBuffer> cmdBuffer)
+        {
+            cmdBuffer->copyBuffer(vertexBuffer, vertexReadback);
+            cmdBuffer->copyBuffer(indexBuffer, indexReadback);
+        });
+    QuadricGeometry geometry;
+    geometry.vertexStride = vertexInput.pVertexBindingDescriptions[0].stride;
+    geometry.positionOffset = position->offset;
+    geometry.vertexCount = uint32_t(vertexBuffer->getSize()/geometry.vertexStride);
+    geometry.vertices.resize(std::size_t(geometry.vertexCount) * geometry.vertexStride);
+    magma::helpers::mapScoped<uint8_t>(vertexReadback,
+        [&geometry](const uint8_t *data)
+        {
+            memcpy(geometry.vertices.data(), data, geometry.vertices.size());
+        });
+    const uint32_t indexCount = indexBuffer->getIndexCount();
+    assert(0 == indexCount % 3);
+    geometry.indices.resize(indexCount);
+    const bool shortIndices = (VK_INDEX_TYPE_UINT16 == indexBuffer->getIndexType());
+    magma::helpers::mapScoped<uint8_t>(indexReadback,
+        [&geometry, shortIndices](const uint8_t *data)
+        {
+            if (shortIndices)
+                std::copy((const uint16_t *)data, (const uint16_t *)data + geometry.indices.size(), geometry.indices.begin());
+            else
+                memcpy(geometry.indices.data(), data, geometry.indices.size() * sizeof(uint32_t));
+        });
+    return geometry;
+}
+
+std::pair<VertexCacheStatistics, VertexCacheStatistics> optimize(quadric::Quadric& quadric,
+    std::shared_ptr<magma::CommandPool> commandPool)
+{
+    QuadricGeometry geometry = readBack(quadric, commandPool);
+    const VertexCacheStatistics before = analyzeVertexCache(geometry.indices, geometry.vertexCount);
+    const float *positions = (const float *)(geometry.vertices.data() + geometry.positionOffset);
+    const std::vector<uint32_t> vertexOrder = optimize(geometry.indices, positions,
+        geometry.vertexStride, geometry.vertexCount);
+    const VertexCacheStatistics after = analyzeVertexCache(geometry.indices, geometry.vertexCount);
+    // Sizes don't change, so write back to the same buffers
+    std::shared_ptr<magma::VertexBuffer> vertexBuffer = quadric.getVertexBuffer();
+    std::shared_ptr<magma::IndexBuffer> indexBuffer = quadric.getIndexBuffer();
+    std::shared_ptr<magma::Device> device = commandPool->getDevice();
+    std::shared_ptr<magma::SrcTransferBuffer> vertexStaging = std::make_shared<magma::SrcTransferBuffer>(
+        device, vertexBuffer->getSize());
+    std::shared_ptr<magma::SrcTransferBuffer> indexStaging = std::make_shared<magma::SrcTransferBuffer>(
+        device, indexBuffer->getSize());
+    magma::helpers::mapScoped<uint8_t>(vertexStaging,
+        [&geometry, &vertexOrder](uint8_t *data)
+        {
+            const uint32_t stride = geometry.vertexStride;
+            for (uint32_t v : vertexOrder)
+            {
+                memcpy(data, geometry.vertices.data() + std::size_t(v) * stride, stride);
+                data += stride;
+            }
+        });
+    const bool shortIndices = (VK_INDEX_TYPE_UINT16 == indexBuffer->getIndexType());
+    magma::helpers::mapScoped<uint8_t>(indexStaging,
+        [&geometry, shortIndices](uint8_t *data)
+        {
+            if (shortIndices)
+            {
+                uint16_t *idx = (uint16_t *)data;
+                for (uint32_t index : geometry.indices)
+                    *idx++ = uint16_t(index);
+            }
+            else
+                memcpy(data, geometry.indices.data(), geometry.indices.size() * sizeof(uint32_t));
+        });
+    magma::helpers::executeCommandBuffer(commandPool,
+        [&](std::shared_ptr<magma::CommandBuffer> cmdBuffer)
+        {
+            cmdBuffer->copyBuffer(vertexStaging, vertexBuffer);
+            cmdBuffer->copyBuffer(indexStaging, indexBuffer);
+        });
+    return {before, after};
+}
+
+void optimize(quadric::Quadric& quadric, const char *name,
+    std::shared_ptr<magma::CommandPool> commandPool)
+{
+    const auto stats = optimize(quadric, std::move(commandPool));
+    std::cout << name << " vertex cache: ACMR " << stats.first.acmr << " -> " << stats.second.acmr
+        << ", ATVR " << stats.first.atvr << " -> " << stats.second.atvr << std::endl;
+}
+} // namespace mesh
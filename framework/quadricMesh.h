@@ -0,0 +1,43 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+#include "meshOptimizer.h"
+
+namespace magma
+{
+    class CommandPool;
+}
+
+namespace quadric
+{
+    class Quadric;
+}
+
+/* Quadric objects upload their vertices and indices to device local
+   buffers without keeping them on CPU side, so buffers are read back
+   once after creation. Optimization reorders triangles and vertices
+   (see meshOptimizer.h) and writes them back to the same buffers,
+   as their sizes don't change, so quadric is drawn as before. */
+
+namespace mesh
+{
+    struct QuadricGeometry
+    {
+        std::vector<uint8_t> vertices; // Interleaved
+        std::vector<uint32_t> indices; // Triangle list
+        uint32_t vertexCount = 0;
+        uint32_t vertexStride = 0;
+        uint32_t positionOffset = 0; // Float X, Y, Z
+    };
+
+    QuadricGeometry readBack(const quadric::Quadric& quadric,
+        std::shared_ptr<magma::CommandPool> commandPool);
+    // Returns vertex cache statistics before optimization and after
+    std::pair<VertexCacheStatistics, VertexCacheStatistics> optimize(quadric::Quadric& quadric,
+        std::shared_ptr<magma::CommandPool> commandPool);
+    // Optimizes and prints ACMR and ATVR of quadric
+    void optimize(quadric::Quadric& quadric, const char *name,
+        std::shared_ptr<magma::CommandPool> commandPool);
+} // namespace mesh
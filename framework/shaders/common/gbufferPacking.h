@@ -0,0 +1,54 @@
+// https://aras-p.info/texts/CompactNormalStorage.html
+vec2 encodeSpheremap(vec3 n)
+{
+    vec2 enc = normalize(n.xy) * (sqrt(-n.z * .5 + .5));
+    enc = enc * .5 + .5;
+    return enc;
+}
+
+vec3 decodeSpheremap(vec2 enc)
+{
+    vec4 nn = vec4(enc * 2., 0., 0.) + vec4(-1., -1., 1., -1.);
+    float l = dot(nn.xyz, -nn.xyw);
+    nn.z = l;
+    nn.xy *= sqrt(l);
+    return nn.xyz * 2. + vec3(0., 0., -1.);
+}
+
+// https://knarkowicz.wordpress.com/2014/04/16/octahedron-normal-vector-encoding/
+vec2 signNotZero(vec2 v)
+{
+    return vec2(v.x >= 0. ? 1. : -1., v.y >= 0. ? 1. : -1.);
+}
+
+vec2 encodeOctahedral(vec3 n)
+{
+    n /= abs(n.x) + abs(n.y) + abs(n.z);
+    vec2 enc = n.z >= 0. ? n.xy : (1. - abs(n.yx)) * signNotZero(n.xy);
+    return enc * .5 + .5;
+}
+
+vec3 decodeOctahedral(vec2 enc)
+{
+    enc = enc * 2. - 1.;
+    vec3 n = vec3(enc, 1. - abs(enc.x) - abs(enc.y));
+    float t = clamp(-n.z, 0., 1.);
+    n.xy -= t * signNotZero(n.xy);
+    return normalize(n);
+}
+
+// Packs ambient factor and shininess (1..256) into 10-bit UNORM channel,
+// shininess is stored in log2 space to keep precision for small exponents.
+float packAmbientShininess(float ambient, float shininess)
+{
+    uint a = uint(round(clamp(ambient, 0., 1.) * 31.));
+    uint s = uint(round(clamp(log2(shininess) * .125, 0., 1.) * 31.));
+    return float((a << 5) | s)/1023.;
+}
+
+void unpackAmbientShininess(float packed, out float ambient, out float shininess)
+{
+    uint bits = uint(round(packed * 1023.));
+    ambient = float(bits >> 5)/31.;
+    shininess = exp2(float(bits & 31) * 8./31.);
+}
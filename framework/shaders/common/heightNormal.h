@@ -0,0 +1,14 @@
+float height(vec2 uv); // Should be defined by includer
+
+// Object space normal from central differences of height at neighbour texels
+vec3 heightNormal(vec2 uv, vec2 texelSize, float strength)
+{
+    vec2 dx = vec2(texelSize.x, 0.);
+    vec2 dy = vec2(0., texelSize.y);
+    vec2 slope = vec2( // dh/duv
+        height(uv + dx) - height(uv - dx),
+        height(uv + dy) - height(uv - dy))/(2. * texelSize);
+    // Sobel filter responds with 8x slope per texel, keep the same scale
+    vec2 grad = slope * texelSize * 8.;
+    return normalize(vec3(-grad.x, 1./strength, -grad.y));
+}
@@ -0,0 +1,43 @@
+// Bilinear-weighted PCF of NxN texel footprint. Each textureGather()
+// returns four depth comparisons, so 3x3, 5x5 and 7x7 kernels take
+// 4, 9 and 16 fetches respectively.
+
+float pcfGatherWeight(int i, int size, float f)
+{
+    if (0 == i)
+        return 1. - f;
+    if (size == i)
+        return f;
+    return 1.;
+}
+
+float pcfGather(sampler2DShadow shadowMap, vec3 shadowCoord, int size)
+{
+    vec2 texSize = vec2(textureSize(shadowMap, 0));
+    vec2 texelSize = 1./texSize;
+    vec2 pos = shadowCoord.xy * texSize - .5;
+    vec2 base = floor(pos);
+    vec2 f = pos - base;
+    int halfSize = size/2;
+    int fetchCount = (size + 1)/2;
+    float sum = 0.;
+    for (int y = 0; y < fetchCount; ++y)
+    {
+        float wy0 = pcfGatherWeight(y * 2, size, f.y);
+        float wy1 = pcfGatherWeight(y * 2 + 1, size, f.y);
+        for (int x = 0; x < fetchCount; ++x)
+        {
+            float wx0 = pcfGatherWeight(x * 2, size, f.x);
+            float wx1 = pcfGatherWeight(x * 2 + 1, size, f.x);
+            // Sample at the corner shared by four texels
+            vec2 texel = base + vec2(x * 2 - halfSize, y * 2 - halfSize);
+            vec4 s = textureGather(shadowMap, (texel + 1.) * texelSize, shadowCoord.z);
+            // Gather order is (0,1), (1,1), (1,0), (0,0)
+            sum += s.w * wx0 * wy0 +
+                   s.z * wx1 * wy0 +
+                   s.x * wx0 * wy1 +
+                   s.y * wx1 * wy1;
+        }
+    }
+    return sum/float(size * size);
+}
@@ -33,8 +33,11 @@ VkFormat getSupportedDepthFormat(std::shared_ptr<magma::PhysicalDevice> physical
 
 uint32_t getSupportedMultisampleLevel(std::shared_ptr<magma::PhysicalDevice> physicalDevice, VkFormat format)
 {
+    const magma::Format fmt(format);
+    const VkImageUsageFlags usage = (fmt.depth() || fmt.depthStencil()) ?
+        VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT : VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
     const VkImageFormatProperties formatProperties = physicalDevice->getImageFormatProperties(
-        format, VK_IMAGE_TYPE_2D, true, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT);
+        format, VK_IMAGE_TYPE_2D, true, usage);
     for (VkSampleCountFlags bit : {
         VK_SAMPLE_COUNT_16_BIT,
         VK_SAMPLE_COUNT_8_BIT,
@@ -47,6 +50,44 @@ uint32_t getSupportedMultisampleLevel(std::shared_ptr<magma::PhysicalDevice> phy
     return 1;
 }
 
+uint32_t getFormatSize(VkFormat format)
+{   // Bytes per texel of render target formats used in samples
+    switch (format)
+    {
+    case VK_FORMAT_R8_UNORM:
+        return 1;
+    case VK_FORMAT_R8G8_UNORM:
+    case VK_FORMAT_R16_SFLOAT:
+    case VK_FORMAT_D16_UNORM:
+        return 2;
+    case VK_FORMAT_D16_UNORM_S8_UINT:
+        return 3;
+    case VK_FORMAT_R8G8B8A8_UNORM:
+    case VK_FORMAT_R8G8B8A8_SRGB:
+    case VK_FORMAT_B8G8R8A8_UNORM:
+    case VK_FORMAT_B8G8R8A8_SRGB:
+    case VK_FORMAT_A2R10G10B10_UNORM_PACK32:
+    case VK_FORMAT_A2B10G10R10_UNORM_PACK32:
+    case VK_FORMAT_R16G16_UNORM:
+    case VK_FORMAT_R16G16_SFLOAT:
+    case VK_FORMAT_R32_UINT:
+    case VK_FORMAT_R32_SFLOAT:
+    case VK_FORMAT_X8_D24_UNORM_PACK32:
+    case VK_FORMAT_D24_UNORM_S8_UINT:
+    case VK_FORMAT_D32_SFLOAT:
+        return 4;
+    case VK_FORMAT_D32_SFLOAT_S8_UINT:
+        return 5;
+    case VK_FORMAT_R16G16B16A16_SFLOAT:
+    case VK_FORMAT_R32G32_SFLOAT:
+        return 8;
+    case VK_FORMAT_R32G32B32A32_SFLOAT:
+        return 16;
+    default:
+        return 0;
+    }
+}
+
 std::vector<char, core::aligned_allocator<char>> loadBinaryFile(const std::string& filename)
 {
     std::ifstream file(filename, std::ios::in | std::ios::binary | std::ios::ate);
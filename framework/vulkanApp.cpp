@@ -102,6 +102,12 @@ void VulkanApp::enableDeviceFeatures(VkPhysicalDeviceFeatures& features) const n
     features.samplerAnisotropy = VK_TRUE;
     features.textureCompressionBC = VK_TRUE;
     features.occlusionQueryPrecise = VK_TRUE;
+    // Optional features
+    features.depthBounds = physicalDevice->getFeatures().depthBounds;
+    features.geometryShader = physicalDevice->getFeatures().geometryShader;
+    features.vertexPipelineStoresAndAtomics = physicalDevice->getFeatures().vertexPipelineStoresAndAtomics;
+    features.fragmentStoresAndAtomics = physicalDevice->getFeatures().fragmentStoresAndAtomics;
+    features.shaderClipDistance = physicalDevice->getFeatures().shaderClipDistance;
 }
 
 void VulkanApp::enableDeviceFeaturesExt(std::vector<void *>& features) const
@@ -2,6 +2,7 @@
 #include "colorTable.h"
 #include "textureLoader.h"
 #include "utilities.h"
+#include "quadricMesh.h"
 
 #include "quadric/include/cube.h"
 #include "quadric/include/sphere.h"
@@ -32,6 +33,7 @@ class Gbuffer : public GraphicsApp
 
     rapid::matrix objTransforms[MaxObjects];
     uint32_t currLayer = 0;
+    bool packedGbuffer = false;
 
 public:
     Gbuffer(const AppEntry& entry):
@@ -78,6 +80,20 @@ public:
         return GraphicsApp::onMouseLButton(down, x, y);
     }
 
+    virtual void onKeyDown(char key, int repeat, uint32_t flags) override
+    {
+        if (AppKey::Space == key)
+        {
+            packedGbuffer = !packedGbuffer;
+            createGbuffer();
+            setupGraphicsPipelines();
+            setupDrawLayers();
+            renderScene(FrontBuffer);
+            renderScene(BackBuffer);
+        }
+        VulkanApp::onKeyDown(key, repeat, flags);
+    }
+
     void updateTransforms()
     {
         constexpr float speed = 0.05f;
@@ -158,14 +174,25 @@ public:
         constexpr bool depthSampled = true;
         constexpr bool noDepthPass = false;
         const VkFormat depthFormat = utilities::getSupportedDepthFormat(physicalDevice, false, true);
+        const std::initializer_list<VkFormat> standardFormats = {
+            VK_FORMAT_R16G16_SFLOAT, // Normal
+            VK_FORMAT_R8G8B8A8_UNORM, // Albedo
+            VK_FORMAT_R8G8B8A8_UNORM}; // Specular
+        const std::initializer_list<VkFormat> packedFormats = {
+            VK_FORMAT_A2B10G10R10_UNORM_PACK32, // Octahedral normal, ambient and shininess
+            VK_FORMAT_R8G8B8A8_UNORM}; // Albedo and specular intensity
+        const std::initializer_list<VkFormat>& colorFormats = packedGbuffer ? packedFormats : standardFormats;
         gbuffer = std::make_shared<magma::aux::MultiAttachmentFramebuffer>(device,
-            std::initializer_list<VkFormat>{
-                VK_FORMAT_R16G16_SFLOAT, // Normal
-                VK_FORMAT_R8G8B8A8_UNORM, // Albedo
-                VK_FORMAT_R8G8B8A8_UNORM}, // Specular
-            depthFormat, framebuffers[FrontBuffer]->getExtent(),
+            colorFormats, depthFormat, framebuffers[FrontBuffer]->getExtent(),
             depthSampled, // Reconstruct position from depth
             noDepthPass);
+        uint32_t bytesPerPixel = utilities::getFormatSize(depthFormat);
+        for (VkFormat format : colorFormats)
+            bytesPerPixel += utilities::getFormatSize(format);
+        const VkExtent2D extent = gbuffer->getExtent();
+        std::cout << (packedGbuffer ? "Packed" : "Standard") << " G-buffer: "
+            << colorFormats.size() << " color attachments, " << bytesPerPixel << " bytes per pixel, "
+            << extent.width * extent.height * bytesPerPixel/(1024.f * 1024.f) << " MB per frame" << std::endl;
     }
 
     void createMeshObjects()
@@ -175,6 +202,9 @@ public:
         objects[Sphere] = std::make_unique<quadric::Sphere>(1.7f, 64, 64, false, cmdCopyBuf);
         objects[Torus] = std::make_unique<quadric::Torus>(0.5f, 2.0f, 32, 128, true, cmdCopyBuf);
         objects[Ground] = std::make_unique<quadric::Plane>(25.f, 25.f, true, cmdCopyBuf);
+        mesh::optimize(*objects[Teapot], "Teapot", commandPools[0]);
+        mesh::optimize(*objects[Sphere], "Sphere", commandPools[0]);
+        mesh::optimize(*objects[Torus], "Torus", commandPools[0]);
     }
 
     void loadTextures()
@@ -220,27 +250,50 @@ public:
                 magma::blendstates::writeRgba, // Albedo
                 magma::blendstates::writeRgba  // Specular
             });
-        gbufferPipeline = createMrtPipeline("transform.o", "fillGbuffer.o",
+        const magma::MultiColorBlendState packedGbufferBlendState(
+            {
+                magma::blendstates::writeRgb, // Normal, ambient and shininess
+                magma::blendstates::writeRgba // Albedo and specular
+            });
+        gbufferPipeline = createMrtPipeline("transform.o", packedGbuffer ? "fillGbufferPacked.o" : "fillGbuffer.o",
             objects[0]->getVertexInput(),
-            gbufferBlendState,
+            packedGbuffer ? packedGbufferBlendState : gbufferBlendState,
             gbuffer,
             descriptor.layout);
-        gbufferTexPipeline = createMrtPipeline("transform.o", "fillGbufferTex.o",
+        gbufferTexPipeline = createMrtPipeline("transform.o", packedGbuffer ? "fillGbufferTexPacked.o" : "fillGbufferTex.o",
             objects[0]->getVertexInput(),
-            gbufferBlendState,
+            packedGbuffer ? packedGbufferBlendState : gbufferBlendState,
             gbuffer,
             texDescriptor.layout);
     }
 
     void setupDrawLayers()
     {
-        layers[Normal] = std::make_unique<magma::aux::BlitRectangle>(renderPass, loadShader("decodeNormal.o"));
+        if (packedGbuffer)
+        {
+            layers[Normal] = std::make_unique<magma::aux::BlitRectangle>(renderPass, loadShader("decodeOctahedralNormal.o"));
+            layers[Specular] = std::make_unique<magma::aux::BlitRectangle>(renderPass, loadShader("loadSpecularIntensity.o"));
+            layers[Shininess] = std::make_unique<magma::aux::BlitRectangle>(renderPass, loadShader("unpackShininess.o"));
+        }
+        else
+        {
+            layers[Normal] = std::make_unique<magma::aux::BlitRectangle>(renderPass, loadShader("decodeNormal.o"));
+            layers[Specular] = std::make_unique<magma::aux::BlitRectangle>(renderPass, loadShader("loadColor.o"));
+            layers[Shininess] = std::make_unique<magma::aux::BlitRectangle>(renderPass, loadShader("loadShininess.o"));
+        }
         layers[Albedo] = std::make_unique<magma::aux::BlitRectangle>(renderPass, loadShader("loadColor.o"));
-        layers[Specular] = std::make_unique<magma::aux::BlitRectangle>(renderPass, loadShader("loadColor.o"));
-        layers[Shininess] = std::make_unique<magma::aux::BlitRectangle>(renderPass, loadShader("loadShininess.o"));
         layers[Depth] = std::make_unique<magma::aux::BlitRectangle>(renderPass, loadShader("linearizeDepth.o"));
     }
 
+    std::shared_ptr<const magma::ImageView> getLayerView(uint32_t layer) const
+    {   // Packed layout stores specular in albedo attachment and shininess in normal one
+        constexpr uint32_t attachments[] = {0, 1, 2, 2};
+        constexpr uint32_t packedAttachments[] = {0, 1, 1, 0};
+        if (Depth == layer)
+            return gbuffer->getDepthStencilView();
+        return gbuffer->getAttachmentView(packedGbuffer ? packedAttachments[layer] : attachments[layer]);
+    }
+
     void renderScene(uint32_t bufferIndex)
     {
         std::shared_ptr<magma::CommandBuffer> cmdBuffer = commandBuffers[bufferIndex];
@@ -255,13 +308,25 @@ public:
 
     void gbufferPass(std::shared_ptr<magma::CommandBuffer> cmdBuffer)
     {
-        cmdBuffer->beginRenderPass(gbuffer->getRenderPass(), gbuffer->getFramebuffer(),
-            {
-                magma::clears::blackColor,
-                magma::ClearColor(0.35f, 0.53f, 0.7f, 1.f),
-                magma::ClearColor(0.35f, 0.53f, 0.7f, 1.f),
-                magma::clears::depthOne
-            });
+        if (packedGbuffer)
+        {
+            cmdBuffer->beginRenderPass(gbuffer->getRenderPass(), gbuffer->getFramebuffer(),
+                {
+                    magma::clears::blackColor,
+                    magma::ClearColor(0.35f, 0.53f, 0.7f, 1.f),
+                    magma::clears::depthOne
+                });
+        }
+        else
+        {
+            cmdBuffer->beginRenderPass(gbuffer->getRenderPass(), gbuffer->getFramebuffer(),
+                {
+                    magma::clears::blackColor,
+                    magma::ClearColor(0.35f, 0.53f, 0.7f, 1.f),
+                    magma::ClearColor(0.35f, 0.53f, 0.7f, 1.f),
+                    magma::clears::depthOne
+                });
+        }
         {   // 1. Draw objects
             cmdBuffer->bindPipeline(gbufferPipeline);
             for (uint32_t i = Cube; i < Ground; ++i)
@@ -289,13 +354,8 @@ public:
     {
         cmdBuffer->beginRenderPass(renderPass, framebuffers[bufferIndex]);
         {
-            std::shared_ptr<const magma::ImageView> imageView;
-            if (currLayer < Depth)
-                imageView = gbuffer->getAttachmentView(std::min(currLayer, 2U));
-            else
-                imageView = gbuffer->getDepthStencilView();
             const VkRect2D rect{0, 0, gbuffer->getExtent()};
-            layers[currLayer]->blit(cmdBuffer, imageView, VK_FILTER_NEAREST, rect);
+            layers[currLayer]->blit(cmdBuffer, getLayerView(currLayer), VK_FILTER_NEAREST, rect);
             drawDecodedLayers(cmdBuffer);
         }
         cmdBuffer->endRenderPass();
@@ -306,11 +366,8 @@ public:
         constexpr VkFilter filter = VK_FILTER_NEAREST;
         const VkExtent2D extent{width/5, height/5};
         const int32_t h = (int32_t)extent.height;
-        layers[Normal]->blit(cmdBuffer, gbuffer->getAttachmentView(0), filter, VkRect2D{0, 0, extent});
-        layers[Albedo]->blit(cmdBuffer, gbuffer->getAttachmentView(1), filter, VkRect2D{0, h, extent});
-        layers[Specular]->blit(cmdBuffer, gbuffer->getAttachmentView(2), filter, VkRect2D{0, h * 2, extent});
-        layers[Shininess]->blit(cmdBuffer, gbuffer->getAttachmentView(2), filter, VkRect2D{0, h * 3, extent});
-        layers[Depth]->blit(cmdBuffer, gbuffer->getDepthStencilView(), filter, VkRect2D{0, h * 4, extent});
+        for (uint32_t layer = Normal; layer <= Depth; ++layer)
+            layers[layer]->blit(cmdBuffer, getLayerView(layer), filter, VkRect2D{0, h * (int32_t)layer, extent});
     }
 };
 
@@ -1,5 +1,6 @@
 #include "graphicsApp.h"
 #include "textureLoader.h"
+#include "quadricMesh.h"
 
 #include "quadric/include/torus.h"
 #include "quadric/include/sphere.h"
@@ -119,6 +120,7 @@ public:
     {
         torus = std::make_unique<quadric::Torus>(0.4f, 1.0f, 64, 128, true, cmdCopyBuf);
         sphere = std::make_unique<quadric::Sphere>(0.02f, 8, 8, true, cmdCopyBuf);
+        mesh::optimize(*torus, "Torus", commandPools[0]);
     }
 
     void loadTexture()
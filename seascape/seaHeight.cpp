@@ -0,0 +1,130 @@
+#include <algorithm>
+#include <cmath>
+#include <thread>
+#include <vector>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#include "seaHeight.h"
+
+namespace
+{
+constexpr int iterations = 5; // ITERATIONS of heightmap.frag
+constexpr std::size_t minBatchSize = 4096;
+
+bool cpuSupportsAvx2() noexcept
+{
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7)
+        return false;
+    __cpuid(info, 1);
+    const bool osxsave = (info[2] & (1 << 27)) != 0;
+    if (!osxsave || ((_xgetbv(0) & 6) != 6)) // YMM state saved by OS
+        return false;
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#elif defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    return __builtin_cpu_supports("avx2");
+#else
+    return false;
+#endif
+}
+
+inline float fract(float x) noexcept { return x - floorf(x); }
+inline float mix(float a, float b, float t) noexcept { return a + (b - a) * t; }
+
+inline float sinhash(float x, float y) noexcept
+{   // sinhash() of noise2d.h
+    const float h = x * 127.1f + y * 311.7f;
+    return fract(sinf(h) * 43758.5453123f);
+}
+
+// wavenoise() of noise2d.h
+float wavenoise(float x, float y) noexcept
+{
+    const float ix = floorf(x), iy = floorf(y);
+    const float fx = x - ix, fy = y - iy;
+    const float ux = fx * fx * (3.f - 2.f * fx);
+    const float uy = fy * fy * (3.f - 2.f * fy);
+    return mix(mix(sinhash(ix, iy), sinhash(ix + 1.f, iy), ux),
+               mix(sinhash(ix, iy + 1.f), sinhash(ix + 1.f, iy + 1.f), ux), uy) * 2.f - 1.f;
+}
+
+float octave(float x, float y, float choppy) noexcept
+{
+    const float n = wavenoise(x, y);
+    x += n; y += n;
+    float wvx = 1.f - fabsf(sinf(x));
+    float wvy = 1.f - fabsf(sinf(y));
+    wvx = mix(wvx, fabsf(cosf(x)), wvx);
+    wvy = mix(wvy, fabsf(cosf(y)), wvy);
+    return powf(1.f - powf(wvx * wvy, 0.65f), choppy);
+}
+} // namespace
+
+SeaHeight::SeaHeight(const Parameters& parameters, unsigned threadCount /* 0 */):
+    parameters(parameters),
+    threadCount(threadCount ? threadCount : std::max(std::thread::hardware_concurrency(), 1u)),
+    avx2(avx2::compiled() && cpuSupportsAvx2())
+{}
+
+float SeaHeight::evaluate(float u, float v, float time) const noexcept
+{
+    float freq = parameters.frequency;
+    float amp = parameters.height;
+    float choppy = parameters.choppy;
+    const float t = 1.f + time * parameters.speed;
+    float height = 0.f;
+    for (int i = 0; i < iterations; ++i)
+    {
+        float d = octave((u + t) * freq, (v + t) * freq, choppy);
+        d +=      octave((u - t) * freq, (v - t) * freq, choppy);
+        height += d * amp;
+        // uv *= octaveMat
+        const float x = 1.6f * u + 1.2f * v;
+        v = -1.2f * u + 1.6f * v;
+        u = x;
+        freq *= 1.9f;
+        amp *= 0.22f;
+        choppy = mix(choppy, 1.f, 0.2f);
+    }
+    return height;
+}
+
+void SeaHeight::evaluate(const float *u, const float *v, float *heights, std::size_t count, float time,
+    bool simd /* true */, bool threaded /* true */) const
+{
+    const std::size_t batchCount = threaded ? std::min<std::size_t>(threadCount, count/minBatchSize) : 1;
+    if (batchCount <= 1)
+    {
+        evaluateRange(u, v, heights, count, time, simd);
+        return;
+    }
+    // Keep batch size multiple of SIMD width
+    const std::size_t batchSize = ((count + batchCount - 1)/batchCount + 7) & ~std::size_t(7);
+    std::vector<std::thread> workers;
+    for (std::size_t first = batchSize; first < count; first += batchSize)
+    {
+        const std::size_t size = std::min(batchSize, count - first);
+        workers.emplace_back([=]() {
+            evaluateRange(u + first, v + first, heights + first, size, time, simd);
+        });
+    }
+    evaluateRange(u, v, heights, batchSize, time, simd);
+    for (std::thread& worker : workers)
+        worker.join();
+}
+
+void SeaHeight::evaluateRange(const float *u, const float *v, float *heights, std::size_t count, float time,
+    bool simd) const noexcept
+{
+    if (simd && avx2)
+        avx2::evaluateSeaHeight(parameters, u, v, heights, count, time);
+    else
+    {
+        for (std::size_t i = 0; i < count; ++i)
+            heights[i] = evaluate(u[i], v[i], time);
+    }
+}
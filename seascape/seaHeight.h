@@ -0,0 +1,43 @@
+#pragma once
+#include <cstddef>
+#include "core/noncopyable.h"
+
+/* CPU port of procedural height function of heightmap.frag for gameplay
+   queries like buoyancy, collisions or camera clamping. Query points are
+   given in texture coordinates of the height map. Large batches are split
+   between threads, and each thread evaluates 8 points at once if CPU
+   supports AVX2. */
+
+class SeaHeight : public core::NonCopyable
+{
+public:
+    struct Parameters
+    {   // Same as specialization constants of height map pass
+        float height;
+        float choppy;
+        float speed;
+        float frequency;
+    };
+
+    explicit SeaHeight(const Parameters& parameters, unsigned threadCount = 0);
+    float evaluate(float u, float v, float time) const noexcept;
+    void evaluate(const float *u, const float *v, float *heights, std::size_t count, float time,
+        bool simd = true, bool threaded = true) const;
+    bool avx2Supported() const noexcept { return avx2; }
+    unsigned getThreadCount() const noexcept { return threadCount; }
+
+private:
+    void evaluateRange(const float *u, const float *v, float *heights, std::size_t count, float time,
+        bool simd) const noexcept;
+
+    const Parameters parameters;
+    const unsigned threadCount;
+    const bool avx2;
+};
+
+namespace avx2
+{
+    bool compiled() noexcept;
+    void evaluateSeaHeight(const SeaHeight::Parameters& parameters,
+        const float *u, const float *v, float *heights, std::size_t count, float time) noexcept;
+}
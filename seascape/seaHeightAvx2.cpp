@@ -0,0 +1,246 @@
+// This file is compiled with /arch:AVX2, functions are called
+// only after CPU support has been checked at runtime.
+#include "seaHeight.h"
+
+#ifdef __AVX2__
+#include <immintrin.h>
+
+namespace
+{
+constexpr int iterations = 5; // ITERATIONS of heightmap.frag
+
+#define PS(x) _mm256_set1_ps(x)
+#define PI32(x) _mm256_set1_epi32(x)
+
+// Floating-point multiply and add are kept separate (no FMA) to round
+// the same way as the scalar version.
+
+inline __m256 fract(__m256 x) noexcept
+{
+    return _mm256_sub_ps(x, _mm256_floor_ps(x));
+}
+
+inline __m256 mix(__m256 a, __m256 b, __m256 t) noexcept
+{
+    return _mm256_add_ps(a, _mm256_mul_ps(_mm256_sub_ps(b, a), t));
+}
+
+inline __m256 abs(__m256 x) noexcept
+{
+    return _mm256_andnot_ps(PS(-0.f), x);
+}
+
+// Cephes single precision sin/cos polynomials for |x| <= Pi/4
+inline void sincos(__m256 x, __m256i j, __m256 signBit, __m256& s, __m256& c) noexcept
+{   // Octant selects polynomial and sign of result
+    const __m256 polyMask = _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(j, PI32(2)), PI32(2)));
+    const __m256 sinSign = _mm256_xor_ps(signBit, _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(j, PI32(4)), 29)));
+    const __m256 cosSign = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_andnot_si256(_mm256_sub_epi32(j, PI32(2)), PI32(4)), 29));
+    const __m256 z = _mm256_mul_ps(x, x);
+    // Cosine polynomial for 0 <= x <= Pi/4
+    __m256 yc = PS(2.443315711809948e-5f);
+    yc = _mm256_add_ps(_mm256_mul_ps(yc, z), PS(-1.388731625493765e-3f));
+    yc = _mm256_add_ps(_mm256_mul_ps(yc, z), PS(4.166664568298827e-2f));
+    yc = _mm256_mul_ps(_mm256_mul_ps(yc, z), z);
+    yc = _mm256_add_ps(_mm256_sub_ps(yc, _mm256_mul_ps(z, PS(0.5f))), PS(1.f));
+    // Sine polynomial for 0 <= x <= Pi/4
+    __m256 ys = PS(-1.9515295891e-4f);
+    ys = _mm256_add_ps(_mm256_mul_ps(ys, z), PS(8.3321608736e-3f));
+    ys = _mm256_add_ps(_mm256_mul_ps(ys, z), PS(-1.6666654611e-1f));
+    ys = _mm256_add_ps(_mm256_mul_ps(_mm256_mul_ps(ys, z), x), x);
+    s = _mm256_xor_ps(_mm256_blendv_ps(ys, yc, polyMask), sinSign);
+    c = _mm256_xor_ps(_mm256_blendv_ps(yc, ys, polyMask), cosSign);
+}
+
+// Octant of |x|, j = (int(|x| * 4/Pi) + 1) & ~1
+inline __m256i octant(__m256 x) noexcept
+{
+    const __m256i j = _mm256_cvttps_epi32(_mm256_mul_ps(x, PS(1.27323954473516f)));
+    return _mm256_and_si256(_mm256_add_epi32(j, PI32(1)), PI32(~1));
+}
+
+// Cephes single precision sin/cos
+void sincos(__m256 x, __m256& s, __m256& c) noexcept
+{
+    const __m256 signBit = _mm256_and_ps(x, PS(-0.f));
+    x = abs(x);
+    const __m256i j = octant(x);
+    const __m256 y = _mm256_cvtepi32_ps(j);
+    // Extended precision modular arithmetic
+    x = _mm256_sub_ps(x, _mm256_mul_ps(y, PS(0.78515625f)));
+    x = _mm256_sub_ps(x, _mm256_mul_ps(y, PS(2.4187564849853515625e-4f)));
+    x = _mm256_sub_ps(x, _mm256_mul_ps(y, PS(3.77489497744594108e-8f)));
+    sincos(x, j, signBit, s, c);
+}
+
+// Arguments of sinhash() reach 1e5 and more, where single precision
+// modular arithmetic loses bits that 43758x scale of hash amplifies,
+// so argument is reduced in double precision as sinf() does.
+__m256 sinLarge(__m256 x) noexcept
+{
+    const __m256 signBit = _mm256_and_ps(x, PS(-0.f));
+    x = abs(x);
+    const __m256i j = octant(x);
+    const __m256 y = _mm256_cvtepi32_ps(j);
+    const __m256d pio4 = _mm256_set1_pd(0.785398163397448309616);
+    const __m256d lo = _mm256_sub_pd(_mm256_cvtps_pd(_mm256_castps256_ps128(x)),
+        _mm256_mul_pd(_mm256_cvtps_pd(_mm256_castps256_ps128(y)), pio4));
+    const __m256d hi = _mm256_sub_pd(_mm256_cvtps_pd(_mm256_extractf128_ps(x, 1)),
+        _mm256_mul_pd(_mm256_cvtps_pd(_mm256_extractf128_ps(y, 1)), pio4));
+    x = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm256_cvtpd_ps(lo)), _mm256_cvtpd_ps(hi), 1);
+    __m256 s, c;
+    sincos(x, j, signBit, s, c);
+    return s;
+}
+
+inline __m256 sinhash(__m256 x, __m256 y) noexcept
+{
+    const __m256 h = _mm256_add_ps(_mm256_mul_ps(x, PS(127.1f)), _mm256_mul_ps(y, PS(311.7f)));
+    return fract(_mm256_mul_ps(sinLarge(h), PS(43758.5453123f)));
+}
+
+inline __m256 wavenoise(__m256 x, __m256 y) noexcept
+{
+    const __m256 ix = _mm256_floor_ps(x), iy = _mm256_floor_ps(y);
+    const __m256 fx = _mm256_sub_ps(x, ix), fy = _mm256_sub_ps(y, iy);
+    const __m256 ux = _mm256_mul_ps(_mm256_mul_ps(fx, fx), _mm256_sub_ps(PS(3.f), _mm256_mul_ps(PS(2.f), fx)));
+    const __m256 uy = _mm256_mul_ps(_mm256_mul_ps(fy, fy), _mm256_sub_ps(PS(3.f), _mm256_mul_ps(PS(2.f), fy)));
+    const __m256 ix1 = _mm256_add_ps(ix, PS(1.f)), iy1 = _mm256_add_ps(iy, PS(1.f));
+    const __m256 n = mix(mix(sinhash(ix, iy), sinhash(ix1, iy), ux),
+                         mix(sinhash(ix, iy1), sinhash(ix1, iy1), ux), uy);
+    return _mm256_sub_ps(_mm256_mul_ps(n, PS(2.f)), PS(1.f));
+}
+
+// Cephes single precision log2 for x > 0
+__m256 log2(__m256 x) noexcept
+{
+    __m256i e = _mm256_sub_epi32(_mm256_srli_epi32(_mm256_castps_si256(x), 23), PI32(127));
+    // Mantissa in [0.5, 1)
+    x = _mm256_or_ps(_mm256_and_ps(x, _mm256_castsi256_ps(PI32(0x007FFFFF))), PS(0.5f));
+    e = _mm256_add_epi32(e, PI32(1));
+    // if (x < sqrt(1/2)) { --e; x += x; }
+    const __m256 mask = _mm256_cmp_ps(x, PS(0.707106781186547524f), _CMP_LT_OQ);
+    __m256 exponent = _mm256_sub_ps(_mm256_cvtepi32_ps(e), _mm256_and_ps(mask, PS(1.f)));
+    x = _mm256_add_ps(_mm256_sub_ps(x, PS(1.f)), _mm256_and_ps(mask, x));
+    const __m256 z = _mm256_mul_ps(x, x);
+    __m256 y = PS(7.0376836292e-2f);
+    y = _mm256_add_ps(_mm256_mul_ps(y, x), PS(-1.1514610310e-1f));
+    y = _mm256_add_ps(_mm256_mul_ps(y, x), PS(1.1676998740e-1f));
+    y = _mm256_add_ps(_mm256_mul_ps(y, x), PS(-1.2420140846e-1f));
+    y = _mm256_add_ps(_mm256_mul_ps(y, x), PS(1.4249322787e-1f));
+    y = _mm256_add_ps(_mm256_mul_ps(y, x), PS(-1.6668057665e-1f));
+    y = _mm256_add_ps(_mm256_mul_ps(y, x), PS(2.0000714765e-1f));
+    y = _mm256_add_ps(_mm256_mul_ps(y, x), PS(-2.4999993993e-1f));
+    y = _mm256_add_ps(_mm256_mul_ps(y, x), PS(3.3333331174e-1f));
+    y = _mm256_mul_ps(_mm256_mul_ps(y, x), z);
+    y = _mm256_sub_ps(y, _mm256_mul_ps(z, PS(0.5f)));
+    // ln(x) * log2(e)
+    const __m256 lnx = _mm256_add_ps(x, y);
+    return _mm256_add_ps(_mm256_mul_ps(lnx, PS(1.44269504088896341f)), exponent);
+}
+
+// Cephes single precision exp2
+__m256 exp2(__m256 x) noexcept
+{
+    x = _mm256_min_ps(_mm256_max_ps(x, PS(-126.f)), PS(127.f));
+    // x = i + f, -0.5 <= f <= 0.5
+    const __m256 i = _mm256_round_ps(x, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    const __m256 f = _mm256_sub_ps(x, i);
+    __m256 y = PS(1.535336188319500e-4f);
+    y = _mm256_add_ps(_mm256_mul_ps(y, f), PS(1.339887440266574e-3f));
+    y = _mm256_add_ps(_mm256_mul_ps(y, f), PS(9.618437357674640e-3f));
+    y = _mm256_add_ps(_mm256_mul_ps(y, f), PS(5.550332471162809e-2f));
+    y = _mm256_add_ps(_mm256_mul_ps(y, f), PS(2.402264791363012e-1f));
+    y = _mm256_add_ps(_mm256_mul_ps(y, f), PS(6.931472028550421e-1f));
+    y = _mm256_add_ps(_mm256_mul_ps(y, f), PS(1.f));
+    // Scale by 2^i
+    const __m256i pow2i = _mm256_slli_epi32(_mm256_add_epi32(_mm256_cvtps_epi32(i), PI32(127)), 23);
+    return _mm256_mul_ps(y, _mm256_castsi256_ps(pow2i));
+}
+
+inline __m256 pow(__m256 x, __m256 y) noexcept
+{   // Result is undefined for x < 0 in GLSL, return zero
+    const __m256 positive = _mm256_cmp_ps(x, PS(0.f), _CMP_GT_OQ);
+    return _mm256_and_ps(positive, exp2(_mm256_mul_ps(y, log2(_mm256_max_ps(x, PS(1e-30f))))));
+}
+
+inline __m256 octave(__m256 x, __m256 y, __m256 choppy) noexcept
+{
+    const __m256 n = wavenoise(x, y);
+    x = _mm256_add_ps(x, n);
+    y = _mm256_add_ps(y, n);
+    __m256 sx, cx, sy, cy;
+    sincos(x, sx, cx);
+    sincos(y, sy, cy);
+    __m256 wvx = _mm256_sub_ps(PS(1.f), abs(sx));
+    __m256 wvy = _mm256_sub_ps(PS(1.f), abs(sy));
+    wvx = mix(wvx, abs(cx), wvx);
+    wvy = mix(wvy, abs(cy), wvy);
+    return pow(_mm256_sub_ps(PS(1.f), pow(_mm256_mul_ps(wvx, wvy), PS(0.65f))), choppy);
+}
+
+__m256 seaHeight(const SeaHeight::Parameters& parameters, __m256 u, __m256 v, __m256 t) noexcept
+{
+    float freq = parameters.frequency;
+    float amp = parameters.height;
+    float choppy = parameters.choppy;
+    __m256 height = _mm256_setzero_ps();
+    for (int i = 0; i < iterations; ++i)
+    {
+        const __m256 f = PS(freq), c = PS(choppy);
+        __m256 d = octave(_mm256_mul_ps(_mm256_add_ps(u, t), f), _mm256_mul_ps(_mm256_add_ps(v, t), f), c);
+        d = _mm256_add_ps(d, octave(_mm256_mul_ps(_mm256_sub_ps(u, t), f), _mm256_mul_ps(_mm256_sub_ps(v, t), f), c));
+        height = _mm256_add_ps(height, _mm256_mul_ps(d, PS(amp)));
+        // uv *= octaveMat
+        const __m256 x = _mm256_add_ps(_mm256_mul_ps(PS(1.6f), u), _mm256_mul_ps(PS(1.2f), v));
+        v = _mm256_add_ps(_mm256_mul_ps(PS(-1.2f), u), _mm256_mul_ps(PS(1.6f), v));
+        u = x;
+        freq *= 1.9f;
+        amp *= 0.22f;
+        choppy = choppy + (1.f - choppy) * 0.2f;
+    }
+    return height;
+}
+} // namespace
+
+bool avx2::compiled() noexcept
+{
+    return true;
+}
+
+void avx2::evaluateSeaHeight(const SeaHeight::Parameters& parameters,
+    const float *u, const float *v, float *heights, std::size_t count, float time) noexcept
+{
+    const __m256 t = PS(1.f + time * parameters.speed);
+    std::size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        const __m256 h = seaHeight(parameters, _mm256_loadu_ps(u + i), _mm256_loadu_ps(v + i), t);
+        _mm256_storeu_ps(heights + i, h);
+    }
+    if (i < count)
+    {   // Pad the tail to SIMD width
+        alignas(32) float tu[8] = {}, tv[8] = {}, th[8];
+        for (std::size_t j = i; j < count; ++j)
+        {
+            tu[j - i] = u[j];
+            tv[j - i] = v[j];
+        }
+        _mm256_store_ps(th, seaHeight(parameters, _mm256_load_ps(tu), _mm256_load_ps(tv), t));
+        for (std::size_t j = i; j < count; ++j)
+            heights[j] = th[j - i];
+    }
+}
+
+#else // !__AVX2__
+
+bool avx2::compiled() noexcept
+{
+    return false;
+}
+
+void avx2::evaluateSeaHeight(const SeaHeight::Parameters&,
+    const float *, const float *, float *, std::size_t, float) noexcept
+{}
+
+#endif // !__AVX2__
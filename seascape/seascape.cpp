@@ -1,10 +1,19 @@
+#include <chrono>
+#include <random>
 #include "graphicsApp.h"
+#include "gpuTimer.h"
 #include "gridMesh.h"
+#include "seaHeight.h"
 #include "textureLoader.h"
 #include "colorTable.h"
 
 class Seascape : public GraphicsApp
 {
+    enum GpuPass
+    {
+        HeightMapPass, FftOceanPass, MarinePass
+    };
+
     struct SeaConstants
     {
         float invWidth;
@@ -13,6 +22,30 @@ class Seascape : public GraphicsApp
         float choppy;
         float speed;
         float frequency;
+        float normalStrength;
+    };
+
+    struct OceanConstants
+    {
+        uint32_t fftSize;
+        float patchSize;
+        float windSpeed;
+        float amplitude;
+        float choppiness;
+        uint32_t groupSize;
+        VkBool32 vertical;
+    };
+
+    struct MarineConstants
+    {
+        VkBool32 fftOcean;
+        VkBool32 projectedGrid;
+        float maxDistance;
+        float patchSize;
+        uint32_t gridColumns;
+        uint32_t gridRows;
+        float gridScale;
+        VkBool32 sobelNormals;
     };
 
     struct alignas(16) Seabed
@@ -24,34 +57,99 @@ class Seascape : public GraphicsApp
     const float seaChoppy = 4.f;
     const float seaSpeed = 0.8f;
     const float seaFrequency = 0.16f;
+    // Tessendorf ocean
+    const uint32_t maxFftSize = 512;
+    const float patchSize = 16.f;
+    const float windSpeed = 6.f;
+    const float phillipsAmplitude = 0.001f;
+    const float choppiness = 1.f;
+    // Grid meshes
+    const uint16_t gridSize = 255;
+    const float gridScale = 32.f;
+    const uint16_t screenGridColumns = 192;
+    const uint16_t screenGridRows = 108;
+    const uint32_t maxPulledGridSize = 4095;
+    // CPU height queries
+    const uint32_t probeGridSize = 64;
+    const uint32_t probeStride = 32; // PROBE_STRIDE in heightProbe.comp
+    const uint32_t benchmarkPointCount = 1 << 20;
 
     std::unique_ptr<GridMesh> grid;
+    std::unique_ptr<GridMesh> screenGrid;
+    std::unique_ptr<GridMesh> pulledGrid;
+    std::unique_ptr<GridMesh> pulledScreenGrid;
     std::shared_ptr<magma::UniformBuffer<Seabed>> seabed;
     std::shared_ptr<magma::DynamicUniformBuffer<PhongMaterial>> material;
     std::shared_ptr<magma::aux::ColorFramebuffer> heightMap;
     std::shared_ptr<magma::ImageView> envMap;
     std::shared_ptr<magma::GraphicsPipeline> heightMapPipeline;
     std::shared_ptr<magma::GraphicsPipeline> marinePipeline;
+    std::shared_ptr<magma::StorageImage2D> spectrum;
+    std::shared_ptr<magma::StorageImage2D> waves[2];
+    std::shared_ptr<magma::StorageImage2D> displacementMap;
+    std::shared_ptr<magma::StorageImage2D> normalMap;
+    std::shared_ptr<magma::ImageView> spectrumView;
+    std::shared_ptr<magma::ImageView> wavesView[2];
+    std::shared_ptr<magma::ImageView> displacementView;
+    std::shared_ptr<magma::ImageView> normalView;
+    std::shared_ptr<magma::ComputePipeline> spectrumPipeline;
+    std::shared_ptr<magma::ComputePipeline> wavesPipeline;
+    std::shared_ptr<magma::ComputePipeline> fftRowsPipeline;
+    std::shared_ptr<magma::ComputePipeline> fftColumnsPipeline;
+    std::shared_ptr<magma::ComputePipeline> oceanMapsPipeline;
+    std::shared_ptr<magma::ComputePipeline> heightProbePipeline;
+    std::shared_ptr<magma::StorageBuffer> probeHeights;
+    std::shared_ptr<magma::DstTransferBuffer> probeReadback;
+    std::unique_ptr<SeaHeight> cpuSeaHeight;
+    std::unique_ptr<GpuTimer> gpuTimer;
     DescriptorSet hmDescriptor;
+    DescriptorSet probeDescriptor;
     DescriptorSet vtfDescriptor;
+    DescriptorSet oceanDescriptor;
+    DescriptorSet fftDescriptors[2];
 
     const float seaDepth = -5.;
     const rapid::plane seabedPlane = rapid::plane(0.f, 1.f, 0.f, -seaDepth);
     bool wireframe = false;
+    bool fftOcean = false;
+    bool projectedGrid = false;
+    bool vertexPulling = false;
+    bool sobelNormals = false;
+    uint32_t fftSize = 256;
+    bool maxFftSizeSupported = false;
 
 public:
     explicit Seascape(const AppEntry& entry):
         GraphicsApp(entry, TEXT("Seascape"), 1280, 720, true)
-    {
+    {   // Workgroup transforms a line of FFT with ping-pong buffer of two lines in shared memory
+        const VkPhysicalDeviceLimits limits = physicalDevice->getProperties().limits;
+        maxFftSizeSupported = (limits.maxComputeWorkGroupSize[0] >= maxFftSize/2) &&
+            (limits.maxComputeWorkGroupInvocations >= maxFftSize/2) &&
+            (limits.maxComputeSharedMemorySize >= maxFftSize * 2 * 4 * sizeof(float));
         createTransformBuffer(1);
         setupViewProjection();
         setupMaterials();
         createHeightmapFramebuffer();
+        createOceanImages();
         createUniformBuffer();
+        createProbeBuffers();
         createGridMesh();
+        printCacheStats(grid.get());
         loadEnvMap();
         setupDescriptorSets();
         setupGraphicsPipelines();
+        setupComputePipelines();
+        computeOceanSpectrum();
+        cpuSeaHeight = std::make_unique<SeaHeight>(getSeaParameters());
+        // Check CPU port against height map at fixed probe points before time starts running
+        magma::helpers::mapScoped<SysUniforms>(sysUniforms,
+            [](auto *sys)
+            {
+                sys->time = 0.f;
+            });
+        std::cout << "CPU port of sea height " << (compareSeaHeight() ? "passed" : "failed") << " GPU check" << std::endl;
+        gpuTimer = std::make_unique<GpuTimer>(commandPools[0],
+            std::vector<std::string>{"Procedural height map", "FFT ocean", "Marine"});
 
         renderScene(drawCmdBuffer);
         blit(msaaFramebuffer->getColorView(), FrontBuffer);
@@ -62,6 +160,7 @@ public:
 
     virtual void render(uint32_t bufferIndex) override
     {
+        gpuTimer->update();
         updateSysUniforms();
         updateTransforms();
         submitCommandBuffers(bufferIndex);
@@ -76,6 +175,63 @@ public:
             setupGraphicsPipelines();
             renderScene(drawCmdBuffer);
             break;
+        case AppKey::Enter:
+            projectedGrid = !projectedGrid;
+            printGridStats();
+            setupGraphicsPipelines();
+            renderScene(drawCmdBuffer);
+            break;
+        case AppKey::Home:
+            vertexPulling = !vertexPulling;
+            printGridStats();
+            setupGraphicsPipelines();
+            renderScene(drawCmdBuffer);
+            break;
+        case AppKey::PgUp:
+        case AppKey::PgDn:
+            if (vertexPulling && !projectedGrid)
+            {   // Pulled grid isn't limited by 16-bit indices
+                const uint32_t size = pulledGrid->getRows() + 1;
+                const uint32_t newSize = (AppKey::PgUp == key) ? size * 2 : size/2;
+                if ((newSize >= 64) && (newSize <= maxPulledGridSize + 1))
+                {
+                    pulledGrid = std::make_unique<GridMesh>(newSize - 1, newSize - 1, gridScale);
+                    printGridStats();
+                    setupGraphicsPipelines();
+                    renderScene(drawCmdBuffer);
+                }
+            }
+            break;
+        case AppKey::End:
+            sobelNormals = !sobelNormals;
+            std::cout << (sobelNormals ? "Sobel filter of height map per fragment" : "Normals from height map pass") << std::endl;
+            setupGraphicsPipelines();
+            renderScene(drawCmdBuffer);
+            break;
+        case '1':
+            benchmarkSeaHeight();
+            break;
+        case '2':
+            compareSeaHeight();
+            break;
+        case '3':
+            if (fftOcean && maxFftSizeSupported)
+            {   // 512x512 line fills 16 KB of shared memory, which is the minimum guaranteed limit
+                fftSize = (fftSize < maxFftSize) ? maxFftSize : maxFftSize/2;
+                std::cout << "FFT ocean " << fftSize << "x" << fftSize << std::endl;
+                createOceanImages();
+                updateOceanDescriptors();
+                setupComputePipelines();
+                computeOceanSpectrum();
+                renderScene(drawCmdBuffer);
+            }
+            break;
+        case AppKey::Tab:
+            fftOcean = !fftOcean;
+            std::cout << (fftOcean ? "FFT ocean" : "Procedural height map") << std::endl;
+            setupGraphicsPipelines();
+            renderScene(drawCmdBuffer);
+            break;
         }
         GraphicsApp::onKeyDown(key, repeat, flags);
     }
@@ -144,21 +300,96 @@ public:
     }
 
     void createHeightmapFramebuffer()
-    {
-        constexpr VkFormat format = VK_FORMAT_R16_SFLOAT;
+    {   // Height and normal
+        constexpr VkFormat format = VK_FORMAT_R16G16B16A16_SFLOAT;
         constexpr VkExtent2D extent{2048, 2048};
 		constexpr bool clearOp = false;
         heightMap = std::make_shared<magma::aux::ColorFramebuffer>(device, format, extent, clearOp);
     }
 
+    void createOceanImages()
+    {
+        const VkExtent2D extent{fftSize, fftSize};
+        spectrum = std::make_shared<magma::StorageImage2D>(device, VK_FORMAT_R32G32B32A32_SFLOAT, extent, 1);
+        spectrumView = std::make_shared<magma::ImageView>(spectrum);
+        for (uint32_t i = 0; i < 2; ++i)
+        {
+            waves[i] = std::make_shared<magma::StorageImage2D>(device, VK_FORMAT_R32G32B32A32_SFLOAT, extent, 1);
+            wavesView[i] = std::make_shared<magma::ImageView>(waves[i]);
+        }
+        displacementMap = std::make_shared<magma::StorageImage2D>(device, VK_FORMAT_R16G16B16A16_SFLOAT, extent, 1);
+        displacementView = std::make_shared<magma::ImageView>(displacementMap);
+        normalMap = std::make_shared<magma::StorageImage2D>(device, VK_FORMAT_R16G16B16A16_SFLOAT, extent, 1);
+        normalView = std::make_shared<magma::ImageView>(normalMap);
+        magma::helpers::executeCommandBuffer(commandPools[0],
+            [this](std::shared_ptr<magma::CommandBuffer> cmdBuffer)
+            {   // Perform transition from undefined to general image layout
+                for (auto& image : {spectrum, waves[0], waves[1], displacementMap, normalMap})
+                {
+                    const magma::ImageSubresourceRange subresourceRange(image);
+                    cmdBuffer->pipelineBarrier(VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                        magma::ImageMemoryBarrier(image, VK_IMAGE_LAYOUT_GENERAL, subresourceRange));
+                }
+            });
+    }
+
     void createUniformBuffer()
     {
         seabed = std::make_shared<magma::UniformBuffer<Seabed>>(device);
     }
 
+    void createProbeBuffers()
+    {
+        const VkDeviceSize size = probeGridSize * probeGridSize * sizeof(float);
+        probeHeights = std::make_shared<magma::StorageBuffer>(device, size);
+        probeReadback = std::make_shared<magma::DstTransferBuffer>(device, size);
+    }
+
     void createGridMesh()
     {
-        grid = std::make_unique<GridMesh>(255, 255, 32.f, cmdCopyBuf);
+        grid = std::make_unique<GridMesh>(gridSize, gridSize, gridScale, cmdCopyBuf);
+        // Covers [-1, 1] range of screen
+        screenGrid = std::make_unique<GridMesh>(screenGridRows, screenGridColumns, 2.f, cmdCopyBuf);
+        pulledGrid = std::make_unique<GridMesh>(uint32_t(gridSize), uint32_t(gridSize), gridScale);
+        pulledScreenGrid = std::make_unique<GridMesh>(uint32_t(screenGridRows), uint32_t(screenGridColumns), 2.f);
+    }
+
+    GridMesh *activeGrid() const noexcept
+    {
+        if (projectedGrid)
+            return vertexPulling ? pulledScreenGrid.get() : screenGrid.get();
+        return vertexPulling ? pulledGrid.get() : grid.get();
+    }
+
+    void printGridStats() const
+    {
+        const GridMesh *mesh = activeGrid();
+        if (projectedGrid)
+        {
+            std::cout << "Projected grid: " << mesh->getVertexCount() << " vertices, spacing "
+                << width * 1.1f/mesh->getColumns() << "x" << height * 1.1f/mesh->getRows() << " pixels"
+                << ", up to " << viewProj->getFarZ() << " units from the eye";
+        }
+        else
+        {
+            std::cout << "Fixed grid: " << mesh->getVertexCount() << " vertices, spacing "
+                << gridScale/mesh->getColumns() << " units over " << gridScale << "x" << gridScale << " units";
+        }
+        // Pulled grid shades row boundaries twice, but doesn't fetch any vertex attributes
+        std::cout << (mesh->pulled() ? ", pulled from vertex index" : ", indexed") << ", "
+            << mesh->getMemorySize()/1024.f << " KB of buffers" << std::endl;
+        if (!mesh->pulled())
+            printCacheStats(mesh);
+    }
+
+    void printCacheStats(const GridMesh *mesh) const
+    {
+        const auto& strip = mesh->getStripCacheStatistics();
+        const auto& optimized = mesh->getCacheStatistics();
+        std::cout << "Vertex cache: ACMR " << strip.acmr << " -> " << optimized.acmr
+            << ", ATVR " << strip.atvr << " -> " << optimized.atvr << std::endl;
+        std::cout << "Index memory: " << mesh->getStripIndexCount() * sizeof(uint16_t)/1024.f << " KB -> "
+            << mesh->getIndexCount() * sizeof(uint16_t)/1024.f << " KB" << std::endl;
     }
 
     void loadEnvMap()
@@ -186,7 +417,9 @@ public:
                 FragmentStageBinding(3, DynamicUniformBuffer(1)), // material
                 FragmentStageBinding(4, UniformBuffer(1)), // seabed
                 VertexFragmentStageBinding(5, CombinedImageSampler(1)), // heightmap
-                FragmentStageBinding(6, CombinedImageSampler(1)) // envmap
+                FragmentStageBinding(6, CombinedImageSampler(1)), // envmap
+                VertexStageBinding(7, CombinedImageSampler(1)), // displacement map
+                FragmentStageBinding(8, CombinedImageSampler(1)) // normal map
             }));
         vtfDescriptor.set = descriptorPool->allocateDescriptorSet(vtfDescriptor.layout);
         vtfDescriptor.set->writeDescriptor(0, transforms);
@@ -196,19 +429,72 @@ public:
         vtfDescriptor.set->writeDescriptor(4, seabed);
         vtfDescriptor.set->writeDescriptor(5, heightMap->getColorView(), nearestClampToEdge);
         vtfDescriptor.set->writeDescriptor(6, envMap, anisotropicClampToEdge);
+        // 3. FFT ocean
+        oceanDescriptor.layout = std::shared_ptr<magma::DescriptorSetLayout>(new magma::DescriptorSetLayout(device,
+            {
+                ComputeStageBinding(0, StorageImage(1)), // spectrum
+                ComputeStageBinding(1, StorageImage(1)),
+                ComputeStageBinding(2, StorageImage(1)),
+                ComputeStageBinding(3, StorageImage(1)), // displacement map
+                ComputeStageBinding(4, StorageImage(1)), // normal map
+                ComputeStageBinding(5, UniformBuffer(1))
+            }));
+        oceanDescriptor.set = descriptorPool->allocateDescriptorSet(oceanDescriptor.layout);
+        oceanDescriptor.set->writeDescriptor(5, sysUniforms);
+        // 4. Height probes
+        probeDescriptor.layout = std::shared_ptr<magma::DescriptorSetLayout>(new magma::DescriptorSetLayout(device,
+            {
+                ComputeStageBinding(0, CombinedImageSampler(1)), // heightmap
+                ComputeStageBinding(1, StorageBuffer(1))
+            }));
+        probeDescriptor.set = descriptorPool->allocateDescriptorSet(probeDescriptor.layout);
+        probeDescriptor.set->writeDescriptor(0, heightMap->getColorView(), nearestClampToEdge);
+        probeDescriptor.set->writeDescriptor(1, probeHeights);
+        for (uint32_t i = 0; i < 2; ++i)
+        {
+            fftDescriptors[i].layout = std::make_shared<magma::DescriptorSetLayout>(device,
+                ComputeStageBinding(0, StorageImage(1)));
+            fftDescriptors[i].set = descriptorPool->allocateDescriptorSet(fftDescriptors[i].layout);
+        }
+        updateOceanDescriptors();
     }
 
-    std::shared_ptr<magma::Specialization> createSpecialization()
+    void updateOceanDescriptors()
+    {   // Ocean images are recreated when FFT size changes
+        vtfDescriptor.set->writeDescriptor(7, displacementView, bilinearRepeat);
+        vtfDescriptor.set->writeDescriptor(8, normalView, bilinearRepeat);
+        oceanDescriptor.set->writeDescriptor(0, spectrumView, nullptr);
+        oceanDescriptor.set->writeDescriptor(1, wavesView[0], nullptr);
+        oceanDescriptor.set->writeDescriptor(2, wavesView[1], nullptr);
+        oceanDescriptor.set->writeDescriptor(3, displacementView, nullptr);
+        oceanDescriptor.set->writeDescriptor(4, normalView, nullptr);
+        for (uint32_t i = 0; i < 2; ++i)
+            fftDescriptors[i].set->writeDescriptor(0, wavesView[i], nullptr);
+    }
+
+    SeaHeight::Parameters getSeaParameters() const
     {
         const float ratio = heightMap->getExtent().width/64.f;
-        const SeaConstants constants = {
-            1.f/heightMap->getExtent().width,
-            1.f/heightMap->getExtent().height,
+        return SeaHeight::Parameters{
             seaHeight,
             seaChoppy,
             seaSpeed/ratio,
             seaFrequency * ratio
         };
+    }
+
+    std::shared_ptr<magma::Specialization> createSpecialization()
+    {
+        const SeaHeight::Parameters sea = getSeaParameters();
+        const SeaConstants constants = {
+            1.f/heightMap->getExtent().width,
+            1.f/heightMap->getExtent().height,
+            sea.height,
+            sea.choppy,
+            sea.speed,
+            sea.frequency,
+            10.f // Normal strength
+        };
         return std::make_shared<magma::Specialization>(constants,
             std::initializer_list<magma::SpecializationEntry>
             {
@@ -217,23 +503,69 @@ public:
                 {2, &SeaConstants::height},
                 {3, &SeaConstants::choppy},
                 {4, &SeaConstants::speed},
-                {5, &SeaConstants::frequency}
+                {5, &SeaConstants::frequency},
+                {6, &SeaConstants::normalStrength}
             });
     }
 
+    std::shared_ptr<magma::Specialization> createOceanSpecialization(bool vertical) const
+    {
+        const OceanConstants constants = {
+            fftSize,
+            patchSize,
+            windSpeed,
+            phillipsAmplitude,
+            choppiness,
+            fftSize/2, // Thread per butterfly
+            vertical ? VK_TRUE : VK_FALSE
+        };
+        return std::shared_ptr<magma::Specialization>(new magma::Specialization(constants,
+            {
+                {6, &OceanConstants::fftSize},
+                {7, &OceanConstants::patchSize},
+                {8, &OceanConstants::windSpeed},
+                {9, &OceanConstants::amplitude},
+                {10, &OceanConstants::choppiness},
+                {11, &OceanConstants::groupSize},
+                {12, &OceanConstants::vertical}
+            }));
+    }
+
     void setupGraphicsPipelines()
     {
         auto specialization = createSpecialization();
         heightMapPipeline = createFullscreenPipeline("quad.o", "heightmap.o", std::move(specialization),
             hmDescriptor.layout, heightMap);
 
+        const GridMesh *mesh = activeGrid();
+        const MarineConstants constants = {
+            fftOcean ? VK_TRUE : VK_FALSE,
+            projectedGrid ? VK_TRUE : VK_FALSE,
+            viewProj->getFarZ(),
+            patchSize,
+            mesh->getColumns(),
+            mesh->getRows(),
+            mesh->getScale(),
+            sobelNormals ? VK_TRUE : VK_FALSE
+        };
+        auto marineSpecialization = std::shared_ptr<magma::Specialization>(new magma::Specialization(constants,
+            {
+                {0, &MarineConstants::fftOcean},
+                {1, &MarineConstants::projectedGrid},
+                {2, &MarineConstants::maxDistance},
+                {7, &MarineConstants::patchSize},
+                {13, &MarineConstants::gridColumns},
+                {14, &MarineConstants::gridRows},
+                {15, &MarineConstants::gridScale},
+                {16, &MarineConstants::sobelNormals}
+            }));
         auto pipelineLayout = std::make_shared<magma::PipelineLayout>(vtfDescriptor.layout);
         marinePipeline = std::make_shared<magma::GraphicsPipeline>(device,
             std::vector<magma::PipelineShaderStage>{
-                loadShaderStage("displace.o"),
-                loadShaderStage("marine.o")},
-            magma::renderstates::pos2h,
-            magma::renderstates::triangleStripRestart,
+                loadShaderStage(mesh->pulled() ? "displacePulled.o" : "displace.o", marineSpecialization),
+                loadShaderStage("marine.o", marineSpecialization)},
+            mesh->getVertexInput(),
+            mesh->getInputAssembly(),
             magma::TesselationState(),
             magma::ViewportState(0.f, 0.f, msaaFramebuffer->getExtent()),
             wireframe ? magma::renderstates::lineCullBackCW : magma::renderstates::fillCullBackCW,
@@ -247,11 +579,135 @@ public:
             nullptr, nullptr, 0);
     }
 
+    void setupComputePipelines()
+    {
+        spectrumPipeline = createComputePipeline("oceanSpectrum.o", createOceanSpecialization(false), oceanDescriptor.layout);
+        wavesPipeline = createComputePipeline("oceanWaves.o", createOceanSpecialization(false), oceanDescriptor.layout);
+        fftRowsPipeline = createComputePipeline("oceanFft.o", createOceanSpecialization(false), fftDescriptors[0].layout);
+        fftColumnsPipeline = createComputePipeline("oceanFft.o", createOceanSpecialization(true), fftDescriptors[0].layout);
+        oceanMapsPipeline = createComputePipeline("oceanMaps.o", createOceanSpecialization(false), oceanDescriptor.layout);
+        heightProbePipeline = createComputePipeline("heightProbe.o", nullptr, probeDescriptor.layout);
+    }
+
+    void computeOceanSpectrum()
+    {   // Initial spectrum doesn't depend on time
+        magma::helpers::executeCommandBuffer(commandPools[0],
+            [this](std::shared_ptr<magma::CommandBuffer> cmdBuffer)
+            {
+                cmdBuffer->bindPipeline(spectrumPipeline);
+                cmdBuffer->bindDescriptorSet(spectrumPipeline, oceanDescriptor.set);
+                cmdBuffer->dispatch(fftSize/8, fftSize/8, 1);
+            });
+    }
+
+    void benchmarkSeaHeight() const
+    {   // Random query points over the whole height map
+        std::mt19937 rng(benchmarkPointCount);
+        std::uniform_real_distribution<float> dist(0.f, 1.f);
+        std::vector<float> u(benchmarkPointCount), v(benchmarkPointCount);
+        for (uint32_t i = 0; i < benchmarkPointCount; ++i)
+        {
+            u[i] = dist(rng);
+            v[i] = dist(rng);
+        }
+        std::vector<float> reference(benchmarkPointCount), heights(benchmarkPointCount);
+        const float time = 1.f;
+        auto measure = [&](const std::string& name, std::vector<float>& result, bool simd, bool threaded)
+        {
+            const auto start = std::chrono::high_resolution_clock::now();
+            cpuSeaHeight->evaluate(u.data(), v.data(), result.data(), benchmarkPointCount, time, simd, threaded);
+            const std::chrono::duration<double> seconds = std::chrono::high_resolution_clock::now() - start;
+            std::cout << name << ": " << benchmarkPointCount/seconds.count() * 1e-6 << " Mpoints/s" << std::endl;
+        };
+        measure("Scalar", reference, false, false);
+        if (!cpuSeaHeight->avx2Supported())
+        {
+            std::cout << "AVX2 isn't supported" << std::endl;
+            return;
+        }
+        measure("AVX2", heights, true, false);
+        measure("AVX2, " + std::to_string(cpuSeaHeight->getThreadCount()) + " threads", heights, true, true);
+        float maxError = 0.f;
+        for (uint32_t i = 0; i < benchmarkPointCount; ++i)
+            maxError = std::max(maxError, fabsf(heights[i] - reference[i]));
+        std::cout << "Max difference between scalar and AVX2: " << maxError << std::endl;
+    }
+
+    bool compareSeaHeight()
+    {   // Current time is already in uniform buffer
+        float time = 0.f;
+        magma::helpers::mapScoped<SysUniforms>(sysUniforms,
+            [&time](auto *sys)
+            {
+                time = sys->time;
+            });
+        magma::helpers::executeCommandBuffer(commandPools[0],
+            [this](std::shared_ptr<magma::CommandBuffer> cmdBuffer)
+            {
+                cmdBuffer->beginRenderPass(heightMap->getRenderPass(), heightMap->getFramebuffer());
+                {
+                    cmdBuffer->bindPipeline(heightMapPipeline);
+                    cmdBuffer->bindDescriptorSet(heightMapPipeline, hmDescriptor.set);
+                    cmdBuffer->draw(4, 0);
+                }
+                cmdBuffer->endRenderPass();
+                cmdBuffer->pipelineBarrier(VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                    magma::MemoryBarrier(VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT));
+                cmdBuffer->bindPipeline(heightProbePipeline);
+                cmdBuffer->bindDescriptorSet(heightProbePipeline, probeDescriptor.set);
+                cmdBuffer->dispatch(probeGridSize/8, probeGridSize/8, 1);
+                cmdBuffer->pipelineBarrier(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                    magma::MemoryBarrier(VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT));
+                cmdBuffer->copyBuffer(probeHeights, probeReadback);
+            });
+        // Probe at the center of texel, as gl_FragCoord in height map pass
+        const float invSize = 1.f/heightMap->getExtent().width;
+        std::vector<float> u, v;
+        for (uint32_t y = 0; y < probeGridSize; ++y)
+        {
+            for (uint32_t x = 0; x < probeGridSize; ++x)
+            {
+                u.push_back((x * probeStride + probeStride/2 + 0.5f) * invSize);
+                v.push_back((y * probeStride + probeStride/2 + 0.5f) * invSize);
+            }
+        }
+        std::vector<float> heights(u.size());
+        cpuSeaHeight->evaluate(u.data(), v.data(), heights.data(), heights.size(), time);
+        bool match = false;
+        magma::helpers::mapScoped<float>(probeReadback,
+            [&heights, &match](const float *gpuHeights)
+            {   // Height map is stored in half float. sinhash() amplifies difference
+                // of sin() between GPU and CPU, so few lattice points may not match.
+                constexpr float tolerance = 0.01f;
+                constexpr float minMatchRatio = 0.99f;
+                float maxError = 0.f, sumError = 0.f;
+                size_t matchCount = 0;
+                for (size_t i = 0; i < heights.size(); ++i)
+                {
+                    const float error = fabsf(heights[i] - gpuHeights[i]);
+                    maxError = std::max(maxError, error);
+                    sumError += error;
+                    if (error <= tolerance)
+                        ++matchCount;
+                }
+                const float matchRatio = matchCount/float(heights.size());
+                match = (matchRatio >= minMatchRatio);
+                std::cout << "CPU vs GPU height: max error " << maxError << ", mean error " << sumError/heights.size()
+                    << ", " << matchRatio * 100.f << "% within " << tolerance
+                    << (match ? " (match)" : " (mismatch)") << std::endl;
+            });
+        return match;
+    }
+
     void renderScene(std::shared_ptr<magma::CommandBuffer> cmdBuffer)
     {
         cmdBuffer->begin();
         {
-            heightMapPass(cmdBuffer);
+            gpuTimer->reset(cmdBuffer);
+            if (fftOcean)
+                fftOceanPass(cmdBuffer);
+            else
+                heightMapPass(cmdBuffer);
             marinePass(cmdBuffer);
         }
         cmdBuffer->end();
@@ -259,6 +715,7 @@ public:
 
     void heightMapPass(std::shared_ptr<magma::CommandBuffer> cmdBuffer)
     {
+        gpuTimer->begin(cmdBuffer, HeightMapPass);
         cmdBuffer->beginRenderPass(heightMap->getRenderPass(), heightMap->getFramebuffer());
         {
             cmdBuffer->bindPipeline(heightMapPipeline);
@@ -266,10 +723,41 @@ public:
             cmdBuffer->draw(4, 0);
         }
         cmdBuffer->endRenderPass();
+        gpuTimer->end(cmdBuffer, HeightMapPass);
+    }
+
+    void fftOceanPass(std::shared_ptr<magma::CommandBuffer> cmdBuffer)
+    {
+        const magma::MemoryBarrier computeBarrier(VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+        gpuTimer->begin(cmdBuffer, FftOceanPass);
+        // Previous frame should finish reading of ocean maps
+        cmdBuffer->pipelineBarrier(VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            magma::MemoryBarrier(VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_SHADER_WRITE_BIT));
+        cmdBuffer->bindPipeline(wavesPipeline);
+        cmdBuffer->bindDescriptorSet(wavesPipeline, oceanDescriptor.set);
+        cmdBuffer->dispatch(fftSize/8, fftSize/8, 1);
+        for (auto& pipeline : {fftRowsPipeline, fftColumnsPipeline})
+        {   // Workgroup per line
+            cmdBuffer->pipelineBarrier(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, computeBarrier);
+            cmdBuffer->bindPipeline(pipeline);
+            for (const DescriptorSet& descriptor : fftDescriptors)
+            {
+                cmdBuffer->bindDescriptorSet(pipeline, descriptor.set);
+                cmdBuffer->dispatch(fftSize, 1, 1);
+            }
+        }
+        cmdBuffer->pipelineBarrier(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, computeBarrier);
+        cmdBuffer->bindPipeline(oceanMapsPipeline);
+        cmdBuffer->bindDescriptorSet(oceanMapsPipeline, oceanDescriptor.set);
+        cmdBuffer->dispatch(fftSize/8, fftSize/8, 1);
+        cmdBuffer->pipelineBarrier(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+            magma::MemoryBarrier(VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT));
+        gpuTimer->end(cmdBuffer, FftOceanPass);
     }
 
     void marinePass(std::shared_ptr<magma::CommandBuffer> cmdBuffer)
     {
+        gpuTimer->begin(cmdBuffer, MarinePass);
         cmdBuffer->beginRenderPass(msaaFramebuffer->getRenderPass(), msaaFramebuffer->getFramebuffer(),
             {
                 magma::clears::whiteColor,
@@ -282,9 +770,10 @@ public:
                     transforms->getDynamicOffset(0),
                     material->getDynamicOffset(0)
                 });
-            grid->draw(cmdBuffer);
+            activeGrid()->draw(cmdBuffer);
         }
         cmdBuffer->endRenderPass();
+        gpuTimer->end(cmdBuffer, MarinePass);
     }
 };
 
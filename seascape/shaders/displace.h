@@ -0,0 +1,46 @@
+#include "common/transforms.h"
+#include "projectedGrid.h"
+
+layout(constant_id = 0) const bool c_fftOcean = false;
+layout(constant_id = 1) const bool c_projectedGrid = false;
+layout(constant_id = 2) const float c_maxDistance = 100.;
+layout(constant_id = 7) const float c_patchSize = 16.;
+
+layout(binding = 5) uniform sampler2D heightMap;
+layout(binding = 7) uniform sampler2D displacementMap;
+
+layout(location = 0) out vec3 oViewPos;
+layout(location = 1) out vec2 oTexCoord;
+out gl_PerVertex {
+    vec4 gl_Position;
+};
+
+// gridPos is X, Z of grid mesh or screen position of projected grid
+void displace(vec2 gridPos)
+{
+    vec2 pos = gridPos;
+    if (c_projectedGrid)
+    {   // Water plane is invariant to world rotation around Y
+        vec3 worldPos = projectOnWater(gridPos, c_maxDistance);
+        pos = (worldInv * vec4(worldPos, 1.)).xz;
+    }
+    vec2 texCoord;
+    vec4 position;
+    if (c_fftOcean)
+    {   // FFT patch is tiled over the grid
+        texCoord = pos.xy/c_patchSize;
+        vec3 disp = textureLod(displacementMap, texCoord, 0).xyz;
+        position = vec4(pos.x + disp.x, disp.y, pos.y + disp.z, 1.);
+    }
+    else
+    {
+        const float gridScale = 32.;
+        texCoord = pos.xy/gridScale + 0.5;
+        // fetch value from height map
+        float h = textureLod(heightMap, c_projectedGrid ? mirrorRepeat(texCoord) : texCoord, 0).x;
+        position = vec4(pos.x, h, pos.y, 1.);
+    }
+    oViewPos = (worldView * position).xyz;
+    oTexCoord = texCoord;
+    gl_Position = worldViewProj * position;
+}
@@ -0,0 +1,13 @@
+#version 450
+#extension GL_GOOGLE_include_directive : enable
+#include "displace.h"
+#include "gridVertex.h"
+
+layout(constant_id = 13) const uint c_gridColumns = 1;
+layout(constant_id = 14) const uint c_gridRows = 1;
+layout(constant_id = 15) const float c_gridScale = 1.;
+
+void main()
+{
+    displace(gridVertex(c_gridColumns, c_gridRows, c_gridScale));
+}
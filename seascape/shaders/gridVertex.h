@@ -0,0 +1,8 @@
+// Grid vertex without vertex buffer. Each instance is triangle strip
+// of single row, so even vertices lie on the row and odd ones on the next.
+vec2 gridVertex(uint columns, uint rows, float scale)
+{
+    uint column = uint(gl_VertexIndex) >> 1;
+    uint row = uint(gl_InstanceIndex) % rows + (uint(gl_VertexIndex) & 1u);
+    return (vec2(column, row)/vec2(columns, rows) - .5) * scale;
+}
@@ -1,6 +1,7 @@
 #version 450
 #extension GL_GOOGLE_include_directive : enable
 #include "common/noise2d.h"
+#include "common/heightNormal.h"
 
 #define ITERATIONS 5
 
@@ -10,16 +11,17 @@ layout(constant_id = 2) const float c_height = 0.;
 layout(constant_id = 3) const float c_choppy = 0.;
 layout(constant_id = 4) const float c_speed = 0.;
 layout(constant_id = 5) const float c_frequency = 0.;
+layout(constant_id = 6) const float c_strength = 10.;
 
 layout(binding = 0) uniform Sys {
     float time;
 };
 
-layout(location = 0) out float oHeight;
+layout(location = 0) out vec4 oHeightNormal; // height, object space normal
 
 float octave(vec2 uv, float choppy)
 {
-    uv += wavenoise(uv);
+    uv += wavenoise(uv); // Evaluated on CPU too, see seaHeight.cpp
     vec2 wv = 1. - abs(sin(uv));
     vec2 swv = abs(cos(uv));
     wv = mix(wv, swv, wv);
@@ -27,7 +29,7 @@ float octave(vec2 uv, float choppy)
 }
 
 // Seascape shader: https://www.shadertoy.com/view/Ms2SD1
-void main()
+float height(vec2 uv)
 {
     const mat2 octaveMat = mat2(
         1.6, 1.2,
@@ -36,17 +38,24 @@ void main()
     float amp = c_height;
     float choppy = c_choppy;
     float t = 1. + time * c_speed;
-    vec2 uv = gl_FragCoord.xy * vec2(c_invWidth, c_invHeight); // [0,1]
-
-    oHeight = 0.;
+    float h = 0.;
     for (int i = 0; i < ITERATIONS; ++i)
     {
         float d = octave((uv + t) * freq, choppy);
         d +=      octave((uv - t) * freq, choppy);
-        oHeight += d * amp;
-    	uv *= octaveMat;
+        h += d * amp;
+        uv *= octaveMat;
         freq *= 1.9;
         amp *= 0.22;
         choppy = mix(choppy, 1.0, 0.2);
     }
+    return h;
+}
+
+void main()
+{
+    vec2 texelSize = vec2(c_invWidth, c_invHeight);
+    vec2 uv = gl_FragCoord.xy * texelSize; // [0,1]
+    vec3 normal = heightNormal(uv, texelSize, c_strength);
+    oHeightNormal = vec4(height(uv), normal);
 }
@@ -6,6 +6,11 @@
 #include "common/ior.h"
 #include "brdf/schlick.h"
 #include "sobel.h"
+#include "projectedGrid.h"
+
+layout(constant_id = 0) const bool c_fftOcean = false;
+layout(constant_id = 1) const bool c_projectedGrid = false;
+layout(constant_id = 16) const bool c_sobelNormals = false;
 
 layout(binding = 2) uniform DirectionalLight {
     vec4 viewDir;
@@ -25,8 +30,9 @@ layout(binding = 4) uniform Seabed {
     vec4 viewPlane;
 } seabed;
 
-layout(binding = 5) uniform sampler2D heightMap;
+layout(binding = 5) uniform sampler2D heightMap; // height, normal
 layout(binding = 6) uniform samplerCube envMap;
+layout(binding = 8) uniform sampler2D normalMap;
 
 layout(location = 0) in vec3 viewPos;
 layout(location = 1) in vec2 texCoord;
@@ -35,10 +41,25 @@ layout(location = 0) out vec3 oColor;
 
 void main()
 {
-    // reconstruct normal from height map
-    const float strength = 10.;
-    vec3 normal = sobel(heightMap, texCoord, strength);
-	vec3 n = mat3(normalMatrix) * normal.xzy; // swap Y, Z
+    vec3 normal;
+    if (c_fftOcean)
+        normal = texture(normalMap, texCoord).xyz;
+    else
+    {
+        vec2 uv = c_projectedGrid ? mirrorRepeat(texCoord) : texCoord;
+        if (c_sobelNormals)
+        {   // reconstruct normal from height map
+            const float strength = 10.;
+            normal = sobel(heightMap, uv, strength).xzy; // swap Y, Z
+        }
+        else
+        {   // normal computed by height map pass
+            normal = texture(heightMap, uv).yzw;
+        }
+        if (c_projectedGrid)
+            normal.xz *= mirrorSign(texCoord);
+    }
+	vec3 n = normalize(mat3(normalMatrix) * normal);
 
     // calculate indicent and refracted rays
     vec3 i = normalize(viewPos);
@@ -0,0 +1,19 @@
+layout(constant_id = 6) const int c_fftSize = 256;
+layout(constant_id = 7) const float c_patchSize = 16.;
+layout(constant_id = 8) const float c_windSpeed = 6.;
+layout(constant_id = 9) const float c_amplitude = 0.001;
+layout(constant_id = 10) const float c_choppiness = 1.;
+
+const float gravity = 9.81;
+const float twoPi = 6.28318530718;
+
+// Zero frequency is in the center of spectrum
+vec2 waveVector(ivec2 texel)
+{
+    return twoPi * vec2(texel - c_fftSize/2)/c_patchSize;
+}
+
+vec2 cmul(vec2 a, vec2 b)
+{
+    return vec2(a.x * b.x - a.y * b.y, a.x * b.y + a.y * b.x);
+}
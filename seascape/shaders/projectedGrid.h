@@ -0,0 +1,31 @@
+// Projects vertex of screen space grid onto water plane y = 0
+vec3 projectOnWater(vec2 gridPos, float maxDistance)
+{
+    vec3 eyePos = viewInv[3].xyz;
+    // Camera has no roll, so horizon is horizontal line on the screen
+    vec3 forward = (viewInv * vec4(0., 0., 1., 0.)).xyz;
+    float horizonY = -1.1;
+    if (length(forward.xz) > 1e-3)
+    {
+        vec4 horizon = viewProj * vec4(normalize(forward.xz), 0., 0.).xzyw;
+        horizonY = max(horizon.y/horizon.w + 0.01, horizonY);
+    }
+    // From the bottom of the screen to the horizon, with margin for displacement
+    vec2 screenPos = vec2(gridPos.x * 1.1, mix(1.1, horizonY, gridPos.y * .5 + .5));
+    vec4 farPos = viewProjInv * vec4(screenPos, 1., 1.);
+    vec3 dir = normalize(farPos.xyz/farPos.w - eyePos);
+    float t = (dir.y < -1e-5) ? -eyePos.y/dir.y : maxDistance;
+    vec3 pos = eyePos + dir * min(t, maxDistance);
+    return vec3(pos.x, 0., pos.z);
+}
+
+// Height map is mirrored to be continuous outside of its bounds
+vec2 mirrorRepeat(vec2 uv)
+{
+    return 1. - abs(mod(uv, 2.) - 1.);
+}
+
+vec2 mirrorSign(vec2 uv)
+{
+    return step(mod(uv, 2.), vec2(1.)) * 2. - 1.;
+}
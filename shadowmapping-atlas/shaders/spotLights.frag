@@ -0,0 +1,87 @@
+#version 450
+#extension GL_GOOGLE_include_directive : enable
+#include "common/transforms.h"
+#include "brdf/phong.h"
+
+// Should match ShadowAtlasMapping::MaxLights
+#define MAX_LIGHTS 16
+
+struct SpotLight
+{
+    mat4 shadowProj; // World to atlas texture space
+    vec4 position; // w is range
+    vec4 direction; // w is cosine of outer cone angle
+    vec4 color; // w is cosine of inner cone angle
+    vec4 atlasRect; // Tile in texture space, zero size if light doesn't cast shadow
+};
+
+layout(binding = 2) uniform SpotLights {
+    SpotLight lights[MAX_LIGHTS];
+    uint lightCount;
+    float depthBias;
+};
+
+layout(binding = 3) uniform Material {
+    vec4 ambient;
+    vec4 diffuse;
+    vec4 specular;
+    float shininess;
+} surface;
+
+layout(binding = 4) uniform sampler2DShadow shadowAtlas;
+
+layout(location = 0) in vec4 worldPos;
+layout(location = 1) in vec3 viewPos;
+layout(location = 2) in vec3 viewNormal;
+
+layout(location = 0) out vec3 oColor;
+
+float atlasShadow(SpotLight light)
+{
+    if (light.atlasRect.z <= 0.)
+        return 1.;
+    vec4 shadowPos = light.shadowProj * worldPos;
+    vec3 coord = shadowPos.xyz/shadowPos.w;
+    coord.z -= depthBias;
+    // Filter footprint should stay inside of the tile
+    vec2 texel = 1./textureSize(shadowAtlas, 0);
+    vec2 minCoord = light.atlasRect.xy + texel;
+    vec2 maxCoord = light.atlasRect.xy + light.atlasRect.zw - texel;
+    const vec2 offsets[4] = vec2[](
+        vec2(-.5, -.5), vec2(.5, -.5),
+        vec2(-.5,  .5), vec2(.5,  .5));
+    float sum = 0.;
+    for (int i = 0; i < 4; ++i)
+    {
+        vec2 uv = clamp(coord.xy + offsets[i] * texel, minCoord, maxCoord);
+        sum += texture(shadowAtlas, vec3(uv, coord.z));
+    }
+    return sum * .25;
+}
+
+void main()
+{   // Lights are in world space
+    vec3 n = normalize(mat3(viewInv) * viewNormal);
+    vec3 v = normalize(viewInv[3].xyz - worldPos.xyz);
+    const vec3 ambient = vec3(.05);
+    oColor = surface.ambient.rgb * ambient;
+    for (uint i = 0; i < lightCount; ++i)
+    {
+        vec3 l = lights[i].position.xyz - worldPos.xyz;
+        float dist = length(l);
+        l /= dist;
+        float attenuation = clamp(1. - dist/lights[i].position.w, 0., 1.);
+        float cosAngle = dot(-l, lights[i].direction.xyz);
+        float cone = smoothstep(lights[i].direction.w, lights[i].color.w, cosAngle);
+        float intensity = attenuation * attenuation * cone;
+        if (intensity > 0.)
+        {
+            float shadow = atlasShadow(lights[i]);
+            oColor += phong(n, l, v,
+                vec3(0.), vec3(0.),
+                surface.diffuse.rgb, lights[i].color.rgb,
+                surface.specular.rgb, lights[i].color.rgb,
+                surface.shininess, shadow) * intensity;
+        }
+    }
+}
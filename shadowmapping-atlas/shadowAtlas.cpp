@@ -0,0 +1,49 @@
+#include <algorithm>
+#include "shadowAtlas.h"
+
+ShadowAtlas::ShadowAtlas(uint32_t atlasSize, uint32_t minTileSize):
+    atlasSize(atlasSize),
+    minTileSize(minTileSize)
+{
+    freeTiles.resize(level(minTileSize) + 1);
+    clear();
+}
+
+void ShadowAtlas::clear()
+{
+    for (auto& tiles : freeTiles)
+        tiles.clear();
+    freeTiles[0].push_back(Tile{0, 0, atlasSize});
+}
+
+ShadowAtlas::Tile ShadowAtlas::allocate(uint32_t tileSize)
+{
+    tileSize = std::min(std::max(tileSize, minTileSize), atlasSize);
+    const uint32_t target = level(tileSize);
+    // Find the smallest free tile that is large enough
+    int32_t parent = static_cast<int32_t>(target);
+    while ((parent >= 0) && freeTiles[parent].empty())
+        --parent;
+    if (parent < 0)
+        return Tile(); // Atlas is full
+    Tile tile = freeTiles[parent].back();
+    freeTiles[parent].pop_back();
+    // Split it down to requested size, keeping three quadrants free
+    for (uint32_t i = static_cast<uint32_t>(parent); i < target; ++i)
+    {
+        const uint32_t half = tile.size/2;
+        freeTiles[i + 1].push_back(Tile{tile.x + half, tile.y + half, half});
+        freeTiles[i + 1].push_back(Tile{tile.x, tile.y + half, half});
+        freeTiles[i + 1].push_back(Tile{tile.x + half, tile.y, half});
+        tile.size = half;
+    }
+    return tile;
+}
+
+uint32_t ShadowAtlas::level(uint32_t tileSize) const noexcept
+{
+    uint32_t level = 0;
+    for (uint32_t size = atlasSize; size > tileSize; size >>= 1)
+        ++level;
+    return level;
+}
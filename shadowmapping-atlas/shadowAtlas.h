@@ -0,0 +1,32 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "core/noncopyable.h"
+
+/* Quadtree allocator of square power-of-two tiles. Tiles should be
+   allocated in descending size order, then the atlas has no holes
+   until it is full. */
+
+class ShadowAtlas : public core::NonCopyable
+{
+public:
+    struct Tile
+    {
+        uint32_t x = 0;
+        uint32_t y = 0;
+        uint32_t size = 0; // Zero if tile wasn't allocated
+    };
+
+    explicit ShadowAtlas(uint32_t atlasSize, uint32_t minTileSize);
+    uint32_t getSize() const noexcept { return atlasSize; }
+    uint32_t getMinTileSize() const noexcept { return minTileSize; }
+    void clear();
+    Tile allocate(uint32_t tileSize);
+
+private:
+    uint32_t level(uint32_t tileSize) const noexcept;
+
+    const uint32_t atlasSize;
+    const uint32_t minTileSize;
+    std::vector<std::vector<Tile>> freeTiles; // Per quadtree level
+};
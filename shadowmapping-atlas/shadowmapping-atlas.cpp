@@ -0,0 +1,531 @@
+#include "graphicsApp.h"
+#include "gpuTimer.h"
+#include "colorTable.h"
+#include "quadricMesh.h"
+#include "quadric/include/cube.h"
+#include "quadric/include/sphere.h"
+#include "quadric/include/teapot.h"
+#include "quadric/include/plane.h"
+#include "shadowAtlas.h"
+
+class ShadowAtlasMapping : public GraphicsApp
+{
+    enum {
+        Cube = 0, Teapot, Sphere, Ground,
+        MaxMeshes
+    };
+
+    enum {
+        ShadowAtlasPass = 0, LightingPass,
+        MaxPasses
+    };
+
+    // Should match spotLights.frag
+    static constexpr uint32_t MaxLights = 16;
+    static constexpr uint32_t GridSize = 3;
+    static constexpr uint32_t MaxObjects = GridSize * GridSize + 1; // + ground
+
+    struct alignas(16) SpotLight
+    {
+        rapid::matrix shadowProj; // World to atlas texture space
+        rapid::float4a position; // w is range
+        rapid::float4a direction; // w is cosine of outer cone angle
+        LinearColor color; // w is cosine of inner cone angle
+        rapid::float4a atlasRect; // Tile in texture space
+    };
+
+    struct alignas(16) SpotLights
+    {
+        SpotLight lights[MaxLights];
+        uint32_t lightCount;
+        float depthBias;
+    };
+
+    std::unique_ptr<quadric::Quadric> meshes[MaxMeshes];
+    uint32_t objectMeshes[MaxObjects];
+    std::unique_ptr<LeftHandedViewProjection> spotViewProj[MaxLights];
+    LinearColor lightColors[MaxLights];
+    ShadowAtlas::Tile tiles[MaxLights];
+    std::unique_ptr<ShadowAtlas> atlasAllocator;
+    std::shared_ptr<magma::DynamicUniformBuffer<PhongMaterial>> materials;
+    std::shared_ptr<magma::DynamicUniformBuffer<rapid::matrix>> lightTransforms;
+    std::shared_ptr<magma::UniformBuffer<SpotLights>> spotLights;
+    std::shared_ptr<magma::aux::DepthFramebuffer> shadowAtlas;
+    std::shared_ptr<magma::Sampler> shadowSampler;
+    std::shared_ptr<magma::GraphicsPipeline> shadowAtlasPipeline;
+    std::shared_ptr<magma::GraphicsPipeline> lightingPipeline;
+    std::unique_ptr<GpuTimer> gpuTimer;
+    DescriptorSet smDescriptor;
+    DescriptorSet descriptor;
+
+    rapid::matrix objTransforms[MaxObjects];
+    uint32_t lightCount = MaxLights;
+    bool importanceSizes = true;
+    bool showAtlas = false;
+    float lightAngle = 0.f;
+    uint32_t frameIndex = 0;
+
+public:
+    explicit ShadowAtlasMapping(const AppEntry& entry):
+        GraphicsApp(entry, TEXT("Shadow atlas"), 1280, 720, true)
+    {
+        setupViewProjection();
+        setupTransforms();
+        setupMaterials();
+        setupSpotLights();
+        createShadowAtlas();
+        createMeshObjects();
+        setupDescriptorSets();
+        setupGraphicsPipelines();
+        gpuTimer = std::make_unique<GpuTimer>(commandPools[0],
+            std::vector<std::string>{"Shadow atlas", "Lighting"});
+
+        updateSpotLights();
+        renderScene(drawCmdBuffer);
+        blit(msaaFramebuffer->getColorView(), FrontBuffer);
+        blit(msaaFramebuffer->getColorView(), BackBuffer);
+
+        timer->run();
+    }
+
+    virtual void render(uint32_t bufferIndex) override
+    {
+        gpuTimer->update();
+        updateTransforms();
+        updateSpotLights();
+        if (++frameIndex % 300 == 0)
+            printAtlasUsage();
+        // Tiles are repacked every frame, so viewports should be recorded again.
+        // Previous frame is flushed by VulkanApp::onPaint(), so it's safe to reuse command buffer.
+        renderScene(drawCmdBuffer);
+        submitCommandBuffers(bufferIndex);
+        std::this_thread::sleep_for(std::chrono::milliseconds(2)); // Cap fps
+    }
+
+    virtual void onKeyDown(char key, int repeat, uint32_t flags) override
+    {
+        switch (key)
+        {
+        case AppKey::Enter:
+            importanceSizes = !importanceSizes;
+            std::cout << (importanceSizes ? "Tile size from screen-space importance" : "Uniform tile size") << std::endl;
+            break;
+        case AppKey::Space:
+            showAtlas = !showAtlas;
+            break;
+        case '1': case '2': case '3': case '4':
+            lightCount = (key - '0') * 4;
+            std::cout << lightCount << " lights" << std::endl;
+            break;
+        }
+        VulkanApp::onKeyDown(key, repeat, flags);
+    }
+
+    void setupViewProjection()
+    {
+        viewProj = std::make_unique<LeftHandedViewProjection>();
+        viewProj->setPosition(0.f, 13.f, -20.f);
+        viewProj->setFocus(0.f, 0.f, 0.f);
+        viewProj->setFieldOfView(45.f);
+        viewProj->setNearZ(1.f);
+        viewProj->setFarZ(100.f);
+        viewProj->setAspectRatio(width/(float)height);
+        viewProj->updateView();
+        viewProj->updateProjection();
+
+        updateViewProjTransforms();
+    }
+
+    void setupTransforms()
+    {
+        createTransformBuffer(MaxObjects);
+        constexpr float spacing = 5.f;
+        for (uint32_t i = 0; i < GridSize * GridSize; ++i)
+        {
+            const float x = (float(i % GridSize) - 1.f) * spacing;
+            const float z = (float(i / GridSize) - 1.f) * spacing;
+            objectMeshes[i] = i % Ground;
+            switch (objectMeshes[i])
+            {
+            case Cube: objTransforms[i] = rapid::translation(x, 1.f, z); break;
+            case Teapot: objTransforms[i] = rapid::translation(x, 0.f, z); break;
+            case Sphere: objTransforms[i] = rapid::translation(x, 1.5f, z); break;
+            }
+        }
+        constexpr float bias = -0.05f; // Shift slightly down to get rid of shadow leakage
+        objectMeshes[MaxObjects - 1] = Ground;
+        objTransforms[MaxObjects - 1] = rapid::translation(0.f, bias, 0.f);
+    }
+
+    void updateTransforms()
+    {
+        const rapid::matrix rotation = rapid::rotationY(rapid::radians(-spinX/4.f));
+        std::vector<rapid::matrix, core::aligned_allocator<rapid::matrix>> transforms(MaxObjects);
+        for (uint32_t i = 0; i < MaxObjects; ++i)
+            transforms[i] = objTransforms[i] * rotation;
+        updateObjectTransforms(transforms);
+    }
+
+    void setupMaterials()
+    {
+        materials = std::make_shared<magma::DynamicUniformBuffer<PhongMaterial>>(device, MaxMeshes);
+        magma::helpers::mapScoped<PhongMaterial>(materials,
+            [this](magma::helpers::AlignedUniformArray<PhongMaterial>& materials)
+            {
+                materials[Cube].ambient = medium_sea_green;
+                materials[Cube].diffuse = medium_sea_green;
+                materials[Cube].specular = medium_sea_green;
+                materials[Cube].shininess = 2.f;
+
+                materials[Teapot].ambient = pale_golden_rod;
+                materials[Teapot].diffuse = pale_golden_rod;
+                materials[Teapot].specular = pale_golden_rod;
+                materials[Teapot].shininess = 128.f;
+
+                materials[Sphere].ambient = light_steel_blue;
+                materials[Sphere].diffuse = light_steel_blue;
+                materials[Sphere].specular = white;
+                materials[Sphere].shininess = 32.f;
+
+                materials[Ground].ambient = floral_white;
+                materials[Ground].diffuse = floral_white;
+                materials[Ground].specular = floral_white * 0.1f;
+                materials[Ground].shininess = 2.f;
+            });
+    }
+
+    void setupSpotLights()
+    {
+        const sRGBColor colors[8] = {tomato, gold, lime_green, deep_sky_blue, orchid, orange, aqua_marine, ghost_white};
+        for (uint32_t i = 0; i < MaxLights; ++i)
+        {
+            spotViewProj[i] = std::make_unique<LeftHandedViewProjection>();
+            spotViewProj[i]->setFieldOfView(70.f);
+            spotViewProj[i]->setNearZ(0.5f);
+            spotViewProj[i]->setFarZ(25.f); // Light range
+            spotViewProj[i]->setAspectRatio(1.f);
+            lightColors[i] = colors[i % 8];
+        }
+    }
+
+    void createShadowAtlas()
+    {
+        constexpr VkFormat depthFormat = VK_FORMAT_D16_UNORM;
+        constexpr VkExtent2D extent{4096, 4096};
+        constexpr uint32_t minTileSize = 64;
+        shadowAtlas = std::make_shared<magma::aux::DepthFramebuffer>(device, depthFormat, extent);
+        shadowSampler = std::make_shared<magma::DepthSampler>(device, magma::samplers::magMinNearestCompareLessOrEqual);
+        atlasAllocator = std::make_unique<ShadowAtlas>(extent.width, minTileSize);
+        lightTransforms = std::make_shared<magma::DynamicUniformBuffer<rapid::matrix>>(device, MaxLights);
+        spotLights = std::make_shared<magma::UniformBuffer<SpotLights>>(device);
+    }
+
+    uint32_t calculateTileSize(const LeftHandedViewProjection& light) const
+    {
+        constexpr uint32_t maxTileSize = 1024;
+        if (!importanceSizes)
+        {   // Split atlas evenly between lights
+            uint32_t tileSize = atlasAllocator->getSize();
+            while (tileSize > maxTileSize || (atlasAllocator->getSize()/tileSize) * (atlasAllocator->getSize()/tileSize) < lightCount)
+                tileSize >>= 1;
+            return tileSize;
+        }
+        // Bounding sphere of the cone of influence
+        const rapid::vector3 apex(light.getPosition());
+        const rapid::vector3 direction = (rapid::vector3(light.getFocus()) - apex).normalized();
+        const float range = light.getFarZ();
+        const float halfAngle = rapid::radians(light.getFieldOfView() * 0.5f);
+        const float cosHalfAngle = cosf(halfAngle);
+        // Cone wider than 90 degrees is bounded by its base, narrow one by circumsphere of apex and base rim
+        const bool wideCone = cosHalfAngle < 0.7071068f;
+        const float sphereRadius = wideCone ? range * sinf(halfAngle) : range/(2.f * cosHalfAngle);
+        const rapid::vector3 center = apex + direction * (wideCone ? range * cosHalfAngle : sphereRadius);
+        // Reject light if sphere is out of camera frustum
+        const rapid::vector3 eye(viewProj->getPosition());
+        const rapid::vector3 up(0.f, 1.f, 0.f);
+        const rapid::vector3 forward = (rapid::vector3(viewProj->getFocus()) - eye).normalized();
+        const rapid::vector3 right = (up ^ forward).normalized();
+        const rapid::vector3 cameraUp = forward ^ right;
+        const rapid::vector3 offset = center - eye;
+        const float x = offset.dot(right), y = offset.dot(cameraUp), z = offset.dot(forward);
+        const float halfFovY = rapid::radians(viewProj->getFieldOfView()) * 0.5f;
+        const float halfFovX = atanf(tanf(halfFovY) * viewProj->getAspectRatio());
+        if ((z + sphereRadius < viewProj->getNearZ()) || (z - sphereRadius > viewProj->getFarZ()) ||
+            (fabsf(x) * cosf(halfFovX) - z * sinf(halfFovX) > sphereRadius) ||
+            (fabsf(y) * cosf(halfFovY) - z * sinf(halfFovY) > sphereRadius))
+            return 0;
+        // Size of shadow texel should be close to the screen pixel, so tile size
+        // is the projected diameter of the sphere in pixels
+        const float distance = offset.length();
+        float footprint = 1.f; // Camera inside of the sphere
+        if (distance > sphereRadius)
+        {
+            const float projectedRadius = sphereRadius/sqrtf(distance * distance - sphereRadius * sphereRadius);
+            footprint = std::min(projectedRadius/tanf(halfFovY), 1.f);
+        }
+        const uint32_t desiredSize = static_cast<uint32_t>(footprint * height);
+        // Round up to power of two
+        uint32_t tileSize = atlasAllocator->getMinTileSize();
+        while (tileSize < desiredSize && tileSize < maxTileSize)
+            tileSize <<= 1;
+        return tileSize;
+    }
+
+    void packShadowAtlas()
+    {   // Allocate larger tiles first
+        uint32_t tileSizes[MaxLights];
+        uint32_t order[MaxLights];
+        for (uint32_t i = 0; i < lightCount; ++i)
+        {
+            tileSizes[i] = calculateTileSize(*spotViewProj[i]);
+            order[i] = i;
+        }
+        std::sort(order, order + lightCount,
+            [&tileSizes](uint32_t a, uint32_t b)
+            {
+                return tileSizes[a] > tileSizes[b];
+            });
+        atlasAllocator->clear();
+        for (uint32_t i = 0; i < lightCount; ++i)
+        {
+            const uint32_t light = order[i];
+            uint32_t tileSize = tileSizes[light];
+            if (!tileSize)
+            {   // Light isn't visible
+                tiles[light] = ShadowAtlas::Tile();
+                continue;
+            }
+            tiles[light] = atlasAllocator->allocate(tileSize);
+            while (!tiles[light].size && (tileSize > atlasAllocator->getMinTileSize()))
+            {   // Atlas is full, try smaller tile
+                tileSize >>= 1;
+                tiles[light] = atlasAllocator->allocate(tileSize);
+            }
+        }
+    }
+
+    void updateSpotLights()
+    {
+        constexpr float speed = 0.0002f;
+        lightAngle += timer->millisecondsElapsed() * speed;
+        for (uint32_t i = 0; i < MaxLights; ++i)
+        {   // Two rings of lights rotating in opposite directions
+            const bool outer = (i % 2) != 0;
+            const float angle = rapid::constants::twoPi * i/MaxLights + (outer ? -lightAngle : lightAngle);
+            const float radius = outer ? 14.f : 8.f;
+            const float height = outer ? 9.f : 6.f;
+            const float focusRadius = radius * 0.4f;
+            spotViewProj[i]->setPosition(cosf(angle) * radius, height, sinf(angle) * radius);
+            spotViewProj[i]->setFocus(cosf(angle) * focusRadius, 0.f, sinf(angle) * focusRadius);
+            spotViewProj[i]->updateView();
+            spotViewProj[i]->updateProjection();
+        }
+        packShadowAtlas();
+        const float atlasSize = float(atlasAllocator->getSize());
+        const float cosOuter = cosf(rapid::radians(spotViewProj[0]->getFieldOfView() * 0.5f));
+        const float cosInner = cosf(rapid::radians(spotViewProj[0]->getFieldOfView() * 0.4f));
+        magma::helpers::mapScoped<rapid::matrix>(lightTransforms,
+            [this](magma::helpers::AlignedUniformArray<rapid::matrix>& lightTransforms)
+            {
+                for (uint32_t i = 0; i < lightCount; ++i)
+                    lightTransforms[i] = spotViewProj[i]->getViewProj();
+            });
+        magma::helpers::mapScoped(spotLights,
+            [&](auto *spotLights)
+            {
+                for (uint32_t i = 0; i < lightCount; ++i)
+                {
+                    SpotLight& light = spotLights->lights[i];
+                    const ShadowAtlas::Tile& tile = tiles[i];
+                    // (x,y) [-1,1] -> tile of atlas
+                    const float scale = 0.5f * tile.size/atlasSize;
+                    const float x = tile.x/atlasSize;
+                    const float y = tile.y/atlasSize;
+                    const rapid::matrix tileBias(
+                        scale, 0.f, 0.f, 0.f,
+                        0.f, scale, 0.f, 0.f,
+                        0.f, 0.f, 1.f, 0.f,
+                        x + scale, y + scale, 0.f, 1.f);
+                    light.shadowProj = spotViewProj[i]->getViewProj() * tileBias;
+                    const rapid::float3& position = spotViewProj[i]->getPosition();
+                    const rapid::vector3 direction = (rapid::vector3(spotViewProj[i]->getFocus()) - rapid::vector3(position)).normalized();
+                    light.position = rapid::float4a(position.x, position.y, position.z, spotViewProj[i]->getFarZ());
+                    light.direction = rapid::float4a(direction.x(), direction.y(), direction.z(), cosOuter);
+                    light.color = lightColors[i];
+                    light.color.w = cosInner;
+                    light.atlasRect = rapid::float4a(x, y, tile.size/atlasSize, tile.size/atlasSize);
+                }
+                spotLights->lightCount = lightCount;
+                spotLights->depthBias = 0.0005f;
+            });
+    }
+
+    void printAtlasUsage() const
+    {
+        uint64_t usedTexels = 0;
+        uint32_t shadowedLights = 0;
+        for (uint32_t i = 0; i < lightCount; ++i)
+        {
+            usedTexels += tiles[i].size * tiles[i].size;
+            if (tiles[i].size)
+                ++shadowedLights;
+        }
+        const uint64_t atlasTexels = uint64_t(atlasAllocator->getSize()) * atlasAllocator->getSize();
+        std::cout << "Shadow atlas: " << shadowedLights << " of " << lightCount << " lights, "
+            << usedTexels * 100 / atlasTexels << "% occupied, tiles:";
+        for (uint32_t size = atlasAllocator->getSize(); size >= atlasAllocator->getMinTileSize(); size >>= 1)
+        {
+            const uint32_t count = static_cast<uint32_t>(std::count_if(tiles, tiles + lightCount,
+                [size](const ShadowAtlas::Tile& tile) { return tile.size == size; }));
+            if (count)
+                std::cout << " " << count << "x" << size;
+        }
+        std::cout << ", " << lightCount - shadowedLights << " without shadow" << std::endl;
+    }
+
+    void createMeshObjects()
+    {
+        meshes[Cube] = std::make_unique<quadric::Cube>(cmdCopyBuf);
+        meshes[Teapot] = std::make_unique<quadric::Teapot>(16, cmdCopyBuf);
+        meshes[Sphere] = std::make_unique<quadric::Sphere>(1.5f, 64, 64, false, cmdCopyBuf);
+        meshes[Ground] = std::make_unique<quadric::Plane>(100.f, 100.f, false, cmdCopyBuf);
+        mesh::optimize(*meshes[Teapot], "Teapot", commandPools[0]);
+        mesh::optimize(*meshes[Sphere], "Sphere", commandPools[0]);
+    }
+
+    void setupDescriptorSets()
+    {
+        using namespace magma::bindings;
+        using namespace magma::descriptors;
+        // Shadow atlas shader
+        smDescriptor.layout = std::shared_ptr<magma::DescriptorSetLayout>(new magma::DescriptorSetLayout(device,
+            {
+                VertexStageBinding(0, DynamicUniformBuffer(1)),
+                VertexStageBinding(1, DynamicUniformBuffer(1))
+            }));
+        smDescriptor.set = descriptorPool->allocateDescriptorSet(smDescriptor.layout);
+        smDescriptor.set->writeDescriptor(0, transforms);
+        smDescriptor.set->writeDescriptor(1, lightTransforms);
+        // Lighting shader
+        descriptor.layout = std::shared_ptr<magma::DescriptorSetLayout>(new magma::DescriptorSetLayout(device,
+            {
+                VertexStageBinding(0, DynamicUniformBuffer(1)),
+                FragmentStageBinding(1, UniformBuffer(1)),
+                FragmentStageBinding(2, UniformBuffer(1)),
+                FragmentStageBinding(3, DynamicUniformBuffer(1)),
+                FragmentStageBinding(4, CombinedImageSampler(1))
+            }));
+        descriptor.set = descriptorPool->allocateDescriptorSet(descriptor.layout);
+        descriptor.set->writeDescriptor(0, transforms);
+        descriptor.set->writeDescriptor(1, viewProjTransforms);
+        descriptor.set->writeDescriptor(2, spotLights);
+        descriptor.set->writeDescriptor(3, materials);
+        descriptor.set->writeDescriptor(4, shadowAtlas->getDepthView(), shadowSampler);
+    }
+
+    void setupGraphicsPipelines()
+    {   // Viewport selects tile of the atlas
+        shadowAtlasPipeline = std::make_shared<magma::GraphicsPipeline>(device,
+            std::vector<magma::PipelineShaderStage>{
+                loadShaderStage("atlasShadowMap.o")
+            },
+            meshes[0]->getVertexInput(),
+            magma::renderstates::triangleList,
+            magma::TesselationState(),
+            magma::ViewportState(0.f, 0.f, shadowAtlas->getExtent()),
+            magma::renderstates::fillCullFrontCW, // Draw only back faces to get rid of shadow acne
+            magma::renderstates::dontMultisample,
+            magma::renderstates::depthLessOrEqual,
+            magma::renderstates::dontWriteRgba,
+            std::initializer_list<VkDynamicState>{VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR},
+            std::make_shared<magma::PipelineLayout>(smDescriptor.layout),
+            shadowAtlas->getRenderPass(), 0,
+            pipelineCache,
+            nullptr, nullptr, 0);
+        lightingPipeline = createCommonPipeline(
+            "transform.o", "spotLights.o",
+            meshes[0]->getVertexInput(),
+            descriptor.layout);
+    }
+
+    void renderScene(std::shared_ptr<magma::CommandBuffer> cmdBuffer)
+    {
+        cmdBuffer->begin();
+        {
+            gpuTimer->reset(cmdBuffer);
+            shadowAtlasPass(cmdBuffer);
+            lightingPass(cmdBuffer);
+        }
+        cmdBuffer->end();
+    }
+
+    void shadowAtlasPass(std::shared_ptr<magma::CommandBuffer> cmdBuffer)
+    {   // All lights are rendered in a single render pass
+        gpuTimer->begin(cmdBuffer, ShadowAtlasPass);
+        cmdBuffer->beginRenderPass(shadowAtlas->getRenderPass(), shadowAtlas->getFramebuffer(),
+            {
+                magma::clears::depthOne
+            });
+        {
+            cmdBuffer->bindPipeline(shadowAtlasPipeline);
+            for (uint32_t light = 0; light < lightCount; ++light)
+            {
+                const ShadowAtlas::Tile& tile = tiles[light];
+                if (!tile.size)
+                    continue;
+                const VkExtent2D extent{tile.size, tile.size};
+                cmdBuffer->setViewport(magma::Viewport(float(tile.x), float(tile.y), extent));
+                cmdBuffer->setScissor(magma::Scissor(int32_t(tile.x), int32_t(tile.y), extent));
+                for (uint32_t i = 0; i < MaxObjects - 1; ++i) // Ground doesn't cast shadows
+                {
+                    cmdBuffer->bindDescriptorSet(shadowAtlasPipeline, smDescriptor.set, {
+                        transforms->getDynamicOffset(i),
+                        lightTransforms->getDynamicOffset(light)
+                    });
+                    meshes[objectMeshes[i]]->draw(cmdBuffer);
+                }
+            }
+        }
+        cmdBuffer->endRenderPass();
+        gpuTimer->end(cmdBuffer, ShadowAtlasPass);
+    }
+
+    void lightingPass(std::shared_ptr<magma::CommandBuffer> cmdBuffer)
+    {
+        gpuTimer->begin(cmdBuffer, LightingPass);
+        cmdBuffer->beginRenderPass(msaaFramebuffer->getRenderPass(), msaaFramebuffer->getFramebuffer(),
+            {
+                magma::ClearColor(0.f, 0.f, 0.f, 1.0f),
+                magma::clears::depthOne
+            });
+        {
+            cmdBuffer->setViewport(magma::Viewport(0, 0, msaaFramebuffer->getExtent()));
+            cmdBuffer->setScissor(magma::Scissor(0, 0, msaaFramebuffer->getExtent()));
+            cmdBuffer->bindPipeline(lightingPipeline);
+            for (uint32_t i = 0; i < MaxObjects; ++i)
+            {
+                cmdBuffer->bindDescriptorSet(lightingPipeline, descriptor.set, {
+                    transforms->getDynamicOffset(i),
+                    materials->getDynamicOffset(objectMeshes[i])
+                });
+                meshes[objectMeshes[i]]->draw(cmdBuffer);
+            }
+            if (showAtlas)
+                drawAtlas(cmdBuffer);
+        }
+        cmdBuffer->endRenderPass();
+        gpuTimer->end(cmdBuffer, LightingPass);
+    }
+
+    void drawAtlas(std::shared_ptr<magma::CommandBuffer> cmdBuffer)
+    {
+        constexpr VkRect2D rect = VkRect2D{0, 0, 512U, 512U};
+        if (!bltRect) bltRect = std::make_unique<magma::aux::BlitRectangle>(renderPass, loadShader("linearizeDepth.o"));
+        bltRect->blit(std::move(cmdBuffer), shadowAtlas->getDepthView(), VK_FILTER_NEAREST, rect);
+    }
+};
+
+std::unique_ptr<IApplication> appFactory(const AppEntry& entry)
+{
+    return std::make_unique<ShadowAtlasMapping>(entry);
+}
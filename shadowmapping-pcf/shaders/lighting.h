@@ -0,0 +1,89 @@
+#include "common/transforms.h"
+#include "common/sRGB.h"
+#include "pcf.h"
+#include "pcfPoisson.h"
+#include "common/pcfGather.h"
+#include "moments.h"
+
+#define FILTER_GRID 0
+#define FILTER_POISSON 1
+#define FILTER_GATHER 2
+#define FILTER_MOMENTS 3
+
+layout(constant_id = 0) const int c_filter = FILTER_GRID;
+
+layout(binding = 2) uniform LightSource {
+    vec4 viewPos;
+} light;
+
+layout(binding = 3) uniform sampler2DShadow shadowMap;
+
+layout(constant_id = 4) const int c_gatherSize = 5; // 3, 5 or 7
+
+#if defined(COUNT_EARLY_EXIT)
+// Requires fragmentStoresAndAtomics feature
+layout(binding = 4) buffer Statistics {
+    uint earlyExitCount;
+    uint penumbraCount;
+};
+#endif
+
+layout(constant_id = 6) const bool c_linearMoments = true;
+
+layout(binding = 5) uniform sampler2D momentMap;
+layout(binding = 6) uniform MomentParameters {
+    vec2 lightNearFar;
+    vec2 exponents;
+    float minVariance;
+    float lightBleedingReduction;
+    float momentBias;
+};
+
+layout(location = 0) in vec4 worldPos;
+layout(location = 1) in vec3 viewPos;
+layout(location = 2) in vec3 viewNormal;
+
+layout(location = 0) out vec3 oColor;
+
+void main()
+{
+    vec3 n = normalize(viewNormal);
+    vec3 l = normalize(light.viewPos.xyz - viewPos);
+    float NdL = dot(n, l);
+
+    float shadow;
+    if (NdL <= 0.)
+        shadow = 0.;
+    else
+    {
+        vec4 clipPos = shadowProj * worldPos;
+        if (FILTER_POISSON == c_filter)
+        {
+            bool penumbra;
+            shadow = pcfPoisson(shadowMap, clipPos, penumbra);
+#if defined(COUNT_EARLY_EXIT)
+            if (penumbra)
+                atomicAdd(penumbraCount, 1);
+            else
+                atomicAdd(earlyExitCount, 1);
+#endif
+        }
+        else if (FILTER_MOMENTS == c_filter)
+        {   // Prefiltered, so single bilinear fetch is enough
+            vec2 uv = clipPos.xy/clipPos.w;
+            vec4 moments = c_linearMoments ? texture(momentMap, uv) : bilinearMoments(momentMap, uv);
+            float depth = linearLightDepth(clipPos.w, lightNearFar);
+            shadow = momentShadow(moments, depth, exponents,
+                minVariance, lightBleedingReduction, momentBias);
+        }
+        else if (FILTER_GATHER == c_filter)
+            shadow = pcfGather(shadowMap, clipPos.xyz/clipPos.w, c_gatherSize);
+        else
+            shadow = pcf(shadowMap, clipPos);
+    }
+
+    const vec3 floral_white = linear(vec3(1., 0.98, 0.941));
+    const float ambient = linear(0.16);
+
+    oColor = ambient + max(NdL, 0.) * floral_white * shadow;
+}
@@ -0,0 +1,48 @@
+#version 450
+#extension GL_GOOGLE_include_directive : enable
+#include "moments.h"
+
+#define N 9 // odd
+
+layout(constant_id = 0) const bool c_horzPass = true;
+
+// Horizontal pass reads shadow map and converts depth to moments,
+// averaging 2x2 depth texels per moment texel, vertical pass blurs moments.
+layout(binding = 0) uniform sampler2D img;
+layout(binding = 1) uniform MomentParameters {
+    vec2 lightNearFar;
+    vec2 exponents;
+    float minVariance;
+    float lightBleedingReduction;
+    float momentBias;
+};
+
+layout(location = 0) in vec4 texCoord; // u, v, du, dv
+layout(location = 0) out vec4 oMoments;
+
+void main()
+{   // Binomial approximation of Gaussian
+    const float weights[N] = float[](1., 8., 28., 56., 70., 56., 28., 8., 1.);
+    vec2 uv = texCoord.xy;
+    vec2 duv = texCoord.zw;
+    oMoments = vec4(0.);
+    for (int i = 0; i < N; ++i, uv += duv)
+    {
+        vec4 moments;
+        if (c_horzPass)
+        {   // Texel center of moment map is the corner of 2x2 depth texels
+            vec4 depths = textureGather(img, uv, 0);
+            moments = vec4(0.);
+            for (int j = 0; j < 4; ++j)
+            {
+                float viewDepth = viewDepthFromDepthBuffer(depths[j], lightNearFar);
+                moments += computeMoments(linearLightDepth(viewDepth, lightNearFar), exponents);
+            }
+            moments *= .25;
+        }
+        else
+            moments = textureLod(img, uv, 0);
+        oMoments += moments * weights[i];
+    }
+    oMoments /= 256.;
+}
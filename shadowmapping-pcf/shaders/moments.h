@@ -0,0 +1,123 @@
+#define MOMENTS_VSM 0
+#define MOMENTS_EVSM 1
+#define MOMENTS_MSM 2
+
+// Should match PcfShadowMapping::Constants
+layout(constant_id = 5) const int c_momentMethod = MOMENTS_EVSM;
+
+// Light space depth is linearized to distribute precision evenly
+float linearLightDepth(float viewDepth, vec2 nearFar)
+{
+    return clamp((viewDepth - nearFar.x)/(nearFar.y - nearFar.x), 0., 1.);
+}
+
+float viewDepthFromDepthBuffer(float depth, vec2 nearFar)
+{
+    float zn = nearFar.x, zf = nearFar.y;
+    return zn * zf/(zf - depth * (zf - zn));
+}
+
+vec2 warpDepth(float depth, vec2 exponents)
+{   // Rescale to [-1, 1]
+    depth = depth * 2. - 1.;
+    float pos = exp(exponents.x * depth);
+    float neg = -exp(-exponents.y * depth);
+    return vec2(pos, neg);
+}
+
+vec4 computeMoments(float depth, vec2 exponents)
+{
+    if (MOMENTS_EVSM == c_momentMethod)
+    {
+        vec2 warped = warpDepth(depth, exponents);
+        return vec4(warped.x, warped.x * warped.x, warped.y, warped.y * warped.y);
+    }
+    if (MOMENTS_MSM == c_momentMethod)
+    {
+        float sq = depth * depth;
+        return vec4(depth, sq, sq * depth, sq * sq);
+    }
+    return vec4(depth, depth * depth, 0., 0.);
+}
+
+float reduceLightBleeding(float pMax, float amount)
+{   // Cut off the tail of distribution
+    return clamp((pMax - amount)/(1. - amount), 0., 1.);
+}
+
+float chebyshevUpperBound(vec2 moments, float depth, float minVariance, float lightBleedingReduction)
+{
+    if (depth <= moments.x)
+        return 1.;
+    float variance = max(moments.y - moments.x * moments.x, minVariance);
+    float d = depth - moments.x;
+    float pMax = variance/(variance + d * d);
+    return reduceLightBleeding(pMax, lightBleedingReduction);
+}
+
+// Peters, Klein. Moment Shadow Mapping
+float hamburger4MSM(vec4 b, float depth, float momentBias, float lightBleedingReduction)
+{   // Bias moments towards uniform distribution to avoid numeric instability
+    b = mix(b, vec4(.5), momentBias);
+    // Cholesky decomposition of Hankel matrix
+    float l32d22 = -b.x * b.y + b.z;
+    float d22 = -b.x * b.x + b.y;
+    float squaredDepthVariance = -b.y * b.y + b.w;
+    float d33d22 = dot(vec2(squaredDepthVariance, -l32d22), vec2(d22, l32d22));
+    float invD22 = 1./d22;
+    float l32 = l32d22 * invD22;
+    // Solve linear system to find coefficients of the quadratic polynomial
+    vec3 z;
+    z.x = depth;
+    vec3 c = vec3(1., z.x, z.x * z.x);
+    c.y -= b.x;
+    c.z -= b.y + l32 * c.y;
+    c.y *= invD22;
+    c.z *= d22/d33d22;
+    c.y -= l32 * c.z;
+    c.x -= dot(c.yz, b.xy);
+    // Roots of the polynomial are support points of the distribution
+    float p = c.y/c.z;
+    float q = c.x/c.z;
+    float r = sqrt(max(p * p * .25 - q, 0.));
+    z.y = -p * .5 - r;
+    z.z = -p * .5 + r;
+    vec4 switchVal = (z.z < z.x) ? vec4(z.y, z.x, 1., 1.) :
+                    ((z.y < z.x) ? vec4(z.x, z.y, 0., 1.) : vec4(0.));
+    float quotient = (switchVal.x * z.z - b.x * (switchVal.x + z.z) + b.y)/((z.z - switchVal.y) * (z.x - z.y));
+    float shadowIntensity = clamp(switchVal.z + switchVal.w * quotient, 0., 1.);
+    return reduceLightBleeding(1. - shadowIntensity, lightBleedingReduction);
+}
+
+float momentShadow(vec4 moments, float depth, vec2 exponents,
+    float minVariance, float lightBleedingReduction, float momentBias)
+{
+    if (MOMENTS_EVSM == c_momentMethod)
+    {
+        vec2 warped = warpDepth(depth, exponents);
+        // Derivative of warping at depth gives variance scale
+        vec2 depthScale = minVariance * exponents * vec2(warped.x, -warped.y);
+        vec2 minVar = depthScale * depthScale;
+        float pos = chebyshevUpperBound(moments.xy, warped.x, minVar.x, lightBleedingReduction);
+        float neg = chebyshevUpperBound(moments.zw, warped.y, minVar.y, lightBleedingReduction);
+        return min(pos, neg);
+    }
+    if (MOMENTS_MSM == c_momentMethod)
+        return hamburger4MSM(moments, depth, momentBias, lightBleedingReduction);
+    return chebyshevUpperBound(moments.xy, depth, minVariance, lightBleedingReduction);
+}
+
+// Fallback if device can't filter 32-bit float format
+vec4 bilinearMoments(sampler2D momentMap, vec2 uv)
+{
+    ivec2 size = textureSize(momentMap, 0);
+    vec2 st = uv * size - .5;
+    ivec2 i0 = clamp(ivec2(floor(st)), ivec2(0), size - 1);
+    ivec2 i1 = min(i0 + 1, size - 1);
+    vec2 f = fract(st);
+    vec4 m00 = texelFetch(momentMap, i0, 0);
+    vec4 m10 = texelFetch(momentMap, ivec2(i1.x, i0.y), 0);
+    vec4 m01 = texelFetch(momentMap, ivec2(i0.x, i1.y), 0);
+    vec4 m11 = texelFetch(momentMap, i1, 0);
+    return mix(mix(m00, m10, f.x), mix(m01, m11, f.x), f.y);
+}
@@ -1,37 +1,53 @@
-float pcfPoisson(sampler2DShadow shadowMap, vec4 clipPos)
+#include "common/poisson8.h"
+#include "common/poisson16.h"
+#include "common/poisson32.h"
+
+// Should match PcfShadowMapping::Constants
+layout(constant_id = 1) const int c_poissonSamples = 32; // 8, 16 or 32
+layout(constant_id = 2) const bool c_earlyExit = true;
+
+// Samples on the outer radius of the kernel. If all of them agree,
+// fragment is most likely either fully lit or fully shadowed.
+const vec2 poissonRing[4] = vec2[](
+    vec2(-1.,  0.),
+    vec2( 1.,  0.),
+    vec2( 0., -1.),
+    vec2( 0.,  1.)
+);
+
+vec2 poissonSample(int i)
 {
+    if (8 == c_poissonSamples)
+        return poisson8[i];
+    if (16 == c_poissonSamples)
+        return poisson16[i];
+    return poisson32[i];
+}
+
+float pcfPoisson(sampler2DShadow shadowMap, vec4 clipPos, out bool penumbra)
+{
+    const float radius = 7.; // In texels
+    vec2 scale = radius/textureSize(shadowMap, 0) * clipPos.w;
     float sum = 0.;
-    sum += textureProjOffset(shadowMap, clipPos, ivec2(-3, 4));
-    sum += textureProjOffset(shadowMap, clipPos, ivec2(-3, -3));
-    sum += textureProjOffset(shadowMap, clipPos, ivec2(1, -5));
-    sum += textureProjOffset(shadowMap, clipPos, ivec2(4, 4));
-    sum += textureProjOffset(shadowMap, clipPos, ivec2(2, -1));
-    sum += textureProjOffset(shadowMap, clipPos, ivec2(6, 2));
-    sum += textureProjOffset(shadowMap, clipPos, ivec2(1, 5));
-    sum += textureProjOffset(shadowMap, clipPos, ivec2(-4, 1));
-    sum += textureProjOffset(shadowMap, clipPos, ivec2(-3, -6));
-    sum += textureProjOffset(shadowMap, clipPos, ivec2(-1, 1));
-    sum += textureProjOffset(shadowMap, clipPos, ivec2(3, -6));
-    sum += textureProjOffset(shadowMap, clipPos, ivec2(6, -1));
-    sum += textureProjOffset(shadowMap, clipPos, ivec2(-2, 6));
-    sum += textureProjOffset(shadowMap, clipPos, ivec2(-0, -2));
-    sum += textureProjOffset(shadowMap, clipPos, ivec2(-5, 5));
-    sum += textureProjOffset(shadowMap, clipPos, ivec2(2, 2));
-    sum += textureProjOffset(shadowMap, clipPos, ivec2(4, 1));
-    sum += textureProjOffset(shadowMap, clipPos, ivec2(3, -3));
-    sum += textureProjOffset(shadowMap, clipPos, ivec2(3, 6));
-    sum += textureProjOffset(shadowMap, clipPos, ivec2(-5, -2));
-    sum += textureProjOffset(shadowMap, clipPos, ivec2(-6, 2));
-    sum += textureProjOffset(shadowMap, clipPos, ivec2(-1, 4));
-    sum += textureProjOffset(shadowMap, clipPos, ivec2(-1, -7));
-    sum += textureProjOffset(shadowMap, clipPos, ivec2(-7, 0));
-    sum += textureProjOffset(shadowMap, clipPos, ivec2(-5, -5));
-    sum += textureProjOffset(shadowMap, clipPos, ivec2(-3, -1));
-    sum += textureProjOffset(shadowMap, clipPos, ivec2(-3, 2));
-    sum += textureProjOffset(shadowMap, clipPos, ivec2(1, 1));
-    sum += textureProjOffset(shadowMap, clipPos, ivec2(2, -2));
-    sum += textureProjOffset(shadowMap, clipPos, ivec2(1, 7));
-    sum += textureProjOffset(shadowMap, clipPos, ivec2(-1, -5));
-    sum += textureProjOffset(shadowMap, clipPos, ivec2(5, -5));
-    return sum/32.f;
+    if (c_earlyExit)
+    {
+        for (int i = 0; i < 4; ++i)
+        {
+            vec2 offset = poissonRing[i] * scale;
+            sum += textureProj(shadowMap, vec4(clipPos.xy + offset, clipPos.zw));
+        }
+        penumbra = (sum > 0.) && (sum < 4.);
+        if (!penumbra)
+            return sum * .25;
+        // Run the full kernel only in penumbra
+        sum = 0.;
+    }
+    else
+        penumbra = true;
+    for (int i = 0; i < c_poissonSamples; ++i)
+    {
+        vec2 offset = poissonSample(i) * scale;
+        sum += textureProj(shadowMap, vec4(clipPos.xy + offset, clipPos.zw));
+    }
+    return sum/float(c_poissonSamples);
 }
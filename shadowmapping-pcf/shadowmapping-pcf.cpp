@@ -1,5 +1,7 @@
 #include "graphicsApp.h"
+#include "gpuTimer.h"
 #include "colorTable.h"
+#include "quadricMesh.h"
 #include "quadric/include/cube.h"
 #include "quadric/include/sphere.h"
 #include "quadric/include/teapot.h"
@@ -12,9 +14,53 @@ class PcfShadowMapping : public GraphicsApp
         MaxObjects
     };
 
+    enum {
+        ShadowMapPass = 0, MomentsPrefilterPass, LightingPass,
+        MaxPasses
+    };
+
+    // Should match shadow.frag
+    enum {
+        GridFilter = 0, PoissonFilter, GatherFilter, MomentsFilter,
+        MaxFilters
+    };
+
+    // Should match moments.h
+    enum {
+        VsmMethod = 0, EvsmMethod, MsmMethod,
+        MaxMomentMethods
+    };
+
     struct alignas(16) Constants
     {
-        VkBool32 filterPoisson = false;
+        int32_t filter = GridFilter;
+        int32_t poissonSamples = 32;
+        VkBool32 earlyExit = true;
+        VkBool32 countEarlyExit = false;
+        int32_t gatherSize = 5;
+        int32_t momentMethod = EvsmMethod;
+        VkBool32 linearMoments = true;
+    };
+
+    struct alignas(16) BlurConstants
+    {
+        VkBool32 horzPass;
+        int32_t momentMethod;
+    };
+
+    struct alignas(16) MomentParameters
+    {
+        rapid::float2 lightNearFar;
+        rapid::float2 exponents; // EVSM positive and negative exponents
+        float minVariance;
+        float lightBleedingReduction;
+        float momentBias; // MSM
+    };
+
+    struct Statistics
+    {
+        uint32_t earlyExitCount;
+        uint32_t penumbraCount;
     };
 
     std::unique_ptr<quadric::Quadric> objects[MaxObjects];
@@ -22,12 +68,24 @@ class PcfShadowMapping : public GraphicsApp
     std::shared_ptr<magma::GraphicsPipeline> pcfShadowPipeline;
     std::shared_ptr<magma::aux::DepthFramebuffer> shadowMap;
     std::shared_ptr<magma::Sampler> shadowSampler;
+    std::shared_ptr<magma::aux::ColorFramebuffer> momentMap;
+    std::shared_ptr<magma::aux::ColorFramebuffer> tempMomentMap;
+    std::shared_ptr<magma::UniformBuffer<MomentParameters>> momentParameters;
+    std::shared_ptr<magma::GraphicsPipeline> horzBlurPipeline;
+    std::shared_ptr<magma::GraphicsPipeline> vertBlurPipeline;
+    std::shared_ptr<magma::StorageBuffer> statistics;
+    std::shared_ptr<magma::DstTransferBuffer> statisticsReadback;
+    std::unique_ptr<GpuTimer> gpuTimer;
     DescriptorSet smDescriptor;
+    DescriptorSet horzBlurDescriptor;
+    DescriptorSet vertBlurDescriptor;
     DescriptorSet descriptor;
 
     rapid::matrix objTransforms[MaxObjects];
     Constants constants;
     bool showDepthMap = false;
+    uint32_t frameIndex = 0;
+    float lightBleedingReduction = 0.2f;
 
 public:
     explicit PcfShadowMapping(const AppEntry& entry):
@@ -36,9 +94,13 @@ public:
         setupViewProjection();
         setupTransforms();
         createShadowMap();
+        createMomentMaps();
+        updateMomentParameters();
         createMeshObjects();
         setupDescriptorSets();
         setupGraphicsPipelines();
+        gpuTimer = std::make_unique<GpuTimer>(commandPools[0],
+            std::vector<std::string>{"Shadow map", "Moments prefilter", "Lighting"});
 
         renderScene(drawCmdBuffer);
         blit(msaaFramebuffer->getColorView(), FrontBuffer);
@@ -47,8 +109,11 @@ public:
 
     virtual void render(uint32_t bufferIndex) override
     {
+        gpuTimer->update();
         updateTransforms();
         submitCommandBuffers(bufferIndex);
+        if ((PoissonFilter == constants.filter) && constants.countEarlyExit && (++frameIndex % 300 == 0))
+            printStatistics(bufferIndex);
         std::this_thread::sleep_for(std::chrono::milliseconds(2)); // Cap fps
     }
 
@@ -57,10 +122,47 @@ public:
         switch (key)
         {
         case AppKey::Enter:
-            constants.filterPoisson = !constants.filterPoisson;
+            constants.filter = (constants.filter + 1) % MaxFilters;
+            printFetchCount();
             setupGraphicsPipelines();
             renderScene(drawCmdBuffer);
             break;
+        case AppKey::Tab:
+            constants.earlyExit = !constants.earlyExit;
+            std::cout << "Early exit " << (constants.earlyExit ? "on" : "off") << std::endl;
+            setupGraphicsPipelines();
+            renderScene(drawCmdBuffer);
+            break;
+        case '1': case '2': case '3':
+            if (GatherFilter == constants.filter)
+                constants.gatherSize = 3 + (key - '1') * 2;
+            else if (MomentsFilter == constants.filter)
+                constants.momentMethod = key - '1';
+            else
+                constants.poissonSamples = 8 << (key - '1');
+            printFetchCount();
+            setupGraphicsPipelines();
+            renderScene(drawCmdBuffer);
+            break;
+        case '0':
+            if (!physicalDevice->getFeatures().fragmentStoresAndAtomics)
+                break;
+            // Atomic counters are expensive, so counting is disabled when measuring timings
+            constants.countEarlyExit = !constants.countEarlyExit;
+            std::cout << "Early exit statistics " << (constants.countEarlyExit ? "on" : "off") << std::endl;
+            setupGraphicsPipelines();
+            renderScene(drawCmdBuffer);
+            break;
+        case AppKey::PgUp:
+            lightBleedingReduction = std::min(lightBleedingReduction + 0.05f, 0.95f);
+            updateMomentParameters();
+            std::cout << "Light bleeding reduction: " << lightBleedingReduction << std::endl;
+            break;
+        case AppKey::PgDn:
+            lightBleedingReduction = std::max(lightBleedingReduction - 0.05f, 0.f);
+            updateMomentParameters();
+            std::cout << "Light bleeding reduction: " << lightBleedingReduction << std::endl;
+            break;
         case AppKey::Space:
             showDepthMap = !showDepthMap;
             renderScene(drawCmdBuffer);
@@ -69,6 +171,32 @@ public:
         VulkanApp::onKeyDown(key, repeat, flags);
     }
 
+    void printFetchCount() const
+    {
+        switch (constants.filter)
+        {
+        case GridFilter:
+            std::cout << "Grid PCF 5x5: 25 fetches" << std::endl;
+            break;
+        case PoissonFilter:
+            std::cout << "Poisson PCF: 4 + " << constants.poissonSamples << " fetches" << std::endl;
+            break;
+        case GatherFilter:
+            {
+                const int32_t fetchCount = (constants.gatherSize + 1)/2;
+                std::cout << "Gather PCF " << constants.gatherSize << "x" << constants.gatherSize << ": "
+                    << fetchCount * fetchCount << " fetches" << std::endl;
+            }
+            break;
+        case MomentsFilter:
+            {
+                const char *methods[MaxMomentMethods] = {"VSM", "EVSM", "MSM"};
+                std::cout << methods[constants.momentMethod] << ": 1 fetch" << std::endl;
+            }
+            break;
+        }
+    }
+
     virtual void updateLightSource()
     {
         magma::helpers::mapScoped<LightSource>(lightSource,
@@ -135,6 +263,52 @@ public:
         constexpr VkExtent2D extent{2048, 2048};
         shadowMap = std::make_shared<magma::aux::DepthFramebuffer>(device, depthFormat, extent);
         shadowSampler = std::make_shared<magma::DepthSampler>(device, magma::samplers::magMinNearestCompareLessOrEqual);
+        statistics = std::make_shared<magma::StorageBuffer>(device, sizeof(Statistics));
+        statisticsReadback = std::make_shared<magma::DstTransferBuffer>(device, sizeof(Statistics));
+    }
+
+    void createMomentMaps()
+    {   // Moments are prefiltered, so they can have lower resolution than shadow map
+        constexpr VkFormat format = VK_FORMAT_R32G32B32A32_SFLOAT; // EVSM exponents overflow half float
+        constexpr VkExtent2D extent{1024, 1024};
+        // Linear filtering of 32-bit float formats is optional, otherwise shader does it
+        const VkFormatProperties properties = physicalDevice->getFormatProperties(format);
+        constants.linearMoments = (properties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT) ? VK_TRUE : VK_FALSE;
+        if (!constants.linearMoments)
+            std::cout << "Moment map is filtered in shader" << std::endl;
+        constexpr bool clearOp = false;
+        momentMap = std::make_shared<magma::aux::ColorFramebuffer>(device, format, extent, clearOp);
+        tempMomentMap = std::make_shared<magma::aux::ColorFramebuffer>(device, format, extent, clearOp);
+    }
+
+    void updateMomentParameters()
+    {
+        if (!momentParameters)
+            momentParameters = std::make_shared<magma::UniformBuffer<MomentParameters>>(device);
+        magma::helpers::mapScoped(momentParameters, [this](auto *parameters)
+            {
+                parameters->lightNearFar = rapid::float2(lightViewProj->getNearZ(), lightViewProj->getFarZ());
+                parameters->exponents = rapid::float2(40.f, 5.f); // Max for 32-bit float
+                parameters->minVariance = 0.00002f;
+                parameters->lightBleedingReduction = lightBleedingReduction;
+                parameters->momentBias = 0.00003f;
+            });
+    }
+
+    void printStatistics(uint32_t bufferIndex) const
+    {   // Wait until draw command buffer has copied counters to readback buffer
+        waitFences[bufferIndex]->wait();
+        magma::helpers::mapScoped<Statistics>(statisticsReadback,
+            [](Statistics *stats)
+            {
+                const uint32_t total = stats->earlyExitCount + stats->penumbraCount;
+                if (total)
+                {
+                    const float fraction = stats->earlyExitCount/float(total);
+                    std::cout << "Early exit: " << stats->earlyExitCount << " of " << total
+                        << " fragments (" << fraction * 100.f << "%)" << std::endl;
+                }
+            });
     }
 
     void createMeshObjects()
@@ -143,6 +317,8 @@ public:
         objects[Teapot] = std::make_unique<quadric::Teapot>(16, cmdCopyBuf);
         objects[Sphere] = std::make_unique<quadric::Sphere>(1.5f, 64, 64, false, cmdCopyBuf);
         objects[Ground] = std::make_unique<quadric::Plane>(100.f, 100.f, false, cmdCopyBuf);
+        mesh::optimize(*objects[Teapot], "Teapot", commandPools[0]);
+        mesh::optimize(*objects[Sphere], "Sphere", commandPools[0]);
     }
 
     void setupDescriptorSets()
@@ -160,13 +336,38 @@ public:
                 VertexStageBinding(0, DynamicUniformBuffer(1)),
                 FragmentStageBinding(1, UniformBuffer(1)),
                 FragmentStageBinding(2, UniformBuffer(1)),
-                FragmentStageBinding(3, CombinedImageSampler(1))
+                FragmentStageBinding(3, CombinedImageSampler(1)),
+                FragmentStageBinding(4, StorageBuffer(1)),
+                FragmentStageBinding(5, CombinedImageSampler(1)),
+                FragmentStageBinding(6, UniformBuffer(1))
             }));
         descriptor.set = descriptorPool->allocateDescriptorSet(descriptor.layout);
         descriptor.set->writeDescriptor(0, transforms);
         descriptor.set->writeDescriptor(1, viewProjTransforms);
         descriptor.set->writeDescriptor(2, lightSource);
         descriptor.set->writeDescriptor(3, shadowMap->getDepthView(), shadowSampler);
+        descriptor.set->writeDescriptor(4, statistics);
+        descriptor.set->writeDescriptor(5, momentMap->getColorView(),
+            constants.linearMoments ? bilinearClampToEdge : nearestClampToEdge);
+        descriptor.set->writeDescriptor(6, momentParameters);
+        // Conversion of depth to moments and horizontal blur
+        horzBlurDescriptor.layout = std::shared_ptr<magma::DescriptorSetLayout>(new magma::DescriptorSetLayout(device,
+            {
+                VertexFragmentStageBinding(0, CombinedImageSampler(1)),
+                FragmentStageBinding(1, UniformBuffer(1))
+            }));
+        horzBlurDescriptor.set = descriptorPool->allocateDescriptorSet(horzBlurDescriptor.layout);
+        horzBlurDescriptor.set->writeDescriptor(0, shadowMap->getDepthView(), nearestClampToEdge);
+        horzBlurDescriptor.set->writeDescriptor(1, momentParameters);
+        // Vertical blur
+        vertBlurDescriptor.layout = std::shared_ptr<magma::DescriptorSetLayout>(new magma::DescriptorSetLayout(device,
+            {
+                VertexFragmentStageBinding(0, CombinedImageSampler(1)),
+                FragmentStageBinding(1, UniformBuffer(1))
+            }));
+        vertBlurDescriptor.set = descriptorPool->allocateDescriptorSet(vertBlurDescriptor.layout);
+        vertBlurDescriptor.set->writeDescriptor(0, tempMomentMap->getColorView(), nearestClampToEdge);
+        vertBlurDescriptor.set->writeDescriptor(1, momentParameters);
     }
 
     void setupGraphicsPipelines()
@@ -177,27 +378,62 @@ public:
             magma::renderstates::fillCullFrontCW, // Draw only back faces to get rid of shadow acne
             smDescriptor.layout,
             shadowMap);
-        auto specialization(std::make_shared<magma::Specialization>(constants,
-            magma::SpecializationEntry(0, &Constants::filterPoisson)));
+        std::shared_ptr<magma::Specialization> specialization(new magma::Specialization(constants, {
+            {0, &Constants::filter},
+            {1, &Constants::poissonSamples},
+            {2, &Constants::earlyExit},
+            {4, &Constants::gatherSize},
+            {5, &Constants::momentMethod},
+            {6, &Constants::linearMoments}}
+        ));
+        // Fragment shader with atomic counters is compiled only if device supports fragment stores
         pcfShadowPipeline = createCommonSpecializedPipeline(
-            "transform.o", "shadow.o",
+            "transform.o", constants.countEarlyExit ? "shadowStatistics.o" : "shadow.o",
             std::move(specialization),
             objects[0]->getVertexInput(),
             descriptor.layout);
+        // Separable prefilter of moments
+        BlurConstants blurConstants;
+        blurConstants.horzPass = VK_TRUE;
+        blurConstants.momentMethod = constants.momentMethod;
+        std::shared_ptr<magma::Specialization> horzSpecialization(new magma::Specialization(blurConstants, {
+            {0, &BlurConstants::horzPass},
+            {5, &BlurConstants::momentMethod}}
+        ));
+        horzBlurPipeline = createFullscreenPipeline("blurOffset.o", "momentBlur.o",
+            std::move(horzSpecialization), horzBlurDescriptor.layout, tempMomentMap);
+        blurConstants.horzPass = VK_FALSE;
+        std::shared_ptr<magma::Specialization> vertSpecialization(new magma::Specialization(blurConstants, {
+            {0, &BlurConstants::horzPass},
+            {5, &BlurConstants::momentMethod}}
+        ));
+        vertBlurPipeline = createFullscreenPipeline("blurOffset.o", "momentBlur.o",
+            std::move(vertSpecialization), vertBlurDescriptor.layout, momentMap);
     }
 
     void renderScene(std::shared_ptr<magma::CommandBuffer> cmdBuffer)
     {
         cmdBuffer->begin();
         {
+            gpuTimer->reset(cmdBuffer);
             shadowMapPass(cmdBuffer);
+            if (MomentsFilter == constants.filter)
+                momentsPrefilterPass(cmdBuffer);
+            cmdBuffer->fillBuffer(statistics, 0, sizeof(Statistics));
+            cmdBuffer->pipelineBarrier(VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                magma::MemoryBarrier(VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT));
             lightingPass(cmdBuffer);
+            cmdBuffer->pipelineBarrier(VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                magma::MemoryBarrier(VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT));
+            // Read back number of early exit fragments for statistics
+            cmdBuffer->copyBuffer(statistics, statisticsReadback);
         }
         cmdBuffer->end();
     }
 
     void shadowMapPass(std::shared_ptr<magma::CommandBuffer> cmdBuffer)
     {
+        gpuTimer->begin(cmdBuffer, ShadowMapPass);
         cmdBuffer->beginRenderPass(shadowMap->getRenderPass(), shadowMap->getFramebuffer(),
             {
                 magma::clears::depthOne
@@ -213,10 +449,34 @@ public:
             }
         }
         cmdBuffer->endRenderPass();
+        gpuTimer->end(cmdBuffer, ShadowMapPass);
     }
 
-    void lightingPass(std::shared_ptr<magma::CommandBuffer> cmdBuffer)
+    void momentsPrefilterPass(std::shared_ptr<magma::CommandBuffer> cmdBuffer)
     {
+        gpuTimer->begin(cmdBuffer, MomentsPrefilterPass);
+        // 1. Convert depth to moments and blur horizontally
+        cmdBuffer->beginRenderPass(tempMomentMap->getRenderPass(), tempMomentMap->getFramebuffer());
+        {
+            cmdBuffer->bindPipeline(horzBlurPipeline);
+            cmdBuffer->bindDescriptorSet(horzBlurPipeline, horzBlurDescriptor.set);
+            cmdBuffer->draw(4, 0);
+        }
+        cmdBuffer->endRenderPass();
+        // 2. Blur vertically
+        cmdBuffer->beginRenderPass(momentMap->getRenderPass(), momentMap->getFramebuffer());
+        {
+            cmdBuffer->bindPipeline(vertBlurPipeline);
+            cmdBuffer->bindDescriptorSet(vertBlurPipeline, vertBlurDescriptor.set);
+            cmdBuffer->draw(4, 0);
+        }
+        cmdBuffer->endRenderPass();
+        gpuTimer->end(cmdBuffer, MomentsPrefilterPass);
+    }
+
+    void lightingPass(std::shared_ptr<magma::CommandBuffer> cmdBuffer)
+    {   // Includes cost of shadow filtering
+        gpuTimer->begin(cmdBuffer, LightingPass);
         cmdBuffer->beginRenderPass(msaaFramebuffer->getRenderPass(), msaaFramebuffer->getFramebuffer(),
             {
                 magma::ClearColor(0.35f, 0.53f, 0.7f, 1.0f),
@@ -235,6 +495,7 @@ public:
                 drawDepthMap(cmdBuffer);
         }
         cmdBuffer->endRenderPass();
+        gpuTimer->end(cmdBuffer, LightingPass);
     }
 
     void drawDepthMap(std::shared_ptr<magma::CommandBuffer> cmdBuffer)
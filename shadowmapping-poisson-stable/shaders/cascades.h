@@ -0,0 +1,52 @@
+// Should match StablePoissonShadowMapping::MaxCascades
+#define MAX_CASCADES 4
+
+layout(binding = 6) uniform Cascades
+{
+    mat4 cascadeProj[MAX_CASCADES]; // World to atlas texture space
+    vec4 cascadeSplits; // View depth of far plane of each cascade
+    vec4 cascadeBias;
+    vec4 viewLightDir;
+    uint cascadeCount;
+    float blendRange;
+};
+
+// Cascades are packed into 2x2 tiles of the atlas. Each tile covers
+// bounding sphere of its frustum slice with a border of the largest
+// filter radius, so kernel never reaches neighbour tile for points
+// inside of the slice.
+layout(binding = 7) uniform sampler2DShadow cascadeAtlas;
+
+uint selectCascade(float viewDepth)
+{
+    uint cascade = 0;
+    for (uint i = 0; i < cascadeCount - 1; ++i)
+    {
+        if (viewDepth > cascadeSplits[i])
+            cascade = i + 1;
+    }
+    return cascade;
+}
+
+float cascadeShadow(uint cascade, vec4 worldPos, mat2 jitter)
+{
+    vec4 shadowPos = cascadeProj[cascade] * worldPos;
+    return pcf(cascadeAtlas, shadowPos, cascadeBias[cascade], jitter);
+}
+
+float cascadedShadow(vec4 worldPos, float viewDepth, mat2 jitter, out uint cascade)
+{
+    cascade = selectCascade(viewDepth);
+    if (viewDepth > cascadeSplits[cascadeCount - 1])
+        return 1.; // Beyond shadow distance
+    float shadow = cascadeShadow(cascade, worldPos, jitter);
+    if (cascade + 1 < cascadeCount)
+    {   // Blend with the next cascade near the far plane to hide the seam
+        float sliceNear = (cascade > 0) ? cascadeSplits[cascade - 1] : 0.;
+        float band = (cascadeSplits[cascade] - sliceNear) * blendRange;
+        float t = (cascadeSplits[cascade] - viewDepth)/band;
+        if (t < 1.)
+            shadow = mix(cascadeShadow(cascade + 1, worldPos, jitter), shadow, t);
+    }
+    return shadow;
+}
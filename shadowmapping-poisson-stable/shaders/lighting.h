@@ -0,0 +1,101 @@
+#include "common/transforms.h"
+#include "common/noise2d.h"
+#include "common/noise3d.h"
+#include "common/jitter.h"
+#include "brdf/phong.h"
+#include "pcf.h"
+#include "cascades.h"
+#include "shadow.h"
+
+#include "common/linearizeDepth.h"
+
+layout(constant_id = 0) const bool c_screenSpaceNoise = true;
+layout(constant_id = 1) const bool c_showNoise = false;
+layout(constant_id = 3) const bool c_showCascades = false;
+layout(constant_id = 7) const bool c_shadowMask = false;
+
+layout(binding = 2) uniform Light {
+    vec4 viewPos;
+    vec4 ambient;
+    vec4 diffuse;
+    vec4 specular;
+} light;
+
+layout(binding = 3) uniform Material {
+    vec4 ambient;
+    vec4 diffuse;
+    vec4 specular;
+    float shininess;
+} surface;
+
+layout(binding = 8) uniform sampler2D shadowMask;
+
+#if defined(COUNT_EARLY_EXIT)
+// Requires fragmentStoresAndAtomics feature
+layout(binding = 9) buffer Statistics {
+    uint earlyExitCount;
+    uint penumbraCount;
+};
+#endif
+
+layout(location = 0) in vec4 worldPos;
+layout(location = 1) in vec3 viewPos;
+layout(location = 2) in vec3 viewNormal;
+
+layout(location = 0) out vec3 oColor;
+
+void main()
+{
+    vec3 n = normalize(viewNormal);
+    vec3 l;
+    if (c_cascaded) // Directional light
+        l = -viewLightDir.xyz;
+    else
+        l = normalize(light.viewPos.xyz - viewPos);
+    vec3 v = -normalize(viewPos);
+
+    float theta;
+    if (c_screenSpaceNoise)
+        theta = screenNoise(gl_FragCoord.xy);
+    else
+        theta = worldNoise(worldPos.xyz, viewPos.z, jitterDensity);
+
+    float shadow;
+    uint cascade = 0;
+    if (c_shadowMask)
+    {   // Accumulated over frames in compute pass
+        shadow = texelFetch(shadowMask, ivec2(gl_FragCoord.xy), 0).r;
+        if (c_cascaded)
+            cascade = selectCascade(viewPos.z);
+    }
+    else if (dot(n, l) <= 0.)
+        shadow = 0.;
+    else
+    {
+        shadow = shadowTerm(worldPos, viewPos.z, theta, cascade);
+#if defined(COUNT_EARLY_EXIT)
+        if (penumbra)
+            atomicAdd(penumbraCount, 1);
+        else
+            atomicAdd(earlyExitCount, 1);
+#endif
+    }
+
+    oColor = phong(n, l, v,
+        surface.ambient.rgb, light.ambient.rgb,
+        surface.diffuse.rgb, light.diffuse.rgb,
+        surface.specular.rgb, light.specular.rgb,
+        surface.shininess, shadow);
+    if (c_showNoise)
+        oColor *= theta;
+    if (c_cascaded && c_showCascades)
+    {
+        const vec3 colors[MAX_CASCADES] = vec3[](
+            vec3(1., .5, .5),
+            vec3(.5, 1., .5),
+            vec3(.5, .5, 1.),
+            vec3(1., 1., .5)
+        );
+        oColor *= colors[cascade];
+    }
+}
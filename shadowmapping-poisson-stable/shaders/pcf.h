@@ -1,13 +1,63 @@
+#include "common/poisson8.h"
+#include "common/poisson16.h"
 #include "common/poisson32.h"
 
+// Should match StablePoissonShadowMapping::Constants
+layout(constant_id = 4) const int c_poissonSamples = 32; // 8, 16 or 32
+layout(constant_id = 5) const bool c_earlyExit = true;
+layout(constant_id = 6) const int c_temporalSamples = 0; // Taps per frame of temporal filter
+
+// Samples on the outer radius of the kernel. If all of them agree,
+// fragment is most likely either fully lit or fully shadowed.
+const vec2 poissonRing[4] = vec2[](
+    vec2(-1.,  0.),
+    vec2( 1.,  0.),
+    vec2( 0., -1.),
+    vec2( 0.,  1.)
+);
+
+// Set if full kernel was evaluated, e.g. for any of blended cascades
+bool penumbra = false;
+
+vec2 poissonSample(int i)
+{
+    if (8 == c_poissonSamples)
+        return poisson8[i];
+    if (16 == c_poissonSamples)
+        return poisson16[i];
+    return poisson32[i];
+}
+
 float pcf(sampler2DShadow shadowMap, vec4 clipPos, float bias, mat2 jitter)
 {
     clipPos.z += bias;
     float sum = 0.;
-    for (int i = 0; i < 32; ++i)
+    if (c_temporalSamples > 0)
+    {   // Kernel is rotated every frame and accumulated over time
+        for (int i = 0; i < c_temporalSamples; ++i)
+        {
+            vec2 offset = jitter * poisson8[i];
+            sum += textureProj(shadowMap, vec4(clipPos.xy + offset, clipPos.zw));
+        }
+        return sum/float(c_temporalSamples);
+    }
+    if (c_earlyExit)
+    {
+        for (int i = 0; i < 4; ++i)
+        {
+            vec2 offset = jitter * poissonRing[i];
+            sum += textureProj(shadowMap, vec4(clipPos.xy + offset, clipPos.zw));
+        }
+        if (sum == 0. || sum == 4.)
+            return sum * .25;
+        // Run the full kernel only in penumbra
+        sum = 0.;
+    }
+    penumbra = true;
+    for (int i = 0; i < c_poissonSamples; ++i)
     {
-        vec2 offset = jitter * poisson32[i];
+        vec2 offset = jitter * poissonSample(i);
         sum += textureProj(shadowMap, vec4(clipPos.xy + offset, clipPos.zw));
     }
-    return sum/32.;
+    return sum/float(c_poissonSamples);
 }
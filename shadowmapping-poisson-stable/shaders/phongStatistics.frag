@@ -0,0 +1,5 @@
+#version 450
+#extension GL_GOOGLE_include_directive : enable
+// Variant with atomic counters of early exit
+#define COUNT_EARLY_EXIT
+#include "lighting.h"
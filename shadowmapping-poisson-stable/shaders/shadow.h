@@ -0,0 +1,39 @@
+layout(constant_id = 2) const bool c_cascaded = false;
+
+layout(binding = 4) uniform Parameters {
+    vec4 screenSize; // x, y, 1/x, 1/y
+    float radius;
+    float zbias;
+    float jitterDensity;
+};
+
+layout(binding = 5) uniform sampler2DShadow shadowMap;
+
+float screenNoise(vec2 fragCoord)
+{
+    vec2 uv = fragCoord * screenSize.zw;
+    float aspectRatio = screenSize.x * screenSize.w;
+    uv.x *= aspectRatio;
+    return noise(uv * screenSize.x);
+}
+
+float worldNoise(vec3 worldPos, float z, float density)
+{
+    float w = 1./z;
+    return noise(worldPos * density * w);
+}
+
+float shadowTerm(vec4 worldPos, float viewDepth, float theta, out uint cascade)
+{
+    cascade = 0;
+    if (c_cascaded)
+    {   // Orthographic projection, so w is 1
+        vec2 scale = radius/textureSize(cascadeAtlas, 0);
+        mat2 jitMat = jitter(theta * TWO_PI, scale.x, scale.y);
+        return cascadedShadow(worldPos, viewDepth, jitMat, cascade);
+    }
+    vec4 shadowPos = shadowProj * worldPos;
+    vec2 scale = radius/textureSize(shadowMap, 0) * shadowPos.w;
+    mat2 jitMat = jitter(theta * TWO_PI, scale.x, scale.y);
+    return pcf(shadowMap, shadowPos, zbias, jitMat);
+}
@@ -1,5 +1,7 @@
 #include "graphicsApp.h"
+#include "gpuTimer.h"
 #include "colorTable.h"
+#include "quadricMesh.h"
 #include "quadric/include/cube.h"
 #include "quadric/include/sphere.h"
 #include "quadric/include/teapot.h"
@@ -12,10 +14,36 @@ class StablePoissonShadowMapping : public GraphicsApp
         MaxObjects
     };
 
+    enum {
+        ShadowMapPass = 0, CascadeShadowMapPass, DepthPrePass, TemporalShadowPass, LightingPass,
+        MaxPasses
+    };
+
     struct alignas(16) Constants
     {
         VkBool32 screenSpaceNoise = true;
         VkBool32 showNoise = false;
+        VkBool32 cascaded = false;
+        VkBool32 showCascades = false;
+        int32_t poissonSamples = 32;
+        VkBool32 earlyExit = true;
+        int32_t temporalSamples = 0;
+        VkBool32 shadowMask = false;
+        VkBool32 countEarlyExit = false;
+    };
+
+    // Should match cascades.h
+    static constexpr uint32_t MaxCascades = 4;
+    static constexpr float MaxFilterRadius = 20.f; // In texels
+
+    struct alignas(16) Cascades
+    {
+        rapid::matrix shadowProj[MaxCascades]; // World to atlas texture space
+        rapid::float4a splits; // View depth of far plane of each cascade
+        rapid::float4a depthBias;
+        rapid::float4a viewLightDirection;
+        uint32_t cascadeCount;
+        float blendRange;
     };
 
     struct alignas(16) Parameters
@@ -26,6 +54,20 @@ class StablePoissonShadowMapping : public GraphicsApp
         float jitterDensity;
     };
 
+    struct Statistics
+    {
+        uint32_t earlyExitCount;
+        uint32_t penumbraCount;
+    };
+
+    struct alignas(16) Temporal
+    {
+        rapid::matrix prevViewProj;
+        float rotation;
+        float historyWeight;
+        float depthTolerance;
+    };
+
     std::unique_ptr<quadric::Quadric> objects[MaxObjects];
     std::shared_ptr<magma::DynamicUniformBuffer<PhongMaterial>> materials;
     std::shared_ptr<magma::UniformBuffer<Parameters>> parameters;
@@ -33,13 +75,36 @@ class StablePoissonShadowMapping : public GraphicsApp
     std::shared_ptr<magma::GraphicsPipeline> phongShadowPipeline;
     std::shared_ptr<magma::aux::DepthFramebuffer> shadowMap;
     std::shared_ptr<magma::Sampler> shadowSampler;
+    std::shared_ptr<magma::aux::DepthFramebuffer> cascadeAtlas;
+    std::shared_ptr<magma::DynamicUniformBuffer<rapid::matrix>> cascadeTransforms;
+    std::shared_ptr<magma::UniformBuffer<Cascades>> cascades;
+    std::shared_ptr<magma::GraphicsPipeline> cascadeShadowMapPipeline;
+    std::shared_ptr<magma::aux::DepthFramebuffer> depthPrePass;
+    std::shared_ptr<magma::GraphicsPipeline> depthPipeline;
+    std::shared_ptr<magma::StorageImage2D> history[2];
+    std::shared_ptr<magma::ImageView> historyViews[2];
+    std::shared_ptr<magma::StorageImage2D> shadowMask;
+    std::shared_ptr<magma::ImageView> shadowMaskView;
+    std::shared_ptr<magma::UniformBuffer<Temporal>> temporal;
+    std::shared_ptr<magma::ComputePipeline> temporalShadowPipeline;
+    std::shared_ptr<magma::StorageBuffer> statistics;
+    std::shared_ptr<magma::DstTransferBuffer> statisticsReadback;
+    std::unique_ptr<GpuTimer> gpuTimer;
     DescriptorSet smDescriptor;
+    DescriptorSet cascadeDescriptor;
     DescriptorSet descriptor;
+    DescriptorSet temporalDescriptor;
+    std::shared_ptr<magma::DescriptorSet> temporalSets[2]; // Ping-pong between history images
 
     rapid::matrix objTransforms[MaxObjects];
     Constants constants;
     float radius = 10.f;
     float jitterDensity = 6.f;
+    uint32_t cascadeCount = 4;
+    float splitLambda = 0.8f; // Blend between logarithmic and uniform splits
+    const int32_t temporalSamples = 4; // Taps per frame
+    uint32_t frameIndex = 0;
+    bool historyValid = false;
 
 public:
     explicit StablePoissonShadowMapping(const AppEntry& entry):
@@ -50,9 +115,13 @@ public:
         setupMaterials();
         updateParameters();
         createShadowMap();
+        createCascadeAtlas();
+        createTemporalHistory();
         createMeshObjects();
         setupDescriptorSets();
         setupGraphicsPipelines();
+        gpuTimer = std::make_unique<GpuTimer>(commandPools[0],
+            std::vector<std::string>{"Shadow map", "Cascade shadow map", "Depth pre-pass", "Temporal shadow", "Lighting"});
 
         renderScene(drawCmdBuffer);
         blit(msaaFramebuffer->getColorView(), FrontBuffer);
@@ -63,9 +132,21 @@ public:
 
     virtual void render(uint32_t bufferIndex) override
     {
+        gpuTimer->update();
+        const rapid::matrix prevViewProj = viewProj->getViewProj();
         updateView();
         updateTransforms();
+        if (constants.cascaded)
+            updateCascades();
+        if (constants.shadowMask)
+        {   // Swap history images
+            updateTemporal(prevViewProj);
+            ++frameIndex;
+            renderScene(drawCmdBuffer);
+        }
         submitCommandBuffers(bufferIndex);
+        if (constants.countEarlyExit && !constants.shadowMask && (++frameIndex % 300 == 0))
+            printStatistics(bufferIndex);
         std::this_thread::sleep_for(std::chrono::milliseconds(2)); // Cap fps
     }
 
@@ -74,7 +155,7 @@ public:
         switch (key)
         {
         case AppKey::PgUp:
-            if (radius <= 19.5f)
+            if (radius <= MaxFilterRadius - 0.5f)
             {
                 radius += 0.5f;
                 updateParameters();
@@ -119,6 +200,60 @@ public:
             setupGraphicsPipelines();
             renderScene(drawCmdBuffer);
             break;
+        case AppKey::Tab:
+            constants.cascaded = !constants.cascaded;
+            std::cout << (constants.cascaded ? "Cascaded shadow maps" : "Single shadow map") << std::endl;
+            setupGraphicsPipelines();
+            renderScene(drawCmdBuffer);
+            break;
+        case '2': case '3': case '4':
+            cascadeCount = key - '0';
+            std::cout << cascadeCount << " cascades" << std::endl;
+            renderScene(drawCmdBuffer);
+            break;
+        case '9':
+            splitLambda = std::max(splitLambda - 0.1f, 0.f);
+            std::cout << "Split lambda: " << splitLambda << std::endl;
+            break;
+        case '0':
+            splitLambda = std::min(splitLambda + 0.1f, 1.f);
+            std::cout << "Split lambda: " << splitLambda << std::endl;
+            break;
+        case '1':
+            constants.showCascades = !constants.showCascades;
+            setupGraphicsPipelines();
+            renderScene(drawCmdBuffer);
+            break;
+        case '5': case '6': case '7':
+            constants.poissonSamples = 8 << (key - '5');
+            std::cout << "Poisson kernel: " << constants.poissonSamples << " samples" << std::endl;
+            setupGraphicsPipelines();
+            renderScene(drawCmdBuffer);
+            break;
+        case '8':
+            constants.earlyExit = !constants.earlyExit;
+            std::cout << "Early exit " << (constants.earlyExit ? "on" : "off") << std::endl;
+            setupGraphicsPipelines();
+            renderScene(drawCmdBuffer);
+            break;
+        case AppKey::Up:
+            constants.shadowMask = !constants.shadowMask;
+            std::cout << (constants.shadowMask ? "Temporal accumulation of " : "Full kernel of ")
+                << (constants.shadowMask ? temporalSamples : constants.poissonSamples)
+                << " Poisson samples per frame" << std::endl;
+            historyValid = false;
+            setupGraphicsPipelines();
+            renderScene(drawCmdBuffer);
+            break;
+        case AppKey::Down:
+            if (!physicalDevice->getFeatures().fragmentStoresAndAtomics)
+                break;
+            // Atomic counters are expensive, so counting is disabled when measuring timings
+            constants.countEarlyExit = !constants.countEarlyExit;
+            std::cout << "Early exit statistics " << (constants.countEarlyExit ? "on" : "off") << std::endl;
+            setupGraphicsPipelines();
+            renderScene(drawCmdBuffer);
+            break;
         }
         VulkanApp::onKeyDown(key, repeat, flags);
     }
@@ -256,6 +391,173 @@ public:
         constexpr VkExtent2D extent{2048, 2048};
         shadowMap = std::make_shared<magma::aux::DepthFramebuffer>(device, depthFormat, extent);
         shadowSampler = std::make_shared<magma::DepthSampler>(device, magma::samplers::magMinNearestCompareLessOrEqual);
+        statistics = std::make_shared<magma::StorageBuffer>(device, sizeof(Statistics));
+        statisticsReadback = std::make_shared<magma::DstTransferBuffer>(device, sizeof(Statistics));
+    }
+
+    void printStatistics(uint32_t bufferIndex) const
+    {   // Wait until draw command buffer has copied counters to readback buffer
+        waitFences[bufferIndex]->wait();
+        magma::helpers::mapScoped<Statistics>(statisticsReadback,
+            [](Statistics *stats)
+            {
+                const uint32_t total = stats->earlyExitCount + stats->penumbraCount;
+                if (total)
+                {
+                    const float fraction = stats->earlyExitCount/float(total);
+                    std::cout << "Early exit: " << stats->earlyExitCount << " of " << total
+                        << " fragments (" << fraction * 100.f << "%)" << std::endl;
+                }
+            });
+    }
+
+    void createCascadeAtlas()
+    {   // Cascades are packed into 2x2 tiles of a single depth image
+        constexpr VkFormat depthFormat = VK_FORMAT_D16_UNORM;
+        constexpr VkExtent2D extent{4096, 4096};
+        cascadeAtlas = std::make_shared<magma::aux::DepthFramebuffer>(device, depthFormat, extent);
+        cascadeTransforms = std::make_shared<magma::DynamicUniformBuffer<rapid::matrix>>(device, MaxCascades);
+        cascades = std::make_shared<magma::UniformBuffer<Cascades>>(device);
+    }
+
+    void createTemporalHistory()
+    {   // Single sample depth to reconstruct world position of each pixel
+        const VkExtent2D extent = msaaFramebuffer->getExtent();
+        depthPrePass = std::make_shared<magma::aux::DepthFramebuffer>(device, VK_FORMAT_D32_SFLOAT, extent);
+        for (uint32_t i = 0; i < 2; ++i)
+        {
+            history[i] = std::make_shared<magma::StorageImage2D>(device, VK_FORMAT_R16G16B16A16_SFLOAT, extent, 1);
+            historyViews[i] = std::make_shared<magma::ImageView>(history[i]);
+        }
+        shadowMask = std::make_shared<magma::StorageImage2D>(device, VK_FORMAT_R8G8B8A8_UNORM, extent, 1);
+        shadowMaskView = std::make_shared<magma::ImageView>(shadowMask);
+        magma::helpers::executeCommandBuffer(commandPools[0],
+            [this](std::shared_ptr<magma::CommandBuffer> cmdBuffer)
+            {   // Perform transition from undefined to general image layout
+                for (auto image : {history[0], history[1], shadowMask})
+                {
+                    const magma::ImageSubresourceRange subresourceRange(image);
+                    cmdBuffer->pipelineBarrier(VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                        magma::ImageMemoryBarrier(image, VK_IMAGE_LAYOUT_GENERAL, subresourceRange));
+                }
+            });
+        temporal = std::make_shared<magma::UniformBuffer<Temporal>>(device);
+    }
+
+    void updateTemporal(const rapid::matrix& prevViewProj)
+    {
+        magma::helpers::mapScoped(temporal,
+            [&](auto *temporal)
+            {
+                constexpr float goldenRatio = 0.618034f;
+                temporal->prevViewProj = prevViewProj;
+                // Low discrepancy sequence of kernel rotations
+                temporal->rotation = fmodf(frameIndex * goldenRatio, 1.f);
+                // Exponential moving average of about 10 frames
+                temporal->historyWeight = historyValid ? 0.9f : 0.f;
+                temporal->depthTolerance = 0.02f;
+            });
+        historyValid = true;
+    }
+
+    void updateCascades()
+    {
+        const uint32_t tileSize = cascadeAtlas->getExtent().width/2;
+        const float zNear = viewProj->getNearZ();
+        const float zFar = viewProj->getFarZ();
+        // Practical split scheme: blend of logarithmic and uniform splits
+        float splits[MaxCascades] = {};
+        for (uint32_t i = 0; i < cascadeCount; ++i)
+        {
+            const float p = (i + 1)/float(cascadeCount);
+            const float logSplit = zNear * powf(zFar/zNear, p);
+            const float uniformSplit = zNear + (zFar - zNear) * p;
+            splits[i] = splitLambda * logSplit + (1.f - splitLambda) * uniformSplit;
+        }
+        // Camera basis
+        const rapid::vector3 up(0.f, 1.f, 0.f);
+        const rapid::vector3 eye(viewProj->getPosition());
+        const rapid::vector3 forward = (rapid::vector3(viewProj->getFocus()) - eye).normalized();
+        const rapid::vector3 right = (up ^ forward).normalized();
+        const rapid::vector3 cameraUp = forward ^ right;
+        const float tanHalfFov = tanf(rapid::radians(viewProj->getFieldOfView()) * 0.5f);
+        const float aspectRatio = viewProj->getAspectRatio();
+        // Directional light basis
+        const rapid::vector3 lightDir = (rapid::vector3(lightViewProj->getFocus()) - rapid::vector3(lightViewProj->getPosition())).normalized();
+        const rapid::vector3 lightRight = (up ^ lightDir).normalized();
+        const rapid::vector3 lightUp = lightDir ^ lightRight;
+        constexpr float casterDistance = 20.f; // Pull near plane back to catch casters out of the slice
+        constexpr float worldBias = 0.02f;
+        rapid::matrix shadowProj[MaxCascades];
+        float depthBias[MaxCascades] = {};
+        magma::helpers::mapScoped<rapid::matrix>(cascadeTransforms,
+            [&](magma::helpers::AlignedUniformArray<rapid::matrix>& cascadeTransforms)
+            {
+                float sliceNear = zNear;
+                for (uint32_t i = 0; i < cascadeCount; ++i)
+                {   // Bounding sphere of the frustum slice doesn't change with camera rotation
+                    const float sliceFar = splits[i];
+                    rapid::vector3 center(0.f, 0.f, 0.f);
+                    rapid::vector3 corners[8];
+                    for (uint32_t j = 0; j < 8; ++j)
+                    {
+                        const float z = (j & 4) ? sliceFar : sliceNear;
+                        const float x = ((j & 1) ? 1.f : -1.f) * z * tanHalfFov * aspectRatio;
+                        const float y = ((j & 2) ? 1.f : -1.f) * z * tanHalfFov;
+                        corners[j] = eye + forward * z + right * x + cameraUp * y;
+                        center += corners[j];
+                    }
+                    center = center * (1.f/8.f);
+                    float sphereRadius = 0.f;
+                    for (const rapid::vector3& corner : corners)
+                        sphereRadius = std::max(sphereRadius, (corner - center).length());
+                    sphereRadius = ceilf(sphereRadius * 16.f)/16.f;
+                    // Pad tile by the largest filter kernel plus bilinear footprint,
+                    // so taps of points inside of the sphere never reach neighbour tile
+                    const float padding = MaxFilterRadius + 1.f;
+                    const float halfExtent = sphereRadius * tileSize/(tileSize - 2.f * padding);
+                    // Snap center to texel grid, so shadow edges don't shimmer when camera moves
+                    const float texelSize = 2.f * halfExtent/tileSize;
+                    const float cx = floorf(center.dot(lightRight)/texelSize) * texelSize;
+                    const float cy = floorf(center.dot(lightUp)/texelSize) * texelSize;
+                    const float cz = center.dot(lightDir);
+                    const float minZ = cz - sphereRadius - casterDistance;
+                    const float maxZ = cz + sphereRadius;
+                    const float sxy = 1.f/halfExtent;
+                    const float sz = 1.f/(maxZ - minZ);
+                    // Orthographic projection with Vulkan Y flip
+                    const rapid::matrix lightProj(
+                        lightRight.x() * sxy, -lightUp.x() * sxy, lightDir.x() * sz, 0.f,
+                        lightRight.y() * sxy, -lightUp.y() * sxy, lightDir.y() * sz, 0.f,
+                        lightRight.z() * sxy, -lightUp.z() * sxy, lightDir.z() * sz, 0.f,
+                        -cx * sxy, cy * sxy, -minZ * sz, 1.f);
+                    cascadeTransforms[i] = lightProj;
+                    // (x,y) [-1,1] -> tile of atlas
+                    const float tileX = float(i % 2) * 0.5f;
+                    const float tileY = float(i / 2) * 0.5f;
+                    const rapid::matrix tileBias(
+                        .25f, .0f, 0.f, 0.f,
+                        .0f, .25f, 0.f, 0.f,
+                        .0f, .0f, 1.f, 0.f,
+                        .25f + tileX, .25f + tileY, 0.f, 1.f);
+                    shadowProj[i] = lightProj * tileBias;
+                    // Scale bias with filter footprint in world units
+                    depthBias[i] = (worldBias + texelSize * this->radius) * sz;
+                    sliceNear = sliceFar;
+                }
+            });
+        magma::helpers::mapScoped(cascades,
+            [&](auto *cascades)
+            {
+                for (uint32_t i = 0; i < cascadeCount; ++i)
+                    cascades->shadowProj[i] = shadowProj[i];
+                cascades->splits = rapid::float4a(splits[0], splits[1], splits[2], splits[3]);
+                cascades->depthBias = rapid::float4a(depthBias[0], depthBias[1], depthBias[2], depthBias[3]);
+                // Rotate light direction to view space using camera basis
+                cascades->viewLightDirection = rapid::float4a(lightDir.dot(right), lightDir.dot(cameraUp), lightDir.dot(forward), 0.f);
+                cascades->cascadeCount = cascadeCount;
+                cascades->blendRange = 0.1f; // Fraction of cascade depth blended with the next one
+            });
     }
 
     void createMeshObjects()
@@ -264,6 +566,8 @@ public:
         objects[Teapot] = std::make_unique<quadric::Teapot>(16, cmdCopyBuf);
         objects[Sphere] = std::make_unique<quadric::Sphere>(1.5f, 64, 64, false, cmdCopyBuf);
         objects[Ground] = std::make_unique<quadric::Plane>(100.f, 100.f, false, cmdCopyBuf);
+        mesh::optimize(*objects[Teapot], "Teapot", commandPools[0]);
+        mesh::optimize(*objects[Sphere], "Sphere", commandPools[0]);
     }
 
     void setupDescriptorSets()
@@ -275,6 +579,15 @@ public:
             VertexStageBinding(0, DynamicUniformBuffer(1)));
         smDescriptor.set = descriptorPool->allocateDescriptorSet(smDescriptor.layout);
         smDescriptor.set->writeDescriptor(0, transforms);
+        // Cascade shadow map shader
+        cascadeDescriptor.layout = std::shared_ptr<magma::DescriptorSetLayout>(new magma::DescriptorSetLayout(device,
+            {
+                VertexStageBinding(0, DynamicUniformBuffer(1)),
+                VertexStageBinding(1, DynamicUniformBuffer(1))
+            }));
+        cascadeDescriptor.set = descriptorPool->allocateDescriptorSet(cascadeDescriptor.layout);
+        cascadeDescriptor.set->writeDescriptor(0, transforms);
+        cascadeDescriptor.set->writeDescriptor(1, cascadeTransforms);
         // Lighting shader
         descriptor.layout = std::shared_ptr<magma::DescriptorSetLayout>(new magma::DescriptorSetLayout(device,
             {
@@ -283,7 +596,11 @@ public:
                 FragmentStageBinding(2, UniformBuffer(1)),
                 FragmentStageBinding(3, DynamicUniformBuffer(1)),
                 FragmentStageBinding(4, UniformBuffer(1)),
-                FragmentStageBinding(5, CombinedImageSampler(1))
+                FragmentStageBinding(5, CombinedImageSampler(1)),
+                FragmentStageBinding(6, UniformBuffer(1)),
+                FragmentStageBinding(7, CombinedImageSampler(1)),
+                FragmentStageBinding(8, CombinedImageSampler(1)), // Shadow mask
+                FragmentStageBinding(9, StorageBuffer(1))
             }));
         descriptor.set = descriptorPool->allocateDescriptorSet(descriptor.layout);
         descriptor.set->writeDescriptor(0, transforms);
@@ -292,6 +609,38 @@ public:
         descriptor.set->writeDescriptor(3, materials);
         descriptor.set->writeDescriptor(4, parameters);
         descriptor.set->writeDescriptor(5, shadowMap->getDepthView(), shadowSampler);
+        descriptor.set->writeDescriptor(6, cascades);
+        descriptor.set->writeDescriptor(7, cascadeAtlas->getDepthView(), shadowSampler);
+        descriptor.set->writeDescriptor(8, shadowMaskView, nearestClampToEdge);
+        descriptor.set->writeDescriptor(9, statistics);
+        // Temporal shadow accumulation
+        temporalDescriptor.layout = std::shared_ptr<magma::DescriptorSetLayout>(new magma::DescriptorSetLayout(device,
+            {
+                ComputeStageBinding(1, UniformBuffer(1)),
+                ComputeStageBinding(4, UniformBuffer(1)),
+                ComputeStageBinding(5, CombinedImageSampler(1)), // Shadow map
+                ComputeStageBinding(6, UniformBuffer(1)),
+                ComputeStageBinding(7, CombinedImageSampler(1)), // Cascade atlas
+                ComputeStageBinding(8, CombinedImageSampler(1)), // Depth
+                ComputeStageBinding(9, CombinedImageSampler(1)), // Previous history
+                ComputeStageBinding(10, StorageImage(1)), // Current history
+                ComputeStageBinding(11, StorageImage(1)), // Shadow mask
+                ComputeStageBinding(12, UniformBuffer(1))
+            }));
+        for (uint32_t i = 0; i < 2; ++i)
+        {
+            temporalSets[i] = descriptorPool->allocateDescriptorSet(temporalDescriptor.layout);
+            temporalSets[i]->writeDescriptor(0, viewProjTransforms);
+            temporalSets[i]->writeDescriptor(1, parameters);
+            temporalSets[i]->writeDescriptor(2, shadowMap->getDepthView(), shadowSampler);
+            temporalSets[i]->writeDescriptor(3, cascades);
+            temporalSets[i]->writeDescriptor(4, cascadeAtlas->getDepthView(), shadowSampler);
+            temporalSets[i]->writeDescriptor(5, depthPrePass->getDepthView(), nearestClampToEdge);
+            temporalSets[i]->writeDescriptor(6, historyViews[1 - i], bilinearClampToEdge);
+            temporalSets[i]->writeDescriptor(7, historyViews[i], nullptr);
+            temporalSets[i]->writeDescriptor(8, shadowMaskView, nullptr);
+            temporalSets[i]->writeDescriptor(9, temporal);
+        }
     }
 
     void setupGraphicsPipelines()
@@ -304,30 +653,83 @@ public:
                 magma::renderstates::fillCullFrontCW, // Draw only back faces to get rid of shadow acne
                 smDescriptor.layout,
                 shadowMap);
+            // Viewport selects tile of the atlas
+            cascadeShadowMapPipeline = std::make_shared<magma::GraphicsPipeline>(device,
+                std::vector<magma::PipelineShaderStage>{
+                    loadShaderStage("cascadeShadowMap.o")
+                },
+                objects[0]->getVertexInput(),
+                magma::renderstates::triangleList,
+                magma::TesselationState(),
+                magma::ViewportState(0.f, 0.f, cascadeAtlas->getExtent()),
+                magma::renderstates::fillCullFrontCW,
+                magma::renderstates::dontMultisample,
+                magma::renderstates::depthLessOrEqual,
+                magma::renderstates::dontWriteRgba,
+                std::initializer_list<VkDynamicState>{VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR},
+                std::make_shared<magma::PipelineLayout>(cascadeDescriptor.layout),
+                cascadeAtlas->getRenderPass(), 0,
+                pipelineCache,
+                nullptr, nullptr, 0);
+            depthPipeline = createDepthOnlyPipeline("transform.o",
+                objects[0]->getVertexInput(),
+                smDescriptor.layout,
+                depthPrePass);
         }
         std::shared_ptr<magma::Specialization> specialization(new magma::Specialization(constants, {
             {0, &Constants::screenSpaceNoise},
-            {1, &Constants::showNoise}}
+            {1, &Constants::showNoise},
+            {2, &Constants::cascaded},
+            {3, &Constants::showCascades},
+            {4, &Constants::poissonSamples},
+            {5, &Constants::earlyExit},
+            {6, &Constants::temporalSamples},
+            {7, &Constants::shadowMask}}
         ));
+        // Fragment shader with atomic counters is compiled only if device supports fragment stores
         phongShadowPipeline = createCommonSpecializedPipeline(
-            "transform.o", "phong.o",
+            "transform.o", constants.countEarlyExit ? "phongStatistics.o" : "phong.o",
             std::move(specialization),
             objects[0]->getVertexInput(),
             descriptor.layout);
+        Constants temporalConstants = constants;
+        temporalConstants.temporalSamples = temporalSamples;
+        std::shared_ptr<magma::Specialization> temporalSpecialization(new magma::Specialization(temporalConstants, {
+            {2, &Constants::cascaded},
+            {6, &Constants::temporalSamples}}
+        ));
+        temporalShadowPipeline = createComputePipeline("temporalShadow.o", std::move(temporalSpecialization), temporalDescriptor.layout);
     }
 
     void renderScene(std::shared_ptr<magma::CommandBuffer> cmdBuffer)
     {
         cmdBuffer->begin();
         {
-            shadowMapPass(cmdBuffer);
+            gpuTimer->reset(cmdBuffer);
+            if (constants.cascaded)
+                cascadeShadowMapPass(cmdBuffer);
+            else
+                shadowMapPass(cmdBuffer);
+            if (constants.shadowMask)
+            {
+                depthPass(cmdBuffer);
+                temporalShadowPass(cmdBuffer);
+            }
+            cmdBuffer->fillBuffer(statistics, 0, sizeof(Statistics));
+            cmdBuffer->pipelineBarrier(VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                magma::MemoryBarrier(VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT));
             lightingPass(cmdBuffer);
+            cmdBuffer->pipelineBarrier(VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                magma::MemoryBarrier(VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT));
+            // Read back number of early exit fragments for statistics
+            cmdBuffer->copyBuffer(statistics, statisticsReadback);
         }
         cmdBuffer->end();
     }
 
     void shadowMapPass(std::shared_ptr<magma::CommandBuffer> cmdBuffer)
     {
+        gpuTimer->begin(cmdBuffer, ShadowMapPass);
         cmdBuffer->beginRenderPass(shadowMap->getRenderPass(), shadowMap->getFramebuffer(),
             {
                 magma::clears::depthOne
@@ -343,10 +745,77 @@ public:
             }
         }
         cmdBuffer->endRenderPass();
+        gpuTimer->end(cmdBuffer, ShadowMapPass);
+    }
+
+    void cascadeShadowMapPass(std::shared_ptr<magma::CommandBuffer> cmdBuffer)
+    {
+        gpuTimer->begin(cmdBuffer, CascadeShadowMapPass);
+        cmdBuffer->beginRenderPass(cascadeAtlas->getRenderPass(), cascadeAtlas->getFramebuffer(),
+            {
+                magma::clears::depthOne
+            });
+        {
+            const uint32_t tileSize = cascadeAtlas->getExtent().width/2;
+            cmdBuffer->bindPipeline(cascadeShadowMapPipeline);
+            for (uint32_t cascade = 0; cascade < cascadeCount; ++cascade)
+            {
+                const int32_t x = (cascade % 2) * tileSize;
+                const int32_t y = (cascade / 2) * tileSize;
+                cmdBuffer->setViewport(magma::Viewport(float(x), float(y), VkExtent2D{tileSize, tileSize}));
+                cmdBuffer->setScissor(magma::Scissor(x, y, VkExtent2D{tileSize, tileSize}));
+                for (uint32_t i = Cube; i < Ground; ++i)
+                {
+                    cmdBuffer->bindDescriptorSet(cascadeShadowMapPipeline, cascadeDescriptor.set, {
+                        transforms->getDynamicOffset(i),
+                        cascadeTransforms->getDynamicOffset(cascade)
+                    });
+                    objects[i]->draw(cmdBuffer);
+                }
+            }
+        }
+        cmdBuffer->endRenderPass();
+        gpuTimer->end(cmdBuffer, CascadeShadowMapPass);
+    }
+
+    void depthPass(std::shared_ptr<magma::CommandBuffer> cmdBuffer)
+    {
+        gpuTimer->begin(cmdBuffer, DepthPrePass);
+        cmdBuffer->beginRenderPass(depthPrePass->getRenderPass(), depthPrePass->getFramebuffer(),
+            {
+                magma::clears::depthOne
+            });
+        {
+            cmdBuffer->bindPipeline(depthPipeline);
+            for (uint32_t i = Cube; i < MaxObjects; ++i)
+            {
+                cmdBuffer->bindDescriptorSet(depthPipeline, smDescriptor.set, transforms->getDynamicOffset(i));
+                objects[i]->draw(cmdBuffer);
+            }
+        }
+        cmdBuffer->endRenderPass();
+        gpuTimer->end(cmdBuffer, DepthPrePass);
+    }
+
+    void temporalShadowPass(std::shared_ptr<magma::CommandBuffer> cmdBuffer)
+    {   // Blend few taps of current frame with reprojected history
+        gpuTimer->begin(cmdBuffer, TemporalShadowPass);
+        cmdBuffer->pipelineBarrier(VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            magma::MemoryBarrier(VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT));
+        const VkExtent2D extent = depthPrePass->getExtent();
+        std::shared_ptr<magma::DescriptorSet> set = temporalSets[frameIndex % 2];
+        cmdBuffer->bindPipeline(temporalShadowPipeline);
+        cmdBuffer->bindDescriptorSet(temporalShadowPipeline, set);
+        cmdBuffer->dispatch((extent.width + 7)/8, (extent.height + 7)/8, 1);
+        cmdBuffer->pipelineBarrier(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+            magma::MemoryBarrier(VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT));
+        gpuTimer->end(cmdBuffer, TemporalShadowPass);
     }
 
     void lightingPass(std::shared_ptr<magma::CommandBuffer> cmdBuffer)
     {
+        gpuTimer->begin(cmdBuffer, LightingPass);
         cmdBuffer->beginRenderPass(msaaFramebuffer->getRenderPass(), msaaFramebuffer->getFramebuffer(),
             {
                 magma::ClearColor(0.35f, 0.53f, 0.7f, 1.0f),
@@ -366,6 +835,7 @@ public:
             }
         }
         cmdBuffer->endRenderPass();
+        gpuTimer->end(cmdBuffer, LightingPass);
     }
 };
 
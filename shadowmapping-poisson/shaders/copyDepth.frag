@@ -0,0 +1,8 @@
+#version 450
+
+layout(binding = 0) uniform sampler2D staticDepth;
+
+void main()
+{   // Shadow map and its cache have the same size
+    gl_FragDepth = texelFetch(staticDepth, ivec2(gl_FragCoord.xy), 0).r;
+}
@@ -5,6 +5,9 @@
 #include "common/jitter.h"
 #include "brdf/phong.h"
 #include "pcf.h"
+#include "shadow.h"
+
+layout(constant_id = 0) const bool c_shadowMask = false;
 
 layout(binding = 2) uniform Light {
     vec4 viewPos;
@@ -20,13 +23,7 @@ layout(binding = 3) uniform Material {
     float shininess;
 } surface;
 
-layout(binding = 4) uniform Parameters {
-    vec4 screenSize; // x, y, 1/x, 1/y
-    float radius;
-    float zbias;
-};
-
-layout(binding = 5) uniform sampler2DShadow shadowMap;
+layout(binding = 6) uniform sampler2D shadowMask;
 
 layout(location = 0) in vec4 worldPos;
 layout(location = 1) in vec3 viewPos;
@@ -34,14 +31,6 @@ layout(location = 2) in vec3 viewNormal;
 
 layout(location = 0) out vec3 oColor;
 
-float screenNoise(vec4 fragCoord)
-{
-    vec2 uv = fragCoord.xy * screenSize.zw;
-    float aspectRatio = screenSize.x * screenSize.w;
-    uv.x *= aspectRatio;
-    return noise(uv * screenSize.x);
-}
-
 void main()
 {
     vec3 n = normalize(viewNormal);
@@ -49,16 +38,12 @@ void main()
     vec3 v = -normalize(viewPos);
 
     float shadow;
-    if (dot(n, l) <= 0.)
+    if (c_shadowMask) // Filtered once per pixel in compute pass
+        shadow = texelFetch(shadowMask, ivec2(gl_FragCoord.xy), 0).r;
+    else if (dot(n, l) <= 0.)
         shadow = 0.;
     else
-    {
-        float theta = screenNoise(gl_FragCoord);
-        vec4 shadowPos = shadowProj * worldPos;
-        vec2 scale = radius/textureSize(shadowMap, 0) * shadowPos.w;
-        mat2 jitMat = jitter(theta * TWO_PI, scale.x, scale.y);
-        shadow = pcf(shadowMap, shadowPos, zbias, jitMat);
-    }
+        shadow = shadowFilter(worldPos, gl_FragCoord.xy);
 
     oColor = phong(n, l, v,
         surface.ambient.rgb, light.ambient.rgb,
@@ -0,0 +1,18 @@
+#version 450
+
+out gl_PerVertex {
+    vec4 gl_Position;
+};
+
+void main()
+{
+    vec2 quad[4] = vec2[](
+        // top
+        vec2(-1.,-1.), // left
+        vec2( 1.,-1.), // right
+        // bottom
+        vec2(-1., 1.), // left
+        vec2( 1., 1.)  // right
+    );
+    gl_Position = vec4(quad[gl_VertexIndex], 0., 1.);
+}
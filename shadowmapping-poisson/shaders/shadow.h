@@ -0,0 +1,24 @@
+layout(binding = 4) uniform Parameters {
+    vec4 screenSize; // x, y, 1/x, 1/y
+    float radius;
+    float zbias;
+};
+
+layout(binding = 5) uniform sampler2DShadow shadowMap;
+
+float screenNoise(vec2 fragCoord)
+{
+    vec2 uv = fragCoord * screenSize.zw;
+    float aspectRatio = screenSize.x * screenSize.w;
+    uv.x *= aspectRatio;
+    return noise(uv * screenSize.x);
+}
+
+float shadowFilter(vec4 worldPos, vec2 fragCoord)
+{
+    float theta = screenNoise(fragCoord);
+    vec4 shadowPos = shadowProj * worldPos;
+    vec2 scale = radius/textureSize(shadowMap, 0) * shadowPos.w;
+    mat2 jitMat = jitter(theta * TWO_PI, scale.x, scale.y);
+    return pcf(shadowMap, shadowPos, zbias, jitMat);
+}
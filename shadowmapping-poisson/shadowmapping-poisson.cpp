@@ -1,5 +1,7 @@
 #include "graphicsApp.h"
+#include "gpuTimer.h"
 #include "colorTable.h"
+#include "quadricMesh.h"
 #include "quadric/include/cube.h"
 #include "quadric/include/sphere.h"
 #include "quadric/include/teapot.h"
@@ -12,6 +14,16 @@ class PcfPoissonShadowMapping : public GraphicsApp
         MaxObjects
     };
 
+    enum {
+        AllCasters = 0, CachedStaticCasters, CachedIntervalUpdate,
+        MaxCachingModes
+    };
+
+    enum {
+        ShadowMapPass = 0, CachedShadowMapPass, DepthPrePass, ShadowMaskPass, LightingPass,
+        MaxPasses
+    };
+
     struct alignas(16) Parameters
     {
         rapid::float4a screenSize; // x, y, 1/x, 1/y
@@ -19,19 +31,46 @@ class PcfPoissonShadowMapping : public GraphicsApp
         float zbias;
     };
 
+    struct Constants
+    {
+        VkBool32 shadowMask;
+    };
+
     std::unique_ptr<quadric::Quadric> objects[MaxObjects];
     std::shared_ptr<magma::DynamicUniformBuffer<PhongMaterial>> materials;
     std::shared_ptr<magma::UniformBuffer<Parameters>> parameters;
     std::shared_ptr<magma::GraphicsPipeline> shadowMapPipeline;
     std::shared_ptr<magma::GraphicsPipeline> phongShadowPipeline;
+    std::shared_ptr<magma::GraphicsPipeline> phongMaskPipeline;
     std::shared_ptr<magma::aux::DepthFramebuffer> shadowMap;
     std::shared_ptr<magma::Sampler> shadowSampler;
+    std::shared_ptr<magma::aux::DepthFramebuffer> staticShadowMap;
+    std::shared_ptr<magma::GraphicsPipeline> copyDepthPipeline;
+    std::shared_ptr<magma::PrimaryCommandBuffer> lightingCmdBuffer;
+    std::shared_ptr<magma::aux::DepthFramebuffer> depthPrePass;
+    std::shared_ptr<magma::GraphicsPipeline> depthPipeline;
+    std::shared_ptr<magma::StorageImage2D> shadowMask;
+    std::shared_ptr<magma::ImageView> shadowMaskView;
+    std::shared_ptr<magma::ComputePipeline> shadowMaskPipeline;
+    std::unique_ptr<GpuTimer> gpuTimer;
     DescriptorSet smDescriptor;
+    DescriptorSet copyDescriptor;
+    DescriptorSet maskDescriptor;
     DescriptorSet descriptor;
 
     rapid::matrix objTransforms[MaxObjects];
+    rapid::matrix teapotUpset;
+    rapid::matrix teapotPlacement;
+    const uint32_t staticCasters[2] = {Cube, Sphere};
     float radius = 10.f;
+    float teapotAngle = 0.f;
     bool showDepthMap = false;
+    uint32_t cachingMode = AllCasters;
+    const uint32_t updateInterval = 4; // Frames between updates of distant light
+    uint32_t frameIndex = 0;
+    bool staticCacheValid = false;
+    float cachedSpinX = 0.f;
+    bool screenSpaceMask = false;
 
 public:
     explicit PcfPoissonShadowMapping(const AppEntry& entry):
@@ -42,19 +81,40 @@ public:
         setupMaterials();
         updateParameters();
         createShadowMap();
+        createShadowMask();
         createMeshObjects();
         setupDescriptorSets();
         setupGraphicsPipelines();
+        gpuTimer = std::make_unique<GpuTimer>(commandPools[0],
+            std::vector<std::string>{"Shadow map", "Cached shadow map", "Depth pre-pass", "Shadow mask", "Lighting"});
+        lightingCmdBuffer = std::make_shared<magma::PrimaryCommandBuffer>(commandPools[0]);
 
         renderScene(drawCmdBuffer);
+        renderScene(lightingCmdBuffer, false);
         blit(msaaFramebuffer->getColorView(), FrontBuffer);
         blit(msaaFramebuffer->getColorView(), BackBuffer);
+
+        timer->run();
     }
 
     virtual void render(uint32_t bufferIndex) override
     {
+        gpuTimer->update();
         updateTransforms();
-        submitCommandBuffers(bufferIndex);
+        if ((cachingMode != AllCasters) && (!staticCacheValid || (spinX != cachedSpinX)))
+            updateStaticShadowMap();
+        // Shadow map of distant light may be updated less frequently
+        const bool updateShadowMap = (cachingMode != CachedIntervalUpdate) || (frameIndex++ % updateInterval == 0);
+        queue->submit(updateShadowMap ? drawCmdBuffer : lightingCmdBuffer,
+            VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+            presentFinished, // Wait for swapchain
+            drawSemaphore,
+            nullptr);
+        queue->submit(commandBuffers[bufferIndex],
+            VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+            drawSemaphore, // Wait for scene rendering
+            renderFinished,
+            waitFences[bufferIndex]);
         std::this_thread::sleep_for(std::chrono::milliseconds(2)); // Cap fps
     }
 
@@ -79,6 +139,25 @@ public:
         case AppKey::Space:
             showDepthMap = !showDepthMap;
             renderScene(drawCmdBuffer);
+            renderScene(lightingCmdBuffer, false);
+            break;
+        case AppKey::Tab:
+            cachingMode = (cachingMode + 1) % MaxCachingModes;
+            switch (cachingMode)
+            {
+            case AllCasters: std::cout << "Render all shadow casters every frame" << std::endl; break;
+            case CachedStaticCasters: std::cout << "Cache static shadow casters, render dynamic ones every frame" << std::endl; break;
+            case CachedIntervalUpdate: std::cout << "Cache static shadow casters, update shadow map every "
+                << updateInterval << " frames" << std::endl; break;
+            }
+            renderScene(drawCmdBuffer);
+            break;
+        case AppKey::Enter:
+            screenSpaceMask = !screenSpaceMask;
+            std::cout << (screenSpaceMask ? "Filter shadow in screen space after depth pre-pass" :
+                "Filter shadow in forward lighting pass") << std::endl;
+            renderScene(drawCmdBuffer);
+            renderScene(lightingCmdBuffer, false);
             break;
         }
         VulkanApp::onKeyDown(key, repeat, flags);
@@ -112,7 +191,12 @@ public:
     }
 
     void updateTransforms()
-    {
+    {   // Teapot is the only animated shadow caster
+        constexpr float speed = 0.02f;
+        teapotAngle += timer->millisecondsElapsed() * speed;
+        objTransforms[Teapot] = teapotUpset *
+            rapid::rotationY(rapid::radians(-140.f + teapotAngle)) *
+            teapotPlacement;
         const rapid::matrix rotation = rapid::rotationY(rapid::radians(-spinX / 4.f));
         std::vector<rapid::matrix, core::aligned_allocator<rapid::matrix>> transforms(MaxObjects);
         transforms[Cube] = objTransforms[Cube] * rotation,
@@ -152,13 +236,14 @@ public:
         createTransformBuffer(MaxObjects);
         constexpr float radius = 4.f;
         objTransforms[Cube] = rapid::translation(radius, 1.f, 0.f) * rapid::rotationY(rapid::radians(30.f));
-        const rapid::matrix upset =
+        teapotUpset =
             rapid::rotationX(rapid::radians(-98.f)) *
             rapid::rotationZ(rapid::radians(-30.f)) *
             rapid::translation(0.f, 2.05f, 0.f);
-        objTransforms[Teapot] = upset *
+        teapotPlacement = rapid::translation(radius, 0.f, 0.f) * rapid::rotationY(rapid::radians(150.f));
+        objTransforms[Teapot] = teapotUpset *
             rapid::rotationY(rapid::radians(-140.f)) *
-            rapid::translation(radius, 0.f, 0.f) * rapid::rotationY(rapid::radians(150.f));
+            teapotPlacement;
         objTransforms[Sphere] = rapid::translation(radius, 1.5f, 0.f) * rapid::rotationY(rapid::radians(270.f));
         constexpr float bias = -0.05f; // Shift slightly down to get rid of shadow leakage
         objTransforms[Ground] = rapid::translation(0.f, bias, 0.f);
@@ -199,6 +284,23 @@ public:
         constexpr VkExtent2D extent{2048, 2048};
         shadowMap = std::make_shared<magma::aux::DepthFramebuffer>(device, depthFormat, extent);
         shadowSampler = std::make_shared<magma::DepthSampler>(device, magma::samplers::magMinNearestCompareLessOrEqual);
+        // Depth of static casters is kept between frames
+        staticShadowMap = std::make_shared<magma::aux::DepthFramebuffer>(device, depthFormat, extent);
+    }
+
+    void createShadowMask()
+    {   // Single sample depth to reconstruct world position of each pixel
+        const VkExtent2D extent = msaaFramebuffer->getExtent();
+        depthPrePass = std::make_shared<magma::aux::DepthFramebuffer>(device, VK_FORMAT_D32_SFLOAT, extent);
+        shadowMask = std::make_shared<magma::StorageImage2D>(device, VK_FORMAT_R8G8B8A8_UNORM, extent, 1);
+        shadowMaskView = std::make_shared<magma::ImageView>(shadowMask);
+        magma::helpers::executeCommandBuffer(commandPools[0],
+            [this](std::shared_ptr<magma::CommandBuffer> cmdBuffer)
+            {   // Perform transition from undefined to general image layout
+                const magma::ImageSubresourceRange subresourceRange(shadowMask);
+                cmdBuffer->pipelineBarrier(VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                    magma::ImageMemoryBarrier(shadowMask, VK_IMAGE_LAYOUT_GENERAL, subresourceRange));
+            });
     }
 
     void createMeshObjects()
@@ -207,6 +309,8 @@ public:
         objects[Teapot] = std::make_unique<quadric::Teapot>(16, cmdCopyBuf);
         objects[Sphere] = std::make_unique<quadric::Sphere>(1.5f, 64, 64, false, cmdCopyBuf);
         objects[Ground] = std::make_unique<quadric::Plane>(100.f, 100.f, false, cmdCopyBuf);
+        mesh::optimize(*objects[Teapot], "Teapot", commandPools[0]);
+        mesh::optimize(*objects[Sphere], "Sphere", commandPools[0]);
     }
 
     void setupDescriptorSets()
@@ -218,6 +322,11 @@ public:
             VertexStageBinding(0, DynamicUniformBuffer(1)));
         smDescriptor.set = descriptorPool->allocateDescriptorSet(smDescriptor.layout);
         smDescriptor.set->writeDescriptor(0, transforms);
+        // Copy of cached depth
+        copyDescriptor.layout = std::make_shared<magma::DescriptorSetLayout>(device,
+            FragmentStageBinding(0, CombinedImageSampler(1)));
+        copyDescriptor.set = descriptorPool->allocateDescriptorSet(copyDescriptor.layout);
+        copyDescriptor.set->writeDescriptor(0, staticShadowMap->getDepthView(), nearestClampToEdge);
         // Lighting shader
         descriptor.layout = std::shared_ptr<magma::DescriptorSetLayout>(new magma::DescriptorSetLayout(device,
             {
@@ -226,7 +335,8 @@ public:
                 FragmentStageBinding(2, UniformBuffer(1)),
                 FragmentStageBinding(3, DynamicUniformBuffer(1)),
                 FragmentStageBinding(4, UniformBuffer(1)),
-                FragmentStageBinding(5, CombinedImageSampler(1))
+                FragmentStageBinding(5, CombinedImageSampler(1)),
+                FragmentStageBinding(6, CombinedImageSampler(1)) // Shadow mask
             }));
         descriptor.set = descriptorPool->allocateDescriptorSet(descriptor.layout);
         descriptor.set->writeDescriptor(0, transforms);
@@ -235,6 +345,22 @@ public:
         descriptor.set->writeDescriptor(3, materials);
         descriptor.set->writeDescriptor(4, parameters);
         descriptor.set->writeDescriptor(5, shadowMap->getDepthView(), shadowSampler);
+        descriptor.set->writeDescriptor(6, shadowMaskView, nearestClampToEdge);
+        // Screen-space shadow mask
+        maskDescriptor.layout = std::shared_ptr<magma::DescriptorSetLayout>(new magma::DescriptorSetLayout(device,
+            {
+                ComputeStageBinding(1, UniformBuffer(1)),
+                ComputeStageBinding(4, UniformBuffer(1)),
+                ComputeStageBinding(5, CombinedImageSampler(1)), // Shadow map
+                ComputeStageBinding(6, CombinedImageSampler(1)), // Depth
+                ComputeStageBinding(7, StorageImage(1)) // Shadow mask
+            }));
+        maskDescriptor.set = descriptorPool->allocateDescriptorSet(maskDescriptor.layout);
+        maskDescriptor.set->writeDescriptor(0, viewProjTransforms);
+        maskDescriptor.set->writeDescriptor(1, parameters);
+        maskDescriptor.set->writeDescriptor(2, shadowMap->getDepthView(), shadowSampler);
+        maskDescriptor.set->writeDescriptor(3, depthPrePass->getDepthView(), nearestClampToEdge);
+        maskDescriptor.set->writeDescriptor(4, shadowMaskView, nullptr);
     }
 
     void setupGraphicsPipelines()
@@ -245,24 +371,113 @@ public:
             magma::renderstates::fillCullFrontCW, // Draw only back faces to get rid of shadow acne
             smDescriptor.layout,
             shadowMap);
+        magma::DepthStencilState depthAlwaysWrite(magma::renderstates::depthAlwaysDontWrite);
+        depthAlwaysWrite.depthWriteEnable = VK_TRUE;
+        copyDepthPipeline = std::make_shared<magma::GraphicsPipeline>(device,
+            std::vector<magma::PipelineShaderStage>{
+                loadShaderStage("quad.o"),
+                loadShaderStage("copyDepth.o")
+            },
+            magma::renderstates::nullVertexInput,
+            magma::renderstates::triangleStrip,
+            magma::TesselationState(),
+            magma::ViewportState(0.f, 0.f, shadowMap->getExtent()),
+            magma::renderstates::fillCullBackCW,
+            magma::renderstates::dontMultisample,
+            depthAlwaysWrite,
+            magma::renderstates::dontWriteRgba,
+            std::initializer_list<VkDynamicState>{},
+            std::make_shared<magma::PipelineLayout>(copyDescriptor.layout),
+            shadowMap->getRenderPass(), 0,
+            pipelineCache,
+            nullptr, nullptr, 0);
         phongShadowPipeline = createCommonPipeline(
             "transform.o", "phong.o",
             objects[0]->getVertexInput(),
             descriptor.layout);
+        depthPipeline = createDepthOnlyPipeline("transform.o",
+            objects[0]->getVertexInput(),
+            smDescriptor.layout,
+            depthPrePass);
+        shadowMaskPipeline = createComputePipeline("shadowMask.o", nullptr, maskDescriptor.layout);
+        Constants constants = {VK_TRUE};
+        auto specialization(std::make_shared<magma::Specialization>(constants,
+            magma::SpecializationEntry(0, &Constants::shadowMask)));
+        phongMaskPipeline = createCommonSpecializedPipeline(
+            "transform.o", "phong.o",
+            std::move(specialization),
+            objects[0]->getVertexInput(),
+            descriptor.layout);
     }
 
-    void renderScene(std::shared_ptr<magma::CommandBuffer> cmdBuffer)
+    void renderScene(std::shared_ptr<magma::CommandBuffer> cmdBuffer, bool updateShadowMap = true)
     {
         cmdBuffer->begin();
         {
-            shadowMapPass(cmdBuffer);
+            gpuTimer->reset(cmdBuffer);
+            if (updateShadowMap)
+            {
+                if (AllCasters == cachingMode)
+                    shadowMapPass(cmdBuffer);
+                else
+                    cachedShadowMapPass(cmdBuffer);
+            }
+            if (screenSpaceMask)
+            {
+                depthPass(cmdBuffer);
+                shadowMaskPass(cmdBuffer);
+            }
             lightingPass(cmdBuffer);
         }
         cmdBuffer->end();
     }
 
+    void updateStaticShadowMap()
+    {   // Static casters are re-rendered only when they move
+        magma::helpers::executeCommandBuffer(commandPools[0],
+            [this](std::shared_ptr<magma::CommandBuffer> cmdBuffer)
+            {
+                cmdBuffer->beginRenderPass(staticShadowMap->getRenderPass(), staticShadowMap->getFramebuffer(),
+                    {
+                        magma::clears::depthOne
+                    });
+                {
+                    cmdBuffer->bindPipeline(shadowMapPipeline);
+                    for (uint32_t i : staticCasters)
+                    {
+                        cmdBuffer->bindDescriptorSet(shadowMapPipeline, smDescriptor.set, transforms->getDynamicOffset(i));
+                        objects[i]->draw(cmdBuffer);
+                    }
+                }
+                cmdBuffer->endRenderPass();
+            });
+        cachedSpinX = spinX;
+        staticCacheValid = true;
+    }
+
+    void cachedShadowMapPass(std::shared_ptr<magma::CommandBuffer> cmdBuffer)
+    {
+        gpuTimer->begin(cmdBuffer, CachedShadowMapPass);
+        cmdBuffer->beginRenderPass(shadowMap->getRenderPass(), shadowMap->getFramebuffer(),
+            {
+                magma::clears::depthOne
+            });
+        {   // 1. Restore depth of static casters
+            cmdBuffer->bindPipeline(copyDepthPipeline);
+            cmdBuffer->bindDescriptorSet(copyDepthPipeline, copyDescriptor.set);
+            cmdBuffer->draw(4, 0);
+            // 2. Draw dynamic casters on top
+            cmdBuffer->bindPipeline(shadowMapPipeline);
+            cmdBuffer->bindDescriptorSet(shadowMapPipeline, smDescriptor.set, transforms->getDynamicOffset(Teapot));
+            objects[Teapot]->draw(cmdBuffer);
+        }
+        cmdBuffer->endRenderPass();
+        gpuTimer->end(cmdBuffer, CachedShadowMapPass);
+    }
+
     void shadowMapPass(std::shared_ptr<magma::CommandBuffer> cmdBuffer)
     {
+        gpuTimer->begin(cmdBuffer, ShadowMapPass);
         cmdBuffer->beginRenderPass(shadowMap->getRenderPass(), shadowMap->getFramebuffer(),
             {
                 magma::clears::depthOne
@@ -278,10 +493,45 @@ public:
             }
         }
         cmdBuffer->endRenderPass();
+        gpuTimer->end(cmdBuffer, ShadowMapPass);
+    }
+
+    void depthPass(std::shared_ptr<magma::CommandBuffer> cmdBuffer)
+    {
+        gpuTimer->begin(cmdBuffer, DepthPrePass);
+        cmdBuffer->beginRenderPass(depthPrePass->getRenderPass(), depthPrePass->getFramebuffer(),
+            {
+                magma::clears::depthOne
+            });
+        {
+            cmdBuffer->bindPipeline(depthPipeline);
+            for (uint32_t i = Cube; i < MaxObjects; ++i)
+            {
+                cmdBuffer->bindDescriptorSet(depthPipeline, smDescriptor.set, transforms->getDynamicOffset(i));
+                objects[i]->draw(cmdBuffer);
+            }
+        }
+        cmdBuffer->endRenderPass();
+        gpuTimer->end(cmdBuffer, DepthPrePass);
+    }
+
+    void shadowMaskPass(std::shared_ptr<magma::CommandBuffer> cmdBuffer)
+    {   // Filter shadow once per pixel, regardless of overdraw and sample count
+        gpuTimer->begin(cmdBuffer, ShadowMaskPass);
+        cmdBuffer->pipelineBarrier(VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            magma::MemoryBarrier(VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT));
+        const VkExtent2D extent = depthPrePass->getExtent();
+        cmdBuffer->bindPipeline(shadowMaskPipeline);
+        cmdBuffer->bindDescriptorSet(shadowMaskPipeline, maskDescriptor.set);
+        cmdBuffer->dispatch((extent.width + 7)/8, (extent.height + 7)/8, 1);
+        cmdBuffer->pipelineBarrier(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+            magma::MemoryBarrier(VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT));
+        gpuTimer->end(cmdBuffer, ShadowMaskPass);
     }
 
     void lightingPass(std::shared_ptr<magma::CommandBuffer> cmdBuffer)
     {
+        gpuTimer->begin(cmdBuffer, LightingPass);
         cmdBuffer->beginRenderPass(msaaFramebuffer->getRenderPass(), msaaFramebuffer->getFramebuffer(),
             {
                 magma::ClearColor(0.35f, 0.53f, 0.7f, 1.0f),
@@ -290,10 +540,11 @@ public:
         {
             cmdBuffer->setViewport(magma::Viewport(0, 0, msaaFramebuffer->getExtent()));
             cmdBuffer->setScissor(magma::Scissor(0, 0, msaaFramebuffer->getExtent()));
-            cmdBuffer->bindPipeline(phongShadowPipeline);
+            std::shared_ptr<magma::GraphicsPipeline> pipeline = screenSpaceMask ? phongMaskPipeline : phongShadowPipeline;
+            cmdBuffer->bindPipeline(pipeline);
             for (uint32_t i = Cube; i < MaxObjects; ++i)
             {
-                cmdBuffer->bindDescriptorSet(phongShadowPipeline, descriptor.set, {
+                cmdBuffer->bindDescriptorSet(pipeline, descriptor.set, {
                     transforms->getDynamicOffset(i),
                     materials->getDynamicOffset(i)
                 });
@@ -303,6 +554,7 @@ public:
                 drawDepthMap(cmdBuffer);
         }
         cmdBuffer->endRenderPass();
+        gpuTimer->end(cmdBuffer, LightingPass);
     }
 
     void drawDepthMap(std::shared_ptr<magma::CommandBuffer> cmdBuffer)
@@ -0,0 +1,315 @@
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include "lightFrustum.h"
+#include "viewProjection.h"
+
+namespace
+{
+typedef rapid::float3 float3;
+
+struct Plane
+{
+    float3 normal; // Points inside
+    float d;
+};
+
+// Box corner index: bit 0 - right, bit 1 - top, bit 2 - far
+constexpr uint32_t boxFaces[6][4] = {
+    {0, 2, 6, 4}, {1, 5, 7, 3}, // left, right
+    {0, 4, 5, 1}, {2, 3, 7, 6}, // bottom, top
+    {0, 1, 3, 2}, {4, 6, 7, 5}  // near, far
+};
+
+inline float3 add(const float3& a, const float3& b) noexcept { return float3(a.x + b.x, a.y + b.y, a.z + b.z); }
+inline float3 sub(const float3& a, const float3& b) noexcept { return float3(a.x - b.x, a.y - b.y, a.z - b.z); }
+inline float3 mul(const float3& a, float s) noexcept { return float3(a.x * s, a.y * s, a.z * s); }
+inline float dot(const float3& a, const float3& b) noexcept { return a.x * b.x + a.y * b.y + a.z * b.z; }
+inline float3 cross(const float3& a, const float3& b) noexcept { return float3(a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x); }
+inline float length(const float3& a) noexcept { return sqrtf(dot(a, a)); }
+inline float3 normalize(const float3& a) noexcept { return mul(a, 1.f/length(a)); }
+
+void lookAtBasis(const ViewProjection& viewProj, float3& dir, float3& right, float3& up) noexcept
+{   // Same as in left-handed look-at transform
+    dir = normalize(sub(viewProj.getFocus(), viewProj.getPosition()));
+    right = normalize(cross(float3(0.f, 1.f, 0.f), dir));
+    up = cross(dir, right);
+}
+
+void frustumCorners(const ViewProjection& viewProj, float3 corners[8]) noexcept
+{
+    float3 dir, right, up;
+    lookAtBasis(viewProj, dir, right, up);
+    const float tanHalfFov = tanf(rapid::radians(viewProj.getFieldOfView()) * 0.5f);
+    for (uint32_t i = 0; i < 8; ++i)
+    {
+        const float z = (i & 4) ? viewProj.getFarZ() : viewProj.getNearZ();
+        const float x = ((i & 1) ? 1.f : -1.f) * z * tanHalfFov * viewProj.getAspectRatio();
+        const float y = ((i & 2) ? 1.f : -1.f) * z * tanHalfFov;
+        corners[i] = add(add(add(viewProj.getPosition(), mul(dir, z)), mul(right, x)), mul(up, y));
+    }
+}
+
+void boxPlanes(const float3 corners[8], Plane planes[6]) noexcept
+{
+    float3 center(0.f, 0.f, 0.f);
+    for (uint32_t i = 0; i < 8; ++i)
+        center = add(center, corners[i]);
+    center = mul(center, 1.f/8.f);
+    for (uint32_t i = 0; i < 6; ++i)
+    {
+        const float3& a = corners[boxFaces[i][0]];
+        const float3& b = corners[boxFaces[i][1]];
+        const float3& c = corners[boxFaces[i][2]];
+        float3 normal = normalize(cross(sub(b, a), sub(c, a)));
+        if (dot(normal, sub(center, a)) < 0.f)
+            normal = mul(normal, -1.f);
+        planes[i] = Plane{normal, -dot(normal, a)};
+    }
+}
+
+void clip(std::vector<float3>& polygon, const Plane& plane)
+{   // Sutherland-Hodgman
+    std::vector<float3> clipped;
+    for (std::size_t i = 0, n = polygon.size(); i < n; ++i)
+    {
+        const float3& a = polygon[i];
+        const float3& b = polygon[(i + 1) % n];
+        const float da = dot(plane.normal, a) + plane.d;
+        const float db = dot(plane.normal, b) + plane.d;
+        if (da >= 0.f)
+            clipped.push_back(a);
+        if ((da >= 0.f) != (db >= 0.f))
+            clipped.push_back(add(a, mul(sub(b, a), da/(da - db))));
+    }
+    polygon.swap(clipped);
+}
+
+void intersect(const float3 *const boxes[], uint32_t count, std::vector<float3>& vertices)
+{   // Faces of each box clipped by the others give vertices of convex intersection
+    Plane planes[3][6];
+    for (uint32_t i = 0; i < count; ++i)
+        boxPlanes(boxes[i], planes[i]);
+    std::vector<float3> polygon;
+    vertices.clear();
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        for (const auto& face : boxFaces)
+        {
+            polygon.assign({boxes[i][face[0]], boxes[i][face[1]], boxes[i][face[2]], boxes[i][face[3]]});
+            for (uint32_t j = 0; (j < count) && !polygon.empty(); ++j)
+            {
+                if (j != i)
+                {
+                    for (const Plane& plane : planes[j])
+                        clip(polygon, plane);
+                }
+            }
+            vertices.insert(vertices.end(), polygon.begin(), polygon.end());
+        }
+    }
+}
+} // namespace
+
+LightFrustum::LightFrustum(const rapid::float3& sceneMin, const rapid::float3& sceneMax) noexcept
+{
+    for (uint32_t i = 0; i < 8; ++i)
+    {
+        sceneCorners[i] = float3(
+            (i & 1) ? sceneMax.x : sceneMin.x,
+            (i & 2) ? sceneMax.y : sceneMin.y,
+            (i & 4) ? sceneMax.z : sceneMin.z);
+    }
+}
+
+void LightFrustum::setup(const ViewProjection& light) noexcept
+{
+    eye = light.getPosition();
+    lookAtBasis(light, dir, right, up);
+    const float tanHalfFov = tanf(rapid::radians(light.getFieldOfView()) * 0.5f);
+    tanRight = tanHalfFov * light.getAspectRatio();
+    tanLeft = -tanRight;
+    tanTop = tanHalfFov;
+    tanBottom = -tanTop;
+    zNear = light.getNearZ();
+    zFar = light.getFarZ();
+    receivers.clear();
+    warped = false;
+}
+
+bool LightFrustum::fit(const ViewProjection& camera, const ViewProjection& light)
+{
+    setup(light);
+    float3 cameraCorners[8], lightCorners[8];
+    frustumCorners(camera, cameraCorners);
+    frustumCorners(light, lightCorners);
+    const float3 *const boxes[3] = {cameraCorners, lightCorners, sceneCorners};
+    intersect(boxes, 3, receivers);
+    if (receivers.empty())
+        return false;
+    // Casters may be out of camera frustum
+    std::vector<float3> casters;
+    intersect(boxes + 1, 2, casters);
+    constexpr float maxFloat = std::numeric_limits<float>::max();
+    float minX = maxFloat, maxX = -maxFloat;
+    float minY = maxFloat, maxY = -maxFloat;
+    float minZ = maxFloat, maxZ = 0.f;
+    for (const float3& pos : receivers)
+    {
+        const float3 v = lightView(pos);
+        const float z = std::max(v.z, zNear);
+        minX = std::min(minX, v.x/z);
+        maxX = std::max(maxX, v.x/z);
+        minY = std::min(minY, v.y/z);
+        maxY = std::max(maxY, v.y/z);
+        maxZ = std::max(maxZ, v.z);
+    }
+    for (const float3& pos : casters)
+        minZ = std::min(minZ, lightView(pos).z);
+    constexpr float minExtent = 1e-3f;
+    if ((maxX - minX < minExtent) || (maxY - minY < minExtent))
+        return false;
+    // Stay inside of light cone
+    tanLeft = std::max(tanLeft, minX);
+    tanRight = std::min(tanRight, maxX);
+    tanBottom = std::max(tanBottom, minY);
+    tanTop = std::min(tanTop, maxY);
+    zNear = std::max(zNear, minZ);
+    zFar = std::max(std::min(zFar, maxZ), zNear + minExtent);
+    return true;
+}
+
+bool LightFrustum::warp(const ViewProjection& camera, float warpScale) noexcept
+{
+    warped = false;
+    if (receivers.empty())
+        return false;
+    float3 forward, cameraRight, cameraUp;
+    lookAtBasis(camera, forward, cameraRight, cameraUp);
+    const float3 cameraEye = camera.getPosition();
+    constexpr float maxFloat = std::numeric_limits<float>::max();
+    float zn = maxFloat, zf = 0.f;
+    float3 center(0.f, 0.f, 0.f);
+    for (const float3& pos : receivers)
+    {
+        const float z = dot(sub(pos, cameraEye), forward);
+        zn = std::min(zn, z);
+        zf = std::max(zf, z);
+        center = add(center, pos);
+    }
+    zn = std::max(zn, camera.getNearZ());
+    if (zf - zn < 1e-3f)
+        return false;
+    center = mul(center, 1.f/receivers.size());
+    const float sinGamma = length(cross(forward, normalize(sub(center, eye))));
+    if (sinGamma < 0.01f)
+        return false; // Looking along the light
+    // Optimal distance from projection center, relative to receivers depth
+    const float nOpt = (zn + sqrtf(zn * zf))/sinGamma;
+    const float ratio = nOpt/((zf - zn) * sinGamma) * warpScale;
+    if (ratio > 100.f)
+        return false; // Negligible warp
+    // View direction in post-perspective space of the light
+    const float3 v0 = lightView(add(cameraEye, mul(forward, zn)));
+    const float3 v1 = lightView(add(cameraEye, mul(forward, zf)));
+    if ((v0.z <= 0.f) || (v1.z <= 0.f))
+        return false;
+    const float3 q0 = lightNdc(v0);
+    const float3 q1 = lightNdc(v1);
+    const float dx = q1.x - q0.x;
+    const float dy = q1.y - q0.y;
+    const float len = sqrtf(dx * dx + dy * dy);
+    if (len < 1e-4f)
+        return false;
+    ax = dx/len;
+    ay = dy/len;
+    std::vector<float3> points;
+    points.reserve(receivers.size());
+    float minA = maxFloat, maxA = -maxFloat;
+    for (const float3& pos : receivers)
+    {
+        const float3 v = lightView(pos);
+        points.push_back(lightNdc(float3(v.x, v.y, std::max(v.z, zNear))));
+        const float a = points.back().x * ax + points.back().y * ay;
+        minA = std::min(minA, a);
+        maxA = std::max(maxA, a);
+    }
+    const float d = std::max(maxA - minA, 1e-3f);
+    const float n = ratio * d;
+    const float f = n + d;
+    eyeA = minA - n;
+    eyeB = q0.x * ay - q0.y * ax;
+    float minB = maxFloat, maxB = -maxFloat, maxZ = 0.f;
+    for (const float3& q : points)
+    {
+        const float a = q.x * ax + q.y * ay - eyeA;
+        const float b = q.x * ay - q.y * ax - eyeB;
+        minB = std::min(minB, b/a);
+        maxB = std::max(maxB, b/a);
+        maxZ = std::max(maxZ, q.z/a);
+    }
+    if ((maxB - minB < 1e-6f) || (maxZ <= 0.f))
+        return false;
+    scaleB = 2.f/(maxB - minB);
+    offsetB = (maxB + minB)/(maxB - minB);
+    alpha = (f + n)/(f - n);
+    beta = -2.f * n * f/(f - n);
+    scaleZ = 1.f/maxZ;
+    warped = true;
+    return true;
+}
+
+rapid::matrix LightFrustum::getViewProj() const noexcept
+{
+    const rapid::matrix view(
+        right.x, up.x, dir.x, 0.f,
+        right.y, up.y, dir.y, 0.f,
+        right.z, up.z, dir.z, 0.f,
+        -dot(right, eye), -dot(up, eye), -dot(dir, eye), 1.f);
+    const float sx = 2.f/(tanRight - tanLeft);
+    const float sy = 2.f/(tanTop - tanBottom);
+    const float sz = zFar/(zFar - zNear);
+    // Off-center perspective projection with Vulkan Y flip
+    const rapid::matrix proj(
+        sx, 0.f, 0.f, 0.f,
+        0.f, -sy, 0.f, 0.f,
+        -(tanRight + tanLeft) * sx * .5f, (tanTop + tanBottom) * sy * .5f, sz, 1.f,
+        0.f, 0.f, -zNear * sz, 0.f);
+    if (!warped)
+        return view * proj;
+    // Perspective along (ax, ay), orthographic along the light direction
+    const rapid::matrix warp(
+        scaleB * ay - offsetB * ax, alpha * ax, 0.f, ax,
+        -scaleB * ax - offsetB * ay, alpha * ay, 0.f, ay,
+        0.f, 0.f, scaleZ, 0.f,
+        offsetB * eyeA - scaleB * eyeB, beta - alpha * eyeA, 0.f, -eyeA);
+    return view * proj * warp;
+}
+
+rapid::float3 LightFrustum::project(const rapid::float3& pos) const noexcept
+{   // Same as getViewProj() followed by perspective division
+    float3 ndc = lightNdc(lightView(pos));
+    if (warped)
+    {
+        const float a = ndc.x * ax + ndc.y * ay - eyeA;
+        const float b = ndc.x * ay - ndc.y * ax - eyeB;
+        ndc = float3(scaleB * b/a - offsetB, alpha + beta/a, scaleZ * ndc.z/a);
+    }
+    return float3(ndc.x * .5f + .5f, ndc.y * .5f + .5f, ndc.z);
+}
+
+rapid::float3 LightFrustum::lightView(const rapid::float3& pos) const noexcept
+{
+    const float3 v = sub(pos, eye);
+    return float3(dot(v, right), dot(v, up), dot(v, dir));
+}
+
+rapid::float3 LightFrustum::lightNdc(const rapid::float3& viewPos) const noexcept
+{
+    const float x = 2.f * viewPos.x/viewPos.z;
+    const float y = 2.f * viewPos.y/viewPos.z;
+    return float3(
+        (x - (tanRight + tanLeft))/(tanRight - tanLeft),
+        ((tanTop + tanBottom) - y)/(tanTop - tanBottom),
+        zFar/(zFar - zNear) * (1.f - zNear/viewPos.z));
+}
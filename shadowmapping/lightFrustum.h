@@ -0,0 +1,43 @@
+#pragma once
+#include <vector>
+#include "core/noncopyable.h"
+#include "rapid/rapid.h"
+
+class ViewProjection;
+
+/* Perspective frustum of spot light. It may be fitted to the intersection
+   of camera frustum, light frustum and scene bounds, then warped in
+   post-perspective space of the light (LiSPSM) to increase shadow map
+   texel density near the viewer. */
+
+class LightFrustum : public core::NonCopyable
+{
+public:
+    explicit LightFrustum(const rapid::float3& sceneMin, const rapid::float3& sceneMax) noexcept;
+    void setup(const ViewProjection& light) noexcept;
+    bool fit(const ViewProjection& camera, const ViewProjection& light);
+    bool warp(const ViewProjection& camera, float warpScale) noexcept;
+    bool isWarped() const noexcept { return warped; }
+    rapid::matrix getViewProj() const noexcept;
+    rapid::float3 project(const rapid::float3& pos) const noexcept;
+
+private:
+    rapid::float3 lightView(const rapid::float3& pos) const noexcept;
+    rapid::float3 lightNdc(const rapid::float3& viewPos) const noexcept;
+
+    rapid::float3 sceneCorners[8];
+    std::vector<rapid::float3> receivers; // Vertices of fitted body
+    // Light view basis
+    rapid::float3 eye, right, up, dir;
+    // Off-center frustum in units of tangent
+    float tanLeft = -1.f, tanRight = 1.f;
+    float tanBottom = -1.f, tanTop = 1.f;
+    float zNear = 1.f, zFar = 100.f;
+    // Perspective warp along axis (ax, ay) in light NDC
+    bool warped = false;
+    float ax = 0.f, ay = 1.f;
+    float eyeA = 0.f, eyeB = 0.f;
+    float scaleB = 1.f, offsetB = 0.f;
+    float alpha = 1.f, beta = 0.f;
+    float scaleZ = 1.f;
+};
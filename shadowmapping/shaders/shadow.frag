@@ -9,6 +9,11 @@ layout(binding = 2) uniform LightSource {
 
 layout(binding = 3) uniform sampler2DShadow shadowMap;
 
+layout(binding = 4) uniform ShadowFrustum {
+    mat4 lightViewProj;
+    mat4 shadowProj;
+} frustum;
+
 layout(location = 0) in vec4 worldPos;
 layout(location = 1) in vec3 viewPos;
 layout(location = 2) in vec3 viewNormal;
@@ -17,7 +22,7 @@ layout(location = 0) out vec3 oColor;
 
 void main()
 {
-    vec4 clipPos = shadowProj * worldPos;
+    vec4 clipPos = frustum.shadowProj * worldPos;
     float shadow = textureProj(shadowMap, clipPos);
 
     vec3 n = normalize(viewNormal);
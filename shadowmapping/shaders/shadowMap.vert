@@ -2,6 +2,11 @@
 #extension GL_GOOGLE_include_directive : enable
 #include "common/transforms.h"
 
+layout(binding = 4) uniform ShadowFrustum {
+    mat4 lightViewProj;
+    mat4 shadowProj;
+} frustum;
+
 layout(location = 0) in vec4 position;
 
 out gl_PerVertex {
@@ -10,5 +15,5 @@ out gl_PerVertex {
 
 void main()
 {
-    gl_Position = worldLightProj * position;
+    gl_Position = frustum.lightViewProj * world * position;
 }
@@ -1,19 +1,37 @@
 #include "graphicsApp.h"
+#include "quadricMesh.h"
 #include "quadric/include/teapot.h"
 #include "quadric/include/plane.h"
+#include "lightFrustum.h"
 
 class ShadowMapping : public GraphicsApp
 {
+    enum FrustumMode
+    {
+        FixedFrustum, FittedFrustum, WarpedFrustum
+    };
+
+    struct alignas(16) ShadowFrustum
+    {
+        rapid::matrix lightViewProj;
+        rapid::matrix shadowProj;
+    };
+
     std::unique_ptr<quadric::Teapot> teapot;
     std::unique_ptr<quadric::Plane> ground;
     std::shared_ptr<magma::GraphicsPipeline> shadowMapPipeline;
     std::shared_ptr<magma::GraphicsPipeline> diffuseShadowPipeline;
     std::shared_ptr<magma::aux::DepthFramebuffer> shadowMap;
     std::shared_ptr<magma::Sampler> shadowSampler;
+    std::shared_ptr<magma::UniformBuffer<ShadowFrustum>> shadowFrustum;
+    std::unique_ptr<LightFrustum> lightFrustum;
     DescriptorSet smDescriptor;
     DescriptorSet descriptor;
 
     rapid::matrix objTransforms[2];
+    FrustumMode frustumMode = FixedFrustum;
+    uint32_t shadowMapSize = 2048;
+    float warpScale = 1.f;
     bool showDepthMap = false;
 
 public:
@@ -23,6 +41,8 @@ public:
         setupViewProjection();
         setupTransforms();
         createShadowMap();
+        updateShadowFrustum();
+        printTexelDensity();
         createMeshObjects();
         setupDescriptorSets();
         setupGraphicsPipelines();
@@ -36,6 +56,7 @@ public:
     {
         updateTransforms();
         updateViewProjTransforms();
+        updateShadowFrustum();
         submitCommandBuffers(bufferIndex);
         std::this_thread::sleep_for(std::chrono::milliseconds(2)); // Cap fps
     }
@@ -64,9 +85,42 @@ public:
             showDepthMap = !showDepthMap;
             renderScene(drawCmdBuffer);
             break;
+        case AppKey::Tab:
+            frustumMode = FrustumMode((frustumMode + 1) % 3);
+            break;
+        case AppKey::PgUp:
+            if (shadowMapSize < shadowMap->getExtent().width)
+                shadowMapSize *= 2;
+            renderScene(drawCmdBuffer);
+            break;
+        case AppKey::PgDn:
+            if (shadowMapSize > 256)
+                shadowMapSize /= 2;
+            renderScene(drawCmdBuffer);
+            break;
+        case AppKey::Home:
+            warpScale = std::max(warpScale * 0.5f, 0.125f);
+            break;
+        case AppKey::End:
+            warpScale = std::min(warpScale * 2.f, 8.f);
+            break;
         }
         lightViewProj->updateView();
         lightViewProj->updateProjection();
+        switch (key)
+        {
+        case AppKey::Left:
+        case AppKey::Right:
+        case AppKey::Up:
+        case AppKey::Down:
+        case AppKey::Tab:
+        case AppKey::PgUp:
+        case AppKey::PgDn:
+        case AppKey::Home:
+        case AppKey::End:
+            printTexelDensity();
+            break;
+        }
         VulkanApp::onKeyDown(key, repeat, flags);
     }
 
@@ -116,12 +170,83 @@ public:
         constexpr VkExtent2D extent{2048, 2048};
         shadowMap = std::make_shared<magma::aux::DepthFramebuffer>(device, depthFormat, extent);
         shadowSampler = std::make_shared<magma::DepthSampler>(device, magma::samplers::magMinNearestCompareLessOrEqual);
+        shadowFrustum = std::make_shared<magma::UniformBuffer<ShadowFrustum>>(device);
+        // Ground and bounding box of teapot
+        lightFrustum = std::make_unique<LightFrustum>(rapid::float3(-50.f, 0.f, -50.f), rapid::float3(50.f, 4.f, 50.f));
+    }
+
+    void setupLightFrustum(FrustumMode mode)
+    {
+        lightFrustum->setup(*lightViewProj);
+        if (mode != FixedFrustum)
+        {
+            if (lightFrustum->fit(*viewProj, *lightViewProj) && (WarpedFrustum == mode))
+                lightFrustum->warp(*viewProj, warpScale);
+        }
+    }
+
+    void updateShadowFrustum()
+    {
+        setupLightFrustum(frustumMode);
+        // (x,y) [-1,1] -> [0,1] scaled to used region of shadow map
+        const float scale = shadowMapSize/float(shadowMap->getExtent().width);
+        const rapid::matrix bias(
+            .5f * scale, .0f, 0.f, 0.f,
+            .0f, .5f * scale, 0.f, 0.f,
+            .0f, .0f, 1.f, 0.f,
+            .5f * scale, .5f * scale, 0.f, 1.f);
+        const rapid::matrix lightProj = lightFrustum->getViewProj();
+        magma::helpers::mapScoped(shadowFrustum,
+            [&lightProj, &bias](auto *frustum)
+            {
+                frustum->lightViewProj = lightProj;
+                frustum->shadowProj = lightProj * bias;
+            });
+    }
+
+    float texelDensity() const
+    {   // Shadow map texels per screen pixel at the closest visible point of the ground
+        const rapid::vector3 up(0.f, 1.f, 0.f);
+        const rapid::vector3 eye(viewProj->getPosition());
+        const rapid::vector3 forward = (rapid::vector3(viewProj->getFocus()) - eye).normalized();
+        const rapid::vector3 right = (up ^ forward).normalized();
+        const rapid::vector3 cameraUp = forward ^ right;
+        const float tanHalfFov = tanf(rapid::radians(viewProj->getFieldOfView()) * 0.5f);
+        auto texCoord = [&](float x, float y)
+        {
+            const rapid::vector3 dir = forward + right * (x * tanHalfFov * viewProj->getAspectRatio()) + cameraUp * (y * tanHalfFov);
+            const rapid::vector3 pos = eye + dir * (-eye.y()/dir.y());
+            const rapid::float3 tc = lightFrustum->project(rapid::float3(pos.x(), pos.y(), pos.z()));
+            return rapid::float2(tc.x * shadowMapSize, tc.y * shadowMapSize);
+        };
+        constexpr float y = -0.95f; // Near the bottom of the screen
+        const rapid::float2 tc = texCoord(0.f, y);
+        const rapid::float2 dx = texCoord(2.f/width, y);
+        const rapid::float2 dy = texCoord(0.f, y + 2.f/height);
+        const float det = (dx.x - tc.x) * (dy.y - tc.y) - (dx.y - tc.y) * (dy.x - tc.x);
+        return sqrtf(fabsf(det));
+    }
+
+    void printTexelDensity()
+    {
+        static const char *modeNames[] = {"Fixed", "Fitted", "Warped"};
+        std::cout << "Shadow map " << shadowMapSize << "x" << shadowMapSize << ", warp scale " << warpScale << std::endl;
+        for (int mode = FixedFrustum; mode <= WarpedFrustum; ++mode)
+        {
+            setupLightFrustum(FrustumMode(mode));
+            const float density = texelDensity();
+            std::cout << (mode == frustumMode ? "* " : "  ") << modeNames[mode] << " frustum: "
+                << density << " texels/pixel, " << uint32_t(shadowMapSize/density) << "^2 for 1 texel/pixel"
+                << (mode == WarpedFrustum && !lightFrustum->isWarped() ? " (no warp)" : "") << std::endl;
+        }
+        setupLightFrustum(frustumMode);
     }
 
     void createMeshObjects()
     {
         teapot = std::make_unique<quadric::Teapot>(16, cmdCopyBuf);
         ground = std::make_unique<quadric::Plane>(100.f, 100.f, false, cmdCopyBuf);
+        mesh::optimize(*teapot, "Teapot", commandPools[0]);
     }
 
     void setupDescriptorSets()
@@ -129,23 +254,29 @@ public:
         using namespace magma::bindings;
         using namespace magma::descriptors;
         // Shadow map shader
-        smDescriptor.layout = std::make_shared<magma::DescriptorSetLayout>(device,
-            VertexStageBinding(0, magma::descriptors::DynamicUniformBuffer(1)));
+        smDescriptor.layout = std::shared_ptr<magma::DescriptorSetLayout>(new magma::DescriptorSetLayout(device,
+            {
+                VertexStageBinding(0, DynamicUniformBuffer(1)),
+                VertexStageBinding(4, UniformBuffer(1))
+            }));
         smDescriptor.set = descriptorPool->allocateDescriptorSet(smDescriptor.layout);
         smDescriptor.set->writeDescriptor(0, transforms);
+        smDescriptor.set->writeDescriptor(1, shadowFrustum);
         // Lighting shader
         descriptor.layout = std::shared_ptr<magma::DescriptorSetLayout>(new magma::DescriptorSetLayout(device,
             {
                 VertexStageBinding(0, DynamicUniformBuffer(1)),
                 FragmentStageBinding(1, UniformBuffer(1)),
                 FragmentStageBinding(2, UniformBuffer(1)),
-                FragmentStageBinding(3, CombinedImageSampler(1))
+                FragmentStageBinding(3, CombinedImageSampler(1)),
+                FragmentStageBinding(4, UniformBuffer(1))
             }));
         descriptor.set = descriptorPool->allocateDescriptorSet(descriptor.layout);
         descriptor.set->writeDescriptor(0, transforms);
         descriptor.set->writeDescriptor(1, viewProjTransforms);
         descriptor.set->writeDescriptor(2, lightSource);
         descriptor.set->writeDescriptor(3, shadowMap->getDepthView(), shadowSampler);
+        descriptor.set->writeDescriptor(4, shadowFrustum);
     }
 
     void setupGraphicsPipelines()
@@ -178,9 +309,10 @@ public:
             {
                 magma::clears::depthOne
             });
-        {
-            cmdBuffer->setViewport(magma::Viewport(0, 0, shadowMap->getExtent()));
-            cmdBuffer->setScissor(magma::Scissor(0, 0, shadowMap->getExtent()));
+        {   // Smaller shadow map is rendered to the corner
+            const VkExtent2D extent{shadowMapSize, shadowMapSize};
+            cmdBuffer->setViewport(magma::Viewport(0, 0, extent));
+            cmdBuffer->setScissor(magma::Scissor(0, 0, extent));
             cmdBuffer->bindPipeline(shadowMapPipeline);
             cmdBuffer->bindDescriptorSet(shadowMapPipeline, smDescriptor.set, transforms->getDynamicOffset(0));
             teapot->draw(cmdBuffer);
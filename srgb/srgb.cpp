@@ -1,5 +1,6 @@
 #include "graphicsApp.h"
 #include "colorTable.h"
+#include "quadricMesh.h"
 #include "quadric/include/sphere.h"
 
 class GammaCorrection : public GraphicsApp
@@ -79,6 +80,7 @@ public:
     void createMesh()
     {
         sphere = std::make_unique<quadric::Sphere>(1.f, 64, 64, false, cmdCopyBuf);
+        mesh::optimize(*sphere, "Sphere", commandPools[0]);
     }
 
     void setupDescriptorSets()
@@ -1,48 +1,75 @@
+#include <cassert>
+#include <limits>
+#include <vector>
 #include "gridMesh.h"
 #include "magma/magma.h"
 #include "rapid/rapid.h"
 
 GridMesh::GridMesh(uint16_t rows, uint16_t cols, float scale,
-    std::shared_ptr<magma::CommandBuffer> cmdBuffer)
+    std::shared_ptr<magma::CommandBuffer> cmdBuffer):
+    rows(rows),
+    columns(cols),
+    scale(scale)
 {
     const float dx = scale/cols;
     const float dz = scale/rows;
     const float o = -scale * .5f;
-    const std::size_t vertexBufferSize = (rows + 1) * (cols + 1) * sizeof(rapid::half2);
-    const std::size_t indexBufferSize = rows * (3 + cols * 2) * sizeof(uint16_t);
-    std::shared_ptr<magma::SrcTransferBuffer> stagingBuffer(std::make_shared<magma::SrcTransferBuffer>(
-        cmdBuffer->getDevice(), vertexBufferSize + indexBufferSize));
-    void *data = stagingBuffer->getMemory()->map();
-    rapid::half2 *vert = (rapid::half2 *)data;
+    const uint32_t vertexCount = (rows + 1) * (cols + 1);
+    std::vector<float> positions;
+    positions.reserve(vertexCount * 3);
     // Setup X, Z coordinates
     float z = o;
     for (uint16_t i = 0, n = rows + 1; i < n; ++i, z += dz)
     {
         float x = o;
         for (uint16_t j = 0, m = cols + 1; j < m; ++j, x += dx)
-        {   // Quantize floats to halves
-            vert->x = rapid::ftoh(x);
-            vert->y = rapid::ftoh(z);
-            ++vert;
+        {
+            positions.push_back(x);
+            positions.push_back(0.f);
+            positions.push_back(z);
         }
     }
-    uint16_t *idx = (uint16_t *)((char *)data + vertexBufferSize);
-    const uint16_t stride = cols + 1;
+    const uint32_t stride = cols + 1;
+    std::vector<uint32_t> strip;
+    strip.reserve(rows * (3 + cols * 2));
     // Generate indices of triangle strip
-    for (uint16_t i = 0; i < rows; ++i)
+    for (uint32_t i = 0; i < rows; ++i)
     {
-        const uint16_t first = i * stride;
-        *idx++ = first;
-        *idx++ = first + stride;
-        for (uint16_t j = 0, k = 1; j < cols; ++j, ++k)
+        const uint32_t first = i * stride;
+        strip.push_back(first);
+        strip.push_back(first + stride);
+        for (uint32_t k = 1; k <= cols; ++k)
         {
-            *idx++ = first + k;
-            *idx++ = first + k + stride;
+            strip.push_back(first + k);
+            strip.push_back(first + k + stride);
             assert(first + k + stride <= std::numeric_limits<uint16_t>::max());
         }
-        // Restart strip
-        *idx++ = std::numeric_limits<uint16_t>::max();
+        // Restart strip, sentinel is out of 16-bit vertex range
+        strip.push_back(~0u);
     }
+    // Row strips reuse only two vertices per triangle pair, so reorder them as triangle list
+    std::vector<uint32_t> indices = mesh::unrollTriangleStrip(strip, ~0u);
+    stripIndexCount = uint32_t(strip.size());
+    indexCount = uint32_t(indices.size());
+    stripCacheStats = mesh::analyzeVertexCache(indices, vertexCount);
+    const std::vector<uint32_t> vertexOrder = mesh::optimize(indices, positions.data(),
+        uint32_t(sizeof(float) * 3), vertexCount);
+    cacheStats = mesh::analyzeVertexCache(indices, vertexCount);
+    const std::size_t vertexBufferSize = vertexCount * sizeof(rapid::half2);
+    const std::size_t indexBufferSize = indices.size() * sizeof(uint16_t);
+    std::shared_ptr<magma::SrcTransferBuffer> stagingBuffer(std::make_shared<magma::SrcTransferBuffer>(
+        cmdBuffer->getDevice(), vertexBufferSize + indexBufferSize));
+    void *data = stagingBuffer->getMemory()->map();
+    rapid::half2 *vert = (rapid::half2 *)data;
+    for (uint32_t v : vertexOrder)
+    {   // Quantize floats to halves
+        vert->x = rapid::ftoh(positions[v * 3]);
+        vert->y = rapid::ftoh(positions[v * 3 + 2]);
+        ++vert;
+    }
+    uint16_t *idx = (uint16_t *)((char *)data + vertexBufferSize);
+    for (uint32_t index : indices)
+        *idx++ = uint16_t(index);
     // Create vertex and index buffers
     vertexBuffer = std::make_shared<magma::VertexBuffer>(cmdBuffer,
         stagingBuffer, vertexBufferSize, 0);
@@ -51,9 +78,51 @@ GridMesh::GridMesh(uint16_t rows, uint16_t cols, float scale,
     stagingBuffer->getMemory()->unmap();
 }
 
-void GridMesh::draw(std::shared_ptr<magma::CommandBuffer> cmdBuffer)
+GridMesh::GridMesh(uint32_t rows, uint32_t columns, float scale) noexcept:
+    rows(rows),
+    columns(columns),
+    scale(scale)
+{}
+
+const magma::VertexInputState& GridMesh::getVertexInput() const noexcept
+{
+    if (pulled())
+        return magma::renderstates::nullVertexInput;
+    return magma::renderstates::pos2h;
+}
+
+const magma::InputAssemblyState& GridMesh::getInputAssembly() const noexcept
+{   // Pulled grid draws strip per row, indexed grid is optimized triangle list
+    if (pulled())
+        return magma::renderstates::triangleStrip;
+    return magma::renderstates::triangleList;
+}
+
+uint64_t GridMesh::getMemorySize() const noexcept
 {
+    if (pulled())
+        return 0;
+    return vertexBuffer->getSize() + indexBuffer->getSize();
+}
+
+uint32_t GridMesh::getVertexCount() const noexcept
+{   // Pulled grid has no vertex reuse, so vertices between rows are shaded twice
+    if (pulled())
+        return rows * (columns + 1) * 2;
+    return (rows + 1) * (columns + 1);
+}
+
+void GridMesh::draw(std::shared_ptr<magma::CommandBuffer> cmdBuffer, uint32_t instanceCount /* 1 */)
+{
+    if (pulled())
+    {   // Instance per row
+        cmdBuffer->drawInstanced((columns + 1) * 2, rows * instanceCount, 0, 0);
+        return;
+    }
     cmdBuffer->bindVertexBuffer(0, vertexBuffer);
     cmdBuffer->bindIndexBuffer(indexBuffer);
-    cmdBuffer->drawIndexed(indexBuffer->getIndexCount());
+    if (1 == instanceCount)
+        cmdBuffer->drawIndexed(indexBuffer->getIndexCount());
+    else
+        cmdBuffer->drawIndexedInstanced(indexBuffer->getIndexCount(), instanceCount, 0, 0, 0);
 }
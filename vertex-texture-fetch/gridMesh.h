@@ -2,22 +2,55 @@
 #include <cstdint>
 #include <memory>
 #include "core/noncopyable.h"
+#include "meshOptimizer.h"
 
 namespace magma
 {
     class CommandBuffer;
     class VertexBuffer;
     class IndexBuffer;
+    class VertexInputState;
+    class InputAssemblyState;
 }
 
+/* Grid in XZ plane. Indexed grid stores half-float X, Z coordinates and
+   16-bit indices, so its size is limited. Its row strips are converted to
+   triangle list reordered for vertex cache and fetch (see meshOptimizer.h),
+   so most vertices are shaded once instead of twice. Pulled grid
+   has no vertex and index buffers at all: each instance draws a strip of
+   single row and vertex shader computes coordinates from gl_VertexIndex
+   and gl_InstanceIndex (see gridVertex.h). */
+
 class GridMesh : public core::NonCopyable
 {
 public:
     explicit GridMesh(uint16_t rows, uint16_t columns, float scale,
         std::shared_ptr<magma::CommandBuffer> cmdBuffer);
-    void draw(std::shared_ptr<magma::CommandBuffer> cmdBuffer);
+    explicit GridMesh(uint32_t rows, uint32_t columns, float scale) noexcept;
+    uint32_t getRows() const noexcept { return rows; }
+    uint32_t getColumns() const noexcept { return columns; }
+    float getScale() const noexcept { return scale; }
+    bool pulled() const noexcept { return !indexBuffer; }
+    const magma::VertexInputState& getVertexInput() const noexcept;
+    const magma::InputAssemblyState& getInputAssembly() const noexcept;
+    // Post-transform cache of row strips and of optimized triangle list
+    const mesh::VertexCacheStatistics& getStripCacheStatistics() const noexcept { return stripCacheStats; }
+    const mesh::VertexCacheStatistics& getCacheStatistics() const noexcept { return cacheStats; }
+    // Triangle list takes about three times more indices than row strips
+    uint32_t getStripIndexCount() const noexcept { return stripIndexCount; }
+    uint32_t getIndexCount() const noexcept { return indexCount; }
+    uint64_t getMemorySize() const noexcept;
+    uint32_t getVertexCount() const noexcept;
+    void draw(std::shared_ptr<magma::CommandBuffer> cmdBuffer, uint32_t instanceCount = 1);
 
 private:
+    const uint32_t rows;
+    const uint32_t columns;
+    const float scale;
     std::shared_ptr<magma::VertexBuffer> vertexBuffer;
     std::shared_ptr<magma::IndexBuffer> indexBuffer;
+    mesh::VertexCacheStatistics stripCacheStats = {};
+    mesh::VertexCacheStatistics cacheStats = {};
+    uint32_t stripIndexCount = 0;
+    uint32_t indexCount = 0;
 };
@@ -4,12 +4,16 @@
 #include "sobel.h"
 
 layout(constant_id = 0) const bool c_showNormals = false;
+layout(constant_id = 1) const bool c_cdlod = false;
+layout(constant_id = 2) const float c_strength = 10.;
+layout(constant_id = 8) const bool c_sobelNormals = false;
 
 layout(binding = 2) uniform DirectionalLight {
     vec3 viewDir;
 } light;
 
-layout(binding = 3) uniform sampler2D heightMap;
+layout(binding = 3) uniform sampler2D heightMap; // height, normal
+layout(binding = 5) uniform sampler2D terrainMap;
 
 layout(location = 0) in vec2 texCoord;
 
@@ -17,17 +21,21 @@ layout(location = 0) out vec3 oColor;
 
 void main()
 {
-    // compute normal from height map (2 texture gathers)
-    const float strength = 10.;
-    vec3 normal = sobel(heightMap, texCoord, strength);
+    vec3 normal;
+    if (c_cdlod) // compute normal from height map (2 texture gathers)
+        normal = sobel(terrainMap, texCoord, c_strength).xzy;
+    else if (c_sobelNormals)
+        normal = sobel(heightMap, texCoord, c_strength).xzy;
+    else // normal computed by height map pass
+        normal = texture(heightMap, texCoord).yzw;
 
     // transform from object space to view space
-    vec3 n = mat3(normalMatrix) * normal.xzy;
+    vec3 n = mat3(normalMatrix) * normal;
     vec3 l = light.viewDir;
     float NdL = dot(n, l);
 
     if (c_showNormals)
-        oColor = normal * .5 + .5;
+        oColor = normal.xzy * .5 + .5;
     else
         oColor = vec3(max(NdL, 0.));
 }
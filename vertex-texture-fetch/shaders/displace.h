@@ -0,0 +1,56 @@
+#include "common/transforms.h"
+
+#define MAX_LEVELS 8
+#define MAX_PATCHES 512
+
+layout(constant_id = 1) const bool c_cdlod = false;
+layout(constant_id = 3) const float c_gridDim = 32.;
+layout(constant_id = 4) const float c_terrainSize = 256.;
+
+layout(binding = 3) uniform sampler2D heightMap;
+layout(binding = 4) uniform Terrain {
+    vec4 eyePos; // Y is distance to height bounds
+    vec4 morphRanges[MAX_LEVELS]; // start, 1/(end - start)
+    vec4 patches[MAX_PATCHES]; // X, Z, size, level
+} terrain;
+layout(binding = 5) uniform sampler2D terrainMap;
+
+layout(location = 0) out vec2 oTexCoord;
+out gl_PerVertex {
+    vec4 gl_Position;
+};
+
+vec2 morphTerrainVertex(vec2 gridPos, vec4 node)
+{
+    vec2 xz = node.xy + gridPos * node.z;
+    vec2 range = terrain.morphRanges[int(node.w)].xy;
+    vec3 v = vec3(xz.x - terrain.eyePos.x, terrain.eyePos.y, xz.y - terrain.eyePos.z);
+    float morphK = clamp((length(v) - range.x) * range.y, 0., 1.);
+    // move odd vertices onto grid of the next coarser level
+    vec2 odd = fract(gridPos * c_gridDim * .5) * 2.;
+    return xz - odd/c_gridDim * node.z * morphK;
+}
+
+// pos is X, Z of grid mesh
+void displace(vec2 pos, int patchIndex)
+{
+    vec4 position;
+    if (c_cdlod)
+    {   // grid of size 1 is instanced per quadtree patch
+        vec4 node = terrain.patches[patchIndex];
+        vec2 xz = morphTerrainVertex(pos + .5, node);
+        oTexCoord = xz/c_terrainSize + .5;
+        float h = textureLod(terrainMap, oTexCoord, 0).x;
+        position = vec4(xz.x, h, xz.y, 1.);
+    }
+    else
+    {
+        const float gridScale = 32.;
+        vec2 texCoord = pos.xy/gridScale + 0.5;
+        // fetch value from height map
+        float h = textureLod(heightMap, texCoord, 0).x;
+        position = vec4(pos.x, h, pos.y, 1.);
+        oTexCoord = texCoord;
+    }
+    gl_Position = worldViewProj * position;
+}
@@ -0,0 +1,14 @@
+#version 450
+#extension GL_GOOGLE_include_directive : enable
+#include "displace.h"
+#include "gridVertex.h"
+
+layout(constant_id = 5) const uint c_gridColumns = 1;
+layout(constant_id = 6) const uint c_gridRows = 1;
+layout(constant_id = 7) const float c_gridScale = 1.;
+
+void main()
+{   // instance per row of each patch
+    vec2 pos = gridVertex(c_gridColumns, c_gridRows, c_gridScale);
+    displace(pos, gl_InstanceIndex/int(c_gridRows));
+}
@@ -0,0 +1,88 @@
+#include <algorithm>
+#include <cmath>
+#include "terrainQuadtree.h"
+#include "viewProjection.h"
+
+TerrainQuadtree::TerrainQuadtree(float terrainSize, uint32_t levelCount, float leafRange,
+    float minHeight, float maxHeight):
+    terrainSize(terrainSize),
+    levelCount(levelCount),
+    minHeight(minHeight),
+    maxHeight(maxHeight)
+{   // LOD range doubles with each level as well as node size
+    for (uint32_t i = 0; i < levelCount; ++i)
+        ranges.push_back(leafRange * float(1 << i));
+}
+
+float TerrainQuadtree::getMorphStart(uint32_t level) const noexcept
+{   // Morph in the last 30% of LOD range
+    const float prevRange = level ? ranges[level - 1] : 0.f;
+    return prevRange + (ranges[level] - prevRange) * 0.7f;
+}
+
+const std::vector<TerrainQuadtree::Patch>& TerrainQuadtree::select(const ViewProjection& camera, uint32_t maxPatches)
+{
+    const rapid::vector3 up(0.f, 1.f, 0.f);
+    const rapid::vector3 eye(camera.getPosition());
+    const rapid::vector3 forward = (rapid::vector3(camera.getFocus()) - eye).normalized();
+    const rapid::vector3 right = (up ^ forward).normalized();
+    const rapid::vector3 cameraUp = forward ^ right;
+    const float tanHalfFov = tanf(rapid::radians(camera.getFieldOfView()) * 0.5f);
+    const float tanHalfWidth = tanHalfFov * camera.getAspectRatio();
+    // Side planes contain the eye point
+    const rapid::vector3 normals[4] = {
+        (cameraUp ^ (forward - right * tanHalfWidth)).normalized(), // left
+        ((forward + right * tanHalfWidth) ^ cameraUp).normalized(), // right
+        ((forward - cameraUp * tanHalfFov) ^ right).normalized(), // bottom
+        (right ^ (forward + cameraUp * tanHalfFov)).normalized() // top
+    };
+    for (uint32_t i = 0; i < 4; ++i)
+        planes[i] = rapid::float4(normals[i].x(), normals[i].y(), normals[i].z(), -normals[i].dot(eye));
+    planes[4] = rapid::float4(forward.x(), forward.y(), forward.z(), -forward.dot(eye) - camera.getNearZ());
+    planes[5] = rapid::float4(-forward.x(), -forward.y(), -forward.z(), forward.dot(eye) + camera.getFarZ());
+    const rapid::float3& pos = camera.getPosition();
+    const float dy = std::max(std::max(minHeight - pos.y, 0.f), pos.y - maxHeight);
+    eyePos = rapid::float3(pos.x, dy, pos.z);
+    this->maxPatches = maxPatches;
+    patches.clear();
+    const float half = terrainSize * 0.5f;
+    selectNode(-half, -half, terrainSize, levelCount - 1);
+    return patches;
+}
+
+void TerrainQuadtree::selectNode(float x, float z, float size, uint32_t level)
+{
+    if (!insideFrustum(x, z, size))
+        return;
+    if ((0 == level) || !insideRange(x, z, size, ranges[level - 1]))
+    {   // Children out of their range would be fully morphed to this level
+        if (patches.size() < maxPatches)
+            patches.push_back(Patch{x, z, size, float(level)});
+        return;
+    }
+    const float half = size * 0.5f;
+    selectNode(x, z, half, level - 1);
+    selectNode(x + half, z, half, level - 1);
+    selectNode(x, z + half, half, level - 1);
+    selectNode(x + half, z + half, half, level - 1);
+}
+
+bool TerrainQuadtree::insideFrustum(float x, float z, float size) const noexcept
+{
+    for (const rapid::float4& plane : planes)
+    {   // Test corner of bounding box which is the farthest along plane normal
+        const float px = (plane.x >= 0.f) ? x + size : x;
+        const float py = (plane.y >= 0.f) ? maxHeight : minHeight;
+        const float pz = (plane.z >= 0.f) ? z + size : z;
+        if (plane.x * px + plane.y * py + plane.z * pz + plane.w < 0.f)
+            return false;
+    }
+    return true;
+}
+
+bool TerrainQuadtree::insideRange(float x, float z, float size, float range) const noexcept
+{   // Sphere vs bounding box
+    const float dx = std::max(std::max(x - eyePos.x, 0.f), eyePos.x - (x + size));
+    const float dz = std::max(std::max(z - eyePos.z, 0.f), eyePos.z - (z + size));
+    return dx * dx + eyePos.y * eyePos.y + dz * dz <= range * range;
+}
@@ -0,0 +1,46 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "core/noncopyable.h"
+#include "rapid/rapid.h"
+
+class ViewProjection;
+
+/* Continuous distance-dependent LOD (CDLOD) quadtree of square terrain
+   centered at origin. Each selected node is drawn as an instance of the same
+   grid, its vertices are morphed to the next coarser level as the distance
+   approaches the LOD range, so there are no cracks or popping. */
+
+class TerrainQuadtree : public core::NonCopyable
+{
+public:
+    struct Patch
+    {
+        float x, z; // Corner with minimal coordinates
+        float size;
+        float level; // Zero is the finest
+    };
+
+    explicit TerrainQuadtree(float terrainSize, uint32_t levelCount, float leafRange,
+        float minHeight, float maxHeight);
+    uint32_t getLevelCount() const noexcept { return levelCount; }
+    float getMorphStart(uint32_t level) const noexcept;
+    float getMorphEnd(uint32_t level) const noexcept { return ranges[level]; }
+    const rapid::float3& getEyePos() const noexcept { return eyePos; }
+    const std::vector<Patch>& select(const ViewProjection& camera, uint32_t maxPatches);
+
+private:
+    void selectNode(float x, float z, float size, uint32_t level);
+    bool insideFrustum(float x, float z, float size) const noexcept;
+    bool insideRange(float x, float z, float size, float range) const noexcept;
+
+    const float terrainSize;
+    const uint32_t levelCount;
+    const float minHeight;
+    const float maxHeight;
+    std::vector<float> ranges;
+    std::vector<Patch> patches;
+    uint32_t maxPatches = 0;
+    rapid::float3 eyePos; // Y is distance to height bounds
+    rapid::float4 planes[6]; // Inside if dot(n, p) + d >= 0
+};
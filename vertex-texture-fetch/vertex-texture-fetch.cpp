@@ -1,11 +1,30 @@
 #include "graphicsApp.h"
+#include "gpuTimer.h"
 #include "gridMesh.h"
+#include "terrainQuadtree.h"
 
 class VertexTextureFetch : public GraphicsApp
 {
+    enum {
+        MaxLevels = 8, MaxPatches = 512
+    };
+
+    enum GpuPass
+    {
+        HeightMapPass, VertexTextureFetchPass
+    };
+
     struct Constants
     {
         VkBool32 showNormals = false;
+        VkBool32 cdlod = false;
+        float normalStrength = 10.f;
+        float gridDim;
+        float terrainSize;
+        uint32_t gridColumns;
+        uint32_t gridRows;
+        float gridScale;
+        VkBool32 sobelNormals = false;
     };
 
     struct SeaConstants
@@ -16,6 +35,7 @@ class VertexTextureFetch : public GraphicsApp
         float choppy;
         float speed;
         float frequency;
+        float normalStrength;
     };
 
     const float seaHeight = 1.f;
@@ -23,15 +43,37 @@ class VertexTextureFetch : public GraphicsApp
     const float seaSpeed = 0.8f;
     const float seaFrequency = 0.16f;
 
+    struct Terrain
+    {
+        rapid::float4a eyePos; // Y is distance to height bounds
+        rapid::float4a morphRanges[MaxLevels];
+        rapid::float4a patches[MaxPatches];
+    };
+
+    const float terrainSize = 256.f;
+    const float terrainHeight = 4.f;
+    const float terrainFrequency = 0.03f;
+    const uint16_t terrainGridDim = 32;
+    const float leafRangeScale = 4.5f;
+
     std::unique_ptr<GridMesh> grid;
+    std::unique_ptr<GridMesh> patchGrid;
+    std::unique_ptr<GridMesh> pulledGrid;
+    std::unique_ptr<GridMesh> pulledPatchGrid;
+    std::unique_ptr<TerrainQuadtree> quadtree;
     std::shared_ptr<magma::aux::ColorFramebuffer> heightMap;
+    std::shared_ptr<magma::aux::ColorFramebuffer> terrainMap;
+    std::shared_ptr<magma::UniformBuffer<Terrain>> terrainParameters;
     std::shared_ptr<magma::GraphicsPipeline> heightMapPipeline;
     std::shared_ptr<magma::GraphicsPipeline> vertexTextureFetchPipeline;
     DescriptorSet hmDescriptor;
+    std::unique_ptr<GpuTimer> gpuTimer;
     DescriptorSet vtfDescriptor;
 
     Constants constants;
+    uint32_t patchCount = 0;
     bool wireframe = false;
+    bool vertexPulling = false;
 
 public:
     explicit VertexTextureFetch(const AppEntry& entry):
@@ -41,8 +83,13 @@ public:
         setupViewProjection();
         createHeightmapFramebuffer();
         createGridMesh();
+        createTerrain();
+        printCacheStats(grid.get());
         setupDescriptorSets();
         setupGraphicsPipelines();
+        renderTerrainMap();
+        gpuTimer = std::make_unique<GpuTimer>(commandPools[0],
+            std::vector<std::string>{"Height map", "Vertex texture fetch"});
 
         renderScene(drawCmdBuffer);
         blit(msaaFramebuffer->getColorView(), FrontBuffer);
@@ -53,8 +100,11 @@ public:
 
     virtual void render(uint32_t bufferIndex) override
     {
+        gpuTimer->update();
         updateSysUniforms();
         updateTransforms();
+        if (constants.cdlod)
+            updateTerrain();
         submitCommandBuffers(bufferIndex);
     }
 
@@ -72,6 +122,42 @@ public:
             setupGraphicsPipelines();
             renderScene(drawCmdBuffer);
             break;
+        case AppKey::Tab:
+            constants.cdlod = !constants.cdlod;
+            constants.normalStrength = constants.cdlod ? 4.f : 10.f;
+            setupCamera();
+            updateViewProjTransforms();
+            setupGraphicsPipelines();
+            if (constants.cdlod)
+                updateTerrain();
+            renderScene(drawCmdBuffer);
+            printTerrainStats();
+            break;
+        case AppKey::Home:
+            vertexPulling = !vertexPulling;
+            setupGraphicsPipelines();
+            renderScene(drawCmdBuffer);
+            printGridStats();
+            break;
+        case AppKey::End:
+            constants.sobelNormals = !constants.sobelNormals;
+            std::cout << (constants.sobelNormals ? "Sobel filter of height map per fragment" : "Normals from height map pass") << std::endl;
+            setupGraphicsPipelines();
+            renderScene(drawCmdBuffer);
+            break;
+        case AppKey::Up:
+        case AppKey::Down:
+        case AppKey::Left:
+        case AppKey::Right:
+            if (constants.cdlod)
+            {
+                const float step = (AppKey::Up == key) ? 2.f : ((AppKey::Down == key) ? -2.f : 0.f);
+                const float yaw = (AppKey::Left == key) ? -5.f : ((AppKey::Right == key) ? 5.f : 0.f);
+                moveCamera(step, rapid::radians(yaw));
+                updateTerrain();
+                printTerrainStats();
+            }
+            break;
         }
         GraphicsApp::onKeyDown(key, repeat, flags);
     }
@@ -90,20 +176,59 @@ public:
     void updateTransforms()
     {
         const std::vector<rapid::matrix, core::aligned_allocator<rapid::matrix>> transforms = {
-            rapid::rotationY(rapid::radians(-spinX/4.f))
+            constants.cdlod ? rapid::identity() : rapid::rotationY(rapid::radians(-spinX/4.f))
         };
         updateObjectTransforms(transforms);
     }
 
+    void updateTerrain()
+    {
+        const std::vector<TerrainQuadtree::Patch>& patches = quadtree->select(*viewProj, MaxPatches);
+        magma::helpers::mapScoped<Terrain>(terrainParameters,
+            [this, &patches](auto *terrain)
+            {
+                const rapid::float3& eyePos = quadtree->getEyePos();
+                terrain->eyePos = rapid::float4a(eyePos.x, eyePos.y, eyePos.z, 0.f);
+                for (uint32_t i = 0; i < quadtree->getLevelCount(); ++i)
+                {
+                    const float morphStart = quadtree->getMorphStart(i);
+                    const float morphEnd = quadtree->getMorphEnd(i);
+                    terrain->morphRanges[i] = rapid::float4a(morphStart, 1.f/(morphEnd - morphStart), 0.f, 0.f);
+                }
+                for (std::size_t i = 0; i < patches.size(); ++i)
+                {
+                    const TerrainQuadtree::Patch& patch = patches[i];
+                    terrain->patches[i] = rapid::float4a(patch.x, patch.z, patch.size, patch.level);
+                }
+            });
+        if (patches.size() != patchCount)
+        {   // Instance count is baked into command buffer
+            patchCount = static_cast<uint32_t>(patches.size());
+            renderScene(drawCmdBuffer);
+        }
+    }
+
+    void printTerrainStats() const
+    {
+        if (constants.cdlod)
+        {
+            const uint32_t trianglesPerPatch = terrainGridDim * terrainGridDim * 2;
+            std::cout << "CDLOD terrain: " << patchCount << " patches, "
+                << patchCount * trianglesPerPatch << " triangles" << std::endl;
+        }
+        else
+        {
+            std::cout << "Uniform grid: " << 64 * 64 * 2 << " triangles" << std::endl;
+        }
+    }
+
     void setupViewProjection()
     {
         viewProj = std::make_unique<LeftHandedViewProjection>();
-        viewProj->setPosition(0.f, 25.f, -25.f - 2.f);
-        viewProj->setFocus(0.f, 0.f, -2.f);
         viewProj->setFieldOfView(45.f);
         viewProj->setNearZ(1.f);
-        viewProj->setFarZ(100.f);
         viewProj->setAspectRatio(width/(float)height);
+        setupCamera();
 
         lightViewProj = std::make_unique<LeftHandedViewProjection>();
         lightViewProj->setPosition(-1.f, 1.5f, -1.f);
@@ -111,9 +236,42 @@ public:
         updateViewProjTransforms();
     }
 
-    void createHeightmapFramebuffer()
+    void setupCamera()
     {
-        constexpr VkFormat format = VK_FORMAT_R16_SFLOAT;
+        if (constants.cdlod)
+        {   // Walk over the terrain
+            viewProj->setPosition(0.f, 14.f, -100.f);
+            viewProj->setFocus(0.f, 4.f, -60.f);
+            viewProj->setFarZ(400.f);
+        }
+        else
+        {
+            viewProj->setPosition(0.f, 25.f, -25.f - 2.f);
+            viewProj->setFocus(0.f, 0.f, -2.f);
+            viewProj->setFarZ(100.f);
+        }
+    }
+
+    void moveCamera(float step, float yaw)
+    {
+        rapid::float3 eye = viewProj->getPosition();
+        const rapid::float3& focus = viewProj->getFocus();
+        const float dx = focus.x - eye.x, dz = focus.z - eye.z;
+        const float cosYaw = cosf(yaw), sinYaw = sinf(yaw);
+        const float dirX = dx * cosYaw + dz * sinYaw;
+        const float dirZ = dz * cosYaw - dx * sinYaw;
+        const float invLength = 1.f/sqrtf(dirX * dirX + dirZ * dirZ);
+        const float halfSize = terrainSize * 0.5f;
+        eye.x = std::min(std::max(eye.x + dirX * invLength * step, -halfSize), halfSize);
+        eye.z = std::min(std::max(eye.z + dirZ * invLength * step, -halfSize), halfSize);
+        viewProj->setPosition(eye);
+        viewProj->setFocus(eye.x + dirX, focus.y, eye.z + dirZ);
+        updateViewProjTransforms();
+    }
+
+    void createHeightmapFramebuffer()
+    {   // Height and normal
+        constexpr VkFormat format = VK_FORMAT_R16G16B16A16_SFLOAT;
         constexpr VkExtent2D extent{2048, 2048};
 		constexpr bool clearOp = false;
         heightMap = std::make_shared<magma::aux::ColorFramebuffer>(device, format, extent, clearOp);
@@ -122,6 +280,51 @@ public:
     void createGridMesh()
     {
         grid = std::make_unique<GridMesh>(64, 64, 32.f, cmdCopyBuf);
+        pulledGrid = std::make_unique<GridMesh>(64u, 64u, 32.f);
+    }
+
+    const GridMesh *activeGrid() const noexcept
+    {
+        if (constants.cdlod)
+            return vertexPulling ? pulledPatchGrid.get() : patchGrid.get();
+        return vertexPulling ? pulledGrid.get() : grid.get();
+    }
+
+    void printGridStats() const
+    {
+        const GridMesh *mesh = activeGrid();
+        std::cout << (mesh->pulled() ? "Pulled grid: " : "Indexed grid: ")
+            << mesh->getVertexCount() << " vertices per instance, "
+            << mesh->getMemorySize()/1024.f << " KB of buffers" << std::endl;
+        if (!mesh->pulled())
+            printCacheStats(mesh);
+    }
+
+    void printCacheStats(const GridMesh *mesh) const
+    {
+        const auto& strip = mesh->getStripCacheStatistics();
+        const auto& optimized = mesh->getCacheStatistics();
+        std::cout << "Vertex cache: ACMR " << strip.acmr << " -> " << optimized.acmr
+            << ", ATVR " << strip.atvr << " -> " << optimized.atvr << std::endl;
+        std::cout << "Index memory: " << mesh->getStripIndexCount() * sizeof(uint16_t)/1024.f << " KB -> "
+            << mesh->getIndexCount() * sizeof(uint16_t)/1024.f << " KB" << std::endl;
+    }
+
+    void createTerrain()
+    {   // Static 8k x 8k height field, normal is reconstructed in fragment shader
+        constexpr VkFormat format = VK_FORMAT_R16_SFLOAT;
+        constexpr VkExtent2D extent{8192, 8192};
+        constexpr bool clearOp = false;
+        terrainMap = std::make_shared<magma::aux::ColorFramebuffer>(device, format, extent, clearOp);
+        // Instanced per quadtree patch
+        patchGrid = std::make_unique<GridMesh>(terrainGridDim, terrainGridDim, 1.f, cmdCopyBuf);
+        pulledPatchGrid = std::make_unique<GridMesh>(uint32_t(terrainGridDim), uint32_t(terrainGridDim), 1.f);
+        const float leafSize = terrainSize/(1 << (MaxLevels - 1));
+        const float maxHeight = terrainHeight * 2.6f; // Sum of octave amplitudes
+        quadtree = std::make_unique<TerrainQuadtree>(terrainSize, MaxLevels, leafSize * leafRangeScale, 0.f, maxHeight);
+        terrainParameters = std::make_shared<magma::UniformBuffer<Terrain>>(device);
+        constants.gridDim = terrainGridDim;
+        constants.terrainSize = terrainSize;
     }
 
     void setupDescriptorSets()
@@ -141,25 +344,30 @@ public:
                 VertexFragmentStageBinding(0, DynamicUniformBuffer(1)),
                 FragmentStageBinding(1, UniformBuffer(1)),
                 FragmentStageBinding(2, UniformBuffer(1)),
-                VertexFragmentStageBinding(3, CombinedImageSampler(1))
+                VertexFragmentStageBinding(3, CombinedImageSampler(1)),
+                VertexStageBinding(4, UniformBuffer(1)),
+                VertexFragmentStageBinding(5, CombinedImageSampler(1))
             }));
         vtfDescriptor.set = descriptorPool->allocateDescriptorSet(vtfDescriptor.layout);
         vtfDescriptor.set->writeDescriptor(0, transforms);
         vtfDescriptor.set->writeDescriptor(1, viewProjTransforms);
         vtfDescriptor.set->writeDescriptor(2, lightSource);
         vtfDescriptor.set->writeDescriptor(3, heightMap->getColorView(), nearestClampToEdge);
+        vtfDescriptor.set->writeDescriptor(4, terrainParameters);
+        vtfDescriptor.set->writeDescriptor(5, terrainMap->getColorView(), bilinearClampToEdge);
     }
 
-    std::shared_ptr<magma::Specialization> createSpecialization()
+    std::shared_ptr<magma::Specialization> createSpecialization(const VkExtent2D& extent,
+        float height, float speed, float frequency)
     {
-        const float ratio = heightMap->getExtent().width/64.f;
         const SeaConstants constants = {
-            1.f/heightMap->getExtent().width,
-            1.f/heightMap->getExtent().height,
-            seaHeight,
+            1.f/extent.width,
+            1.f/extent.height,
+            height,
             seaChoppy,
-            seaSpeed/ratio,
-            seaFrequency * ratio
+            speed,
+            frequency,
+            10.f // Normal strength
         };
         return std::make_shared<magma::Specialization>(constants,
             std::initializer_list<magma::SpecializationEntry>
@@ -169,26 +377,42 @@ public:
                 {2, &SeaConstants::height},
                 {3, &SeaConstants::choppy},
                 {4, &SeaConstants::speed},
-                {5, &SeaConstants::frequency}
+                {5, &SeaConstants::frequency},
+                {6, &SeaConstants::normalStrength}
             });
     }
 
     void setupGraphicsPipelines()
     {
-        auto specialization = createSpecialization();
+        const float ratio = heightMap->getExtent().width/64.f;
+        auto specialization = createSpecialization(heightMap->getExtent(), seaHeight, seaSpeed/ratio, seaFrequency * ratio);
         heightMapPipeline = createFullscreenPipeline("quad.o", "heightmap.o", std::move(specialization),
             hmDescriptor.layout, heightMap);
 
-        specialization = std::make_shared<magma::Specialization>(constants,
-            magma::SpecializationEntry(0, &Constants::showNormals));
+        const GridMesh *mesh = activeGrid();
+        constants.gridColumns = mesh->getColumns();
+        constants.gridRows = mesh->getRows();
+        constants.gridScale = mesh->getScale();
+        specialization = std::shared_ptr<magma::Specialization>(new magma::Specialization(constants,
+            {
+                {0, &Constants::showNormals},
+                {1, &Constants::cdlod},
+                {2, &Constants::normalStrength},
+                {3, &Constants::gridDim},
+                {4, &Constants::terrainSize},
+                {5, &Constants::gridColumns},
+                {6, &Constants::gridRows},
+                {7, &Constants::gridScale},
+                {8, &Constants::sobelNormals}
+            }));
         auto pipelineLayout = std::make_shared<magma::PipelineLayout>(vtfDescriptor.layout);
         vertexTextureFetchPipeline = std::make_shared<magma::GraphicsPipeline>(device,
             std::vector<magma::PipelineShaderStage>{
-                loadShaderStage("displace.o"),
+                loadShaderStage(mesh->pulled() ? "displacePulled.o" : "displace.o", specialization),
                 loadShaderStage("bump.o", std::move(specialization))
             },
-            magma::renderstates::pos2h,
-            magma::renderstates::triangleStripRestart,
+            mesh->getVertexInput(),
+            mesh->getInputAssembly(),
             magma::TesselationState(),
             magma::ViewportState(0.f, 0.f, msaaFramebuffer->getExtent()),
             wireframe ? magma::renderstates::lineCullBackCW : magma::renderstates::fillCullBackCW,
@@ -202,11 +426,32 @@ public:
             nullptr, nullptr, 0);
     }
 
+    void renderTerrainMap()
+    {   // Terrain doesn't change over time, so render it once
+        updateSysUniforms();
+        auto specialization = createSpecialization(terrainMap->getExtent(), terrainHeight, 0.f, terrainFrequency * terrainSize);
+        auto pipeline = createFullscreenPipeline("quad.o", "heightmap.o", std::move(specialization),
+            hmDescriptor.layout, terrainMap);
+        magma::helpers::executeCommandBuffer(commandPools[0],
+            [this, &pipeline](std::shared_ptr<magma::CommandBuffer> cmdBuffer)
+            {
+                cmdBuffer->beginRenderPass(terrainMap->getRenderPass(), terrainMap->getFramebuffer());
+                {
+                    cmdBuffer->bindPipeline(pipeline);
+                    cmdBuffer->bindDescriptorSet(pipeline, hmDescriptor.set);
+                    cmdBuffer->draw(4, 0);
+                }
+                cmdBuffer->endRenderPass();
+            });
+    }
+
     void renderScene(std::shared_ptr<magma::CommandBuffer> cmdBuffer)
     {
         cmdBuffer->begin();
         {
-            heightMapPass(cmdBuffer);
+            gpuTimer->reset(cmdBuffer);
+            if (!constants.cdlod)
+                heightMapPass(cmdBuffer);
             vertexTextureFetchPass(cmdBuffer);
         }
         cmdBuffer->end();
@@ -214,6 +459,7 @@ public:
 
     void heightMapPass(std::shared_ptr<magma::CommandBuffer> cmdBuffer)
     {
+        gpuTimer->begin(cmdBuffer, HeightMapPass);
         cmdBuffer->beginRenderPass(heightMap->getRenderPass(), heightMap->getFramebuffer());
         {
             cmdBuffer->bindPipeline(heightMapPipeline);
@@ -221,10 +467,12 @@ public:
             cmdBuffer->draw(4, 0);
         }
         cmdBuffer->endRenderPass();
+        gpuTimer->end(cmdBuffer, HeightMapPass);
     }
 
     void vertexTextureFetchPass(std::shared_ptr<magma::CommandBuffer> cmdBuffer)
     {
+        gpuTimer->begin(cmdBuffer, VertexTextureFetchPass);
         cmdBuffer->beginRenderPass(msaaFramebuffer->getRenderPass(), msaaFramebuffer->getFramebuffer(),
             {
                 magma::ClearColor(0.1f, 0.243f, 0.448f, 1.f),
@@ -233,9 +481,13 @@ public:
         {
             cmdBuffer->bindPipeline(vertexTextureFetchPipeline);
             cmdBuffer->bindDescriptorSet(vertexTextureFetchPipeline, vtfDescriptor.set, transforms->getDynamicOffset(0));
-            grid->draw(cmdBuffer);
+            if (!constants.cdlod)
+                (vertexPulling ? pulledGrid : grid)->draw(cmdBuffer);
+            else if (patchCount)
+                (vertexPulling ? pulledPatchGrid : patchGrid)->draw(cmdBuffer, patchCount);
         }
         cmdBuffer->endRenderPass();
+        gpuTimer->end(cmdBuffer, VertexTextureFetchPass);
     }
 };
 